@@ -2,6 +2,15 @@
 
 #include "../corelib/ksort.h"
 
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CHAIN_DP_X86 1
+#else
+#define CHAIN_DP_X86 0
+#endif
+
 void
 validate_mem(HBN_LOG_PARAMS_GENERIC,
     const u8* read, 
@@ -32,6 +41,9 @@ ChainWorkDataNew(int min_seed_cnt, int min_can_score)
     kv_init(data->t);
     kv_init(data->v);
     kv_init(data->u);
+    kv_init(data->seed_qoff);
+    kv_init(data->seed_soff);
+    kv_init(data->seed_min_gap);
     kv_init(data->seeds);
     kv_init(data->fwd_seeds);
     kv_init(data->rev_seeds);
@@ -66,6 +78,9 @@ ChainWorkDataFree(ChainWorkData* data)
     kv_destroy(data->t);
     kv_destroy(data->v);
     kv_destroy(data->u);
+    kv_destroy(data->seed_qoff);
+    kv_destroy(data->seed_soff);
+    kv_destroy(data->seed_min_gap);
     kv_destroy(data->seeds);
     kv_destroy(data->fwd_seeds);
     kv_destroy(data->rev_seeds);
@@ -101,7 +116,218 @@ static inline int ilog2_32(uint32_t v)
 }
 
 static void
-scoring_chain_seeds(ChainWorkData* data, 
+load_chain_seed_arrays(ChainWorkData* data, const ChainSeed* seeds, const int n, const BOOL is_maximal_exact_match)
+{
+    kv_resize(idx, data->seed_qoff, n);
+    kv_resize(idx, data->seed_soff, n);
+    kv_resize(int, data->seed_min_gap, n);
+    for (int i = 0; i < n; ++i) {
+        kv_A(data->seed_qoff, i) = seeds[i].qoff;
+        kv_A(data->seed_soff, i) = seeds[i].soff;
+        kv_A(data->seed_min_gap, i) = is_maximal_exact_match ? hbn_max(seeds[i].length, 1) : 1;
+    }
+}
+
+/// state of the predecessor scan of one seed
+typedef struct {
+    int i;
+    idx qi;
+    idx ri;
+    int cov;
+    int avg_cov;
+    int max_f;
+    int max_j;
+    int n_skip;
+} ChainDPScan;
+
+/// score of chaining seed j before the seed of scan, FALSE if j can not precede it
+static inline BOOL
+score_one_predecessor(const ChainWorkData* data,
+    const ChainSeed* seeds,
+    const ChainDPScan* scan,
+    const int j,
+    const BOOL is_maximal_exact_match,
+    int* score)
+{
+    if (is_maximal_exact_match) {
+        if (seeds[j].qoff + seeds[j].length > scan->qi || seeds[j].soff + seeds[j].length > scan->ri) return FALSE;
+    } else {
+        if (seeds[j].qoff > scan->qi || seeds[j].soff > scan->ri) return FALSE;
+    }
+    const idx dr = scan->ri - seeds[j].soff;
+    const idx dq = scan->qi - seeds[j].qoff;
+    if (dr == 0 || dq <= 0) return FALSE;
+    if (dq > data->max_dist_qry || dr > data->max_dist_ref) return FALSE;
+    int dd = (dr > dq) ? (dr - dq) : (dq - dr);
+    if (dd > data->max_band_width) return FALSE;
+    int min_d = hbn_min(dq, dr);
+    int sc = (min_d > scan->cov) ? scan->cov : min_d;
+    int log_dd = dd ? ilog2_32(dd) : 0;
+    if (!is_maximal_exact_match) sc -= (int)(dd * .01 * scan->avg_cov) + (log_dd>>1);
+    else sc -= (log_dd>>1);
+    *score = sc + kv_A(data->f, j);
+    return TRUE;
+}
+
+/// take predecessor j of score sc, FALSE if too many predecessors are skipped and the scan stops.
+/// the scan state is passed in locals, so that the stores to t are not taken to alias it
+static inline BOOL
+add_one_predecessor(const int i, const int j, const int sc, const int max_skip,
+    int* max_f, int* max_j, int* n_skip, int* t, const int* p)
+{
+    if (sc > *max_f) {
+        *max_f = sc;
+        *max_j = j;
+        if (*n_skip) --*n_skip;
+    } else if (t[j] == i) {
+        if (++*n_skip > max_skip) return FALSE;
+    }
+    if (p[j] >= 0) t[p[j]] = i;
+    return TRUE;
+}
+
+#if CHAIN_DP_X86
+
+/// predecessors [st, j] of the seed of scan in decreasing order, one at a time.
+/// the tail of the vector kernel, fewer than 8 predecessors
+static void
+scan_predecessors_tail(ChainWorkData* data, const ChainSeed* seeds, ChainDPScan* scan, const int st, int j, const BOOL is_maximal_exact_match)
+{
+    int* p = kv_data(data->p);
+    int* t = kv_data(data->t);
+    const int i = scan->i, max_skip = data->max_skip;
+    int max_f = scan->max_f, max_j = scan->max_j, n_skip = scan->n_skip;
+    for (; j >= st; --j) {
+        int sc;
+        if (!score_one_predecessor(data, seeds, scan, j, is_maximal_exact_match, &sc)) continue;
+        if (!add_one_predecessor(i, j, sc, max_skip, &max_f, &max_j, &n_skip, t, p)) break;
+    }
+    scan->max_f = max_f;
+    scan->max_j = max_j;
+    scan->n_skip = n_skip;
+}
+
+/// the predecessors are scored 8 at a time, then taken in decreasing order by
+/// add_one_predecessor(), so the skip heuristic sees exactly the scalar sequence.
+/// floor(log2(dd)) is read from the exponent of (float)dd, exact for dd < 2^24.
+__attribute__((target("avx2")))
+static void
+scan_predecessors_avx2(ChainWorkData* data, const ChainSeed* seeds, ChainDPScan* scan, const int st, int j, const BOOL is_maximal_exact_match)
+{
+    const idx* qoff = kv_data(data->seed_qoff);
+    const idx* soff = kv_data(data->seed_soff);
+    const int* min_gap = kv_data(data->seed_min_gap);
+    const int* f = kv_data(data->f);
+    int* p = kv_data(data->p);
+    int* t = kv_data(data->t);
+    const __m256i kZero = _mm256_setzero_si256();
+    const __m256i kLow32 = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+    const __m256i kExpBias = _mm256_set1_epi32(127);
+    const __m256i qi = _mm256_set1_epi64x(scan->qi);
+    const __m256i ri = _mm256_set1_epi64x(scan->ri);
+    const __m256i max_dq = _mm256_set1_epi64x(data->max_dist_qry);
+    const __m256i max_dr = _mm256_set1_epi64x(data->max_dist_ref);
+    const __m256i band_width = _mm256_set1_epi32(data->max_band_width);
+    const __m256i cov = _mm256_set1_epi32(scan->cov);
+    const __m256d kPct = _mm256_set1_pd(.01);
+    const __m256d avg_cov = _mm256_set1_pd(scan->avg_cov);
+    const int i = scan->i, max_skip = data->max_skip;
+    int max_f = scan->max_f, max_j = scan->max_j, n_skip = scan->n_skip;
+    int score[8];
+
+    for (; j - 7 >= st; j -= 8) {
+        const int j0 = j - 7;
+        __m256i dq_lo = _mm256_sub_epi64(qi, _mm256_loadu_si256((const __m256i*)(qoff + j0)));
+        __m256i dq_hi = _mm256_sub_epi64(qi, _mm256_loadu_si256((const __m256i*)(qoff + j0 + 4)));
+        __m256i dr_lo = _mm256_sub_epi64(ri, _mm256_loadu_si256((const __m256i*)(soff + j0)));
+        __m256i dr_hi = _mm256_sub_epi64(ri, _mm256_loadu_si256((const __m256i*)(soff + j0 + 4)));
+        /// 0 < dq <= max_dist_qry and 0 < dr <= max_dist_ref, then both fit in 32 bits
+        __m256i ok_lo = _mm256_and_si256(_mm256_cmpgt_epi64(dq_lo, kZero), _mm256_cmpgt_epi64(dr_lo, kZero));
+        ok_lo = _mm256_andnot_si256(_mm256_or_si256(_mm256_cmpgt_epi64(dq_lo, max_dq), _mm256_cmpgt_epi64(dr_lo, max_dr)), ok_lo);
+        __m256i ok_hi = _mm256_and_si256(_mm256_cmpgt_epi64(dq_hi, kZero), _mm256_cmpgt_epi64(dr_hi, kZero));
+        ok_hi = _mm256_andnot_si256(_mm256_or_si256(_mm256_cmpgt_epi64(dq_hi, max_dq), _mm256_cmpgt_epi64(dr_hi, max_dr)), ok_hi);
+        __m256i dq = _mm256_permute2x128_si256(_mm256_permutevar8x32_epi32(dq_lo, kLow32), _mm256_permutevar8x32_epi32(dq_hi, kLow32), 0x20);
+        __m256i dr = _mm256_permute2x128_si256(_mm256_permutevar8x32_epi32(dr_lo, kLow32), _mm256_permutevar8x32_epi32(dr_hi, kLow32), 0x20);
+        __m256i ok = _mm256_permute2x128_si256(_mm256_permutevar8x32_epi32(ok_lo, kLow32), _mm256_permutevar8x32_epi32(ok_hi, kLow32), 0x20);
+
+        const __m256i gap = _mm256_loadu_si256((const __m256i*)(min_gap + j0));
+        ok = _mm256_andnot_si256(_mm256_or_si256(_mm256_cmpgt_epi32(gap, dq), _mm256_cmpgt_epi32(gap, dr)), ok);
+        const __m256i dd = _mm256_abs_epi32(_mm256_sub_epi32(dr, dq));
+        ok = _mm256_andnot_si256(_mm256_cmpgt_epi32(dd, band_width), ok);
+        const int ok_mask = _mm256_movemask_ps(_mm256_castsi256_ps(ok));
+        if (!ok_mask) continue;
+
+        __m256i sc = _mm256_min_epi32(_mm256_min_epi32(dq, dr), cov);
+        __m256i log_dd = _mm256_srli_epi32(_mm256_castps_si256(_mm256_cvtepi32_ps(dd)), 23);
+        log_dd = _mm256_max_epi32(_mm256_sub_epi32(log_dd, kExpBias), kZero);
+        __m256i penalty = _mm256_srai_epi32(log_dd, 1);
+        if (!is_maximal_exact_match) {
+            const __m128i pen_lo = _mm256_cvttpd_epi32(_mm256_mul_pd(_mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_castsi256_si128(dd)), kPct), avg_cov));
+            const __m128i pen_hi = _mm256_cvttpd_epi32(_mm256_mul_pd(_mm256_mul_pd(_mm256_cvtepi32_pd(_mm256_extracti128_si256(dd, 1)), kPct), avg_cov));
+            penalty = _mm256_add_epi32(_mm256_set_m128i(pen_hi, pen_lo), penalty);
+        }
+        sc = _mm256_sub_epi32(sc, penalty);
+        sc = _mm256_add_epi32(sc, _mm256_loadu_si256((const __m256i*)(f + j0)));
+        _mm256_storeu_si256((__m256i*)score, sc);
+
+        for (unsigned m = ok_mask; m; ) {
+            const int k = 31 - __builtin_clz(m);
+            m ^= 1U << k;
+            if (!add_one_predecessor(i, j0 + k, score[k], max_skip, &max_f, &max_j, &n_skip, t, p)) {
+                scan->max_f = max_f;
+                scan->max_j = max_j;
+                scan->n_skip = n_skip;
+                return;
+            }
+        }
+    }
+    scan->max_f = max_f;
+    scan->max_j = max_j;
+    scan->n_skip = n_skip;
+    /// the tail is scored by legacy SSE code, which stalls on dirty upper halves of the ymm registers
+    _mm256_zeroupper();
+    scan_predecessors_tail(data, seeds, scan, st, j, is_maximal_exact_match);
+}
+
+#endif // CHAIN_DP_X86
+
+typedef void (*ScanPredecessorsFunc)(ChainWorkData* data, const ChainSeed* seeds, ChainDPScan* scan, const int st, int j, const BOOL is_maximal_exact_match);
+
+/// NULL if the cpu has no vector kernel
+static ScanPredecessorsFunc s_scan_predecessors = NULL;
+static pthread_once_t s_chain_dp_kernel_once = PTHREAD_ONCE_INIT;
+
+static const char* s_chain_dp_kernel_name = "scalar";
+
+static void
+select_chain_dp_kernel()
+{
+#if CHAIN_DP_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        s_scan_predecessors = scan_predecessors_avx2;
+        s_chain_dp_kernel_name = "avx2";
+    }
+#endif
+}
+
+const char* chain_dp_kernel_name()
+{
+    pthread_once(&s_chain_dp_kernel_once, select_chain_dp_kernel);
+    return s_chain_dp_kernel_name;
+}
+
+void chain_dp_use_scalar_kernel()
+{
+    pthread_once(&s_chain_dp_kernel_once, select_chain_dp_kernel);
+    s_scan_predecessors = NULL;
+    s_chain_dp_kernel_name = "scalar";
+}
+
+/// the original predecessor loop, kept whole for cpus without the vector kernel:
+/// split into score_one_predecessor() and add_one_predecessor() it runs about 5% slower
+static void
+scoring_chain_seeds_scalar(ChainWorkData* data, 
     const ChainSeed* seeds,
     const int n,
     const BOOL is_maximal_exact_match)
@@ -129,9 +355,6 @@ scoring_chain_seeds(ChainWorkData* data,
         int max_f = cov, n_skip = 0, min_d;
         while (st < i && ri > seeds[st].soff + seeds[st].length + max_dist_ref) ++st;
         for (int j = i - 1; j >= st; --j) {
-            //HBN_LOG("comparing");
-            //fprintf(stderr, "[%d, %d, %d, %d] v.s. [%d, %d, %d, %d]\n",
-            //    i, seeds[i].qoff, seeds[i].soff, seeds[i].length, j, seeds[j].qoff, seeds[j].soff, seeds[j].length);
             if (is_maximal_exact_match) {
                 if (seeds[j].qoff + seeds[j].length > qi || seeds[j].soff + seeds[j].length > ri) continue;
             } else {
@@ -161,7 +384,53 @@ scoring_chain_seeds(ChainWorkData* data,
         }
         f[i] = max_f;
         p[i] = max_j;
-        //HBN_LOG("f[%d] = %d, p[%d] = %d", i, max_f, i, p[i]);
+        // v[i] keeps the peak score up to i;
+        // f[i] is the score ending at i, not always the peak score
+        v[i] = (max_j >= 0 && v[max_j] > max_f) ? v[max_j] : max_f;
+    }
+}
+
+static void
+scoring_chain_seeds(ChainWorkData* data, 
+    const ChainSeed* seeds,
+    const int n,
+    const BOOL is_maximal_exact_match)
+{
+    pthread_once(&s_chain_dp_kernel_once, select_chain_dp_kernel);
+    /// log2 from the float exponent is exact for dd < 2^24 only
+    ScanPredecessorsFunc scan_predecessors = (data->max_band_width < (1 << 24)) ? s_scan_predecessors : NULL;
+    if (!scan_predecessors) {
+        scoring_chain_seeds_scalar(data, seeds, n, is_maximal_exact_match);
+        return;
+    }
+    const int max_dist_ref = data->max_dist_ref;
+    int sum_cov = 0;
+    for (int i = 0; i < n; ++i) sum_cov += seeds[i].length;
+    const int avg_cov = sum_cov / n;
+    int st = 0;
+    ChainWorkDataSetup(data, n);
+    load_chain_seed_arrays(data, seeds, n, is_maximal_exact_match);
+    int* f = kv_data(data->f);
+    int* p = kv_data(data->p);
+    int* v = kv_data(data->v);
+
+    // fill the score and backtrack arrays
+    for (int i = 0; i < n; ++i) {
+        ChainDPScan scan;
+        scan.i = i;
+        scan.qi = seeds[i].qoff;
+        scan.ri = seeds[i].soff;
+        scan.cov = seeds[i].length;
+        scan.avg_cov = avg_cov;
+        scan.max_f = scan.cov;
+        scan.max_j = -1;
+        scan.n_skip = 0;
+        while (st < i && scan.ri > seeds[st].soff + seeds[st].length + max_dist_ref) ++st;
+        scan_predecessors(data, seeds, &scan, st, i - 1, is_maximal_exact_match);
+        const int max_f = scan.max_f;
+        const int max_j = scan.max_j;
+        f[i] = max_f;
+        p[i] = max_j;
         // v[i] keeps the peak score up to i;
         // f[i] is the score ending at i, not always the peak score
         v[i] = (max_j >= 0 && v[max_j] > max_f) ? v[max_j] : max_f;
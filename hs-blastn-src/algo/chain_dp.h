@@ -43,6 +43,14 @@ typedef struct {
     vec_int     t;
     vec_int     v;
     vec_int_pair u;
+
+    /// the seeds being scored in structure-of-arrays form for the vectorised
+    /// predecessor scan, which loads 8 seeds at a time
+    vec_idx     seed_qoff;
+    vec_idx     seed_soff;
+    /// seed j may precede a seed at least this far away on both sequences,
+    /// its length for maximal exact matches and 1 otherwise
+    vec_int     seed_min_gap;
     vec_chain_seed seeds;
     vec_chain_seed fwd_seeds;
     vec_chain_seed rev_seeds;
@@ -51,6 +59,12 @@ typedef struct {
 ChainWorkData*
 ChainWorkDataNew(int min_seed_cnt, int min_can_score);
 
+/// name of the predecessor scan picked for this cpu
+const char* chain_dp_kernel_name();
+
+/// score the predecessors with the scalar loop whatever the cpu, for benchmarking
+void chain_dp_use_scalar_kernel();
+
 ChainWorkData*
 ChainWorkDataFree(ChainWorkData* data);
 
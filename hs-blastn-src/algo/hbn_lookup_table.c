@@ -4,6 +4,12 @@
 #include "../corelib/ksort.h"
 #include "../corelib/khash.h"
 #include "hash_list_bucket_sort.h"
+#include "kmer_hash.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 KHASH_MAP_INIT_INT64(KmerHashToOffsetMap, u64);
 
@@ -12,86 +18,257 @@ typedef struct {
     i64 offset;
 } KmerHashAndOffset;
 
+typedef kvec_t(KmerHashAndOffset) vec_khao;
+
+/// the lookup table is built in phases, each of which runs on num_threads threads:
+/// kmer extraction, radix sort, occurrence filtering and index fill.
+/// the sorted kmer array is split into ranges [part_starts[t], part_starts[t+1])
+/// that never split the occurrences of one kmer, so threads can work on
+/// distinct kmers without synchronisation.
+
+typedef struct {
+    KmerHashAndOffset* khao_array;
+    u64 khao_count;
+    int num_threads;
+    u64* part_starts;
+
+    /// kmer extraction
+    const text_t* db;
+    /// kmers of subject i are khao_array[seq_kmer_starts[i], seq_kmer_starts[i+1]),
+    /// for minimizer sampling these are all the kmers the minimizers are chosen from
+    u64* seq_kmer_starts;
+    int kmer_size;
+    int window_size;
+    EHbnKmerSampling sampling;
+
+    /// occurrence filtering
+    int max_kmer_occ;
+
+    /// index fill
+    LookupTable* lktbl;
+} LktblBuildData;
+
+typedef struct {
+    LktblBuildData* data;
+    int thread_id;
+    u64 distinct_kmers;
+    u64 removed_distinct_kmers;
+    u64 removed_kmers;
+    /// kmers and distinct kmers left after filtering
+    u64 kept_kmers;
+    u64 kept_distinct_kmers;
+    /// index of the first distinct kmer of this range in the bucket index
+    u64 kmer_idx_from;
+    /// minimizers of this range, their number is not known in advance
+    vec_khao minimizer_list;
+} LktblBuildThreadData;
+
+static void
+run_lktbl_build_threads(void* (*func)(void*), LktblBuildThreadData* thread_data, const int num_threads)
+{
+    pthread_t jobs[num_threads];
+    for (int i = 0; i < num_threads; ++i) {
+        pthread_create(jobs + i, NULL, func, thread_data + i);
+    }
+    for (int i = 0; i < num_threads; ++i) {
+        pthread_join(jobs[i], NULL);
+    }
+}
+
 static u64 
 calc_num_kmers(const text_t* db,
     const int kmer_size,
-    const int window_size)
+    const int window_size,
+    u64* seq_kmer_starts)
 {
     u64 num_kmers = 0;
     const int num_subjects = seqdb_num_seqs(db);
     for (int i = 0; i < num_subjects; ++i) {
+        seq_kmer_starts[i] = num_kmers;
         u64 subject_size = seqdb_seq_size(db, i);
         if (subject_size < kmer_size) continue;
         u64 n = (subject_size - kmer_size) / window_size + 1;
         num_kmers += n;
     }
+    seq_kmer_starts[num_subjects] = num_kmers;
     return num_kmers;
 }
 
+static void*
+get_khao_array_thread(void* params)
+{
+    LktblBuildThreadData* thread_data = (LktblBuildThreadData*)(params);
+    LktblBuildData* data = thread_data->data;
+    const text_t* db = data->db;
+    const int kmer_size = data->kmer_size;
+    const int window_size = data->window_size;
+    const u64* seq_kmer_starts = data->seq_kmer_starts;
+    KmerHashAndOffset* khao_array = data->khao_array;
+    const u64 from = data->part_starts[thread_data->thread_id];
+    const u64 to = data->part_starts[thread_data->thread_id + 1];
+    if (from == to) return NULL;
+
+    /// the last subject whose kmers start at or before from
+    int left = 0, right = seqdb_num_seqs(db);
+    while (right - left > 1) {
+        int mid = (left + right) >> 1;
+        if (seq_kmer_starts[mid] <= from) {
+            left = mid;
+        } else {
+            right = mid;
+        }
+    }
+
+    kv_dinit(vec_u64, words);
+    kv_dinit(vec_u64, hash_list);
+    int i = left;
+    u64 kmer_idx = from;
+    while (kmer_idx < to) {
+        while (seq_kmer_starts[i + 1] <= kmer_idx) ++i;
+        /// kmers [sj, ej) of subject i are in this range
+        const u64 sj = kmer_idx - seq_kmer_starts[i];
+        const u64 ej = hbn_min(to, seq_kmer_starts[i + 1]) - seq_kmer_starts[i];
+        const u64 start = seqdb_seq_offset(db, i) + sj * window_size;
+        const u64 size = (ej - sj - 1) * window_size + kmer_size;
+        u64 n = 0;
+        if (db->unpacked_seq) {
+            n = kmer_hash_extract_from_residues(db->unpacked_seq + start, size, kmer_size, window_size, &words, &hash_list);
+        } else {
+            /// ambiguous residues are packed as 0 in the pac, the same as residues > 3 are hashed
+            kv_resize(u64, words, kmer_hash_num_words(size));
+            kmer_hash_load_pac(db->packed_seq, start, start + size, kv_data(words));
+            kv_resize(u64, hash_list, kmer_hash_num_kmers(size, kmer_size, window_size));
+            n = kmer_hash_extract(kv_data(words), 0, size, kmer_size, window_size, kv_data(hash_list));
+        }
+        hbn_assert(n == ej - sj);
+        for (u64 j = 0; j < n; ++j) {
+            KmerHashAndOffset khao = { kv_A(hash_list, j), start + j * window_size };
+            khao_array[kmer_idx + j] = khao;
+        }
+        kmer_idx += n;
+    }
+    kv_destroy(words);
+    kv_destroy(hash_list);
+    return NULL;
+}
+
+/// the minimizers at kmers [sj, ej) of every subject in the range. the windows
+/// holding those kmers span kmers [sj - window_size + 1, ej + window_size - 1),
+/// so a subject split between threads gets the minimizers of the whole subject.
+static void*
+get_minimizer_khao_array_thread(void* params)
+{
+    LktblBuildThreadData* thread_data = (LktblBuildThreadData*)(params);
+    LktblBuildData* data = thread_data->data;
+    const text_t* db = data->db;
+    const int kmer_size = data->kmer_size;
+    const u64 window_size = data->window_size;
+    const u64* seq_kmer_starts = data->seq_kmer_starts;
+    const u64 from = data->part_starts[thread_data->thread_id];
+    const u64 to = data->part_starts[thread_data->thread_id + 1];
+    if (from == to) return NULL;
+
+    int left = 0, right = seqdb_num_seqs(db);
+    while (right - left > 1) {
+        int mid = (left + right) >> 1;
+        if (seq_kmer_starts[mid] <= from) {
+            left = mid;
+        } else {
+            right = mid;
+        }
+    }
+
+    kv_dinit(vec_u64, words);
+    kv_dinit(vec_u64, hash_list);
+    kv_dinit(vec_u64, offset_list);
+    int i = left;
+    u64 kmer_idx = from;
+    while (kmer_idx < to) {
+        while (seq_kmer_starts[i + 1] <= kmer_idx) ++i;
+        const u64 seq_kmers = seq_kmer_starts[i + 1] - seq_kmer_starts[i];
+        const u64 sj = kmer_idx - seq_kmer_starts[i];
+        const u64 ej = hbn_min(to, seq_kmer_starts[i + 1]) - seq_kmer_starts[i];
+        const u64 wsj = (sj + 1 >= window_size) ? (sj + 1 - window_size) : 0;
+        const u64 wej = hbn_min(ej + window_size - 1, seq_kmers);
+        const u64 start = seqdb_seq_offset(db, i) + wsj;
+        const u64 size = wej - wsj - 1 + kmer_size;
+        u64 n = 0;
+        if (db->unpacked_seq) {
+            n = kmer_hash_extract_minimizers_from_residues(db->unpacked_seq + start, size, kmer_size, window_size, &words, &hash_list, &offset_list);
+        } else {
+            kv_resize(u64, words, kmer_hash_num_words(size));
+            kmer_hash_load_pac(db->packed_seq, start, start + size, kv_data(words));
+            kv_resize(u64, hash_list, kmer_hash_num_kmers(size, kmer_size, 1));
+            kv_resize(u64, offset_list, kv_size(hash_list));
+            n = kmer_hash_extract_minimizers(kv_data(words), 0, size, kmer_size, window_size, kv_data(hash_list), kv_data(offset_list));
+        }
+        for (u64 j = 0; j < n; ++j) {
+            const u64 kmer_pos = wsj + kv_A(offset_list, j);
+            if (kmer_pos < sj || kmer_pos >= ej) continue;
+            KmerHashAndOffset khao = { kv_A(hash_list, j), start + kv_A(offset_list, j) };
+            kv_push(KmerHashAndOffset, thread_data->minimizer_list, khao);
+        }
+        kmer_idx += ej - sj;
+    }
+    kv_destroy(words);
+    kv_destroy(hash_list);
+    kv_destroy(offset_list);
+    return NULL;
+}
+
 static KmerHashAndOffset*
 get_khao_array(const text_t* db,
     const int kmer_size,
     const int window_size,
+    const EHbnKmerSampling sampling,
+    const int num_threads,
     u64* khao_count)
 {
     hbn_timing_begin(__FUNCTION__);
 
-    hbn_assert(db->unpacked_seq != NULL);
-    u64 num_kmers = calc_num_kmers(db, kmer_size, window_size);
-    KmerHashAndOffset* khao_array = (KmerHashAndOffset*)calloc(num_kmers, sizeof(KmerHashAndOffset));
-    const int kIntersect = kmer_size > window_size;
-    const int kStride = kmer_size - window_size;
-    const u64 kIntersectMask = kIntersect ? ((U64_ONE << (kStride<<1)) - 1) : 0;
-    const u64 kMaxHashValue = U64_ONE << (kmer_size << 1);
     const int num_subjects = seqdb_num_seqs(db);
-    size_t cnt = 0;
+    u64* seq_kmer_starts = (u64*)malloc(sizeof(u64) * (num_subjects + 1));
+    const BOOL use_minimizers = (sampling == eKmerSampleMinimizer);
+    u64 num_kmers = calc_num_kmers(db, kmer_size, use_minimizers ? 1 : window_size, seq_kmer_starts);
+    KmerHashAndOffset* khao_array = NULL;
+    if (!use_minimizers) khao_array = (KmerHashAndOffset*)malloc(sizeof(KmerHashAndOffset) * hbn_max(num_kmers, 1));
+    HBN_LOG("kmer size = %d, window_size = %d, %s sampling, kmer hash kernel: %s", 
+        kmer_size, window_size, EHbnKmerSamplingToName(sampling), kmer_hash_kernel_name());
 
-    HBN_LOG("kmer size = %d, window_size = %d", kmer_size, window_size);
+    /// subjects are split at kmer granularity, so one long subject is hashed by all threads
+    u64 part_starts[num_threads + 1];
+    for (int t = 0; t <= num_threads; ++t) part_starts[t] = num_kmers * t / num_threads;
+    LktblBuildData data;
+    memset(&data, 0, sizeof(LktblBuildData));
+    data.khao_array = khao_array;
+    data.khao_count = num_kmers;
+    data.num_threads = num_threads;
+    data.part_starts = part_starts;
+    data.db = db;
+    data.seq_kmer_starts = seq_kmer_starts;
+    data.kmer_size = kmer_size;
+    data.window_size = window_size;
+    data.sampling = sampling;
+    LktblBuildThreadData thread_data[num_threads];
+    memset(thread_data, 0, sizeof(LktblBuildThreadData) * num_threads);
+    for (int t = 0; t < num_threads; ++t) {
+        thread_data[t].data = &data;
+        thread_data[t].thread_id = t;
+    }
+    run_lktbl_build_threads(use_minimizers ? get_minimizer_khao_array_thread : get_khao_array_thread, thread_data, num_threads);
 
-    for (int i = 0; i < num_subjects; ++i) {
-        const u64 subject_size = seqdb_seq_size(db, i);
-        if (subject_size < kmer_size) continue;
-        const u64 start = seqdb_seq_offset(db, i);
-
-        if (!kIntersect) {
-            for (u64 j = 0; j <= subject_size - kmer_size; j += window_size) {
-                u64 hash = 0;
-                for (int k = 0; k < kmer_size; ++k) {
-                    const u64 pos = start + j + k;
-                    u8 c = db->unpacked_seq[pos];
-                    if (c > 3) c = 0;
-                    hash = (hash << 2) | c;
-                }
-                hbn_assert(hash < kMaxHashValue);
-                KmerHashAndOffset khao = { hash, start + j };
-                khao_array[cnt++] = khao;
-            }
-        } else {
-            u64 hash = 0;
-            for (int j = 0; j < kmer_size; ++j) {
-                const u64 pos = start + j;
-                u8 c = db->unpacked_seq[pos];
-                if (c > 3) c = 0;
-                hash = (hash << 2) | c;
-            }
-            hbn_assert(hash < kMaxHashValue);
-            KmerHashAndOffset khao = { hash, start };
-            khao_array[cnt++] = khao;
-            for (u64 j = window_size; j <= subject_size - kmer_size; j += window_size) {
-                hash &= kIntersectMask;
-                for (int k = kStride; k < kmer_size; ++k) {
-                    const u64 pos = start + j + k;
-                    u8 c = db->unpacked_seq[pos];
-                    if (c > 3) c = 0;
-                    hash = (hash << 2) | c;
-                }
-                hbn_assert(hash < kMaxHashValue);
-                KmerHashAndOffset khao = { hash, start + j };
-                khao_array[cnt++] = khao;
-            }
+    if (use_minimizers) {
+        num_kmers = 0;
+        for (int t = 0; t < num_threads; ++t) num_kmers += kv_size(thread_data[t].minimizer_list);
+        khao_array = (KmerHashAndOffset*)malloc(sizeof(KmerHashAndOffset) * hbn_max(num_kmers, 1));
+        u64 n = 0;
+        for (int t = 0; t < num_threads; ++t) {
+            memcpy(khao_array + n, kv_data(thread_data[t].minimizer_list), sizeof(KmerHashAndOffset) * kv_size(thread_data[t].minimizer_list));
+            n += kv_size(thread_data[t].minimizer_list);
+            kv_destroy(thread_data[t].minimizer_list);
         }
     }
-    hbn_assert(cnt == num_kmers);
+    free(seq_kmer_starts);
     *khao_count = num_kmers;
     hbn_timing_end(__FUNCTION__);
     return khao_array;
@@ -123,137 +300,322 @@ get_khao_array_from_seq_chunk(BLAST_SequenceBlk* seq_blk,
     HBN_LOG("kmer_size = %d, window_size = %d", kmer_size, window_size);
     u64 num_kmers = calc_num_kmers_from_seq_chunk(seq_blk, seq_info, kmer_size, window_size);
     KmerHashAndOffset* khao_array = (KmerHashAndOffset*)calloc(num_kmers, sizeof(KmerHashAndOffset));
-    const int kIntersect = kmer_size > window_size;
-    const int kStride = kmer_size - window_size;
-    const u64 kIntersectMask = kIntersect ? ((U64_ONE << (kStride<<1)) - 1) : 0;
-    const u64 kMaxHashValue = U64_ONE << (kmer_size << 1);
     size_t cnt = 0;
 
+    kv_dinit(vec_u64, words);
+    kv_dinit(vec_u64, hash_list);
     for (int i = seq_info->first_context; i <= seq_info->last_context; ++i) {
         const u64 subject_size = seq_info->contexts[i].query_length;
         if (subject_size < kmer_size) continue;
         const u64 start = seq_info->contexts[i].query_offset;
-        const u8* seq = seq_blk->sequence;
-
-        if (!kIntersect) {
-            for (u64 j = 0; j <= subject_size - kmer_size; j += window_size) {
-                u64 hash = 0;
-                for (int k = 0; k < kmer_size; ++k) {
-                    const u64 pos = start + j + k;
-                    u8 c = seq[pos];
-                    if (c > 3) c = 0;
-                    hash = (hash << 2) | c;
-                }
-                hbn_assert(hash < kMaxHashValue);
-                KmerHashAndOffset khao = { hash, start + j };
-                khao_array[cnt++] = khao;
-            }
-        } else {
-            u64 hash = 0;
-            for (int j = 0; j < kmer_size; ++j) {
-                const u64 pos = start + j;
-                u8 c = seq[pos];
-                if (c > 3) c = 0;
-                hash = (hash << 2) | c;
-            }
-            hbn_assert(hash < kMaxHashValue);
-            KmerHashAndOffset khao = { hash, start };
+        const u8* seq = seq_blk->sequence + start;
+        u64 n = kmer_hash_extract_from_residues(seq, subject_size, kmer_size, window_size, &words, &hash_list);
+        for (u64 j = 0; j < n; ++j) {
+            KmerHashAndOffset khao = { kv_A(hash_list, j), start + j * window_size };
             khao_array[cnt++] = khao;
-            for (u64 j = window_size; j <= subject_size - kmer_size; j += window_size) {
-                hash &= kIntersectMask;
-                for (int k = kStride; k < kmer_size; ++k) {
-                    const u64 pos = start + j + k;
-                    u8 c = seq[pos];
-                    if (c > 3) c = 0;
-                    hash = (hash << 2) | c;
-                }
-                hbn_assert(hash < kMaxHashValue);
-                KmerHashAndOffset khao = { hash, start + j };
-                khao_array[cnt++] = khao;
-            }
         }
     }
+    kv_destroy(words);
+    kv_destroy(hash_list);
     hbn_assert(cnt == num_kmers);
     *khao_count = num_kmers;
     return khao_array;
 }
 
-static u64
-remove_repetitive_kmers(KmerHashAndOffset* khao_array,
+static void
+partition_sorted_khao_array(const KmerHashAndOffset* khao_array,
     const u64 khao_count,
-    const int max_kmer_occ)
+    const int num_threads,
+    u64* part_starts)
 {
-    u64 distinct_kmers = 0;
-    u64 removed_distinct_kmers = 0;
-    u64 removed_kemrs = 0;
+    part_starts[0] = 0;
+    for (int t = 1; t < num_threads; ++t) {
+        u64 p = hbn_max(khao_count * t / num_threads, part_starts[t - 1]);
+        while (p > 0 && p < khao_count && khao_array[p].hash == khao_array[p - 1].hash) ++p;
+        part_starts[t] = p;
+    }
+    part_starts[num_threads] = khao_count;
+}
 
-    u64 i = 0;
-    while (i < khao_count) {
-        ++distinct_kmers;
+static void*
+remove_repetitive_kmers_thread(void* params)
+{
+    LktblBuildThreadData* thread_data = (LktblBuildThreadData*)(params);
+    LktblBuildData* data = thread_data->data;
+    KmerHashAndOffset* khao_array = data->khao_array;
+    const u64 from = data->part_starts[thread_data->thread_id];
+    const u64 to = data->part_starts[thread_data->thread_id + 1];
+    const int max_kmer_occ = data->max_kmer_occ;
+    if (from > 0 && from < to) hbn_assert(khao_array[from - 1].hash <= khao_array[from].hash);
+
+    /// occurrences of the kept kmers are moved to the front of the range
+    u64 kept = from;
+    u64 i = from;
+    while (i < to) {
+        ++thread_data->distinct_kmers;
         u64 j = i + 1;
-        while (j < khao_count && khao_array[i].hash == khao_array[j].hash) ++j;
+        while (j < to && khao_array[i].hash == khao_array[j].hash) ++j;
+        if (j < to) hbn_assert(khao_array[i].hash < khao_array[j].hash);
         u64 n = j - i;
         if (n > max_kmer_occ) {
-            ++removed_distinct_kmers;
-            removed_kemrs += n;
-            for (u64 k = i; k < j; ++k) khao_array[k].offset = U64_MAX;
+            ++thread_data->removed_distinct_kmers;
+            thread_data->removed_kmers += n;
+        } else {
+            ++thread_data->kept_distinct_kmers;
+            for (u64 k = i; k < j; ++k) khao_array[kept++] = khao_array[k];
         }
         i = j;
     }
+    thread_data->kept_kmers = kept - from;
+    return NULL;
+}
+
+static u64
+remove_repetitive_kmers(LktblBuildData* data, LktblBuildThreadData* thread_data)
+{
+    hbn_timing_begin(__FUNCTION__);
+
+    const int num_threads = data->num_threads;
+    KmerHashAndOffset* khao_array = data->khao_array;
+    const u64 khao_count = data->khao_count;
+    partition_sorted_khao_array(khao_array, khao_count, num_threads, data->part_starts);
+    run_lktbl_build_threads(remove_repetitive_kmers_thread, thread_data, num_threads);
+
+    u64 distinct_kmers = 0;
+    u64 removed_distinct_kmers = 0;
+    u64 removed_kemrs = 0;
+    u64 kept = 0;
+    for (int t = 0; t < num_threads; ++t) {
+        distinct_kmers += thread_data[t].distinct_kmers;
+        removed_distinct_kmers += thread_data[t].removed_distinct_kmers;
+        removed_kemrs += thread_data[t].removed_kmers;
+        const u64 from = data->part_starts[t];
+        if (kept != from) memmove(khao_array + kept, khao_array + from, sizeof(KmerHashAndOffset) * thread_data[t].kept_kmers);
+        data->part_starts[t] = kept;
+        kept += thread_data[t].kept_kmers;
+    }
+    data->part_starts[num_threads] = kept;
+    data->khao_count = kept;
 
     {
         char buf1[64], buf2[64], buf3[64];
         u64_to_string_comma(khao_count, buf1);
         u64_to_string_comma(removed_kemrs, buf2);
-        double perc = 100.0 * removed_kemrs / khao_count;
+        double perc = 100.0 * removed_kemrs / hbn_max(khao_count, 1);
         double_to_string(perc, buf3);
         HBN_LOG("Total kmers: %s, %s (%s%%) are filtered out.", buf1, buf2, buf3);
 
         u64_to_string_comma(distinct_kmers, buf1);
         u64_to_string_comma(removed_distinct_kmers, buf2);
-        perc = 100.0 * removed_distinct_kmers / distinct_kmers;
+        perc = 100.0 * removed_distinct_kmers / hbn_max(distinct_kmers, 1);
         double_to_string(perc, buf3);
         HBN_LOG("Distinct kmers: %s, %s (%s%%) are fltered out.", buf1, buf2, buf3);
     }
 
-    i = 0;
-    for (u64 k = 0; k < khao_count; ++k) {
-        if (khao_array[k].offset != U64_MAX) khao_array[i++] = khao_array[k];
-    }
-    return i;
+    hbn_timing_end(__FUNCTION__);
+    return kept;
 }
 
 static void
 build_lktbl_from_khao_array(KmerHashAndOffset* khao_array,
     u64 khao_count,
-    const int max_kmer_occ,
-    khash_t(KmerHashToOffsetMap)** hash_2_offset_map_pp,
-    u64** offset_array_pp)
+    const u64 kmer_count,
+    khash_t(KmerHashToOffsetMap)** hash_2_offset_map_pp)
 {
-    khao_count = remove_repetitive_kmers(khao_array, khao_count, max_kmer_occ);
     khash_t(KmerHashToOffsetMap)* hash_2_offset_map = kh_init(KmerHashToOffsetMap);
+    kh_resize(KmerHashToOffsetMap, hash_2_offset_map, hbn_max(kmer_count, 1));
     u64 i = 0;
     while (i < khao_count) {
         u64 j = i + 1;
         while (j < khao_count && khao_array[i].hash == khao_array[j].hash) ++j;
         u64 n = j - i;
-        hbn_assert(n <= max_kmer_occ);
-        khiter_t iter = kh_get(KmerHashToOffsetMap, hash_2_offset_map, khao_array[i].hash);
-        hbn_assert(iter == kh_end(hash_2_offset_map));
         int r = 0;
-        iter = kh_put(KmerHashToOffsetMap, hash_2_offset_map, khao_array[i].hash, &r);
+        khiter_t iter = kh_put(KmerHashToOffsetMap, hash_2_offset_map, khao_array[i].hash, &r);
         hbn_assert(r == 1);
         //u64 u = (i << OffsetBits) | n;
         u64 u = (n << OffsetBits) | i;
         kh_value(hash_2_offset_map, iter) = u;
         i = j;
     }
-
-    u64* offset_array = (u64*)calloc(khao_count, sizeof(u64));
-    for (i = 0; i < khao_count; ++i) offset_array[i] = khao_array[i].offset;
-    
     *hash_2_offset_map_pp = hash_2_offset_map;
-    *offset_array_pp = offset_array;
+}
+
+/// kmer_starts[h] is the index of the first kmer >= h, so each thread sets
+/// the entries between the last kmer before its range and each of its kmers.
+/// the entries after the last kmer are set by fill_lktbl_index() after the join
+static void
+fill_direct_index_range(const KmerHashAndOffset* khao_array,
+    const u64 from,
+    const u64 to,
+    u64* kmer_starts)
+{
+    for (u64 i = from; i < to; ++i) {
+        if (i > 0 && khao_array[i].hash == khao_array[i-1].hash) continue;
+        u64 h = (i == 0) ? 0 : khao_array[i-1].hash + 1;
+        for (; h <= khao_array[i].hash; ++h) kmer_starts[h] = i;
+    }
+}
+
+/// the bucket directory is set the same way over the high bits of the distinct kmers
+static void
+fill_bucket_index_range(const KmerHashAndOffset* khao_array,
+    const u64 from,
+    const u64 to,
+    u64 kmer_idx,
+    LookupTable* lktbl)
+{
+    const int bucket_shift = lktbl->bucket_shift;
+    u64 i = from;
+    while (i < to) {
+        u64 j = i + 1;
+        while (j < to && khao_array[i].hash == khao_array[j].hash) ++j;
+        u64 n = j - i;
+        lktbl->kmer_hash_list[kmer_idx] = khao_array[i].hash;
+        lktbl->kmer_stats_list[kmer_idx] = (n << OffsetBits) | i;
+        u64 b = (i == 0) ? 0 : (khao_array[i-1].hash >> bucket_shift) + 1;
+        for (; b <= (khao_array[i].hash >> bucket_shift); ++b) lktbl->bucket_starts[b] = kmer_idx;
+        ++kmer_idx;
+        i = j;
+    }
+}
+
+static void*
+fill_lktbl_index_thread(void* params)
+{
+    LktblBuildThreadData* thread_data = (LktblBuildThreadData*)(params);
+    LktblBuildData* data = thread_data->data;
+    const KmerHashAndOffset* khao_array = data->khao_array;
+    LookupTable* lktbl = data->lktbl;
+    const u64 from = data->part_starts[thread_data->thread_id];
+    const u64 to = data->part_starts[thread_data->thread_id + 1];
+
+    switch (lktbl->type) {
+    case eLktblDirect:
+        fill_direct_index_range(khao_array, from, to, lktbl->kmer_starts);
+        break;
+    case eLktblBucket:
+        fill_bucket_index_range(khao_array, from, to, thread_data->kmer_idx_from, lktbl);
+        break;
+    default:
+        break;
+    }
+
+    for (u64 i = from; i < to; ++i) lktbl->offset_list[i] = khao_array[i].offset;
+    return NULL;
+}
+
+static void
+fill_lktbl_index(LktblBuildData* data, LktblBuildThreadData* thread_data)
+{
+    hbn_timing_begin(__FUNCTION__);
+
+    const int num_threads = data->num_threads;
+    const u64 khao_count = data->khao_count;
+    LookupTable* lktbl = data->lktbl;
+    u64 kmer_count = 0;
+    for (int t = 0; t < num_threads; ++t) {
+        thread_data[t].kmer_idx_from = kmer_count;
+        kmer_count += thread_data[t].kept_distinct_kmers;
+    }
+
+    lktbl->offset_list = (u64*)malloc(sizeof(u64) * hbn_max(khao_count, 1));
+    lktbl->offset_count = khao_count;
+    if (lktbl->type == eLktblDirect) {
+        hbn_assert(lktbl->kmer_size <= kMaxDirectLktblKmerSize);
+        const u64 num_hash_values = U64_ONE << (lktbl->kmer_size << 1);
+        lktbl->kmer_starts = (u64*)malloc(sizeof(u64) * (num_hash_values + 1));
+    } else if (lktbl->type == eLktblBucket) {
+        /// about one distinct kmer per bucket
+        const int hash_bits = lktbl->kmer_size << 1;
+        int bucket_bits = 1;
+        while (bucket_bits < kMaxLktblBucketBits && (U64_ONE << bucket_bits) < kmer_count) ++bucket_bits;
+        bucket_bits = hbn_min(bucket_bits, hash_bits);
+        const u64 num_buckets = U64_ONE << bucket_bits;
+        lktbl->kmer_hash_list = (u64*)malloc(sizeof(u64) * hbn_max(kmer_count, 1));
+        lktbl->kmer_stats_list = (u64*)malloc(sizeof(u64) * hbn_max(kmer_count, 1));
+        lktbl->kmer_count = kmer_count;
+        lktbl->bucket_starts = (u64*)malloc(sizeof(u64) * (num_buckets + 1));
+        lktbl->bucket_shift = hash_bits - bucket_bits;
+        HBN_LOG("%zu distinct kmers are indexed by %zu buckets", kmer_count, num_buckets);
+    }
+
+    run_lktbl_build_threads(fill_lktbl_index_thread, thread_data, num_threads);
+
+    /// the entries after the last kmer, set once here since any number of trailing
+    /// partitions may be empty
+    const KmerHashAndOffset* khao_array = data->khao_array;
+    if (lktbl->type == eLktblDirect) {
+        const u64 num_hash_values = U64_ONE << (lktbl->kmer_size << 1);
+        u64 h = (khao_count == 0) ? 0 : khao_array[khao_count-1].hash + 1;
+        for (; h <= num_hash_values; ++h) lktbl->kmer_starts[h] = khao_count;
+    } else if (lktbl->type == eLktblBucket) {
+        const int bucket_shift = lktbl->bucket_shift;
+        const u64 num_buckets = U64_ONE << (lktbl->kmer_size * 2 - bucket_shift);
+        u64 b = (khao_count == 0) ? 0 : (khao_array[khao_count-1].hash >> bucket_shift) + 1;
+        for (; b <= num_buckets; ++b) lktbl->bucket_starts[b] = kmer_count;
+    }
+
+    /// khash insertion is not thread safe, the hash index is filled by this thread
+    if (lktbl->type == eLktblHash) {
+        khash_t(KmerHashToOffsetMap)* hash_2_offset_map = NULL;
+        build_lktbl_from_khao_array(data->khao_array, khao_count, kmer_count, &hash_2_offset_map);
+        lktbl->kmer_stats = hash_2_offset_map;
+    }
+
+    hbn_timing_end(__FUNCTION__);
+}
+
+/// the direct index takes (4^kmer_size + 1) * 8 bytes whatever the volume size, so auto only
+/// picks it when the volume has at least one residue per index slot. sparser volumes get the
+/// bucket index, whose size follows the number of distinct kmers.
+static EHbnLookupTableType
+resolve_lookup_table_type(const EHbnLookupTableType lktbl_type, const int kmer_size, const size_t num_residues)
+{
+    if (lktbl_type == eLktblAuto) {
+        return (kmer_size <= kMaxDirectLktblKmerSize && num_residues >= (U64_ONE << (kmer_size << 1)))
+               ? eLktblDirect : eLktblBucket;
+    }
+    if (lktbl_type == eLktblDirect && kmer_size > kMaxDirectLktblKmerSize) {
+        HBN_ERR("direct-address lookup table requires kmer size <= %d (kmer size = %d)",
+            kMaxDirectLktblKmerSize, kmer_size);
+    }
+    return lktbl_type;
+}
+
+static LookupTable*
+build_lktbl_from_sorted_khao_array(KmerHashAndOffset* khao_array,
+    u64 khao_count,
+    const size_t num_residues,
+    const int kmer_size,
+    const int max_kmer_occ,
+    const EHbnLookupTableType lktbl_type,
+    const int num_threads)
+{
+    LookupTable* lktbl = (LookupTable*)calloc(1, sizeof(LookupTable));
+    lktbl->type = resolve_lookup_table_type(lktbl_type, kmer_size, num_residues);
+    lktbl->kmer_size = kmer_size;
+    HBN_LOG("lookup table type: %s", EHbnLookupTableTypeToName(lktbl->type));
+
+    u64 part_starts[num_threads + 1];
+    LktblBuildData data;
+    memset(&data, 0, sizeof(LktblBuildData));
+    data.khao_array = khao_array;
+    data.khao_count = khao_count;
+    data.num_threads = num_threads;
+    data.part_starts = part_starts;
+    data.kmer_size = kmer_size;
+    data.max_kmer_occ = max_kmer_occ;
+    data.lktbl = lktbl;
+    LktblBuildThreadData thread_data[num_threads];
+    memset(thread_data, 0, sizeof(LktblBuildThreadData) * num_threads);
+    for (int t = 0; t < num_threads; ++t) {
+        thread_data[t].data = &data;
+        thread_data[t].thread_id = t;
+    }
+
+    remove_repetitive_kmers(&data, thread_data);
+    fill_lktbl_index(&data, thread_data);
+    return lktbl;
 }
 
 static u64 
@@ -278,15 +640,10 @@ set_khao_array_item_value(void* src, const u64 src_idx, void* dst, const u64 dst
     dst_khao_array[dst_idx] = src_khao_array[src_idx];
 }
 
-LookupTable*
-build_lookup_table(const text_t* db,
-    const int kmer_size,
-    const int window_size,
-    const int max_kmer_occ,
-    const int num_threads)
+static void
+sort_khao_array(KmerHashAndOffset* khao_array, const u64 khao_count, const int num_threads)
 {
-    u64 khao_count = 0;
-    KmerHashAndOffset* khao_array = get_khao_array(db, kmer_size, window_size, &khao_count);
+    hbn_timing_begin(__FUNCTION__);
     radix_sort(khao_array, 
         sizeof(KmerHashAndOffset), 
         khao_count, 
@@ -294,15 +651,66 @@ build_lookup_table(const text_t* db,
         offset_extractor,
         hash_extractor,
         set_khao_array_item_value);
-    for (u64 i = 0; i < khao_count - 1; ++i) hbn_assert(khao_array[i].hash <= khao_array[i+1].hash);
-    khash_t(KmerHashToOffsetMap)* hash_2_offset_map = NULL;
-    u64* offset_array = NULL;
-    build_lktbl_from_khao_array(khao_array, khao_count, max_kmer_occ, &hash_2_offset_map, &offset_array);
-    free(khao_array);
+    hbn_timing_end(__FUNCTION__);
+}
 
-    LookupTable* lktbl = (LookupTable*)calloc(1, sizeof(LookupTable));
-    lktbl->offset_list = offset_array;
-    lktbl->kmer_stats = hash_2_offset_map;
+static const char* kLookupTableTypeNames[] = {
+    "auto",
+    "hash",
+    "direct",
+    "bucket"
+};
+
+static const char* kKmerSamplingNames[] = {
+    "stride",
+    "minimizer"
+};
+
+const char* EHbnKmerSamplingToName(const EHbnKmerSampling sampling)
+{
+    hbn_assert(sampling >= 0 && sampling < eKmerSampleEndValue);
+    return kKmerSamplingNames[sampling];
+}
+
+EHbnKmerSampling NameToEHbnKmerSampling(const char* sampling_name)
+{
+    for (int i = 0; i < eKmerSampleEndValue; ++i) {
+        if (strcmp(sampling_name, kKmerSamplingNames[i]) == 0) return (EHbnKmerSampling)i;
+    }
+    HBN_ERR("invalid kmer sampling '%s'", sampling_name);
+    return eKmerSampleEndValue;
+}
+
+const char* EHbnLookupTableTypeToName(const EHbnLookupTableType type)
+{
+    hbn_assert(type >= 0 && type < eLktblEndValue);
+    return kLookupTableTypeNames[type];
+}
+
+EHbnLookupTableType NameToEHbnLookupTableType(const char* type_name)
+{
+    for (int i = 0; i < eLktblEndValue; ++i) {
+        if (strcmp(type_name, kLookupTableTypeNames[i]) == 0) return (EHbnLookupTableType)i;
+    }
+    HBN_ERR("invalid lookup table type '%s'", type_name);
+    return eLktblEndValue;
+}
+
+LookupTable*
+build_lookup_table(const text_t* db,
+    const int kmer_size,
+    const int window_size,
+    const EHbnKmerSampling sampling,
+    const int max_kmer_occ,
+    const EHbnLookupTableType lktbl_type,
+    const int num_threads)
+{
+    u64 khao_count = 0;
+    KmerHashAndOffset* khao_array = get_khao_array(db, kmer_size, window_size, sampling, num_threads, &khao_count);
+    sort_khao_array(khao_array, khao_count, num_threads);
+    LookupTable* lktbl = build_lktbl_from_sorted_khao_array(khao_array, khao_count, seqdb_max_offset(db),
+                            kmer_size, max_kmer_occ, lktbl_type, num_threads);
+    free(khao_array);
     return lktbl;
 }
 
@@ -312,49 +720,123 @@ build_lookup_table_from_seq_chunk(BLAST_SequenceBlk* seq_blk,
     const int kmer_size,
     const int window_size,
     const int max_kmer_occ,
+    const EHbnLookupTableType lktbl_type,
     const int num_threads)
 {
     u64 khao_count = 0;
     KmerHashAndOffset* khao_array = get_khao_array_from_seq_chunk(seq_blk, seq_info, kmer_size, window_size, &khao_count);
-    radix_sort(khao_array, 
-        sizeof(KmerHashAndOffset), 
-        khao_count, 
-        num_threads,
-        offset_extractor,
-        hash_extractor,
-        set_khao_array_item_value);
-    for (u64 i = 0; i < khao_count - 1; ++i) hbn_assert(khao_array[i].hash <= khao_array[i+1].hash);
-    khash_t(KmerHashToOffsetMap)* hash_2_offset_map = NULL;
-    u64* offset_array = NULL;
-    build_lktbl_from_khao_array(khao_array, khao_count, max_kmer_occ, &hash_2_offset_map, &offset_array);
+    sort_khao_array(khao_array, khao_count, num_threads);
+    LookupTable* lktbl = build_lktbl_from_sorted_khao_array(khao_array, khao_count, seq_blk->length,
+                            kmer_size, max_kmer_occ, lktbl_type, num_threads);
     free(khao_array);
-
-    LookupTable* lktbl = (LookupTable*)calloc(1, sizeof(LookupTable));
-    lktbl->offset_list = offset_array;
-    lktbl->kmer_stats = hash_2_offset_map;
     return lktbl;
 }
 
+size_t
+lookup_table_build_mem(const size_t num_residues,
+    const int num_seqs,
+    const int kmer_size,
+    const int window_size,
+    const EHbnKmerSampling sampling,
+    const EHbnLookupTableType lktbl_type)
+{
+    /// about 2 / (window_size + 1) of the kmers are minimizers
+    const size_t num_kmers = (sampling == eKmerSampleMinimizer)
+                             ? (num_residues * 2 / (window_size + 1) + num_seqs)
+                             : (num_residues / window_size + num_seqs);
+    /// radix_sort() holds two copies of the kmer array
+    const size_t sort_mem = sizeof(KmerHashAndOffset) * num_kmers * 2;
+    /// the index is filled while the sorted kmer array is still alive
+    size_t index_mem = sizeof(u64) * num_kmers;
+    switch (resolve_lookup_table_type(lktbl_type, kmer_size, num_residues)) {
+    case eLktblDirect:
+        index_mem += sizeof(u64) * ((U64_ONE << (kmer_size << 1)) + 1);
+        break;
+    case eLktblBucket: {
+        int bucket_bits = 1;
+        while (bucket_bits < kMaxLktblBucketBits && (U64_ONE << bucket_bits) < num_kmers) ++bucket_bits;
+        index_mem += sizeof(u64) * num_kmers * 2 + sizeof(u64) * ((U64_ONE << bucket_bits) + 1);
+        break;
+    }
+    default:
+        index_mem += sizeof(u64) * num_kmers * 4;
+        break;
+    }
+    const size_t fill_mem = sizeof(KmerHashAndOffset) * num_kmers + index_mem;
+    return hbn_max(sort_mem, fill_mem);
+}
+
 LookupTable*
 destroy_lookup_table(LookupTable* lktbl)
 {
+	if (lktbl->mmap_addr) {
+		hbn_munmap_file(lktbl->mmap_addr, lktbl->mmap_size);
+		free(lktbl);
+		return 0;
+	}
 	if (lktbl->offset_list) free(lktbl->offset_list);
-	khash_t(KmerHashToOffsetMap)* hash_2_offset_map = (khash_t(KmerHashToOffsetMap)*)(lktbl->kmer_stats);
-	kh_destroy(KmerHashToOffsetMap, hash_2_offset_map);
+	if (lktbl->kmer_stats) {
+		khash_t(KmerHashToOffsetMap)* hash_2_offset_map = (khash_t(KmerHashToOffsetMap)*)(lktbl->kmer_stats);
+		kh_destroy(KmerHashToOffsetMap, hash_2_offset_map);
+	}
+	if (lktbl->kmer_starts) free(lktbl->kmer_starts);
+	if (lktbl->kmer_hash_list) free(lktbl->kmer_hash_list);
+	if (lktbl->kmer_stats_list) free(lktbl->kmer_stats_list);
+	if (lktbl->bucket_starts) free(lktbl->bucket_starts);
 	free(lktbl);
 	return 0;
 }
 
+static inline u64
+find_kmer_stats_in_bucket(const LookupTable* lktbl, const u64 hash)
+{
+	const u64 bucket = hash >> lktbl->bucket_shift;
+	u64 left = lktbl->bucket_starts[bucket];
+	u64 right = lktbl->bucket_starts[bucket + 1];
+	const u64* kmer_hash_list = lktbl->kmer_hash_list;
+	while (right - left > 8) {
+		u64 mid = (left + right) >> 1;
+		if (kmer_hash_list[mid] <= hash) {
+			left = mid;
+		} else {
+			right = mid;
+		}
+	}
+	for (u64 i = left; i < right; ++i) {
+		if (kmer_hash_list[i] == hash) return lktbl->kmer_stats_list[i];
+		if (kmer_hash_list[i] > hash) break;
+	}
+	return 0;
+}
+
 u64*
 extract_kmer_list(const LookupTable* lktbl, const u64 hash, u64* n)
 {
 	u64* list = 0;
 	*n = 0;
 
-	khash_t(KmerHashToOffsetMap)* hash_2_offset_map = (khash_t(KmerHashToOffsetMap)*)(lktbl->kmer_stats);
-	khiter_t pos = kh_get(KmerHashToOffsetMap, hash_2_offset_map, hash);
-	if (pos == kh_end(hash_2_offset_map)) return NULL;
-	u64 u = kh_value(hash_2_offset_map, pos);
+	u64 u = 0;
+	switch (lktbl->type) {
+	case eLktblDirect: {
+		u64 start = lktbl->kmer_starts[hash];
+		u64 cnt = lktbl->kmer_starts[hash + 1] - start;
+		if (cnt) {
+			list = lktbl->offset_list + start;
+			*n = cnt;
+		}
+		return list;
+	}
+	case eLktblBucket:
+		u = find_kmer_stats_in_bucket(lktbl, hash);
+		break;
+	default: {
+		khash_t(KmerHashToOffsetMap)* hash_2_offset_map = (khash_t(KmerHashToOffsetMap)*)(lktbl->kmer_stats);
+		khiter_t pos = kh_get(KmerHashToOffsetMap, hash_2_offset_map, hash);
+		if (pos == kh_end(hash_2_offset_map)) return NULL;
+		u = kh_value(hash_2_offset_map, pos);
+		break;
+	}
+	}
 	u64 cnt = KmerStats_Cnt(u);
 	u64 start = KmerStats_Offset(u);
 	if (cnt) {
@@ -363,4 +845,341 @@ extract_kmer_list(const LookupTable* lktbl, const u64 hash, u64* n)
 	}
     return list;
 }
-	
\ No newline at end of file
+
+void
+prefetch_kmer_list(const LookupTable* lktbl, const u64 hash)
+{
+    switch (lktbl->type) {
+    case eLktblDirect:
+        __builtin_prefetch(lktbl->kmer_starts + hash);
+        break;
+    case eLktblBucket:
+        __builtin_prefetch(lktbl->bucket_starts + (hash >> lktbl->bucket_shift));
+        break;
+    default: {
+        khash_t(KmerHashToOffsetMap)* hash_2_offset_map = (khash_t(KmerHashToOffsetMap)*)(lktbl->kmer_stats);
+        if (!hash_2_offset_map->n_buckets) break;
+        const khint_t i = kh_int64_hash_func(hash) & (hash_2_offset_map->n_buckets - 1);
+        __builtin_prefetch(hash_2_offset_map->flags + (i >> 4));
+        __builtin_prefetch(hash_2_offset_map->keys + i);
+        __builtin_prefetch(hash_2_offset_map->vals + i);
+        break;
+    }
+    }
+}
+
+void
+prefetch_kmer_stats(const LookupTable* lktbl, const u64 hash)
+{
+    /// the other index types hold (count, offset) in the entry itself
+    if (lktbl->type != eLktblBucket) return;
+    const u64 left = lktbl->bucket_starts[hash >> lktbl->bucket_shift];
+    __builtin_prefetch(lktbl->kmer_hash_list + left);
+    __builtin_prefetch(lktbl->kmer_stats_list + left);
+}
+
+/// on-disk lookup table
+
+#define kLktblFileMagic     ((u64)0x4c4254424b4e4248ULL)
+#define kLktblFileVersion   ((u64)3)
+
+typedef struct {
+    u64 magic;
+    u64 version;
+    u64 type;
+    u64 kmer_size;
+    u64 window_size;
+    u64 sampling;
+    u64 max_kmer_occ;
+    u64 bucket_shift;
+    /// the subject volume the table is built from
+    u64 seq_start_id;
+    u64 num_seqs;
+    u64 db_size;
+    u64 seq_checksum;
+    /// seqdb_file_stamp() of the database the volume belongs to
+    u64 db_stamp;
+    /// sizes of the sections following the header
+    u64 offset_count;
+    u64 kmer_count;
+    u64 index_count;
+    /// checksum of all the sections
+    u64 checksum;
+} LookupTableFileHeader;
+
+#define FNV_OFFSET_BASIS    ((u64)0xcbf29ce484222325ULL)
+#define FNV_PRIME           ((u64)0x100000001b3ULL)
+
+static u64
+fnv_checksum_u64_list(u64 h, const u64* list, const u64 n)
+{
+    for (u64 i = 0; i < n; ++i) {
+        h ^= list[i];
+        h *= FNV_PRIME;
+    }
+    return h;
+}
+
+static u64
+fnv_checksum_u8_list(u64 h, const u8* list, const u64 n)
+{
+    u64 i = 0;
+    for (; i + 8 <= n; i += 8) {
+        u64 w;
+        memcpy(&w, list + i, 8);
+        h ^= w;
+        h *= FNV_PRIME;
+    }
+    for (; i < n; ++i) {
+        h ^= list[i];
+        h *= FNV_PRIME;
+    }
+    return h;
+}
+
+static u64
+seqdb_checksum(const text_t* db)
+{
+    u64 h = FNV_OFFSET_BASIS;
+    const int num_seqs = seqdb_num_seqs(db);
+    kv_dinit(vec_u8, seq_v);
+    for (int i = 0; i < num_seqs; ++i) {
+        const u64 seq_size = seqdb_seq_size(db, i);
+        u64 u[2] = { seqdb_seq_offset(db, i), seq_size };
+        h = fnv_checksum_u64_list(h, u, 2);
+        const u8* seq = seqdb_subsequence_window(db, i, 0, seq_size, &seq_v);
+        h = fnv_checksum_u8_list(h, seq, seq_size);
+    }
+    kv_destroy(seq_v);
+    return h;
+}
+
+/// size, modification time and inode of the pac and seq_info files. a rebuilt
+/// database changes the stamp even if its volumes keep their sizes, and the
+/// stamp is read without touching the sequences
+static u64
+seqdb_file_stamp(const char* data_dir, const char* db_name)
+{
+    u64 h = FNV_OFFSET_BASIS;
+    char path[HBN_MAX_PATH_LEN];
+    for (int i = 0; i < 2; ++i) {
+        if (i == 0) {
+            make_packed_seq_path(data_dir, db_name, path);
+        } else {
+            make_seq_info_path(data_dir, db_name, path);
+        }
+        struct stat st;
+        if (stat(path, &st) != 0) HBN_ERR("fail to stat %s: %s", path, strerror(errno));
+        u64 u[5] = { st.st_size, st.st_mtim.tv_sec, st.st_mtim.tv_nsec, st.st_ino, st.st_dev };
+        h = fnv_checksum_u64_list(h, u, 5);
+    }
+    return h;
+}
+
+static u64
+lookup_table_index_count(const LookupTable* lktbl)
+{
+    switch (lktbl->type) {
+    case eLktblDirect:
+        return (U64_ONE << (lktbl->kmer_size << 1)) + 1;
+    case eLktblBucket:
+        return (U64_ONE << ((lktbl->kmer_size << 1) - lktbl->bucket_shift)) + 1;
+    default:
+        return 0;
+    }
+}
+
+static u64
+lookup_table_checksum(const LookupTable* lktbl)
+{
+    const u64 index_count = lookup_table_index_count(lktbl);
+    u64 h = fnv_checksum_u64_list(FNV_OFFSET_BASIS, lktbl->offset_list, lktbl->offset_count);
+    if (lktbl->type == eLktblDirect) {
+        h = fnv_checksum_u64_list(h, lktbl->kmer_starts, index_count);
+    } else {
+        h = fnv_checksum_u64_list(h, lktbl->kmer_hash_list, lktbl->kmer_count);
+        h = fnv_checksum_u64_list(h, lktbl->kmer_stats_list, lktbl->kmer_count);
+        h = fnv_checksum_u64_list(h, lktbl->bucket_starts, index_count);
+    }
+    return h;
+}
+
+void
+make_lookup_table_path(const char* data_dir,
+    const char* db_name,
+    const int vol_id,
+    const size_t num_residues,
+    const int kmer_size,
+    const int window_size,
+    const EHbnKmerSampling sampling,
+    const int max_kmer_occ,
+    const EHbnLookupTableType lktbl_type,
+    char path[])
+{
+    path[0] = '\0';
+    if (data_dir) sprintf(path, "%s/", data_dir);
+    if (db_name) {
+        strcat(path, db_name);
+        strcat(path, ".");
+    }
+    char* p = path + strlen(path);
+    sprintf(p, "%s.k%d_%c%d_o%d.%s.lktbl",
+        u64_to_fixed_width_string(vol_id, HBN_DIGIT_WIDTH),
+        kmer_size,
+        (sampling == eKmerSampleMinimizer) ? 'm' : 'w',
+        window_size,
+        max_kmer_occ,
+        EHbnLookupTableTypeToName(resolve_lookup_table_type(lktbl_type, kmer_size, num_residues)));
+}
+
+LookupTable*
+load_lookup_table(const char* path,
+    const char* data_dir,
+    const char* db_name,
+    const text_t* db,
+    const int kmer_size,
+    const int window_size,
+    const EHbnKmerSampling sampling,
+    const int max_kmer_occ,
+    const EHbnLookupTableType lktbl_type,
+    const BOOL verify)
+{
+    const EHbnLookupTableType type = resolve_lookup_table_type(lktbl_type, kmer_size, seqdb_max_offset(db));
+    if (type == eLktblHash) return NULL;
+    if (access(path, F_OK) != 0) return NULL;
+    hbn_timing_begin(__FUNCTION__);
+
+    size_t mmap_size = 0;
+    void* mmap_addr = hbn_mmap_file(path, &mmap_size);
+    LookupTable* lktbl = NULL;
+    const char* reason = NULL;
+    const LookupTableFileHeader* hdr = (const LookupTableFileHeader*)(mmap_addr);
+    if (mmap_size < sizeof(LookupTableFileHeader)
+        || hdr->magic != kLktblFileMagic
+        || hdr->version != kLktblFileVersion) {
+        reason = "not a lookup table file";
+        goto load_failed;
+    }
+    if (hdr->type != type
+        || hdr->kmer_size != kmer_size
+        || hdr->window_size != window_size
+        || hdr->sampling != sampling
+        || hdr->max_kmer_occ != max_kmer_occ) {
+        reason = "lookup table parameters mismatch";
+        goto load_failed;
+    }
+    if (hdr->seq_start_id != db->dbinfo.seq_start_id
+        || hdr->num_seqs != seqdb_num_seqs(db)
+        || hdr->db_size != seqdb_size(db)
+        || hdr->db_stamp != seqdb_file_stamp(data_dir, db_name)
+        || (verify && hdr->seq_checksum != seqdb_checksum(db))) {
+        reason = "lookup table is built from another volume";
+        goto load_failed;
+    }
+
+    lktbl = (LookupTable*)calloc(1, sizeof(LookupTable));
+    lktbl->type = type;
+    lktbl->kmer_size = kmer_size;
+    lktbl->bucket_shift = hdr->bucket_shift;
+    lktbl->offset_count = hdr->offset_count;
+    lktbl->kmer_count = hdr->kmer_count;
+    if (lookup_table_index_count(lktbl) != hdr->index_count) {
+        reason = "lookup table index size mismatch";
+        goto load_failed;
+    }
+    u64 list_count = hdr->offset_count + hdr->index_count;
+    if (type == eLktblBucket) list_count += hdr->kmer_count * 2;
+    if (mmap_size != sizeof(LookupTableFileHeader) + sizeof(u64) * list_count) {
+        reason = "lookup table file is truncated";
+        goto load_failed;
+    }
+    u64* list = (u64*)((char*)mmap_addr + sizeof(LookupTableFileHeader));
+    lktbl->offset_list = list;
+    list += hdr->offset_count;
+    if (type == eLktblDirect) {
+        lktbl->kmer_starts = list;
+    } else {
+        lktbl->kmer_hash_list = list;
+        list += hdr->kmer_count;
+        lktbl->kmer_stats_list = list;
+        list += hdr->kmer_count;
+        lktbl->bucket_starts = list;
+    }
+    /// the first and last index entries only touch two pages, the checksums read every page
+    const u64* index = (type == eLktblDirect) ? lktbl->kmer_starts : lktbl->bucket_starts;
+    const u64 index_end = (type == eLktblDirect) ? hdr->offset_count : hdr->kmer_count;
+    if (index[0] != 0 || index[hdr->index_count - 1] != index_end) {
+        reason = "lookup table index is corrupted";
+        goto load_failed;
+    }
+    if (verify && lookup_table_checksum(lktbl) != hdr->checksum) {
+        reason = "lookup table checksum mismatch";
+        goto load_failed;
+    }
+    lktbl->mmap_addr = mmap_addr;
+    lktbl->mmap_size = mmap_size;
+    HBN_LOG("load %s lookup table from %s", EHbnLookupTableTypeToName(type), path);
+
+load_failed:
+    if (reason) {
+        HBN_LOG("ignore %s: %s", path, reason);
+        if (lktbl) free(lktbl);
+        lktbl = NULL;
+        hbn_munmap_file(mmap_addr, mmap_size);
+    }
+    hbn_timing_end(__FUNCTION__);
+    return lktbl;
+}
+
+void
+save_lookup_table(const LookupTable* lktbl,
+    const char* path,
+    const char* data_dir,
+    const char* db_name,
+    const text_t* db,
+    const int window_size,
+    const EHbnKmerSampling sampling,
+    const int max_kmer_occ)
+{
+    if (lktbl->type == eLktblHash) return;
+    hbn_timing_begin(__FUNCTION__);
+
+    LookupTableFileHeader hdr;
+    memset(&hdr, 0, sizeof(LookupTableFileHeader));
+    hdr.magic = kLktblFileMagic;
+    hdr.version = kLktblFileVersion;
+    hdr.type = lktbl->type;
+    hdr.kmer_size = lktbl->kmer_size;
+    hdr.window_size = window_size;
+    hdr.sampling = sampling;
+    hdr.max_kmer_occ = max_kmer_occ;
+    hdr.bucket_shift = lktbl->bucket_shift;
+    hdr.seq_start_id = db->dbinfo.seq_start_id;
+    hdr.num_seqs = seqdb_num_seqs(db);
+    hdr.db_size = seqdb_size(db);
+    hdr.seq_checksum = seqdb_checksum(db);
+    hdr.db_stamp = seqdb_file_stamp(data_dir, db_name);
+    hdr.offset_count = lktbl->offset_count;
+    hdr.kmer_count = (lktbl->type == eLktblBucket) ? lktbl->kmer_count : 0;
+    hdr.index_count = lookup_table_index_count(lktbl);
+    hdr.checksum = lookup_table_checksum(lktbl);
+
+    char tmp_path[HBN_MAX_PATH_LEN];
+    sprintf(tmp_path, "%s.%d.tmp", path, (int)getpid());
+    hbn_dfopen(out, tmp_path, "wb");
+    hbn_fwrite(&hdr, sizeof(LookupTableFileHeader), 1, out);
+    hbn_fwrite(lktbl->offset_list, sizeof(u64), lktbl->offset_count, out);
+    if (lktbl->type == eLktblDirect) {
+        hbn_fwrite(lktbl->kmer_starts, sizeof(u64), hdr.index_count, out);
+    } else {
+        hbn_fwrite(lktbl->kmer_hash_list, sizeof(u64), lktbl->kmer_count, out);
+        hbn_fwrite(lktbl->kmer_stats_list, sizeof(u64), lktbl->kmer_count, out);
+        hbn_fwrite(lktbl->bucket_starts, sizeof(u64), hdr.index_count, out);
+    }
+    hbn_fclose(out);
+    if (rename(tmp_path, path) != 0) {
+        HBN_ERR("fail to rename %s to %s: %s", tmp_path, path, strerror(errno));
+    }
+    HBN_LOG("save %s lookup table to %s", EHbnLookupTableTypeToName(lktbl->type), path);
+    hbn_timing_end(__FUNCTION__);
+}
@@ -18,14 +18,79 @@ extern "C" {
 #define KmerStats_Offset(u) ((u)&OffsetMask)
 #define KmerStats_Cnt(u)	((u)>>OffsetBits)
 
+/// kmer index used for locating the occurrences of a kmer in offset_list
+typedef enum {
+    /// direct-address index for kmer_size <= kMaxDirectLktblKmerSize if the volume has
+    /// at least 4^kmer_size residues, sorted bucket index otherwise
+    eLktblAuto = 0,
+    /// khash map from kmer to (count, offset) pairs
+    eLktblHash,
+    /// dense prefix-count array indexed by the kmer value
+    eLktblDirect,
+    /// sorted distinct kmers, addressed by a bucket directory over their high bits
+    eLktblBucket,
+    eLktblEndValue
+} EHbnLookupTableType;
+
+#define kMaxDirectLktblKmerSize 14
+#define kMaxLktblBucketBits     28
+
+const char* EHbnLookupTableTypeToName(const EHbnLookupTableType type);
+
+EHbnLookupTableType NameToEHbnLookupTableType(const char* type_name);
+
+/// which subject kmers are indexed, and so which read kmers are looked up
+typedef enum {
+    /// subject kmers at every window_size-th position, every read kmer is looked up
+    eKmerSampleStride = 0,
+    /// minimizers of window_size consecutive kmers, in both subjects and reads
+    eKmerSampleMinimizer,
+    eKmerSampleEndValue
+} EHbnKmerSampling;
+
+const char* EHbnKmerSamplingToName(const EHbnKmerSampling sampling);
+
+EHbnKmerSampling NameToEHbnKmerSampling(const char* sampling_name);
+
 typedef struct {
+    EHbnLookupTableType type;
+    int kmer_size;
     u64* offset_list;
+    u64 offset_count;
+
+    /// eLktblHash
     void* kmer_stats;
+
+    /// eLktblDirect, (1 << 2 * kmer_size) + 1 entries,
+    /// occurrences of kmer h are offset_list[kmer_starts[h], kmer_starts[h+1])
+    u64* kmer_starts;
+
+    /// eLktblBucket, distinct kmers are sorted, kmer_hash_list[i] has
+    /// KmerStats packed (count, offset) in kmer_stats_list[i]
+    u64* kmer_hash_list;
+    u64* kmer_stats_list;
+    u64 kmer_count;
+    /// (1 << bucket_bits) + 1 entries, kmers whose high bits are b
+    /// are kmer_hash_list[bucket_starts[b], bucket_starts[b+1])
+    u64* bucket_starts;
+    int bucket_shift;
+
+    /// non-NULL if the lists above point into a memory mapped lookup table file
+    void* mmap_addr;
+    size_t mmap_size;
 } LookupTable;
 
 u64*
 extract_kmer_list(const LookupTable* lktbl, const u64 hash, u64* n);
 
+/// prefetch the index entry that extract_kmer_list(lktbl, hash, n) reads first
+void
+prefetch_kmer_list(const LookupTable* lktbl, const u64 hash);
+
+/// once the index entry of hash is in cache, prefetch the kmer entries it points to
+void
+prefetch_kmer_stats(const LookupTable* lktbl, const u64 hash);
+
 LookupTable*
 destroy_lookup_table(LookupTable* lktbl);
 
@@ -33,7 +98,9 @@ LookupTable*
 build_lookup_table(const text_t* db,
     const int kmer_size,
     const int window_size,
+    const EHbnKmerSampling sampling,
     const int max_kmer_occ,
+    const EHbnLookupTableType lktbl_type,
     const int num_threads);
 
 LookupTable*
@@ -42,8 +109,64 @@ build_lookup_table_from_seq_chunk(BLAST_SequenceBlk* seq_blk,
     const int kmer_size,
     const int window_size,
     const int max_kmer_occ,
+    const EHbnLookupTableType lktbl_type,
     const int num_threads);
 
+/// peak memory of build_lookup_table() over num_residues residues in num_seqs sequences
+size_t
+lookup_table_build_mem(const size_t num_residues,
+    const int num_seqs,
+    const int kmer_size,
+    const int window_size,
+    const EHbnKmerSampling sampling,
+    const EHbnLookupTableType lktbl_type);
+
+/// on-disk lookup tables, stored next to the seqdb volume files as
+/// <data_dir>/<db_name>.<vol_id>.k<kmer_size>_w<window_size>_o<max_kmer_occ>.<type>.lktbl,
+/// with the window written as m<window_size> for minimizer sampling. the type auto resolves to
+/// depends on the num_residues of the volume
+void
+make_lookup_table_path(const char* data_dir,
+    const char* db_name,
+    const int vol_id,
+    const size_t num_residues,
+    const int kmer_size,
+    const int window_size,
+    const EHbnKmerSampling sampling,
+    const int max_kmer_occ,
+    const EHbnLookupTableType lktbl_type,
+    char path[]);
+
+/// map a lookup table file read-only. return NULL if the file does not exist,
+/// or if it was built with other parameters or from another volume, or if it is corrupted.
+/// only the header, the section sizes, the index bounds and the size and modification
+/// time of the database files under data_dir/db_name are checked, so the pages are
+/// faulted in lazily by the search. verify also compares the checksums of the volume and
+/// of the whole table, which reads both of them once.
+LookupTable*
+load_lookup_table(const char* path,
+    const char* data_dir,
+    const char* db_name,
+    const text_t* db,
+    const int kmer_size,
+    const int window_size,
+    const EHbnKmerSampling sampling,
+    const int max_kmer_occ,
+    const EHbnLookupTableType lktbl_type,
+    const BOOL verify);
+
+/// write to a temporary file first, then rename it to path,
+/// so concurrent readers never see a partial lookup table
+void
+save_lookup_table(const LookupTable* lktbl,
+    const char* path,
+    const char* data_dir,
+    const char* db_name,
+    const text_t* db,
+    const int window_size,
+    const EHbnKmerSampling sampling,
+    const int max_kmer_occ);
+
 #ifdef __cplusplus
 }
 #endif
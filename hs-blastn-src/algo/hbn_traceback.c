@@ -12,30 +12,30 @@ HbnTracebackData*
 HbnTracebackDataNew()
 {
     HbnTracebackData* data = (HbnTracebackData*)calloc(1, sizeof(HbnTracebackData));
-    ks_init(data->qabuf);
-    ks_init(data->sabuf);
     ks_init(data->ext_qabuf);
     ks_init(data->ext_sabuf);
+    kv_init(data->ops);
+    kv_init(data->ext_ops);
     kv_init(data->qfrag);
     kv_init(data->sfrag);
     kv_init(data->trace_seeds);
     data->edlib = EdlibAlignDataNew();
-    data->dalign = DalignDataNew(0.35);
+    data->xdrop = XdropExtendDataNew();
     return data;
 }
 
 HbnTracebackData*
 HbnTracebackDataFree(HbnTracebackData* data)
 {
-    ks_destroy(data->qabuf);
-    ks_destroy(data->sabuf);
     ks_destroy(data->ext_qabuf);
     ks_destroy(data->ext_sabuf);
+    kv_destroy(data->ops);
+    kv_destroy(data->ext_ops);
     kv_destroy(data->qfrag);
     kv_destroy(data->sfrag);
     kv_destroy(data->trace_seeds);
     EdlibAlignDataFree(data->edlib);
-    DalignDataFree(data->dalign);
+    XdropExtendDataFree(data->xdrop);
     free(data);
     return NULL;
 }
@@ -85,54 +85,200 @@ compute_trace_points(const ChainSeed* seed_array,
 }
 
 static void
-HbnTracebackDataInit(HbnTracebackData* data,
-    int qoff,
-    int qsize,
-    int soff,
-    int ssize)
+HbnTracebackDataInit(HbnTracebackData* data)
 {
-    int wrk_l = 2 * hbn_max(qsize, ssize);
-    ks_reserve(&data->qabuf, wrk_l);
-    ks_reserve(&data->sabuf, wrk_l);
-    int wrk_ll = 2 * hbn_max(qoff, soff);
-    data->qas = data->qae = ks_s(data->qabuf) + wrk_ll;
-    data->sas = data->sae = ks_s(data->sabuf) + wrk_ll;
-    *data->qae = '\0';
-    *data->sae = '\0';
+    kv_clear(data->ops);
+    data->op_head = 0;
     data->qoff = data->qend = 0;
     data->soff = data->send = 0;
-    data->dist = 0;
+    data->align_len = 0;
+    data->num_ident = 0;
+    data->gaps = 0;
+    data->gap_opens = 0;
     data->ident_perc = 0;
 }
 
 static void
-apped_match_subseq(const u8* query,
+push_back_op(HbnTracebackData* data, const int op, const int num)
+{
+    if (num == 0) return;
+    if (kv_size(data->ops) > data->op_head && ALIGN_OP_TYPE(kv_back(data->ops)) == op) {
+        kv_back(data->ops) += ALIGN_OP_RUN(0, num);
+        return;
+    }
+    kv_push(u32, data->ops, ALIGN_OP_RUN(op, num));
+}
+
+static void
+push_front_op(HbnTracebackData* data, const int op, const int num)
+{
+    if (num == 0) return;
+    if (kv_size(data->ops) > data->op_head && ALIGN_OP_TYPE(kv_A(data->ops, data->op_head)) == op) {
+        kv_A(data->ops, data->op_head) += ALIGN_OP_RUN(0, num);
+        return;
+    }
+    if (data->op_head == 0) {
+        /// make room in front of the runs, as much as they already take
+        size_t n = kv_size(data->ops);
+        size_t room = hbn_max(n, 64);
+        kv_reserve(u32, data->ops, n + room);
+        memmove(kv_data(data->ops) + room, kv_data(data->ops), sizeof(u32) * n);
+        kv_size(data->ops) = n + room;
+        data->op_head = room;
+    }
+    --data->op_head;
+    kv_A(data->ops, data->op_head) = ALIGN_OP_RUN(op, num);
+}
+
+static void
+drop_front_columns(HbnTracebackData* data, int ncol)
+{
+    while (ncol > 0) {
+        hbn_assert(data->op_head < kv_size(data->ops));
+        u32* run = kv_data(data->ops) + data->op_head;
+        int num = ALIGN_OP_NUM(*run);
+        if (num > ncol) {
+            *run -= ALIGN_OP_RUN(0, ncol);
+            return;
+        }
+        ncol -= num;
+        ++data->op_head;
+    }
+}
+
+static void
+drop_back_columns(HbnTracebackData* data, int ncol)
+{
+    while (ncol > 0) {
+        hbn_assert(kv_size(data->ops) > data->op_head);
+        u32* run = &kv_back(data->ops);
+        int num = ALIGN_OP_NUM(*run);
+        if (num > ncol) {
+            *run -= ALIGN_OP_RUN(0, ncol);
+            return;
+        }
+        ncol -= num;
+        kv_pop_back(data->ops);
+    }
+}
+
+static int
+count_columns(const HbnTracebackData* data)
+{
+    int n = 0;
+    for (size_t i = data->op_head; i < kv_size(data->ops); ++i) n += ALIGN_OP_NUM(kv_A(data->ops, i));
+    return n;
+}
+
+/// scan the alignment from its start for the first mat_len matching columns.
+/// returns the number of columns up to and including them, or -1 if there
+/// are none. the residues these columns cover are returned in qcnt and scnt
+static int
+find_first_match_run(const HbnTracebackData* data,
+    const u8* query,
+    const u8* subject,
+    const int mat_len,
+    int* qcnt,
+    int* scnt)
+{
+    int qi = data->qoff, si = data->soff;
+    int ncol = 0, m = 0;
+    for (size_t k = data->op_head; k < kv_size(data->ops); ++k) {
+        const int op = ALIGN_OP_TYPE(kv_A(data->ops, k));
+        const int num = ALIGN_OP_NUM(kv_A(data->ops, k));
+        if (op != kAlignOpSub) {
+            m = 0;
+            ncol += num;
+            if (op == kAlignOpDel) si += num; else qi += num;
+            continue;
+        }
+        for (int p = 0; p < num; ++p, ++qi, ++si) {
+            ++ncol;
+            m = (query[qi] == subject[si]) ? (m+1) : 0;
+            if (m == mat_len) {
+                *qcnt = qi + 1 - data->qoff;
+                *scnt = si + 1 - data->soff;
+                return ncol;
+            }
+        }
+    }
+    return -1;
+}
+
+/// the same as find_first_match_run, scanning from the end of the alignment
+static int
+find_last_match_run(const HbnTracebackData* data,
+    const u8* query,
+    const u8* subject,
+    const int mat_len,
+    int* qcnt,
+    int* scnt)
+{
+    int qi = data->qend, si = data->send;
+    int ncol = 0, m = 0;
+    for (size_t k = kv_size(data->ops); k > data->op_head; --k) {
+        const int op = ALIGN_OP_TYPE(kv_A(data->ops, k - 1));
+        const int num = ALIGN_OP_NUM(kv_A(data->ops, k - 1));
+        if (op != kAlignOpSub) {
+            m = 0;
+            ncol += num;
+            if (op == kAlignOpDel) si -= num; else qi -= num;
+            continue;
+        }
+        for (int p = 0; p < num; ++p) {
+            --qi;
+            --si;
+            ++ncol;
+            m = (query[qi] == subject[si]) ? (m+1) : 0;
+            if (m == mat_len) {
+                *qcnt = data->qend - qi;
+                *scnt = data->send - si;
+                return ncol;
+            }
+        }
+    }
+    return -1;
+}
+
+/// append the columns of a pair of aligned strings to the back of the
+/// alignment, or to its front in reverse order for a left extension
+static void
+add_aligned_strings(HbnTracebackData* data,
+    const char* qaln,
+    const char* saln,
+    const int aln_size,
+    const BOOL at_front)
+{
+    int i = 0;
+    while (i < aln_size) {
+        const int op = (qaln[i] == GAP_CHAR) ? kAlignOpDel : ((saln[i] == GAP_CHAR) ? kAlignOpIns : kAlignOpSub);
+        int j = i + 1;
+        if (op == kAlignOpSub) {
+            while (j < aln_size && qaln[j] != GAP_CHAR && saln[j] != GAP_CHAR) ++j;
+        } else if (op == kAlignOpDel) {
+            while (j < aln_size && qaln[j] == GAP_CHAR) ++j;
+        } else {
+            while (j < aln_size && saln[j] == GAP_CHAR) ++j;
+        }
+        if (at_front) {
+            push_front_op(data, op, j - i);
+        } else {
+            push_back_op(data, op, j - i);
+        }
+        i = j;
+    }
+}
+
+static void
+apped_match_subseq(HbnTracebackData* data,
     const int qfrom,
     const int qto,
-    const u8* subject,
     const int sfrom,
-    const int sto,
-    char** qae,
-    char** sae)
+    const int sto)
 {
     //HBN_LOG("qf = %d, qt = %d, sf = %d, st = %d", qfrom, qto, sfrom, sto);
     hbn_assert(qto - qfrom == sto - sfrom);
-    int n = qto - qfrom;
-    for (int i = 0; i < n; ++i) {
-        int c1 = query[qfrom + i];
-        c1 = DECODE_RESIDUE(c1);
-        **qae = c1;
-        ++(*qae);
-        int c2 = subject[sfrom + i];
-        c2 = DECODE_RESIDUE(c2);
-        **sae = c2;
-        ++(*sae);
-        hbn_assert(c1 == c2, "qfrom = %d, qto = %d, sfrom = %d, sto = %d, qi = %d, si = %d, c1 = %c, c2 = %c", 
-            qfrom, qto, sfrom, sto,
-            qfrom + i, sfrom + i, c1, c2);
-    }
-    **qae = '\0';
-    **sae = '\0';
+    push_back_op(data, kAlignOpSub, qto - qfrom);
 }
 
 static int
@@ -142,130 +288,52 @@ run_nw(const u8* query,
     const int subject_length,
     HbnTracebackData* data,
     kstring_t* qaln,
-    kstring_t* saln,
-    char** qae,
-    char** sae)
+    kstring_t* saln)
 {
     edlib_nw(data->edlib, query, query_length, subject, subject_length, qaln, saln);
     hbn_assert(ks_size(*qaln) == ks_size(*saln));
-    memcpy(*qae, ks_s(*qaln), ks_size(*qaln));
-    *qae += ks_size(*qaln);
-    **qae = '\0';
-    memcpy(*sae, ks_s(*saln), ks_size(*saln));
-    *sae += ks_size(*saln);
-    **sae = '\0';
+    add_aligned_strings(data, ks_s(*qaln), ks_s(*saln), ks_size(*qaln), FALSE);
     return 1;
 }
 
-int
-overhang_extend(DalignData* dalign,
-    EdlibAlignData* edlib,
-    const u8* query,
-    const int query_length,
-    const u8* subject,
-    const int subject_length,
-    kstring_t* qaln,
-    kstring_t* saln)
-{
-    int qoff, qend, soff, send;
-    double ident_perc;
-    int r = dalign_align(dalign,
-                query,
-                0,
-                query_length,
-                subject,
-                0,
-                subject_length,
-                1,
-                0.65,
-                &qoff,
-                &qend,
-                &soff,
-                &send,
-                &ident_perc,
-                NULL,
-                NULL);
-    if (!r) return r;
-    hbn_assert(qoff == 0 && soff == 0);
-
-    r = edlib_nw(edlib,
-            query + qoff,
-            qend - qoff,
-            subject + soff,
-            send - soff,
-            qaln,
-            saln);
-    return r;
-}
-
+/// the overhang before (qoff, soff) is extended from kMatLen residues inside
+/// the aligned part, reading both sequences backwards in place, and its runs
+/// replace the first kMatLen columns
 static int
-left_extend(DalignData* dalign,
-    EdlibAlignData* edlib,
+left_extend(HbnTracebackData* data,
     const u8* query,
-    const u8* subject,
-    vec_u8* qsbuf,
-    vec_u8* ssbuf,
-    kstring_t* qabuf,
-    kstring_t* sabuf,
-    int* qbeg,
-    int* sbeg,
-    char** qas,
-    char** sas)
+    const u8* subject)
 {
-    int qls = *qbeg;
-    int sls = *sbeg;
+    int qls = data->qoff;
+    int sls = data->soff;
     int ls = hbn_min(qls, sls);
     if (ls > kMaxOverHang) return 0;
     if (ls == 0) return 0;
 
     qls += kMatLen;
     sls += kMatLen;
-
-    kv_clear(*qsbuf);
-    kv_clear(*ssbuf);
-    for (ls = qls; ls; --ls) kv_push(u8, *qsbuf, query[ls-1]);
-    for (ls = sls; ls; --ls) kv_push(u8, *ssbuf, subject[ls-1]);
-
-    int r = overhang_extend(dalign, edlib, kv_data(*qsbuf), qls, kv_data(*ssbuf), sls, qabuf, sabuf);
-    if (!r) return r;
-    *qas += kMatLen;
-    *sas += kMatLen;
-    *qbeg += kMatLen;
-    *sbeg += kMatLen;
-    int qi = 0, si = 0;
-    hbn_assert(ks_size(*qabuf) == ks_size(*sabuf));
-    for (size_t i = 0; i < ks_size(*qabuf); ++i) {
-        char qc = ks_A(*qabuf, i);
-        --(*qas);
-        **qas = qc;
-        if (qc != GAP_CHAR) ++qi;
-        char sc = ks_A(*sabuf, i);
-        --(*sas);
-        **sas = sc;
-        if (sc != GAP_CHAR) ++si;
+    int qcnt, scnt;
+    xdrop_extend(data->xdrop, query + qls - 1, qls, subject + sls - 1, sls, -1,
+        &data->ext_ops, &qcnt, &scnt);
+    drop_front_columns(data, kMatLen);
+    for (size_t i = 0; i < kv_size(data->ext_ops); ++i) {
+        u32 run = kv_A(data->ext_ops, i);
+        push_front_op(data, ALIGN_OP_TYPE(run), ALIGN_OP_NUM(run));
     }
-
-    *qbeg -= qi;
-    *sbeg -= si;
+    data->qoff += kMatLen - qcnt;
+    data->soff += kMatLen - scnt;
     return 1;
 }
 
 static int
-right_extend(DalignData* dalign,
-    EdlibAlignData* edlib,
+right_extend(HbnTracebackData* data,
     const u8* query,
-    int* qend,
     const int query_length,
     const u8* subject,
-    int* send,
-    const int subject_length,
-    kstring_t* qabuf,
-    kstring_t* sabuf,
-    char** qae,
-    char** sae)
+    const int subject_length)
 {
-    int qrs = query_length - (*qend);
-    int srs = subject_length - (*send);
+    int qrs = query_length - data->qend;
+    int srs = subject_length - data->send;
     int rs = hbn_min(qrs, srs);
     if (rs > kMaxOverHang || rs == 0) return 0;
 
@@ -273,32 +341,74 @@ right_extend(DalignData* dalign,
     srs += kMatLen;
     const u8* q = query + query_length - qrs;
     const u8* s = subject + subject_length - srs;
-
-    int r = overhang_extend(dalign, edlib, q, qrs, s, srs, qabuf, sabuf);
-    if (!r) return r;
-
-    *qend -= kMatLen;
-    *send -= kMatLen;
-    *qae -= kMatLen;
-    *sae -= kMatLen;
-    int qi = 0;
-    int si = 0;
-    hbn_assert(ks_size(*qabuf) == ks_size(*sabuf));
-    for (size_t i = 0; i < ks_size(*qabuf); ++i) {
-        char qc = ks_A(*qabuf, i);
-        **qae = qc; ++(*qae);
-        if (qc != GAP_CHAR) ++qi;
-        char sc = ks_A(*sabuf, i);
-        **sae = sc; ++(*sae);
-        if (sc != GAP_CHAR) ++si;
+    int qcnt, scnt;
+    xdrop_extend(data->xdrop, q, qrs, s, srs, 1, &data->ext_ops, &qcnt, &scnt);
+    drop_back_columns(data, kMatLen);
+    for (size_t i = 0; i < kv_size(data->ext_ops); ++i) {
+        u32 run = kv_A(data->ext_ops, i);
+        push_back_op(data, ALIGN_OP_TYPE(run), ALIGN_OP_NUM(run));
     }
-    **qae = '\0';
-    **sae = '\0';
-    *qend += qi;
-    *send += si;
+    data->qend += qcnt - kMatLen;
+    data->send += scnt - kMatLen;
     return 1;
 }
 
+/// trim the alignment to its first and last matching columns. returns the
+/// number of columns removed
+static int
+truncate_align_bad_ends(HbnTracebackData* data,
+    const u8* query,
+    const u8* subject)
+{
+    const int aln_size = count_columns(data);
+    int qcnt = 0, scnt = 0;
+    int ncol = find_first_match_run(data, query, subject, 1, &qcnt, &scnt);
+    if (ncol < 0 || ncol == aln_size) return 0;
+    const int head = ncol - 1;
+    drop_front_columns(data, head);
+    data->qoff += qcnt - 1;
+    data->soff += scnt - 1;
+
+    ncol = find_last_match_run(data, query, subject, 1, &qcnt, &scnt);
+    hbn_assert(ncol > 0);
+    if (head == 0 && ncol == aln_size) return 0;
+    drop_back_columns(data, ncol - 1);
+    data->qend -= qcnt - 1;
+    data->send -= scnt - 1;
+    return head + ncol - 1;
+}
+
+/// one pass over the final alignment for the identity and gap counters
+static void
+count_align_stats(HbnTracebackData* data,
+    const u8* query,
+    const u8* subject)
+{
+    int qi = data->qoff, si = data->soff;
+    int align_len = 0, num_ident = 0, gaps = 0, gap_opens = 0;
+    for (size_t k = data->op_head; k < kv_size(data->ops); ++k) {
+        const int op = ALIGN_OP_TYPE(kv_A(data->ops, k));
+        const int num = ALIGN_OP_NUM(kv_A(data->ops, k));
+        align_len += num;
+        if (op == kAlignOpSub) {
+            for (int p = 0; p < num; ++p) num_ident += (query[qi+p] == subject[si+p]);
+            qi += num;
+            si += num;
+            continue;
+        }
+        ++gap_opens;
+        gaps += num;
+        if (op == kAlignOpDel) si += num; else qi += num;
+    }
+    hbn_assert(qi == data->qend && si == data->send,
+        "qoff = %d, qend = %d, qi = %d, soff = %d, send = %d, si = %d",
+        data->qoff, data->qend, qi, data->soff, data->send, si);
+    data->align_len = align_len;
+    data->num_ident = num_ident;
+    data->gaps = gaps;
+    data->gap_opens = gap_opens;
+}
+
 int
 hbn_traceback(HbnTracebackData* data,
     const u8* query,
@@ -316,9 +426,7 @@ hbn_traceback(HbnTracebackData* data,
     compute_trace_points(seed_array, seed_count, &data->trace_seeds);
     ChainSeed* tsa = kv_data(data->trace_seeds);
     int tsc = kv_size(data->trace_seeds);
-    HbnTracebackDataInit(data, tsa[0].qoff, query_length, tsa[0].soff, subject_length);
-    char** qae = &data->qae;
-    char** sae = &data->sae;
+    HbnTracebackDataInit(data);
     const int E = 10;
     const int E2 = E * 2;
     int qfrom = 0, qto = 0;
@@ -329,7 +437,7 @@ hbn_traceback(HbnTracebackData* data,
         qto = tsa[0].qoff + tsa[0].length;
         sfrom = tsa[0].soff;
         sto = tsa[0].soff + tsa[0].length;
-        apped_match_subseq(query, qfrom, qto - E, subject, sfrom, sto - E, qae, sae);
+        apped_match_subseq(data, qfrom, qto - E, sfrom, sto - E);
         qfrom = qto - E;
         sfrom = sto - E;
     } else {
@@ -343,19 +451,19 @@ hbn_traceback(HbnTracebackData* data,
         if (sj.length > E2) {
             qto = sj.qoff + E;
             sto = sj.soff + E;
-            run_nw(query + qfrom, qto - qfrom, subject + sfrom, sto - sfrom, data, &data->ext_qabuf, &data->ext_sabuf, qae, sae);
+            run_nw(query + qfrom, qto - qfrom, subject + sfrom, sto - sfrom, data, &data->ext_qabuf, &data->ext_sabuf);
             hbn_assert(r);
             qfrom = qto;
             qto = sj.qoff + sj.length - E;
             sfrom = sto;
             sto = sj.soff + sj.length - E;
-            apped_match_subseq(query, qfrom, qto, subject, sfrom, sto, qae, sae);
+            apped_match_subseq(data, qfrom, qto, sfrom, sto);
             qfrom = qto;
             sfrom = sto;
         } else {
             qto = sj.qoff + sj.length / 2;
             sto = sj.soff + sj.length / 2;
-            run_nw(query + qfrom, qto - qfrom, subject + sfrom, sto - sfrom, data, &data->ext_qabuf, &data->ext_sabuf, qae, sae);
+            run_nw(query + qfrom, qto - qfrom, subject + sfrom, sto - sfrom, data, &data->ext_qabuf, &data->ext_sabuf);
             hbn_assert(r);
             qfrom = qto;
             sfrom = sto;
@@ -365,8 +473,7 @@ hbn_traceback(HbnTracebackData* data,
     ChainSeed se = tsa[tsc-1];
     qto = se.qoff + se.length;
     sto = se.soff + se.length;
-    apped_match_subseq(query, qfrom, qto, subject, sfrom, sto, qae, sae);
-    hbn_assert(strlen(data->qas) == strlen(data->sas));
+    apped_match_subseq(data, qfrom, qto, sfrom, sto);
 
     data->qoff = tsa[0].qoff;
     data->qend = qto;
@@ -375,61 +482,20 @@ hbn_traceback(HbnTracebackData* data,
     data->send = sto;
     data->ssize = subject_length;
 
-    validate_aligned_string(HBN_LOG_ARGS_DEFAULT,
-        0, query, data->qoff, data->qend,
-        data->qas,
-        0, subject, data->soff, data->send, data->sas,
-        strlen(data->qas),
-        1);
-    
     int qcnt = 0, scnt = 0;
-    char* qa = data->qas;
-    char* sa = data->sas;
-    int m = 0;
-    while (qa < data->qae) {
-        int qc = *qa; ++qa;
-        int sc = *sa; ++sa;
-        if (qc != '-') ++qcnt;
-        if (sc != '-') ++scnt;
-        m = (qc == sc) ? (m+1) : 0;
-        if (m == kMatLen) break;
-    }
-    if (m < kMatLen) return 0;
-    data->qas = qa - kMatLen;
-    data->sas = sa - kMatLen;
+    int ncol = find_first_match_run(data, query, subject, kMatLen, &qcnt, &scnt);
+    if (ncol < 0) return 0;
+    drop_front_columns(data, ncol - kMatLen);
     data->qoff += qcnt - kMatLen;
-    data->soff += scnt - kMatLen;   
-
-    qcnt = 0;
-    scnt = 0;
-    qa = data->qae;
-    sa = data->sae;
-    m = 0;
-    while (qa > data->qas) {
-        --qa;
-        --sa;
-        int qc = *qa;
-        int sc = *sa;
-        if (qc != '-') ++qcnt;
-        if (sc != '-') ++scnt;
-        m = (qc == sc) ? (m+1) : 0;
-        if (m == kMatLen) break;
-    }
-    hbn_assert(m == kMatLen, "m = %d, qcnt = %d, scnt = %d", m, qcnt, scnt);
-    if (qa == data->qas) return 0;
+    data->soff += scnt - kMatLen;
 
-    data->qae = qa + kMatLen;
-    data->sae = sa + kMatLen;
+    ncol = find_last_match_run(data, query, subject, kMatLen, &qcnt, &scnt);
+    hbn_assert(ncol > 0, "qcnt = %d, scnt = %d", qcnt, scnt);
+    if (qcnt == data->qend - data->qoff && scnt == data->send - data->soff) return 0;
+    drop_back_columns(data, ncol - kMatLen);
     data->qend -= qcnt - kMatLen;
     data->send -= scnt - kMatLen;
 
-    validate_aligned_string(HBN_LOG_ARGS_DEFAULT,
-        0, query, data->qoff, data->qend,
-        data->qas,
-        0, subject, data->soff, data->send, data->sas,
-        strlen(data->qas),
-        1);
-
     if (1) { //(data->qoff <= kMaxEdlibOverHang || data->soff <= kMaxEdlibOverHang) {
     edlib_extend(data->edlib,
         query + data->qoff - 1,
@@ -448,23 +514,9 @@ hbn_traceback(HbnTracebackData* data,
     hbn_assert(qcnt <= data->qoff);
     hbn_assert(scnt <= data->soff);
     hbn_assert(ks_size(data->ext_qabuf) == ks_size(data->ext_sabuf));
-    for (size_t i = 0; i < ks_size(data->ext_qabuf); ++i) {
-        int res = ks_A(data->ext_qabuf, i);
-        --data->qas;
-        *data->qas = res;
-        res = ks_A(data->ext_sabuf, i);
-        --data->sas;
-        *data->sas = res;
-    }
+    add_aligned_strings(data, ks_s(data->ext_qabuf), ks_s(data->ext_sabuf), ks_size(data->ext_qabuf), TRUE);
     data->qoff -= qcnt;
     data->soff -= scnt;
-
-    validate_aligned_string(HBN_LOG_ARGS_DEFAULT,
-        0, query, data->qoff, data->qend,
-        data->qas,
-        0, subject, data->soff, data->send, data->sas,
-        strlen(data->qas),
-        1);
     }
 
     if (1) { //if (query_length - data->qend <= kMaxEdlibOverHang || subject_length - data->send <= kMaxEdlibOverHang) {
@@ -484,126 +536,29 @@ hbn_traceback(HbnTracebackData* data,
     hbn_assert(data->qend + qcnt <= query_length);
     hbn_assert(data->send + scnt <= subject_length);
     hbn_assert(ks_size(data->ext_qabuf) == ks_size(data->ext_sabuf));
-    memcpy(data->qae, ks_s(data->ext_qabuf), ks_size(data->ext_qabuf));
-    data->qae += ks_size(data->ext_qabuf);
-    *data->qae = '\0';
-    memcpy(data->sae, ks_s(data->ext_sabuf), ks_size(data->ext_sabuf));
-    data->sae += ks_size(data->ext_sabuf);
-    *data->sae = '\0';
+    add_aligned_strings(data, ks_s(data->ext_qabuf), ks_s(data->ext_sabuf), ks_size(data->ext_qabuf), FALSE);
     data->qend += qcnt;
     data->send += scnt;
-
-    validate_aligned_string(HBN_LOG_ARGS_DEFAULT,
-        0, query, data->qoff, data->qend,
-        data->qas,
-        0, subject, data->soff, data->send, data->sas,
-        strlen(data->qas),
-        1);
     }
 
-    if (data->qas == data->qae) return 0;
+    if (kv_size(data->ops) == data->op_head) return 0;
 
     if (process_over_hang) {
         //HBN_LOG("before:");
         //HbnTracebackDataDump(fprintf, stderr, data);
-        //left_extend(data->ksw, query, subject, &data->ksw->qfrag, &data->ksw->tfrag,
-        //    &data->qoff, &data->soff, &data->qas, &data->sas);
-        //right_extend(data->ksw, query, &data->qend, query_length,
-        //    subject, &data->send, subject_length, &data->qae, &data->sae);
-
-        left_extend(data->dalign, data->edlib, query, subject, &data->qfrag, &data->sfrag,
-            &data->ext_qabuf, &data->ext_sabuf, &data->qoff, &data->soff, &data->qas, &data->sas);
-        right_extend(data->dalign, data->edlib, query, &data->qend, query_length,
-            subject, &data->send, subject_length, &data->ext_qabuf, &data->ext_sabuf,
-            &data->qae, &data->sae);
+        left_extend(data, query, subject);
+        right_extend(data, query, query_length, subject, subject_length);
         //HBN_LOG("after:");
         //HbnTracebackDataDump(fprintf, stderr, data);
     }
 
-    data->ident_perc = calc_ident_perc(data->qas, data->sas, strlen(data->qas), &data->dist, &data->score);
-
-    truncate_align_bad_ends(data->qas,
-        data->sas,
-        data->qae - data->qas,
-        1,
-        &data->qoff,
-        &data->qend,
-        &data->soff,
-        &data->send,
-        &data->qas,
-        &data->qae,
-        &data->sas,
-        &data->sae);
-
-    validate_aligned_string(HBN_LOG_ARGS_DEFAULT,
-        0, query, data->qoff, data->qend,
-        data->qas,
-        0, subject, data->soff, data->send, data->sas,
-        strlen(data->qas),
-        1);
+    /// the truncated ends hold no matches, so the identity of the alignment
+    /// before truncation follows from the counters of the one after it
+    const int num_truncated = truncate_align_bad_ends(data, query, subject);
+    count_align_stats(data, query, subject);
+    const int untruncated_size = data->align_len + num_truncated;
+    data->ident_perc = untruncated_size ? (100.0 * data->num_ident / untruncated_size) : 0.0;
     
-    r = (data->qae - data->qas >= min_align_size) && (data->ident_perc >= min_ident_perc);
+    r = (data->align_len >= min_align_size) && (data->ident_perc >= min_ident_perc);
     return r;
 }
-
-BOOL
-truncate_align_bad_ends(const char* qaln,
-    const char* saln,
-    const int aln_size,
-    int mat_len,
-    int* qoff,
-    int* qend,
-    int* soff,
-    int* send,
-    const char** qas_,
-    const char** qae_,
-    const char** sas_,
-    const char** sae_)
-{
-    const char* const qas = qaln;
-    const char* const qae = qaln + aln_size;
-    const char* const sas = saln;
-    const char* const sae = saln + aln_size;
-    int qcnt = 0, scnt = 0;
-    const char* qa = qas;
-    const char* sa = sas;
-    int m = 0;
-
-    while (qa < qae) {
-        int qc = *qa; ++qa;
-        int sc = *sa; ++sa;
-        if (qc != '-') ++qcnt;
-        if (sc != '-') ++scnt;
-        m = (qc == sc) ? (m+1) : 0;
-        if (m == mat_len) break;
-    }
-    if (m < mat_len || qa == qae) return 0;
-    *qas_ = qa - mat_len;
-    *sas_ = sa - mat_len;
-    *qoff += qcnt - mat_len;
-    *soff += scnt - mat_len;  
-
-    qcnt = 0;
-    scnt = 0;
-    qa = qae;
-    sa = sae;
-    m = 0;
-    while (qa > qas) {
-        --qa;
-        --sa;
-        int qc = *qa;
-        int sc = *sa;
-        if (qc != '-') ++qcnt;
-        if (sc != '-') ++scnt;
-        m = (qc == sc) ? (m+1) : 0;
-        if (m == mat_len) break;
-    }
-    hbn_assert(m == mat_len, "m = %d, qcnt = %d, scnt = %d", m, qcnt, scnt);
-    if (qa == qas) return 0;
-
-    *qae_ = qa + mat_len;
-    *sae_ = sa + mat_len;
-    *qend -= qcnt - mat_len;
-    *send -= scnt - mat_len; 
-    return TRUE;
-}
\ No newline at end of file
@@ -4,6 +4,7 @@
 #include "chain_dp.h"
 #include "dalign.h"
 #include "edlib_wrapper.h"
+#include "xdrop_extend.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -12,22 +13,23 @@ extern "C" {
 typedef struct {
     int qoff, qend, qsize;
     int soff, send, ssize;
-    int score;
-    int dist;
+    /// the alignment is the run-length edit script in ops[op_head, kv_size(ops)),
+    /// with runs added at both ends while it is extended
+    vec_align_op ops;
+    size_t op_head;
+    vec_align_op ext_ops;
+    int align_len;
+    int num_ident;
+    int gaps;
+    int gap_opens;
     double ident_perc;
-    kstring_t qabuf;
-    kstring_t sabuf;
     kstring_t ext_qabuf;
     kstring_t ext_sabuf;
     vec_u8 qfrag;
     vec_u8 sfrag;
-    char* qas;
-    char* qae;
-    char* sas;
-    char* sae;
     vec_chain_seed trace_seeds;
     EdlibAlignData* edlib;
-    DalignData* dalign;
+    XdropExtendData* xdrop;
 } HbnTracebackData;
 
 #define HbnTracebackDataDump(output_func, out, data) \
@@ -54,20 +56,6 @@ hbn_traceback(HbnTracebackData* data,
     const double min_ident_perc,
     const int process_over_hang);
 
-BOOL
-truncate_align_bad_ends(const char* qaln,
-    const char* saln,
-    const int aln_size,
-    int mat_len,
-    int* qoff,
-    int* qend,
-    int* soff,
-    int* send,
-    const char** qas_,
-    const char** qae_,
-    const char** sas_,
-    const char** sae_);
-
 int
 hbn_extend_dalign(HbnTracebackData* data,
     const u8* query,
@@ -19,6 +19,18 @@ extern "C" {
 	fprintf(stream, "\n"); \
 } while (0)
 
+/// an alignment is traced as a run-length edit script, one u32 per run
+/// holding the op in its low two bits and the number of columns above them
+#define kAlignOpSub     0   /// a query residue against a subject residue
+#define kAlignOpDel     1   /// a gap in the query
+#define kAlignOpIns     2   /// a gap in the subject
+
+#define ALIGN_OP_RUN(op, num)   ((((u32)(num)) << 2) | (u32)(op))
+#define ALIGN_OP_TYPE(run)      ((int)((run) & 3))
+#define ALIGN_OP_NUM(run)       ((int)((run) >> 2))
+
+typedef kvec_t(u32) vec_align_op;
+
 double
 calc_ident_perc(const char* query_mapped_string, 
 				const char* target_mapped_string,
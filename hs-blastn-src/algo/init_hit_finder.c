@@ -25,6 +25,7 @@ KSORT_INIT(chain_seed_off_lt, ChainSeed, chain_seed_off_lt);
 
 static const int kMaxWordOcc = 8;
 static const int kMaxSeedOcc = 8;
+static const int kWordIndexPrefetchDistance = 8;
 
 /////////////////
 
@@ -117,17 +118,71 @@ build_word_list(const u8* sequence,
     return kv_size(*word_list);
 }
 
+static void
+s_push_seeds(const InitHitFindWord* s_wa,
+    const int s_from,
+    const int s_to,
+    const int query_offset,
+    vec_ihf_seed* seed_list)
+{
+    InitHitFindSeed seed;
+    seed.query_offset = query_offset;
+    for (int si = s_from; si < s_to; ++si) {
+        seed.subject_offset = s_wa[si].offset;
+        kv_push(InitHitFindSeed, *seed_list, seed);
+    }
+}
+
+/// the high bits of the product depend on all bits of the hash
+static inline u32
+s_word_index_slot(const u32 hash, const int shift)
+{
+    return (hash * 2654435761U) >> shift;
+}
+
+static void
+s_index_subject_words(InitHitFindData* data)
+{
+    InitHitFindWord* s_wa = kv_data(data->subject_word_list);
+    const int s_wc = kv_size(data->subject_word_list);
+    int num_runs = 0;
+    for (int i = 0; i < s_wc; ++i) if (i == 0 || s_wa[i].hash != s_wa[i-1].hash) ++num_runs;
+    u32 size = 16;
+    int shift = 28;
+    while (size < 2 * num_runs) size <<= 1, --shift;
+    kv_resize(InitHitFindWordRun, data->subject_word_index, size);
+    kv_zero(InitHitFindWordRun, data->subject_word_index);
+    data->subject_word_index_mask = size - 1;
+    data->subject_word_index_shift = shift;
+    InitHitFindWordRun* index = kv_data(data->subject_word_index);
+    const u32 mask = data->subject_word_index_mask;
+
+    int i = 0;
+    while (i < s_wc) {
+        const u32 hash = s_wa[i].hash;
+        u32 slot = s_word_index_slot(hash, data->subject_word_index_shift);
+        while (index[slot].to) slot = (slot + 1) & mask;
+        InitHitFindWordRun* run = index + slot;
+        run->hash = hash;
+        run->fwd_from = i;
+        while (i < s_wc && s_wa[i].hash == hash && s_wa[i].strand == FWD) ++i;
+        run->rev_from = i;
+        while (i < s_wc && s_wa[i].hash == hash) ++i;
+        run->to = i;
+    }
+}
+
 static int
-s_proceed_to_next_word_hash_idx(InitHitFindWord* a, int n, int i)
+s_find_subject_word(const InitHitFindData* data, const u32 hash)
 {
-    if (i >= n) return i;
-    int hash = a[i].hash;
-    ++i;
-    while (i < n) {
-        if (a[i].hash != hash) break;
-        ++i;
+    const InitHitFindWordRun* index = kv_data(data->subject_word_index);
+    const u32 mask = data->subject_word_index_mask;
+    u32 slot = s_word_index_slot(hash, data->subject_word_index_shift);
+    while (index[slot].to) {
+        if (index[slot].hash == hash) return slot;
+        slot = (slot + 1) & mask;
     }
-    return i;
+    return -1;
 }
 
 static void
@@ -135,71 +190,51 @@ s_collect_seeds(InitHitFindData* data, int subject_dir)
 {
     InitHitFindWord* q_wa = kv_data(data->query_word_list);
     const int q_wc = kv_size(data->query_word_list);
-    int q_wi = 0;
     InitHitFindWord* s_wa = kv_data(data->subject_word_list);
-    const int s_wc = kv_size(data->subject_word_list);
-    int s_wi = 0;
+    InitHitFindWordRun* index = kv_data(data->subject_word_index);
     kv_clear(data->fwd_subject_seed_list);
     kv_clear(data->rev_subject_seed_list);
-    InitHitFindSeed seed;
-
-    while (s_wi < s_wc && q_wi < q_wc) {
-        while (s_wi < s_wc && s_wa[s_wi].hash < q_wa[q_wi].hash) {
-            s_wi = s_proceed_to_next_word_hash_idx(s_wa, s_wc, s_wi);
-        }
-        if (s_wi >= s_wc) break;
 
-        while (q_wi < q_wc && q_wa[q_wi].hash < s_wa[s_wi].hash) {
-            q_wi = s_proceed_to_next_word_hash_idx(q_wa, q_wc, q_wi);
+    if (++data->window_stamp == 0) {
+        for (size_t i = 0; i < kv_size(data->subject_word_index); ++i) index[i].stamp = 0;
+        data->window_stamp = 1;
+    }
+    const u32 stamp = data->window_stamp;
+
+    /// count the occurrences in the window of every word the subject has
+    kv_resize(int, data->query_word_slot_list, q_wc);
+    int* q_ws = kv_data(data->query_word_slot_list);
+    const int shift = data->subject_word_index_shift;
+    for (int qi = 0; qi < q_wc; ++qi) {
+        /// the index is usually larger than the cache
+        if (qi + kWordIndexPrefetchDistance < q_wc) {
+            __builtin_prefetch(index + s_word_index_slot(q_wa[qi + kWordIndexPrefetchDistance].hash, shift));
         }
-        if (q_wi >= q_wc) break;
-
-        if (q_wa[q_wi].hash != s_wa[s_wi].hash) continue;
-
-        int next_q_wi = s_proceed_to_next_word_hash_idx(q_wa, q_wc, q_wi);
-        int next_s_wi = s_proceed_to_next_word_hash_idx(s_wa, s_wc, s_wi);
-        if (next_q_wi - q_wi > kMaxWordOcc) {
-            q_wi = next_q_wi;
-            s_wi = next_s_wi;
-            continue;
+        const int slot = s_find_subject_word(data, q_wa[qi].hash);
+        q_ws[qi] = slot;
+        if (slot < 0) continue;
+        if (index[slot].stamp != stamp) {
+            index[slot].stamp = stamp;
+            index[slot].window_count = 0;
         }
+        ++index[slot].window_count;
+    }
 
-        int s_wi_d = s_wi;
-        while (s_wi_d < next_s_wi && s_wa[s_wi_d].strand == FWD) ++s_wi_d;
-        int r;
-        r = (subject_dir == FWD || subject_dir == F_R)
-            &&
-            (s_wi_d - s_wi <= kMaxWordOcc)
-            &&
-            ((s_wi_d - s_wi) * (next_q_wi - q_wi) <= kMaxSeedOcc);
-        if (r) {
-            for (int qi = q_wi; qi < next_q_wi; ++qi) {
-                seed.query_offset = q_wa[qi].offset;
-                for (int si = s_wi; si < s_wi_d; ++si) {
-                    hbn_assert(q_wa[qi].hash == s_wa[si].hash);
-                    seed.subject_offset = s_wa[si].offset;
-                    kv_push(InitHitFindSeed, data->fwd_subject_seed_list, seed);
-                }
-            }
+    const BOOL use_fwd = (subject_dir == FWD || subject_dir == F_R);
+    const BOOL use_rev = (subject_dir == REV || subject_dir == F_R);
+    for (int qi = 0; qi < q_wc; ++qi) {
+        if (q_ws[qi] < 0) continue;
+        const InitHitFindWordRun* run = index + q_ws[qi];
+        const int q_cnt = run->window_count;
+        if (q_cnt > kMaxWordOcc) continue;
+        const int f_cnt = run->rev_from - run->fwd_from;
+        if (use_fwd && f_cnt <= kMaxWordOcc && f_cnt * q_cnt <= kMaxSeedOcc) {
+            s_push_seeds(s_wa, run->fwd_from, run->rev_from, q_wa[qi].offset, &data->fwd_subject_seed_list);
         }
-        r = (subject_dir == REV || subject_dir == F_R)
-            &&
-            (next_s_wi - s_wi_d <= kMaxWordOcc)
-            &&
-            ((next_s_wi - s_wi_d) * (next_q_wi - q_wi) <= kMaxSeedOcc);
-        if (r) {
-            for (int qi = q_wi; qi < next_q_wi; ++qi) {
-                seed.query_offset = q_wa[qi].offset;
-                for (int si = s_wi_d; si < next_s_wi; ++si) {
-                    hbn_assert(q_wa[qi].hash == s_wa[si].hash);
-                    seed.subject_offset = s_wa[si].offset;
-                    kv_push(InitHitFindSeed, data->rev_subject_seed_list, seed);
-                }
-            }
+        const int r_cnt = run->to - run->rev_from;
+        if (use_rev && r_cnt <= kMaxWordOcc && r_cnt * q_cnt <= kMaxSeedOcc) {
+            s_push_seeds(s_wa, run->rev_from, run->to, q_wa[qi].offset, &data->rev_subject_seed_list);
         }
-
-        q_wi = next_q_wi;
-        s_wi = next_s_wi;
     }
 }
 
@@ -296,6 +331,10 @@ InitHitFindDataNew(int word_size, int word_stride, int chain_score)
     kv_init(data->subject_word_list);
     kv_init(data->fwd_subject_seed_list);
     kv_init(data->rev_subject_seed_list);
+    kv_init(data->subject_word_index);
+    data->subject_word_index_mask = 0;
+    kv_init(data->query_word_slot_list);
+    data->window_stamp = 0;
 
     data->chain = ChainWorkDataNew(1, chain_score);
     kv_init(data->hit_list);
@@ -311,6 +350,8 @@ InitHitFindDataFree(InitHitFindData* data)
     kv_destroy(data->subject_word_list);
     kv_destroy(data->fwd_subject_seed_list);
     kv_destroy(data->rev_subject_seed_list);
+    kv_destroy(data->subject_word_index);
+    kv_destroy(data->query_word_slot_list);
     data->chain = ChainWorkDataFree(data->chain);
     kv_destroy(data->hit_list);
     kv_destroy(data->hit_seed_list);
@@ -334,14 +375,11 @@ InitHitFindData_AddQuery(InitHitFindData* data,
     data->rev_query = rev_query;
     data->query_size = query_size;
 
+    /// the window words are streamed through the subject word index in s_collect_seeds(), unsorted
     kv_clear(data->query_word_list);
     if (fwd_query) build_word_list(fwd_query, FWD, query_size, FALSE, 
         data->word_size, data->word_stride,
         &data->query_word_list, query_size, 0);
-
-    InitHitFindWord* wa = kv_data(data->query_word_list);
-    size_t wc = kv_size(data->query_word_list);
-    ks_introsort_ihf_word_hash_strand_lt(wc, wa);
 }
 
 void
@@ -369,6 +407,7 @@ InitHitFindData_Init(InitHitFindData* data,
     InitHitFindWord* wa = kv_data(data->subject_word_list);
     size_t wc = kv_size(data->subject_word_list);
     ks_introsort_ihf_word_hash_strand_lt(wc, wa);
+    s_index_subject_words(data);
 }
 
 void
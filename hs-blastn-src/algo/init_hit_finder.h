@@ -23,6 +23,21 @@ typedef struct {
 
 typedef kvec_t(InitHitFindSeed) vec_ihf_seed;
 
+/// the words of subject_word_list sharing one hash, [fwd_from, rev_from) are
+/// on the forward strand and [rev_from, to) on the reverse strand.
+/// a slot of the open addressing word index is empty if to == 0
+typedef struct {
+    u32 hash;
+    int fwd_from;
+    int rev_from;
+    int to;
+    /// occurrences in the current query window, valid if stamp == window_stamp
+    int window_count;
+    u32 stamp;
+} InitHitFindWordRun;
+
+typedef kvec_t(InitHitFindWordRun) vec_ihf_word_run;
+
 typedef struct {
     int word_size;
     int word_stride;
@@ -41,6 +56,14 @@ typedef struct {
 
     vec_ihf_word query_word_list;
     vec_ihf_word subject_word_list;
+    /// the subject words are indexed once in InitHitFindData_Init(),
+    /// the query words of every window are then looked up without sorting them
+    vec_ihf_word_run subject_word_index;
+    u32 subject_word_index_mask;
+    int subject_word_index_shift;
+    /// the index slot of every query word, -1 if the subject has no such word
+    vec_int query_word_slot_list;
+    u32 window_stamp;
     vec_ihf_seed fwd_subject_seed_list;
     vec_ihf_seed rev_subject_seed_list;
 
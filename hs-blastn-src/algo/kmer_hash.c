@@ -0,0 +1,435 @@
+#include "kmer_hash.h"
+
+#include <pthread.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KMER_HASH_X86 1
+#else
+#define KMER_HASH_X86 0
+#endif
+
+static inline u64
+load_be_u64(const u8* p)
+{
+    u64 x;
+    memcpy(&x, p, sizeof(u64));
+    return __builtin_bswap64(x);
+}
+
+/// residues [n, end of the last word) are packed as 0 and the padding word is cleared
+static void
+pack_residues_tail(const u8* seq, const size_t seq_size, u64* words)
+{
+    const size_t n_full = seq_size >> 5;
+    const size_t n_left = seq_size & 31;
+    size_t wi = n_full;
+    if (n_left) {
+        const u8* s = seq + (n_full << 5);
+        u64 w = 0;
+        for (size_t k = 0; k < n_left; ++k) {
+            u8 c = s[k];
+            w = (w << 2) | (c > 3 ? 0 : c);
+        }
+        words[wi++] = w << ((32 - n_left) << 1);
+    }
+    words[wi] = 0;
+}
+
+/// 8 residues (< 16) to 16 bits within a u64
+static inline u64
+pack8_swar(const u8* s)
+{
+    u64 x = load_be_u64(s);
+    u64 m = (x >> 2) & 0x0303030303030303ULL;
+    m = (m | (m >> 1)) & 0x0101010101010101ULL;
+    x &= ~(m * 0xFF);
+    x = (x | (x >> 6)) & 0x000F000F000F000FULL;
+    x = (x | (x >> 12)) & 0x000000FF000000FFULL;
+    x = (x | (x >> 24)) & 0xFFFFULL;
+    return x;
+}
+
+static void
+pack_residues_scalar(const u8* seq, const size_t seq_size, u64* words)
+{
+    const size_t n_full = seq_size >> 5;
+    for (size_t i = 0; i < n_full; ++i) {
+        const u8* s = seq + (i << 5);
+        words[i] = (pack8_swar(s) << 48) | (pack8_swar(s + 8) << 32) | (pack8_swar(s + 16) << 16) | pack8_swar(s + 24);
+    }
+    pack_residues_tail(seq, seq_size, words);
+}
+
+static size_t
+extract_scalar(const u64* words,
+    const size_t from,
+    const size_t to,
+    const int kmer_size,
+    const int window_size,
+    u64* hash_array)
+{
+    const int kHashShift = 64 - (kmer_size << 1);
+    size_t cnt = 0;
+    if (window_size == 1) {
+        /// adjacent kmers, roll the hash one residue at a time
+        if (to < from + kmer_size) return 0;
+        const u64 kHashMask = U64_MAX >> kHashShift;
+        u64 hash = 0;
+        for (size_t p = from; p < to; ++p) {
+            hash = ((hash << 2) | ((words[p >> 5] >> (62 - ((p & 31) << 1))) & 3)) & kHashMask;
+            if (p + 1 >= from + kmer_size) hash_array[cnt++] = hash;
+        }
+        return cnt;
+    }
+    for (size_t p = from; p + kmer_size <= to; p += window_size) {
+        const size_t q = p >> 5;
+        const int r = (p & 31) << 1;
+        u64 x = words[q] << r;
+        if (r) x |= words[q + 1] >> (64 - r);
+        hash_array[cnt++] = x >> kHashShift;
+    }
+    return cnt;
+}
+
+#if KMER_HASH_X86
+
+/// 16 residues to 32 bits: clear residues > 3, then merge adjacent residues
+/// with multiply-adds (c0 * 4 + c1, then (c0c1) * 16 + (c2c3)), so that the
+/// low byte of each 32-bit lane holds 4 residues, the first one on top
+
+__attribute__((target("sse4.2")))
+static inline u32
+pack16_sse42(const u8* s)
+{
+    const __m128i kThree = _mm_set1_epi8(3);
+    const __m128i kMul2 = _mm_set1_epi16(0x0104);
+    const __m128i kMul4 = _mm_set1_epi32(0x00010010);
+    const __m128i kGather = _mm_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    __m128i v = _mm_loadu_si128((const __m128i*)s);
+    __m128i is_base = _mm_cmpeq_epi8(_mm_min_epu8(v, kThree), v);
+    v = _mm_and_si128(v, is_base);
+    v = _mm_maddubs_epi16(v, kMul2);
+    v = _mm_madd_epi16(v, kMul4);
+    v = _mm_shuffle_epi8(v, kGather);
+    return __builtin_bswap32((u32)_mm_cvtsi128_si32(v));
+}
+
+__attribute__((target("sse4.2")))
+static void
+pack_residues_sse42(const u8* seq, const size_t seq_size, u64* words)
+{
+    const size_t n_full = seq_size >> 5;
+    for (size_t i = 0; i < n_full; ++i) {
+        const u8* s = seq + (i << 5);
+        words[i] = ((u64)pack16_sse42(s) << 32) | pack16_sse42(s + 16);
+    }
+    pack_residues_tail(seq, seq_size, words);
+}
+
+__attribute__((target("avx2")))
+static void
+pack_residues_avx2(const u8* seq, const size_t seq_size, u64* words)
+{
+    const __m256i kThree = _mm256_set1_epi8(3);
+    const __m256i kMul2 = _mm256_set1_epi16(0x0104);
+    const __m256i kMul4 = _mm256_set1_epi32(0x00010010);
+    const __m256i kGather = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                             0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m256i kLanes = _mm256_setr_epi32(0, 4, 1, 1, 1, 1, 1, 1);
+    const size_t n_full = seq_size >> 5;
+    for (size_t i = 0; i < n_full; ++i) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(seq + (i << 5)));
+        __m256i is_base = _mm256_cmpeq_epi8(_mm256_min_epu8(v, kThree), v);
+        v = _mm256_and_si256(v, is_base);
+        v = _mm256_maddubs_epi16(v, kMul2);
+        v = _mm256_madd_epi16(v, kMul4);
+        v = _mm256_shuffle_epi8(v, kGather);
+        v = _mm256_permutevar8x32_epi32(v, kLanes);
+        u64 w = (u64)_mm_cvtsi128_si64(_mm256_castsi256_si128(v));
+        words[i] = __builtin_bswap64(w);
+    }
+    pack_residues_tail(seq, seq_size, words);
+}
+
+/// 4 kmers per iteration, the two words holding each kmer are gathered
+__attribute__((target("avx2")))
+static size_t
+extract_avx2(const u64* words,
+    const size_t from,
+    const size_t to,
+    const int kmer_size,
+    const int window_size,
+    u64* hash_array)
+{
+    if (to < from + kmer_size) return 0;
+    const size_t num_kmers = (to - from - kmer_size) / window_size + 1;
+    const __m256i k31 = _mm256_set1_epi64x(31);
+    const __m256i k64 = _mm256_set1_epi64x(64);
+    const __m256i kOne = _mm256_set1_epi64x(1);
+    const __m256i kHashShift = _mm256_set1_epi64x(64 - (kmer_size << 1));
+    const __m256i kStep = _mm256_set1_epi64x((i64)window_size * 4);
+    __m256i pos = _mm256_setr_epi64x(from, from + window_size, from + 2 * window_size, from + 3 * window_size);
+    const long long* base = (const long long*)words;
+    size_t cnt = 0;
+    for (; cnt + 4 <= num_kmers; cnt += 4) {
+        __m256i q = _mm256_srli_epi64(pos, 5);
+        __m256i r = _mm256_slli_epi64(_mm256_and_si256(pos, k31), 1);
+        __m256i lo = _mm256_i64gather_epi64(base, q, 8);
+        __m256i hi = _mm256_i64gather_epi64(base, _mm256_add_epi64(q, kOne), 8);
+        /// a shift count of 64 gives 0, so r == 0 needs no special case
+        __m256i x = _mm256_or_si256(_mm256_sllv_epi64(lo, r), _mm256_srlv_epi64(hi, _mm256_sub_epi64(k64, r)));
+        x = _mm256_srlv_epi64(x, kHashShift);
+        _mm256_storeu_si256((__m256i*)(hash_array + cnt), x);
+        pos = _mm256_add_epi64(pos, kStep);
+    }
+    cnt += extract_scalar(words, from + cnt * window_size, to, kmer_size, window_size, hash_array + cnt);
+    return cnt;
+}
+
+#endif // KMER_HASH_X86
+
+typedef void (*PackResiduesFunc)(const u8* seq, const size_t seq_size, u64* words);
+typedef size_t (*ExtractKmerHashFunc)(const u64* words,
+    const size_t from,
+    const size_t to,
+    const int kmer_size,
+    const int window_size,
+    u64* hash_array);
+
+static PackResiduesFunc s_pack_residues = pack_residues_scalar;
+static ExtractKmerHashFunc s_extract = extract_scalar;
+static const char* s_kernel_name = "scalar";
+static pthread_once_t s_kernel_once = PTHREAD_ONCE_INIT;
+
+static void
+select_kmer_hash_kernel()
+{
+#if KMER_HASH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        s_pack_residues = pack_residues_avx2;
+        s_extract = extract_avx2;
+        s_kernel_name = "avx2";
+    } else if (__builtin_cpu_supports("sse4.2")) {
+        s_pack_residues = pack_residues_sse42;
+        s_kernel_name = "sse4.2";
+    }
+#endif
+}
+
+const char* kmer_hash_kernel_name()
+{
+    pthread_once(&s_kernel_once, select_kmer_hash_kernel);
+    return s_kernel_name;
+}
+
+BOOL kmer_hash_use_kernel(const char* name)
+{
+    pthread_once(&s_kernel_once, select_kmer_hash_kernel);
+    if (strcmp(name, "scalar") == 0) {
+        s_pack_residues = pack_residues_scalar;
+        s_extract = extract_scalar;
+        s_kernel_name = "scalar";
+        return TRUE;
+    }
+#if KMER_HASH_X86
+    if (strcmp(name, "sse4.2") == 0 && __builtin_cpu_supports("sse4.2")) {
+        s_pack_residues = pack_residues_sse42;
+        s_extract = extract_scalar;
+        s_kernel_name = "sse4.2";
+        return TRUE;
+    }
+    if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+        s_pack_residues = pack_residues_avx2;
+        s_extract = extract_avx2;
+        s_kernel_name = "avx2";
+        return TRUE;
+    }
+#endif
+    return FALSE;
+}
+
+void
+kmer_hash_pack_residues(const u8* seq, const size_t seq_size, u64* words)
+{
+    pthread_once(&s_kernel_once, select_kmer_hash_kernel);
+    s_pack_residues(seq, seq_size, words);
+}
+
+void
+kmer_hash_load_pac(const u8* pac, const size_t from, const size_t to, u64* words)
+{
+    hbn_assert(from <= to);
+    const size_t seq_size = to - from;
+    const size_t num_words = kmer_hash_num_words(seq_size);
+    const u8* p = pac + (from >> 2);
+    const size_t num_bytes = ((to + 3) >> 2) - (from >> 2);
+    const int s = (from & 3) << 1;
+    for (size_t i = 0; i < num_words; ++i) {
+        const size_t b = i << 3;
+        u64 x0 = 0, x1 = 0;
+        if (b + 9 <= num_bytes) {
+            x0 = load_be_u64(p + b);
+            x1 = p[b + 8];
+        } else {
+            for (size_t k = 0; k < 8; ++k) x0 = (x0 << 8) | ((b + k < num_bytes) ? p[b + k] : 0);
+            x1 = (b + 8 < num_bytes) ? p[b + 8] : 0;
+        }
+        words[i] = (x0 << s) | (x1 >> (8 - s));
+    }
+    /// clear residues beyond to
+    const size_t last = seq_size >> 5;
+    const int n_left = seq_size & 31;
+    if (n_left) words[last] &= ~(U64_MAX >> (n_left << 1));
+    for (size_t i = last + (n_left > 0); i < num_words; ++i) words[i] = 0;
+}
+
+size_t
+kmer_hash_extract(const u64* words,
+    const size_t from,
+    const size_t to,
+    const int kmer_size,
+    const int window_size,
+    u64* hash_array)
+{
+    hbn_assert(kmer_size > 0 && kmer_size <= kMaxKmerHashKmerSize);
+    hbn_assert(window_size > 0);
+    pthread_once(&s_kernel_once, select_kmer_hash_kernel);
+    return s_extract(words, from, to, kmer_size, window_size, hash_array);
+}
+
+static size_t
+extract_rolling_from_residues(const u8* seq,
+    const size_t seq_size,
+    const int kmer_size,
+    u64* hash_array)
+{
+    const u64 kHashMask = U64_MAX >> (64 - (kmer_size << 1));
+    u64 hash = 0;
+    size_t cnt = 0;
+    for (size_t p = 0; p < seq_size; ++p) {
+        u8 c = seq[p];
+        hash = ((hash << 2) | (c > 3 ? 0 : c)) & kHashMask;
+        if (p + 1 >= kmer_size) hash_array[cnt++] = hash;
+    }
+    return cnt;
+}
+
+size_t
+kmer_hash_extract_from_residues(const u8* seq,
+    const size_t seq_size,
+    const int kmer_size,
+    const int window_size,
+    vec_u64* words,
+    vec_u64* hash_list)
+{
+    pthread_once(&s_kernel_once, select_kmer_hash_kernel);
+    if (window_size == 1 && s_extract == extract_scalar) {
+        /// without vector gathers, rolling over the bytes beats packing them first
+        hbn_assert(kmer_size > 0 && kmer_size <= kMaxKmerHashKmerSize);
+        const size_t num_kmers = kmer_hash_num_kmers(seq_size, kmer_size, window_size);
+        kv_resize(u64, *hash_list, num_kmers);
+        return extract_rolling_from_residues(seq, seq_size, kmer_size, kv_data(*hash_list));
+    }
+    kv_resize(u64, *words, kmer_hash_num_words(seq_size));
+    kmer_hash_pack_residues(seq, seq_size, kv_data(*words));
+    const size_t num_kmers = kmer_hash_num_kmers(seq_size, kmer_size, window_size);
+    kv_resize(u64, *hash_list, num_kmers);
+    size_t n = kmer_hash_extract(kv_data(*words), 0, seq_size, kmer_size, window_size, kv_data(*hash_list));
+    hbn_assert(n == num_kmers);
+    return n;
+}
+
+static inline u64
+minimizer_order(u64 key, const u64 mask)
+{
+    key = (~key + (key << 21)) & mask;
+    key = key ^ (key >> 24);
+    key = ((key + (key << 3)) + (key << 8)) & mask;
+    key = key ^ (key >> 14);
+    key = ((key + (key << 2)) + (key << 4)) & mask;
+    key = key ^ (key >> 28);
+    key = (key + (key << 31)) & mask;
+    return key;
+}
+
+/// keep the minimizers of hash_array[0, n) at the front of hash_array.
+/// a minimizer at p is written to slot j <= p, and once p is selected the slots
+/// before it are never read again, so the selection works in place.
+static size_t
+select_minimizers(u64* hash_array,
+    const size_t n,
+    const int kmer_size,
+    const int window_size,
+    u64* offset_array)
+{
+    if (n == 0) return 0;
+    const u64 mask = U64_MAX >> (64 - (kmer_size << 1));
+    const size_t w = hbn_min((size_t)window_size, n);
+    size_t cnt = 0;
+    size_t min_pos = 0;
+    u64 min_order = minimizer_order(hash_array[0], mask);
+    for (size_t i = 1; i < w; ++i) {
+        const u64 order = minimizer_order(hash_array[i], mask);
+        if (order < min_order) {
+            min_order = order;
+            min_pos = i;
+        }
+    }
+    offset_array[cnt] = min_pos;
+    hash_array[cnt++] = hash_array[min_pos];
+    for (size_t i = w; i < n; ++i) {
+        const u64 order = minimizer_order(hash_array[i], mask);
+        if (min_pos + w <= i) {
+            /// the minimizer has left the window [i - w + 1, i]
+            min_pos = i + 1 - w;
+            min_order = minimizer_order(hash_array[min_pos], mask);
+            for (size_t k = min_pos + 1; k <= i; ++k) {
+                const u64 o = minimizer_order(hash_array[k], mask);
+                if (o < min_order) {
+                    min_order = o;
+                    min_pos = k;
+                }
+            }
+        } else if (order < min_order) {
+            min_order = order;
+            min_pos = i;
+        } else {
+            continue;
+        }
+        offset_array[cnt] = min_pos;
+        hash_array[cnt++] = hash_array[min_pos];
+    }
+    return cnt;
+}
+
+size_t
+kmer_hash_extract_minimizers(const u64* words,
+    const size_t from,
+    const size_t to,
+    const int kmer_size,
+    const int window_size,
+    u64* hash_array,
+    u64* offset_array)
+{
+    hbn_assert(window_size > 0);
+    const size_t n = kmer_hash_extract(words, from, to, kmer_size, 1, hash_array);
+    return select_minimizers(hash_array, n, kmer_size, window_size, offset_array);
+}
+
+size_t
+kmer_hash_extract_minimizers_from_residues(const u8* seq,
+    const size_t seq_size,
+    const int kmer_size,
+    const int window_size,
+    vec_u64* words,
+    vec_u64* hash_list,
+    vec_u64* offset_list)
+{
+    hbn_assert(window_size > 0);
+    const size_t n = kmer_hash_extract_from_residues(seq, seq_size, kmer_size, 1, words, hash_list);
+    kv_resize(u64, *offset_list, n);
+    return select_minimizers(kv_data(*hash_list), n, kmer_size, window_size, kv_data(*offset_list));
+}
@@ -0,0 +1,93 @@
+#ifndef __KMER_HASH_H
+#define __KMER_HASH_H
+
+#include "../corelib/hbn_aux.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// kmer hashing kernel shared by lookup table construction and query seeding.
+///
+/// residues are first packed into 2-bit words, 32 residues per word, with the
+/// first residue in the two most significant bits (the byte order of the seqdb
+/// pac file read as big endian u64). residues > 3 are packed as 0, as in the pac file.
+/// the hash value of a kmer (kmer_size <= 32) is then extracted from two adjacent
+/// words with one 128-bit shift, no matter how far apart the sampled kmers are.
+
+#define kMaxKmerHashKmerSize    32
+
+/// number of words needed to pack seq_size residues, including the zero word
+/// padded for reading the word after the last residue
+#define kmer_hash_num_words(seq_size) (((seq_size) + 31) / 32 + 1)
+
+/// number of kmers starting at 0, window_size, 2 * window_size, ... in seq_size residues
+#define kmer_hash_num_kmers(seq_size, kmer_size, window_size) \
+    (((seq_size) < (kmer_size)) ? 0 : (((seq_size) - (kmer_size)) / (window_size) + 1))
+
+/// name of the kernel selected for this cpu: "avx2", "sse4.2" or "scalar"
+const char* kmer_hash_kernel_name();
+
+/// use the kernel called name instead of the one selected for this cpu, for benchmarking.
+/// return FALSE if the cpu does not support it
+BOOL kmer_hash_use_kernel(const char* name);
+
+/// pack residues seq[0, seq_size) into words
+void
+kmer_hash_pack_residues(const u8* seq, const size_t seq_size, u64* words);
+
+/// pack residues [from, to) of the 2-bit pac into words
+void
+kmer_hash_load_pac(const u8* pac, const size_t from, const size_t to, u64* words);
+
+/// hash values of the kmers of the packed residues [from, to) starting at
+/// from, from + window_size, from + 2 * window_size, ...
+/// return the number of kmers
+size_t
+kmer_hash_extract(const u64* words,
+    const size_t from,
+    const size_t to,
+    const int kmer_size,
+    const int window_size,
+    u64* hash_array);
+
+/// kmer_hash_pack_residues() followed by kmer_hash_extract() over the whole sequence
+size_t
+kmer_hash_extract_from_residues(const u8* seq,
+    const size_t seq_size,
+    const int kmer_size,
+    const int window_size,
+    vec_u64* words,
+    vec_u64* hash_list);
+
+/// minimizers of the packed residues [from, to): the kmer of the smallest order
+/// among every window_size consecutive kmers, the leftmost one on ties. the order is an
+/// invertible mix of the kmer bits, so low complexity kmers are not favoured. fewer than
+/// window_size kmers form one window. every minimizer is reported once, its hash value
+/// in hash_array and its position relative to from in offset_array.
+/// hash_array must have room for kmer_hash_num_kmers(to - from, kmer_size, 1) values.
+/// return the number of minimizers
+size_t
+kmer_hash_extract_minimizers(const u64* words,
+    const size_t from,
+    const size_t to,
+    const int kmer_size,
+    const int window_size,
+    u64* hash_array,
+    u64* offset_array);
+
+/// kmer_hash_extract_minimizers() over the residues of seq
+size_t
+kmer_hash_extract_minimizers_from_residues(const u8* seq,
+    const size_t seq_size,
+    const int kmer_size,
+    const int window_size,
+    vec_u64* words,
+    vec_u64* hash_list,
+    vec_u64* offset_list);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __KMER_HASH_H
@@ -3,6 +3,11 @@
 #include <math.h>
 
 #include "../corelib/ksort.h"
+#include "kmer_hash.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
 
 static int block_size;
 static int block_shift;
@@ -46,36 +51,113 @@ KSORT_INIT(ddfkm_soff_lt, DDFKmerMatch, ddfkm_soff_lt);
 #define kmblk_info_gt(a, b) ((a).score > (b).score)
 KSORT_INIT(kmblk_info_gt, DDFKmerMatchBlockInfo, kmblk_info_gt);
 
-void
-DDFKmerMatchBackboneClear(DDFKmerMatchBackbone* backbone)
+#define kInitDDFKmerMatchBlocks 64
+
+#define block_map_hash(block_index, map_size) \
+    ((int)(((u32)(block_index) * 2654435761U) & (u32)((map_size) - 1)))
+
+#define block_slot_is_used(backbone, slot) ((slot)->stamp == (backbone)->block_map_stamp)
+
+/// the slot of block_index, or the empty slot where it would go
+static DDFKmerMatchBlockSlot*
+block_map_find_slot(const DDFKmerMatchBackbone* backbone, const int block_index)
+{
+    const int mask = backbone->block_map_size - 1;
+    int i = block_map_hash(block_index, backbone->block_map_size);
+    while (block_slot_is_used(backbone, backbone->block_map + i) && backbone->block_map[i].block_index != block_index) {
+        i = (i + 1) & mask;
+    }
+    return backbone->block_map + i;
+}
+
+/// NULL if the block is not touched by the current query
+static DDFKmerMatchBlock*
+find_ddfkm_block(const DDFKmerMatchBackbone* backbone, const int block_index)
+{
+    if (block_index < 0) return NULL;
+    DDFKmerMatchBlockSlot* slot = block_map_find_slot(backbone, block_index);
+    return block_slot_is_used(backbone, slot) ? backbone->ddfkm_block_array + slot->array_index : NULL;
+}
+
+static void
+add_one_block(DDFKmerMatchBackbone* backbone, DDFKmerMatchBlockSlot* slot, const int block_index)
 {
+    slot->block_index = block_index;
+    slot->array_index = backbone->ddfkm_block_count;
+    slot->stamp = backbone->block_map_stamp;
+    ddf_km_block_init(backbone->ddfkm_block_array[backbone->ddfkm_block_count]);
+    backbone->ddfkm_block_info_array[backbone->ddfkm_block_count].block_index = block_index;
+    backbone->ddfkm_block_count++;
+}
+
+static void
+grow_backbone(DDFKmerMatchBackbone* backbone)
+{
+    backbone->ddfkm_block_max *= 2;
+    backbone->ddfkm_block_array = (DDFKmerMatchBlock*)realloc(backbone->ddfkm_block_array, 
+                                        sizeof(DDFKmerMatchBlock) * backbone->ddfkm_block_max);
+    backbone->ddfkm_block_info_array = (DDFKmerMatchBlockInfo*)realloc(backbone->ddfkm_block_info_array,
+                                        sizeof(DDFKmerMatchBlockInfo) * backbone->ddfkm_block_max);
+    /// keep the load factor of the map at most 1/2
+    free(backbone->block_map);
+    backbone->block_map_size = backbone->ddfkm_block_max * 2;
+    backbone->block_map = (DDFKmerMatchBlockSlot*)calloc(backbone->block_map_size, sizeof(DDFKmerMatchBlockSlot));
+    backbone->block_map_stamp = 1;
     for (int i = 0; i < backbone->ddfkm_block_count; ++i) {
-        int block_index = backbone->ddfkm_block_info_array[i].block_index;
-        ddf_km_block_init(backbone->ddfkm_block_array[block_index]);
+        const int block_index = backbone->ddfkm_block_info_array[i].block_index;
+        DDFKmerMatchBlockSlot* slot = block_map_find_slot(backbone, block_index);
+        slot->block_index = block_index;
+        slot->array_index = i;
+        slot->stamp = backbone->block_map_stamp;
     }
+}
+
+/// the block of block_index, added to the backbone if it is not touched yet
+static DDFKmerMatchBlock*
+get_ddfkm_block(DDFKmerMatchBackbone* backbone, const int block_index)
+{
+    DDFKmerMatchBlockSlot* slot = block_map_find_slot(backbone, block_index);
+    if (!block_slot_is_used(backbone, slot)) {
+        if (backbone->ddfkm_block_count == backbone->ddfkm_block_max) {
+            grow_backbone(backbone);
+            slot = block_map_find_slot(backbone, block_index);
+        }
+        add_one_block(backbone, slot, block_index);
+    }
+    return backbone->ddfkm_block_array + slot->array_index;
+}
+
+void
+DDFKmerMatchBackboneClear(DDFKmerMatchBackbone* backbone)
+{
     backbone->ddfkm_block_count = 0;
+    if (++backbone->block_map_stamp == 0) {
+        memset(backbone->block_map, 0, sizeof(DDFKmerMatchBlockSlot) * backbone->block_map_size);
+        backbone->block_map_stamp = 1;
+    }
 }
 
 DDFKmerMatchBackbone*
 DDFKmerMatchBackboneFree(DDFKmerMatchBackbone* backbone)
 {
-    free(backbone->_ddfkm_block_array);
+    free(backbone->ddfkm_block_array);
     free(backbone->ddfkm_block_info_array);
+    free(backbone->block_map);
     free(backbone);
     return NULL;
 }
 
 DDFKmerMatchBackbone*
-DDFKmerMatchBackboneNew(const text_t* reference)
+DDFKmerMatchBackboneNew()
 {
     hbn_assert(kmer_block_size_info_is_set());
-    size_t max_ref_size = seqdb_max_offset(reference);
-    size_t num_block = offset_2_blk_id(max_ref_size) + 5;
     DDFKmerMatchBackbone* backbone = (DDFKmerMatchBackbone*)calloc(1, sizeof(DDFKmerMatchBackbone));
-    backbone->_ddfkm_block_array = (DDFKmerMatchBlock*)calloc(num_block, sizeof(DDFKmerMatchBlock));
-    for (size_t i = 0; i < num_block; ++i) ddf_km_block_init(backbone->_ddfkm_block_array[i]);
-    backbone->ddfkm_block_array = backbone->_ddfkm_block_array + 1;
-    backbone->ddfkm_block_info_array = (DDFKmerMatchBlockInfo*)calloc(num_block, sizeof(DDFKmerMatchBlockInfo));
+    backbone->ddfkm_block_max = kInitDDFKmerMatchBlocks;
+    backbone->ddfkm_block_array = (DDFKmerMatchBlock*)calloc(backbone->ddfkm_block_max, sizeof(DDFKmerMatchBlock));
+    backbone->ddfkm_block_info_array = (DDFKmerMatchBlockInfo*)calloc(backbone->ddfkm_block_max, sizeof(DDFKmerMatchBlockInfo));
+    backbone->block_map_size = backbone->ddfkm_block_max * 2;
+    backbone->block_map = (DDFKmerMatchBlockSlot*)calloc(backbone->block_map_size, sizeof(DDFKmerMatchBlockSlot));
+    backbone->block_map_stamp = 1;
     backbone->ddfkm_block_count = 0;
     return backbone;
 }
@@ -115,77 +197,60 @@ is_related(int qoff,
     return is_related;
 }
 
+/// for minimizer sampling, kmer i starts at kmer_offsets[i], otherwise at i * window_size
 static int
 extract_hash_values(const u8* read,
     const int read_size,
     const int kmer_size,
     const int window_size,
-    vec_u64* hash_list)
+    const EHbnKmerSampling sampling,
+    vec_u64* kmer_words,
+    vec_u64* hash_list,
+    vec_u64* kmer_offsets)
 {
     if (read_size < kmer_size) return 0;
-    kv_clear(*hash_list);
-    const int intersect = kmer_size > window_size;
-	u64 intersect_mask = 0;
-	int stride = kmer_size - window_size;
-	if (intersect) intersect_mask = (U64_ONE << (stride << 1)) - 1;
-
-	if (!intersect) {
-		for (size_t j = 0; j <= read_size - kmer_size; j += window_size) {
-			u64 hash = 0;
-			for (int k = 0; k < kmer_size; ++k) {
-				size_t pos = j + k;
-				u8 c = read[pos];
-                hbn_assert(c >= 0 && c < 4);
-				hash = (hash << 2) | c;
-			}
-            kv_push(u64, *hash_list, hash);
-		}
-	} else {
-		u64 hash = 0;
-		for (int j = 0; j < kmer_size; ++j) {
-			size_t pos = j;
-			u8 c = read[pos];
-            hbn_assert(c >= 0 && c < 4);
-			hash = (hash << 2) | c;
-		}
-		kv_push(u64, *hash_list, hash);
-		for (u64 j = window_size; j <= read_size - kmer_size; j += window_size) {
-			hash &= intersect_mask;
-			for (int k = stride; k < kmer_size; ++k) {
-				size_t pos = j + k;
-                hbn_assert(pos < read_size, "p = %d, read_size = %d, j = %d, k = %d, stride = %d", pos, read_size, j, k, stride);
-				u8 c = read[pos];
-                hbn_assert(c >= 0 && c < 4);
-				hash = (hash << 2) | c;
-			}
-			kv_push(u64, *hash_list, hash);
-		}
-	}
-    return kv_size(*hash_list);
+    if (sampling == eKmerSampleMinimizer) {
+        return kmer_hash_extract_minimizers_from_residues(read, read_size, kmer_size, window_size, kmer_words, hash_list, kmer_offsets);
+    }
+    return kmer_hash_extract_from_residues(read, read_size, kmer_size, window_size, kmer_words, hash_list);
 }
 
-static void
-add_one_block(DDFKmerMatchBackbone* backbone, const int block_index)
+/// kmers whose lookups are in flight together
+#define kSeedLookupBatch    32
+
+static inline u64
+seed_cycle_count()
 {
-    backbone->ddfkm_block_info_array[backbone->ddfkm_block_count].block_index = block_index;
-    backbone->ddfkm_block_count++;
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static inline void
+prefetch_ddfkm_block(const DDFKmerMatchBackbone* backbone, const idx soff)
+{
+    const int block_index = offset_2_blk_id(soff);
+    __builtin_prefetch(backbone->block_map + block_map_hash(block_index, backbone->block_map_size));
 }
 
 static void
 insert_one_ddfkm(DDFKmerMatch* km, DDFKmerMatchBackbone* backbone)
 {
-    size_t block_index = offset_2_blk_id(km->soff);
-    DDFKmerMatchBlock* block = backbone->ddfkm_block_array + block_index;
+    const int block_index = offset_2_blk_id(km->soff);
+    DDFKmerMatchBlock* block = get_ddfkm_block(backbone, block_index);
     if (block->ddfkm_count >= BLOCK_DDF_KM_CNT) return;
     if (block->last_qoff == km->qoff) return;
     block->last_qoff = km->qoff;
     block->ddfkm_array[block->ddfkm_count] = *km;
-    if (!block->ddfkm_count) add_one_block(backbone, block_index);
     ++block->ddfkm_count;
 }
 
 static void
-collect_subseq_seeds(vec_u64* hash_list,
+collect_subseq_seeds(vec_u64* kmer_words,
+    vec_u64* hash_list,
+    vec_u64* kmer_offsets,
     const u8* read,
     const int read_from,
     const int read_to,
@@ -193,8 +258,12 @@ collect_subseq_seeds(vec_u64* hash_list,
     const LookupTable* lktbl,
     const int kmer_size,
     const int window_size,
-    DDFKmerMatchBackbone* backbone)
+    const EHbnKmerSampling sampling,
+    DDFKmerMatchBackbone* backbone,
+    WordFindStats* stats)
 {
+    u64* km_lists[kSeedLookupBatch];
+    u64 km_counts[kSeedLookupBatch];
     int SL = 300, SR = 200;
     int n = read_to - read_from;
     if (n <= 500) SL = n;
@@ -202,18 +271,35 @@ collect_subseq_seeds(vec_u64* hash_list,
     while (s < n) {
         int e = s + SL;
         e = hbn_min(e, n);
-        int n_kmer = extract_hash_values(read + read_from + s, e - s, kmer_size, window_size, hash_list);
+        int n_kmer = extract_hash_values(read + read_from + s, e - s, kmer_size, window_size, sampling, kmer_words, hash_list, kmer_offsets);
         DDFKmerMatch ddfkm;
-        for (int i = 0; i < n_kmer; ++i) {
-            u64 n_km;
-            u64* km_list = extract_kmer_list(lktbl, kv_A(*hash_list, i), &n_km);
-            int qoff = read_from + s + i * window_size;
-            ddfkm.qoff = qoff;
-            for (u64 k = 0; k < n_km; ++k) {
-                idx x = km_list[k];
-                if (x >= soff_max) continue;
-                ddfkm.soff = x;
-                insert_one_ddfkm(&ddfkm, backbone);
+        /// a batch of kmers goes through the index, the offset lists and the blocks in turn,
+        /// so that the misses of one step overlap instead of one kmer waiting for each
+        for (int b = 0; b < n_kmer; b += kSeedLookupBatch) {
+            const int nb = hbn_min(kSeedLookupBatch, n_kmer - b);
+            const u64* hashes = kv_data(*hash_list) + b;
+            /// prefetch_kmer_stats() reads the bucket directory, so the prefetch passes are timed too
+            const u64 t = seed_cycle_count();
+            for (int i = 0; i < nb; ++i) prefetch_kmer_list(lktbl, hashes[i]);
+            for (int i = 0; i < nb; ++i) prefetch_kmer_stats(lktbl, hashes[i]);
+            for (int i = 0; i < nb; ++i) {
+                km_lists[i] = extract_kmer_list(lktbl, hashes[i], km_counts + i);
+                if (km_counts[i]) __builtin_prefetch(km_lists[i]);
+            }
+            stats->lookup_cycles += seed_cycle_count() - t;
+            stats->num_lookups += nb;
+            for (int i = 0; i < nb; ++i) {
+                if (i + 1 < nb && km_counts[i + 1]) prefetch_ddfkm_block(backbone, km_lists[i + 1][0]);
+                int qoff = read_from + s;
+                qoff += (sampling == eKmerSampleMinimizer) ? (int)kv_A(*kmer_offsets, b + i) : (b + i) * window_size;
+                ddfkm.qoff = qoff;
+                for (u64 k = 0; k < km_counts[i]; ++k) {
+                    idx x = km_lists[i][k];
+                    if (x >= soff_max) continue;
+                    ddfkm.soff = x;
+                    insert_one_ddfkm(&ddfkm, backbone);
+                }
+                stats->num_offsets += km_counts[i];
             }
         }
         s = e + SR;                
@@ -221,7 +307,9 @@ collect_subseq_seeds(vec_u64* hash_list,
 }
 
 static void
-collect_seeds(vec_u64* hash_list,
+collect_seeds(vec_u64* kmer_words,
+    vec_u64* hash_list,
+    vec_u64* kmer_offsets,
     const u8* read,
     const int read_id,
     const int read_start_id,
@@ -230,9 +318,11 @@ collect_seeds(vec_u64* hash_list,
     const LookupTable* lktbl,
     const int kmer_size,
     const int window_size,
+    const EHbnKmerSampling sampling,
     const int map_against_myself,
     vec_int_pair* seeding_regions,
-    DDFKmerMatchBackbone* backbone)
+    DDFKmerMatchBackbone* backbone,
+    WordFindStats* stats)
 {
     idx soff_max = IDX_MAX;
     if (map_against_myself) {
@@ -249,7 +339,9 @@ collect_seeds(vec_u64* hash_list,
         int from = kv_A(*seeding_regions, s).first;
         int to = kv_A(*seeding_regions, s).second;
         hbn_assert(to <= read_size);
-        collect_subseq_seeds(hash_list,
+        collect_subseq_seeds(kmer_words,
+            hash_list,
+            kmer_offsets,
             read,
             from,
             to,
@@ -257,13 +349,16 @@ collect_seeds(vec_u64* hash_list,
             lktbl,
             kmer_size,
             window_size,
-            backbone);
+            sampling,
+            backbone,
+            stats);
     }
 
     for (int i = 0; i < backbone->ddfkm_block_count; ++i) {
         int block_index = backbone->ddfkm_block_info_array[i].block_index;
-        DDFKmerMatchBlock* block = backbone->ddfkm_block_array + block_index;
-        backbone->ddfkm_block_info_array[i].score = block->ddfkm_count + (block-1)->ddfkm_count;
+        DDFKmerMatchBlock* block = backbone->ddfkm_block_array + i;
+        DDFKmerMatchBlock* prev_block = find_ddfkm_block(backbone, block_index - 1);
+        backbone->ddfkm_block_info_array[i].score = block->ddfkm_count + (prev_block ? prev_block->ddfkm_count : 0);
     }
 }
 
@@ -369,8 +464,8 @@ find_candidate_for_one_ddfkm_list(DDFKmerMatchBackbone* backbone,
         &ql, &qr, &sl, &sr, &block_id_from, &block_id_to);
     int score = 0;
     for (int i = block_id_from; i < block_id_to; ++i) {
-        DDFKmerMatchBlock* block = backbone->ddfkm_block_array + i;
-        score += scoring_one_km_block(block, ql, qr, sl, sr, seed_qoff, seed_soff);
+        DDFKmerMatchBlock* block = find_ddfkm_block(backbone, i);
+        if (block) score += scoring_one_km_block(block, ql, qr, sl, sr, seed_qoff, seed_soff);
     }
 
     HbnInitHit init_hit;
@@ -400,26 +495,23 @@ find_candidate_for_one_block(const text_t* reference,
     int kmer_size,
     vec_init_hit* init_hist_list)
 {
-    DDFKmerMatchBlock* block = backbone->ddfkm_block_array + block_index;
+    DDFKmerMatchBlock* block = find_ddfkm_block(backbone, block_index);
     if (block->ddfkm_count <= ddf_score_cutoff) return 0;
 
     DDFKmerMatch ddfkm_array[BLOCK_DDF_KM_CNT*2];
     int ddfkm_count = 0;
-    if (block->ddfkm_count < 20) {
-        --block;
-        if (block->ddfkm_count) {
-            ks_introsort_ddfkm_soff_lt(block->ddfkm_count, block->ddfkm_array);
-            int i = 0;
-            while (i < block->ddfkm_count) {
-                int j = i + 1;
-                while (j < block->ddfkm_count && block->ddfkm_array[i].soff == block->ddfkm_array[j].soff) ++j;
-                if (j - i <= 3) {
-                    for (int k = i; k < j; ++k) ddfkm_array[ddfkm_count++] = block->ddfkm_array[k];
-                }
-                i = j;
+    DDFKmerMatchBlock* prev_block = find_ddfkm_block(backbone, block_index - 1);
+    if (block->ddfkm_count < 20 && prev_block && prev_block->ddfkm_count) {
+        ks_introsort_ddfkm_soff_lt(prev_block->ddfkm_count, prev_block->ddfkm_array);
+        int i = 0;
+        while (i < prev_block->ddfkm_count) {
+            int j = i + 1;
+            while (j < prev_block->ddfkm_count && prev_block->ddfkm_array[i].soff == prev_block->ddfkm_array[j].soff) ++j;
+            if (j - i <= 3) {
+                for (int k = i; k < j; ++k) ddfkm_array[ddfkm_count++] = prev_block->ddfkm_array[k];
             }
+            i = j;
         }
-        ++block;
     }
     if (block->ddfkm_count) {
         ks_introsort_ddfkm_soff_lt(block->ddfkm_count, block->ddfkm_array);
@@ -473,7 +565,11 @@ ddfs_find_candidates(WordFindData* word_data,
     const int read_size)
 {
     hbn_assert(block_size_info_is_set);
-    collect_seeds(&word_data->hash_list, 
+    /// with stride sampling the subject kmers are sampled, so every read kmer is looked up
+    const int read_window = (word_data->sampling == eKmerSampleMinimizer) ? word_data->window_size : 1;
+    collect_seeds(&word_data->kmer_words,
+        &word_data->hash_list, 
+        &word_data->kmer_offsets,
         read, 
         read_id, 
         read_start_id, 
@@ -481,10 +577,12 @@ ddfs_find_candidates(WordFindData* word_data,
         word_data->reference, 
         word_data->lktbl, 
         word_data->kmer_size, 
-        1, 
+        read_window, 
+        word_data->sampling,
         word_data->map_against_myself, 
         &word_data->seeding_subseqs,
-        word_data->backbone);
+        word_data->backbone,
+        &word_data->stats);
 
     ks_introsort_kmblk_info_gt(word_data->backbone->ddfkm_block_count, word_data->backbone->ddfkm_block_info_array);
     int added_can = 0;
@@ -511,20 +609,24 @@ WordFindDataNew(const text_t* reference,
     const LookupTable* lktbl,
     int kmer_size,
     int window_size,
+    EHbnKmerSampling sampling,
     int min_block_km,
     int map_against_myself)
 {
     WordFindData* data = (WordFindData*)calloc(1, sizeof(WordFindData));
     data->reference = reference;
-    data->backbone = DDFKmerMatchBackboneNew(reference);
+    data->backbone = DDFKmerMatchBackboneNew();
     data->lktbl = lktbl;
     data->chain_data = ChainWorkDataNew(min_block_km, min_block_km * kmer_size * 0.8);
     data->map_against_myself = map_against_myself;
     data->kmer_size = kmer_size;
     data->window_size = window_size;
+    data->sampling = sampling;
     data->min_block_km = min_block_km;
     kv_init(data->seeding_subseqs);
+    kv_init(data->kmer_words);
     kv_init(data->hash_list);
+    kv_init(data->kmer_offsets);
     kv_init(data->init_hit_list);
 
     return data;
@@ -536,8 +638,21 @@ WordFindDataFree(WordFindData* data)
     DDFKmerMatchBackboneFree(data->backbone);
     ChainWorkDataFree(data->chain_data);
     kv_destroy(data->seeding_subseqs);
+    kv_destroy(data->kmer_words);
     kv_destroy(data->hash_list);
+    kv_destroy(data->kmer_offsets);
     kv_destroy(data->init_hit_list);
     free(data);
     return NULL;
+}
+
+void
+WordFindDataReportStats(WordFindData* data, const int thread_id)
+{
+    WordFindStats* stats = &data->stats;
+    if (!stats->num_lookups) return;
+    HBN_LOG("thread %d: %zu kmer lookups, %zu offsets, %.1lf cycles per lookup",
+        thread_id, stats->num_lookups, stats->num_offsets,
+        (double)stats->lookup_cycles / stats->num_lookups);
+    memset(stats, 0, sizeof(WordFindStats));
 }
\ No newline at end of file
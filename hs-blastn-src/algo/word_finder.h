@@ -37,10 +37,27 @@ typedef struct {
 void ks_introsort_kmblk_info_gt(size_t n, DDFKmerMatchBlockInfo* a);
 
 typedef struct {
-    DDFKmerMatchBlock*      _ddfkm_block_array;
+    int block_index;
+    /// index into ddfkm_block_array
+    int array_index;
+    /// the slot is empty unless stamp is the stamp of the backbone
+    u32 stamp;
+} DDFKmerMatchBlockSlot;
+
+/// the blocks of the subject volume hit by the current query. only touched blocks
+/// are allocated, so the memory scales with the query hits instead of the volume size.
+/// ddfkm_block_array[i] is the i-th block touched and is found by its block index
+/// through an open-addressed map
+typedef struct {
     DDFKmerMatchBlock*      ddfkm_block_array;
     DDFKmerMatchBlockInfo*  ddfkm_block_info_array;
     int                     ddfkm_block_count;
+    int                     ddfkm_block_max;
+    DDFKmerMatchBlockSlot*  block_map;
+    /// power of 2
+    int                     block_map_size;
+    /// advanced by DDFKmerMatchBackboneClear() to empty the map
+    u32                     block_map_stamp;
 } DDFKmerMatchBackbone;
 
 void
@@ -50,7 +67,16 @@ DDFKmerMatchBackbone*
 DDFKmerMatchBackboneFree(DDFKmerMatchBackbone* backbone);
 
 DDFKmerMatchBackbone*
-DDFKmerMatchBackboneNew(const text_t* reference);
+DDFKmerMatchBackboneNew();
+
+/// seeding counters of one thread
+typedef struct {
+    size_t num_lookups;
+    size_t num_offsets;
+    /// cycles spent prefetching and then reading the index entries of the kmers,
+    /// mostly waiting for the ones that are not in cache yet
+    u64 lookup_cycles;
+} WordFindStats;
 
 typedef struct {
     const text_t* reference;
@@ -59,11 +85,16 @@ typedef struct {
     ChainWorkData* chain_data;
     int map_against_myself;
     int kmer_size;
+    /// the sampling window of the subject kmers in lktbl
     int window_size;
+    EHbnKmerSampling sampling;
     int min_block_km;
     vec_int_pair seeding_subseqs;
+    vec_u64 kmer_words;
     vec_u64 hash_list;
+    vec_u64 kmer_offsets;
     vec_init_hit init_hit_list;
+    WordFindStats stats;
 } WordFindData;
 
 WordFindData*
@@ -71,12 +102,17 @@ WordFindDataNew(const text_t* reference,
     const LookupTable* lktbl,
     int kmer_size,
     int window_size,
+    EHbnKmerSampling sampling,
     int min_block_km,
     int map_against_myself);
 
 WordFindData*
 WordFindDataFree(WordFindData* data);
 
+/// log and reset the seeding counters of thread_id
+void
+WordFindDataReportStats(WordFindData* data, const int thread_id);
+
 void
 ddfs_find_candidates(WordFindData* word_data,
     const u8* read,
@@ -0,0 +1,338 @@
+#include "xdrop_extend.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define XDROP_EXTEND_SSE2 1
+#else
+#define XDROP_EXTEND_SSE2 0
+#endif
+
+/// score of a cell that has fallen out of the band
+#define kXdropDeadScore (-16384)
+
+#define kXdropOpDiag    0
+#define kXdropOpUp      1
+#define kXdropOpLeft    2
+
+XdropExtendData*
+XdropExtendDataNew()
+{
+    XdropExtendData* data = (XdropExtendData*)calloc(1, sizeof(XdropExtendData));
+    for (int i = 0; i < 3; ++i) kv_init(data->score[i]);
+    kv_init(data->trace);
+    kv_init(data->trace_lo);
+    kv_init(data->trace_off);
+    return data;
+}
+
+XdropExtendData*
+XdropExtendDataFree(XdropExtendData* data)
+{
+    for (int i = 0; i < 3; ++i) {
+        kv_destroy(data->score[i]);
+    }
+    kv_destroy(data->trace);
+    kv_destroy(data->trace_lo);
+    kv_destroy(data->trace_off);
+    free(data);
+    return NULL;
+}
+
+/// a live cell (i, j) scores at most min(i, j) - kXdropGap * |i - j| and at least
+/// -kXdropScoreDrop, which bounds how far one sequence can run ahead of the other
+static int
+xdrop_reachable_length(const int length, const int other_length)
+{
+    i64 reach = (i64)other_length * (kXdropGap + kXdropMatch) / kXdropGap + kXdropScoreDrop / kXdropGap + 1;
+    return (reach < length) ? (int)reach : length;
+}
+
+#if XDROP_EXTEND_SSE2
+
+/// the band is scored in chunks of eight cells on a fixed grid of query
+/// offsets. the chunks written for one anti-diagonal are read back whole for
+/// the next two, which keeps the loads served by store forwarding, and the
+/// scores one cell up are shifted in from the previous chunk
+#define kXdropChunkSize 8
+
+static inline int
+xdrop_chunk_start(const int i)
+{
+    return ((i + 1) & ~(kXdropChunkSize - 1)) - 1;
+}
+
+/// residues [p, p + 8) widened to 16 bits, in reverse order if reverse is set
+static inline __attribute__((always_inline)) __m128i
+xdrop_load_residues(const u8* p, const int reverse)
+{
+    __m128i v = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)p), _mm_setzero_si128());
+    if (reverse) {
+        v = _mm_shufflelo_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+        v = _mm_shufflehi_epi16(v, _MM_SHUFFLE(0, 1, 2, 3));
+        v = _mm_shuffle_epi32(v, _MM_SHUFFLE(1, 0, 3, 2));
+    }
+    return v;
+}
+
+/// residues of one sequence for cells [i, i + 8), query[step * (i - 1 + k)] or
+/// subject[step * (d - i - 1 - k)], for a chunk running over an end of the sequences
+static inline __attribute__((always_inline)) __m128i
+xdrop_load_edge_residues(const u8* seq, const int length, const int step, const int from, const int dir)
+{
+    i16 r[kXdropChunkSize];
+    for (int k = 0; k < kXdropChunkSize; ++k) {
+        const int x = from + dir * k;
+        r[k] = (x >= 0 && x < length) ? seq[step * x] : 4;
+    }
+    return _mm_loadu_si128((const __m128i*)r);
+}
+
+#endif // XDROP_EXTEND_SSE2
+
+/// fill the band of anti-diagonal d = i + j for query offsets [lo, hi] from the
+/// two previous anti-diagonals and return its best score. cells on the first
+/// row and column only have one predecessor and are handled by the caller.
+/// the cells of an anti-diagonal are independent of each other and are scored
+/// eight at a time, one of the sequences is read backwards along it, which
+/// costs a word shuffle. cells of a chunk outside [lo, hi] are scored from
+/// stale neighbours, and the caller keeps them away from the band.
+static inline __attribute__((always_inline)) int
+xdrop_fill_band(const u8* query,
+    const int query_length,
+    const u8* subject,
+    const int subject_length,
+    const int step,
+    const int d,
+    const int lo,
+    const int hi,
+    const i16* h2,
+    const i16* h1,
+    i16* h,
+    u8* ops)
+{
+    int max_score = kXdropDeadScore;
+#if XDROP_EXTEND_SSE2
+    const __m128i match = _mm_set1_epi16(kXdropMatch + kXdropMismatch);
+    const __m128i mismatch = _mm_set1_epi16(kXdropMismatch);
+    const __m128i gap = _mm_set1_epi16(kXdropGap);
+    const __m128i one = _mm_set1_epi16(1);
+    const __m128i dead = _mm_set1_epi16(kXdropDeadScore);
+    const __m128i lanes = _mm_setr_epi16(0, 1, 2, 3, 4, 5, 6, 7);
+    __m128i vmax = dead;
+    int i = xdrop_chunk_start(lo);
+    /// cells [i - 7, i] of the two previous anti-diagonals
+    __m128i prev2 = _mm_loadu_si128((const __m128i*)(h2 + i - 7));
+    __m128i prev1 = _mm_loadu_si128((const __m128i*)(h1 + i - 7));
+    for (; i <= hi; i += kXdropChunkSize) {
+        /// cells [i, i + 8) read query[i - 1, i + 7) forward and subject[d - i - 8, d - i)
+        /// backwards, or the mirror image for step = -1
+        __m128i qv, sv;
+        if (i < 1 || i + kXdropChunkSize - 1 > query_length || d - i - kXdropChunkSize < 0 || d - i > subject_length) {
+            qv = xdrop_load_edge_residues(query, query_length, step, i - 1, 1);
+            sv = xdrop_load_edge_residues(subject, subject_length, step, d - i - 1, -1);
+        } else if (step > 0) {
+            qv = xdrop_load_residues(query + i - 1, 0);
+            sv = xdrop_load_residues(subject + d - i - 8, 1);
+        } else {
+            qv = xdrop_load_residues(query - i - 6, 1);
+            sv = xdrop_load_residues(subject - (d - i - 1), 0);
+        }
+        __m128i sc = _mm_sub_epi16(_mm_and_si128(_mm_cmpeq_epi16(qv, sv), match), mismatch);
+        __m128i cur2 = _mm_loadu_si128((const __m128i*)(h2 + i + 1));
+        __m128i cur1 = _mm_loadu_si128((const __m128i*)(h1 + i + 1));
+        __m128i hd = _mm_adds_epi16(_mm_or_si128(_mm_slli_si128(cur2, 2), _mm_srli_si128(prev2, 14)), sc);
+        __m128i hu = _mm_subs_epi16(_mm_or_si128(_mm_slli_si128(cur1, 2), _mm_srli_si128(prev1, 14)), gap);
+        __m128i hl = _mm_subs_epi16(cur1, gap);
+        prev2 = cur2;
+        prev1 = cur1;
+        __m128i hg = _mm_max_epi16(hu, hl);
+        __m128i hs = _mm_max_epi16(hd, hg);
+        _mm_storeu_si128((__m128i*)(h + i + 1), hs);
+        /// op = 0 if hd >= hg, else 1 if hu >= hl, else 2
+        __m128i gapped = _mm_cmpgt_epi16(hg, hd);
+        __m128i op = _mm_and_si128(gapped, _mm_add_epi16(one, _mm_and_si128(_mm_cmpgt_epi16(hl, hu), one)));
+        _mm_storel_epi64((__m128i*)(ops + i), _mm_packus_epi16(op, op));
+        if (i < lo || i + kXdropChunkSize - 1 > hi) {
+            __m128i x = _mm_add_epi16(_mm_set1_epi16(i), lanes);
+            __m128i in_band = _mm_and_si128(_mm_cmpgt_epi16(x, _mm_set1_epi16(lo - 1)),
+                                            _mm_cmpgt_epi16(_mm_set1_epi16(hi + 1), x));
+            hs = _mm_or_si128(_mm_and_si128(in_band, hs), _mm_andnot_si128(in_band, dead));
+        }
+        vmax = _mm_max_epi16(vmax, hs);
+    }
+    vmax = _mm_max_epi16(vmax, _mm_shuffle_epi32(vmax, _MM_SHUFFLE(1, 0, 3, 2)));
+    vmax = _mm_max_epi16(vmax, _mm_shuffle_epi32(vmax, _MM_SHUFFLE(2, 3, 0, 1)));
+    vmax = _mm_max_epi16(vmax, _mm_shufflelo_epi16(vmax, _MM_SHUFFLE(2, 3, 0, 1)));
+    max_score = (i16)_mm_extract_epi16(vmax, 0);
+#else
+    for (int i = lo; i <= hi; ++i) {
+        const int qc = query[step * (i - 1)];
+        const int sc = subject[step * (d - i - 1)];
+        const int hd = h2[i] + ((qc == sc) ? kXdropMatch : -kXdropMismatch);
+        const int hu = h1[i] - kXdropGap;
+        const int hl = h1[i + 1] - kXdropGap;
+        const int hg = hbn_max(hu, hl);
+        const int hs = hbn_max(hd, hg);
+        h[i + 1] = hs;
+        ops[i] = (hd >= hg) ? kXdropOpDiag : ((hu >= hl) ? kXdropOpUp : kXdropOpLeft);
+        max_score = hbn_max(max_score, hs);
+    }
+#endif
+    return max_score;
+}
+
+static inline __attribute__((always_inline)) void
+xdrop_fill(XdropExtendData* data,
+    const u8* query,
+    int query_length,
+    const u8* subject,
+    int subject_length,
+    const int step,
+    int* best_i,
+    int* best_d)
+{
+    query_length = xdrop_reachable_length(query_length, subject_length);
+    subject_length = xdrop_reachable_length(subject_length, query_length);
+    /// chunks start up to eight cells before the query and run up to seven cells past its end
+    const int score_size = 8 + query_length + 2 + 8;
+    for (int k = 0; k < 3; ++k) {
+        if (kv_max(data->score[k]) < score_size) kv_reserve(i16, data->score[k], score_size);
+        i16* h = kv_data(data->score[k]);
+        for (int i = 0; i < score_size; ++i) h[i] = kXdropDeadScore;
+    }
+    i16* h2 = kv_data(data->score[0]) + 8;
+    i16* h1 = kv_data(data->score[1]) + 8;
+    i16* h = kv_data(data->score[2]) + 8;
+    const int max_d = query_length + subject_length;
+    if (kv_max(data->trace_lo) < max_d + 1) kv_reserve(int, data->trace_lo, max_d + 1);
+    if (kv_max(data->trace_off) < max_d + 1) kv_reserve(size_t, data->trace_off, max_d + 1);
+    int* trace_lo = kv_data(data->trace_lo);
+    size_t* trace_off = kv_data(data->trace_off);
+    kv_clear(data->trace);
+    kv_push(u8, data->trace, kXdropOpDiag);
+    trace_lo[0] = 0;
+    trace_off[0] = 0;
+
+    h1[1] = 0;
+    int best = 0;
+    *best_i = 0;
+    *best_d = 0;
+    int lo = 0, hi = 0;
+    for (int d = 1; d <= max_d; ++d) {
+        lo = hbn_max(lo, d - subject_length);
+        hi = hbn_min(hi + 1, query_length);
+        if (lo > hi) break;
+        /// the first row and column are filled after the band, over the cells the chunks ran into
+        const int from = lo + (lo == 0);
+        const int to = hi - (hi == d);
+        int trace_from = lo, trace_to = hi;
+#if XDROP_EXTEND_SSE2
+        if (from <= to) {
+            trace_from = hbn_min(lo, xdrop_chunk_start(from));
+            trace_to = hbn_max(hi, xdrop_chunk_start(to) + kXdropChunkSize - 1);
+        }
+#endif
+        size_t off = kv_size(data->trace);
+        size_t trace_size = off + trace_to - trace_from + 1;
+        if (trace_size > kv_max(data->trace)) kv_reserve(u8, data->trace, 2 * trace_size);
+        kv_size(data->trace) = trace_size;
+        trace_lo[d] = trace_from;
+        trace_off[d] = off;
+        /// ops[i] is the op of query offset i on this anti-diagonal
+        u8* ops = kv_data(data->trace) + off - trace_from;
+
+        int max_score = kXdropDeadScore;
+        if (from <= to) {
+            max_score = xdrop_fill_band(query, query_length, subject, subject_length,
+                            step, d, from, to, h2, h1, h, ops);
+        }
+        if (lo == 0) {
+            h[1] = h1[1] - kXdropGap;
+            ops[0] = kXdropOpLeft;
+            max_score = hbn_max(max_score, h[1]);
+        }
+        if (hi == d) {
+            h[d + 1] = h1[d] - kXdropGap;
+            ops[d] = kXdropOpUp;
+            max_score = hbn_max(max_score, h[d + 1]);
+        }
+        if (max_score > best) {
+            best = max_score;
+            int i = lo;
+            while (h[i + 1] != max_score) ++i;
+            *best_i = i;
+            *best_d = d;
+        }
+
+        /// the band shrinks from both ends to the cells not too far below the best score
+        const int min_score = best - kXdropScoreDrop;
+        while (lo <= hi && h[lo + 1] < min_score) ++lo;
+        while (hi >= lo && h[hi + 1] < min_score) --hi;
+        if (lo > hi) break;
+        /// the next two anti-diagonals read one cell beyond each end of the band
+        h[lo] = kXdropDeadScore;
+        h[hi + 2] = kXdropDeadScore;
+
+        i16* t = h2;
+        h2 = h1;
+        h1 = h;
+        h = t;
+    }
+}
+
+static int
+xdrop_traceback(XdropExtendData* data,
+    const int best_i,
+    const int best_d,
+    vec_align_op* ops)
+{
+    const u8* trace = kv_data(data->trace);
+    const int* trace_lo = kv_data(data->trace_lo);
+    const size_t* trace_off = kv_data(data->trace_off);
+
+    /// the trace runs from the far end back to the anchor
+    kv_clear(*ops);
+    int n = 0;
+    for (int i = best_i, d = best_d; d; ++n) {
+        const int op = trace[trace_off[d] + i - trace_lo[d]];
+        const int type = (op == kXdropOpDiag) ? kAlignOpSub : ((op == kXdropOpLeft) ? kAlignOpDel : kAlignOpIns);
+        if (kv_size(*ops) && ALIGN_OP_TYPE(kv_back(*ops)) == type) {
+            kv_back(*ops) += ALIGN_OP_RUN(0, 1);
+        } else {
+            kv_push(u32, *ops, ALIGN_OP_RUN(type, 1));
+        }
+        if (op != kXdropOpLeft) --i;
+        d -= (op == kXdropOpDiag) ? 2 : 1;
+    }
+
+    u32* a = kv_data(*ops);
+    for (size_t x = 0, y = kv_size(*ops); x + 1 < y; ++x, --y) {
+        u32 t = a[x];
+        a[x] = a[y-1];
+        a[y-1] = t;
+    }
+    return n;
+}
+
+int
+xdrop_extend(XdropExtendData* data,
+    const u8* query,
+    const int query_length,
+    const u8* subject,
+    const int subject_length,
+    const int step,
+    vec_align_op* ops,
+    int* qcnt,
+    int* scnt)
+{
+    hbn_assert(step == 1 || step == -1);
+    int best_i, best_d;
+    if (step > 0) {
+        xdrop_fill(data, query, query_length, subject, subject_length, 1, &best_i, &best_d);
+    } else {
+        xdrop_fill(data, query, query_length, subject, subject_length, -1, &best_i, &best_d);
+    }
+    *qcnt = best_i;
+    *scnt = best_d - best_i;
+    return xdrop_traceback(data, best_i, best_d, ops);
+}
@@ -0,0 +1,60 @@
+#ifndef __XDROP_EXTEND_H
+#define __XDROP_EXTEND_H
+
+#include "hbn_traceback_aux.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// linear scores of the overhang extension. an extension only gains score
+/// while its identity stays above 2/3, close to the 0.65 the dalign pass used
+#define kXdropMatch     1
+#define kXdropMismatch  2
+#define kXdropGap       2
+/// stop once every cell of an anti-diagonal is this far below the best score
+#define kXdropScoreDrop 40
+
+typedef kvec_t(i16) vec_i16;
+
+typedef struct {
+    /// scores of the last three anti-diagonals, indexed by query offset + 1
+    vec_i16 score[3];
+    /// one edit op per band cell, the bands are stored one anti-diagonal after another
+    vec_u8 trace;
+    vec_int trace_lo;
+    vec_size_t trace_off;
+} XdropExtendData;
+
+XdropExtendData*
+XdropExtendDataNew();
+
+XdropExtendData*
+XdropExtendDataFree(XdropExtendData* data);
+
+/// extend an alignment anchored before query[0] and subject[0] with an
+/// X-drop, anti-diagonal banded DP. step = 1 reads the sequences forward
+/// from the anchor, step = -1 reads query[0], query[-1], ... so a left
+/// extension works on the sequences in place.
+///
+/// the runs of the extension are returned in ops in the order they leave
+/// the anchor, so a right extension appends them and a left extension
+/// prepends them one after another. returns the number of columns, the
+/// numbers of query and subject residues they cover are returned in qcnt
+/// and scnt.
+int
+xdrop_extend(XdropExtendData* data,
+    const u8* query,
+    const int query_length,
+    const u8* subject,
+    const int subject_length,
+    const int step,
+    vec_align_op* ops,
+    int* qcnt,
+    int* scnt);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __XDROP_EXTEND_H
@@ -0,0 +1,280 @@
+#include "cmdline_args.h"
+
+#include "../../corelib/hbn_aux.h"
+#include "../../corelib/hbn_package_version.h"
+#include "../../ncbi_blast/cmdline_args/blast_args.hpp"
+#include "../../ncbi_blast/setup/blast_types.hpp"
+#include "../../ncbi_blast/cmdline_args/cmdline_flags.hpp"
+
+#include <cmath>
+
+BEGIN_NCBI_SCOPE
+USING_SCOPE(blast);
+USING_SCOPE(align_format);
+
+using namespace std;
+
+/// formatting options
+extern const string align_format::kArgOutputFormat;
+const string kDfltOutfmt("sam");
+const string kArgSamDumpMd("sam_md");
+const bool kDfltSamDumpMd = false;
+const string kArgDumpCigar("cigar");
+const bool kDfltDumpCigar = false;
+
+/// restrict results
+extern const string blast::kArgEvalue;
+const double kDfltEvalue = HUGE_VAL;
+extern const string blast::kArgPercentIdentity;
+const double kDfltPercentIdentity = 0.0;
+
+/// miscellaneous options
+extern const string blast::kArgNumThreads;
+extern const int blast::kDfltNumThreads;
+extern const string blast::kArgOutput;
+const string kDfltOutput("-");
+
+/// groups
+static const char* kGroupFormat = "Formatting options";
+static const char* kGroupRestrictSearch = "Restrict results";
+static const char* kGroupMiscellaneous = "Miscellaneous options";
+
+class CommandLineArguments : public IBlastCmdLineArgs
+{
+public:
+    CommandLineArguments(HbnConvertOptions* options);
+    ~CommandLineArguments();
+
+    virtual void SetArgumentDescriptions(CArgDescriptions& arg_desc);
+
+    virtual void ExtractAlgorithmOptions(const CArgs& cmd_line_args, CBlastOptions& options);
+
+private:
+    HbnConvertOptions*              m_Options;
+};
+
+CommandLineArguments::CommandLineArguments(HbnConvertOptions* options)
+{
+    m_Options = options;
+}
+
+CommandLineArguments::~CommandLineArguments()
+{
+
+}
+
+void CommandLineArguments::SetArgumentDescriptions(CArgDescriptions& arg_desc)
+{
+    /// create the groups so that the ordering is established
+    arg_desc.SetCurrentGroup(kGroupFormat);
+    arg_desc.SetCurrentGroup(kGroupRestrictSearch);
+    arg_desc.SetCurrentGroup(kGroupMiscellaneous);
+
+    /// output format
+    arg_desc.SetCurrentGroup(kGroupFormat);
+
+    arg_desc.AddDefaultKey(kArgOutputFormat, "format",
+                "Output format:\n"
+                "  sam = Sequence Alignment/Map (SAM),\n"
+                "  paf = Pairwise mApping Format (PAF),\n"
+                "  m4  = BLASR M4",
+                CArgDescriptions::eString,
+                kDfltOutfmt);
+    arg_desc.SetConstraint(kArgOutputFormat, &(* new CArgAllow_Strings, "sam", "paf", "m4"));
+
+    arg_desc.AddFlag(kArgSamDumpMd, "Add MD tag to the SAM output", true);
+
+    arg_desc.AddFlag(kArgDumpCigar, "Add the CIGAR to the PAF and M4 output", true);
+
+    /// restrict results
+    arg_desc.SetCurrentGroup(kGroupRestrictSearch);
+
+    arg_desc.AddOptionalKey(kArgEvalue, "evalue",
+                "Skip the alignments of larger expectation value",
+                CArgDescriptions::eDouble);
+    arg_desc.SetConstraint(kArgEvalue, CArgAllowValuesGreaterThanOrEqual(0));
+
+    arg_desc.AddOptionalKey(kArgPercentIdentity, "float_value",
+                "Skip the alignments of smaller percent identity",
+                CArgDescriptions::eDouble);
+    arg_desc.SetConstraint(kArgPercentIdentity, CArgAllow_Doubles(0.0, 100.0));
+
+    /// miscellaneous options
+    arg_desc.SetCurrentGroup(kGroupMiscellaneous);
+
+    arg_desc.AddDefaultKey(kArgOutput, "output_path",
+                "results file",
+                CArgDescriptions::eString,
+                kDfltOutput);
+
+    arg_desc.AddDefaultKey(kArgNumThreads, "int_value",
+                "Number of threads (CPUs) to use in the conversion",
+                CArgDescriptions::eInteger,
+                NStr::IntToString(kDfltNumThreads));
+    arg_desc.SetConstraint(kArgNumThreads, CArgAllowValuesGreaterThanOrEqual(1));
+}
+
+void CommandLineArguments::ExtractAlgorithmOptions(const CArgs& args, CBlastOptions& options)
+{
+    /// output format
+    if (args.Exist(kArgOutputFormat) && args[kArgOutputFormat].HasValue()) {
+        const string fmt = args[kArgOutputFormat].AsString();
+        if (fmt == "sam") {
+            m_Options->outfmt = eConvertSAM;
+        } else if (fmt == "paf") {
+            m_Options->outfmt = eConvertPAF;
+        } else if (fmt == "m4") {
+            m_Options->outfmt = eConvertM4;
+        } else {
+            HBN_ERR("unsupported output format '%s'", fmt.c_str());
+        }
+    }
+
+    if (args.Exist(kArgSamDumpMd))
+        m_Options->dump_md = static_cast<bool>(args[kArgSamDumpMd]);
+
+    if (args.Exist(kArgDumpCigar))
+        m_Options->dump_cigar = static_cast<bool>(args[kArgDumpCigar]);
+
+    /// restrict results
+    if (args.Exist(kArgEvalue) && args[kArgEvalue].HasValue()) {
+        m_Options->max_evalue = args[kArgEvalue].AsDouble();
+    }
+
+    if (args.Exist(kArgPercentIdentity) && args[kArgPercentIdentity].HasValue()) {
+        m_Options->min_perc_identity = args[kArgPercentIdentity].AsDouble();
+    }
+
+    /// misc options
+    if (args.Exist(kArgOutput) && args[kArgOutput].HasValue()) {
+        m_Options->output = strdup(args[kArgOutput].AsString().c_str());
+    }
+
+    const int kMaxValue = static_cast<int>(hbn_get_cpu_count());
+    if (args.Exist(kArgNumThreads) && args[kArgNumThreads].HasValue()) {
+        // use the minimum of the two: user requested number of threads and
+        // number of available CPUs for number of threads
+        int num_threads = args[kArgNumThreads].AsInteger();
+        if (num_threads > kMaxValue) {
+            m_Options->num_threads = kMaxValue;
+
+            string warn_msg = (string)"Number of threads was reduced to " +
+                     NStr::IntToString((unsigned int)m_Options->num_threads) +
+                     " to match the number of available CPUs";
+            HBN_WARN("%s", warn_msg.c_str());
+        }
+        else {
+            m_Options->num_threads = num_threads;
+        }
+    }
+}
+
+static void
+Init_HbnConvertOptions(HbnConvertOptions* opts)
+{
+    opts->db_dir = NULL;
+    opts->output = kDfltOutput.c_str();
+    opts->outfmt = eConvertSAM;
+    opts->dump_md = kDfltSamDumpMd;
+    opts->dump_cigar = kDfltDumpCigar;
+    opts->max_evalue = kDfltEvalue;
+    opts->min_perc_identity = kDfltPercentIdentity;
+    opts->num_threads = kDfltNumThreads;
+}
+
+static void
+s_PreCheckCmdLineArgs(int argc, char* argv[], CArgDescriptions* arg_desc)
+{
+    string kProgram = FindProgramDisplayName(argv[0]);
+    string kHbnUsage = kProgram + " [OPTIONS] db_dir";
+
+    for (int i = 1; i < argc; ++i) {
+        if (argv[i][0] != '-') continue;
+        if (NStr::CompareCase(argv[i] + 1, kArgHelp) == 0) {
+            string usage_info;
+            arg_desc->HbnPrintUsage(kHbnUsage, usage_info);
+            cout << usage_info << endl;
+            exit(0);
+        } else if (NStr::CompareCase(argv[i] + 1, kArgFullHelp) == 0) {
+            string usage_info;
+            arg_desc->HbnPrintUsage(kHbnUsage, usage_info, true);
+            cout << usage_info << endl;
+            exit(0);
+        } else if (NStr::CompareCase(argv[i] + 1, kArgVersion) == 0) {
+            string appname = FindProgramDisplayName(argv[0]);
+            string version = PrintProgramVersion(appname);
+            cout << version << endl;
+            exit(0);
+        }
+    }
+}
+
+extern "C"
+void ParseHbnConvertCmdLineArguments(int argc, char* argv[], HbnConvertOptions* opts)
+{
+    Init_HbnConvertOptions(opts);
+    TBlastCmdLineArgs arg_list;
+
+    /// setup description
+    CRef<IBlastCmdLineArgs> arg;
+    string kProgram = FindProgramDisplayName(argv[0]);
+    string kProgramDescription = string("Converter of the results kept by '") + HBN_PACKAGE_NAME + " -keep_db'";
+    arg.reset(new CProgramDescriptionArgs(kProgram, kProgramDescription));
+    arg_list.push_back(arg);
+
+    arg.reset(new CommandLineArguments(opts));
+    arg_list.push_back(arg);
+
+    unique_ptr<CArgDescriptions> arg_desc(new CArgDescriptions);
+    NON_CONST_ITERATE(TBlastCmdLineArgs, arg_iter, arg_list) {
+        (*arg_iter)->SetArgumentDescriptions(*arg_desc);
+    }
+
+    /// examine trivial arguments (-help, -h, -version)
+    s_PreCheckCmdLineArgs(argc, argv, arg_desc.get());
+
+    /// process nontrivial arguments
+    unique_ptr<CArgs> cmd_args(new CArgs);
+    int argv_idx = 1;
+    auto& supported_args = (*arg_desc).GetArgs();
+    while (argv_idx < argc) {
+        if (argv[argv_idx][0] != '-') break;
+        string argname = argv[argv_idx] + 1;
+        bool negative = false;
+        auto it = (*arg_desc).Find(argname, &negative);
+        if (it == supported_args.end()) HBN_ERR("unrecognised argument '%s'", argname.c_str());
+        CArgDesc& arg = **it;
+        CArgValue* av = nullptr;
+        if (ArgDescIsFlag(arg)) {
+            av = arg.ProcessArgument(kEmptyStr);
+            ++argv_idx;
+        } else {
+            if (argv_idx + 1 >= argc) HBN_ERR("Mandatory value to argument '%s' is missing", argname.c_str());
+            av = arg.ProcessArgument(argv[argv_idx + 1]);
+            argv_idx += 2;
+        }
+        cmd_args->Add(av, true, true);
+    }
+
+    CBlastOptions cblastopts;
+    NON_CONST_ITERATE(TBlastCmdLineArgs, arg_iter, arg_list) {
+        (*arg_iter)->ExtractAlgorithmOptions(*cmd_args, cblastopts);
+    }
+
+    /// db_dir
+    if (argc - argv_idx < 1) {
+        HBN_ERR("The database directory must be specified");
+    } else if (argc - argv_idx > 1) {
+        string err = "Too many database directories: '";
+        for (int i = argv_idx; i < argc; ++i) {
+            err += argv[i];
+            if (i != argc - 1) err += ' ';
+        }
+        err += "'";
+        HBN_ERR("%s", err.c_str());
+    } else {
+        opts->db_dir = argv[argv_idx];
+    }
+}
+
+END_NCBI_SCOPE
@@ -0,0 +1,32 @@
+#ifndef __HBNCONVERT_CMDLINE_ARGS_H
+#define __HBNCONVERT_CMDLINE_ARGS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    eConvertSAM,
+    eConvertPAF,
+    eConvertM4
+} EConvertFormat;
+
+typedef struct {
+    const char* db_dir;
+    const char* output;
+    EConvertFormat outfmt;
+    int dump_md;
+    int dump_cigar;
+    double max_evalue;
+    double min_perc_identity;
+    int num_threads;
+} HbnConvertOptions;
+
+void
+ParseHbnConvertCmdLineArguments(int argc, char* argv[], HbnConvertOptions* opts);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __HBNCONVERT_CMDLINE_ARGS_H
@@ -0,0 +1,210 @@
+#include "cmdline_args.h"
+#include "../hbnmap/align_file.h"
+#include "../hbnmap/backup_results.h"
+#include "../hbnmap/hbn_job_control.h"
+#include "../hbnmap/hbn_results.h"
+#include "../hbnmap/output_writer.h"
+#include "../../corelib/hbn_package_version.h"
+#include "../../corelib/seqdb.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+
+/// renders the alignment files that hbnmap keeps in db_dir/backup_results
+/// (-keep_db) as SAM, PAF or M4 without aligning the sequences again
+
+typedef struct {
+    const HbnConvertOptions* opts;
+    /// options of the SAM formatter of hbnmap
+    const HbnProgramOptions* sam_opts;
+    const HbnAlignFileReader* reader;
+    const CSeqDB* queries;
+    const CSeqDB* db;
+    HbnOutputWriter* out;
+    pthread_mutex_t lock;
+    int next_record;
+} ConvertJob;
+
+/// remove the HSPs the filters skip
+static void
+filter_hsps(const HbnConvertOptions* opts, HbnHSPResults* results)
+{
+    for (int i = 0; i < results->num_queries; ++i) {
+        BlastHitList* hit_list = results->hitlist_array + i;
+        for (int j = 0; j < hit_list->hsplist_count; ++j) {
+            BlastHSPList* hsp_list = hit_list->hsplist_array[j];
+            for (int k = 0; k < hsp_list->hspcnt; ++k) {
+                const BlastHSP* hsp = hsp_list->hsp_array[k];
+                if (hsp->evalue > opts->max_evalue
+                    ||
+                    hsp->hsp_info.perc_identity < opts->min_perc_identity) {
+                    hsp_list->hsp_array[k] = NULL;
+                }
+            }
+            Blast_HSPListPurgeNullHSPs(hsp_list);
+        }
+    }
+}
+
+/// the PAF and M4 records, PAF on the forward strand of the query like SAM
+static void
+print_paf_or_m4_hits(const ConvertJob* job,
+    const BLAST_SequenceBlk* query_blk,
+    const BlastQueryInfo* query_info,
+    HbnHSPResults* results,
+    const BOOL has_residues,
+    kstring_t* line)
+{
+    ks_clear(results->output_buf);
+    for (int i = 0; i < results->num_queries; ++i) {
+        BlastHitList* hit_list = results->hitlist_array + i;
+        for (int j = 0; j < hit_list->hsplist_count; ++j) {
+            BlastHSPList* hsp_list = hit_list->hsplist_array[j];
+            for (int k = 0; k < hsp_list->hspcnt; ++k) {
+                BlastHSP* hsp = hsp_list->hsp_array[k];
+                const u8* query = NULL;
+                const u8* subject = NULL;
+                if (has_residues) {
+                    query = query_blk->sequence_nomask
+                            + query_info->contexts[hsp->context].query_offset
+                            + hsp->hbn_query.offset;
+                    subject = (const u8*)ks_s(results->aligned_subjects) + hsp->hsp_info.subject_align_offset;
+                }
+                const char* qname = seqdb_seq_name(job->queries, hsp->hbn_query.oid);
+                const char* sname = seqdb_seq_name(job->db, hsp->hbn_subject.oid);
+                if (job->opts->outfmt == eConvertM4) {
+                    print_one_m4_result(hsp, query, subject, qname, sname,
+                        job->opts->dump_cigar, job->opts->dump_md, FALSE, line, &results->output_buf);
+                    continue;
+                }
+                if (hsp->hbn_query.strand == REV) {
+                    const size_t offset = hsp->hbn_query.seq_size - hsp->hbn_query.end;
+                    const size_t end = hsp->hbn_query.seq_size - hsp->hbn_query.offset;
+                    hsp->hbn_query.offset = offset;
+                    hsp->hbn_query.end = end;
+                }
+                print_one_paf_result(hsp, query, subject, qname, sname,
+                    job->opts->dump_cigar, job->opts->dump_md, &results->output_buf);
+            }
+        }
+    }
+}
+
+static void*
+convert_thread(void* params)
+{
+    ConvertJob* job = (ConvertJob*)(params);
+    const int num_records = kv_size(job->reader->index);
+    HbnHSPResults* results = HbnHSPResultsNew(HBN_QUERY_CHUNK_SIZE);
+    BLAST_SequenceBlk* query_blk = BLAST_SequenceBlkNew();
+    BlastQueryInfo* query_info = BlastQueryInfoNew(HBN_QUERY_CHUNK_SIZE * 2);
+    ks_dinit(line);
+    while (1) {
+        pthread_mutex_lock(&job->lock);
+        const int from = job->next_record;
+        const int to = hbn_min(from + HBN_QUERY_CHUNK_SIZE, num_records);
+        job->next_record = to;
+        pthread_mutex_unlock(&job->lock);
+        if (from >= num_records) break;
+
+        HbnAlignFileReaderLoadRecords(job->reader, from, to, results);
+        filter_hsps(job->opts, results);
+        /// the M4 records print residues for the MD field only
+        const BOOL has_residues = job->opts->outfmt != eConvertM4 || job->opts->dump_md;
+        if (has_residues) recover_alignment_residues(job->queries, job->db, results, query_blk, query_info);
+        if (job->opts->outfmt == eConvertSAM) {
+            format_one_result_set(job->queries, job->db, query_blk, query_info, results, job->sam_opts, FALSE);
+        } else {
+            print_paf_or_m4_hits(job, query_blk, query_info, results, has_residues, &line);
+        }
+        HbnOutputWriterSubmit(job->out, from, to, &results->output_buf, NULL);
+    }
+    ks_destroy(line);
+    BLAST_SequenceBlkFree(query_blk);
+    BlastQueryInfoFree(query_info);
+    results = HbnHSPResultsFree(results);
+    return NULL;
+}
+
+static void
+convert_one_align_file(const HbnConvertOptions* opts,
+    const HbnProgramOptions* sam_opts,
+    const char* path,
+    const CSeqDB* queries,
+    const CSeqDB* db,
+    HbnOutputWriter* out)
+{
+    HbnAlignFileReader* reader = HbnAlignFileReaderNew(path);
+    ConvertJob job;
+    job.opts = opts;
+    job.sam_opts = sam_opts;
+    job.reader = reader;
+    job.queries = queries;
+    job.db = db;
+    job.out = out;
+    pthread_mutex_init(&job.lock, NULL);
+    job.next_record = 0;
+
+    /// the chunks are written in the order of the records in the file
+    HbnOutputWriterBeginBatch(out, NULL);
+    pthread_t jobs[opts->num_threads];
+    for (int i = 0; i < opts->num_threads; ++i) pthread_create(jobs + i, NULL, convert_thread, &job);
+    for (int i = 0; i < opts->num_threads; ++i) pthread_join(jobs[i], NULL);
+    HbnOutputWriterEndBatch(out);
+
+    HBN_LOG("%zu records in %s", kv_size(reader->index), path);
+    pthread_mutex_destroy(&job.lock);
+    reader = HbnAlignFileReaderFree(reader);
+}
+
+int main(int argc, char* argv[])
+{
+    HbnConvertOptions opts;
+    ParseHbnConvertCmdLineArguments(argc, argv, &opts);
+    HbnProgramOptions sam_opts;
+    memset(&sam_opts, 0, sizeof(HbnProgramOptions));
+    sam_opts.outfmt = eSAM;
+    sam_opts.dump_md = opts.dump_md;
+
+    /// the subject volumes are those of the query if the query was searched against itself
+    char path[HBN_MAX_PATH_LEN];
+    const char* subject_db_title = INIT_SUBJECT_DB_TITLE;
+    make_bin_volume_info_path(opts.db_dir, subject_db_title, path);
+    if (access(path, F_OK) != 0) subject_db_title = INIT_QUERY_DB_TITLE;
+    const int num_query_vols = seqdb_load_num_volumes(opts.db_dir, INIT_QUERY_DB_TITLE);
+    const int num_subject_vols = seqdb_load_num_volumes(opts.db_dir, subject_db_title);
+
+    FILE* out = (strcmp(opts.output, "-") == 0) ? stdout : fopen(opts.output, "w");
+    if (!out) HBN_ERR("Fail to open file '%s' for writing: %s", opts.output, strerror(errno));
+    HbnOutputWriter* out_writer = HbnOutputWriterNew(out, TRUE, FALSE, opts.num_threads);
+    if (opts.outfmt == eConvertSAM) {
+        ks_dinit(prolog);
+        print_sam_prolog(&prolog, kSamVersion, HBN_PACKAGE_VERSION, NULL, NULL, argc, argv);
+        HbnOutputWriterBeginBatch(out_writer, NULL);
+        HbnOutputWriterSubmit(out_writer, 0, 1, &prolog, NULL);
+        HbnOutputWriterEndBatch(out_writer);
+        ks_destroy(prolog);
+    }
+
+    int num_files = 0;
+    for (int svid = 0; svid < num_subject_vols; ++svid) {
+        CSeqDB* db = NULL;
+        for (int qvid = 0; qvid < num_query_vols; ++qvid) {
+            if (!qi_vs_sj_is_mapped(opts.db_dir, kBackupResultsDir, qvid, svid)) continue;
+            /// only the aligned subject windows are decoded
+            if (!db) db = seqdb_load_mapped(opts.db_dir, subject_db_title, svid);
+            CSeqDB* queries = seqdb_load_mapped(opts.db_dir, INIT_QUERY_DB_TITLE, qvid);
+            make_qi_vs_sj_results_path(opts.db_dir, kBackupResultsDir, qvid, svid, path);
+            convert_one_align_file(&opts, &sam_opts, path, queries, db, out_writer);
+            CSeqDBFree(queries);
+            ++num_files;
+        }
+        if (db) db = CSeqDBFree(db);
+    }
+    if (!num_files) HBN_WARN("No results are kept in %s/%s", opts.db_dir, kBackupResultsDir);
+
+    out_writer = HbnOutputWriterFree(out_writer);
+    if (out != stdout) fclose(out);
+    return 0;
+}
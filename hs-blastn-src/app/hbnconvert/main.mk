@@ -0,0 +1,26 @@
+ifeq "$(strip ${BUILD_DIR})" ""
+  BUILD_DIR    := ../$(OSTYPE)-$(MACHINETYPE)/obj
+endif
+ifeq "$(strip ${TARGET_DIR})" ""
+  TARGET_DIR   := ../$(OSTYPE)-$(MACHINETYPE)/bin
+endif
+
+TARGET   := hs-blastn-convert
+SOURCES  := \
+	cmdline_args.cpp \
+	main.c \
+	../hbnmap/align_file.c \
+	../hbnmap/backup_results.c \
+	../hbnmap/hbn_job_control.c \
+	../hbnmap/hbn_results.c \
+	../hbnmap/output_writer.c \
+	../hbnmap/tabular_format.cpp \
+	../hbnmap/traceback_stage.c
+
+SRC_INCDIRS  := .
+
+TGT_LDFLAGS := -L${TARGET_DIR}
+TGT_LDLIBS  := -lhbn
+TGT_PREREQS := libhbn.a
+
+SUBMAKEFILES :=
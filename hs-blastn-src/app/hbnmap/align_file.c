@@ -0,0 +1,525 @@
+#include "align_file.h"
+
+#include "../../corelib/hbn_package_version.h"
+
+#include <sys/mman.h>
+
+static const char kHeaderMagic[8] = { 'H', 'B', 'N', 'A', 'L', 'N', '\r', '\n' };
+static const char kFooterMagic[8] = { 'H', 'B', 'N', 'I', 'D', 'X', '\r', '\n' };
+
+#define kStrandQueryRev     1
+#define kStrandSubjectRev   2
+
+/// op codes of the edit operations in the file
+#define kOpSub  0
+#define kOpDel  1
+#define kOpIns  2
+
+/// encoding
+
+static inline void
+put_varint(u64 x, kstring_t* out)
+{
+    char* p = out->s + out->l;
+    if (out->l + 11 > out->m) {
+        ks_reserve(out, out->l + 11);
+        p = out->s + out->l;
+    }
+    while (x >= 0x80) {
+        *p++ = (char)((x & 0x7f) | 0x80);
+        x >>= 7;
+    }
+    *p++ = (char)x;
+    out->l = p - out->s;
+}
+
+static inline void
+put_svarint(i64 x, kstring_t* out)
+{
+    put_varint(((u64)x << 1) ^ (u64)(x >> 63), out);
+}
+
+static void
+write_u32(u32 x, char* p)
+{
+    for (int i = 0; i < 4; ++i, x >>= 8) p[i] = (char)(x & 0xff);
+}
+
+static void
+put_u32(u32 x, kstring_t* out)
+{
+    char buf[4];
+    write_u32(x, buf);
+    kputsn(buf, 4, out);
+}
+
+static void
+put_u64(u64 x, kstring_t* out)
+{
+    char buf[8];
+    for (int i = 0; i < 8; ++i, x >>= 8) buf[i] = (char)(x & 0xff);
+    kputsn(buf, 8, out);
+}
+
+static void
+put_f64(const double x, kstring_t* out)
+{
+    u64 u;
+    memcpy(&u, &x, sizeof(u64));
+    put_u64(u, out);
+}
+
+static int
+op_code(const EGapAlignOpType op)
+{
+    if (op == eGapAlignSub) return kOpSub;
+    if (op == eGapAlignDel) return kOpDel;
+    hbn_assert(op == eGapAlignIns);
+    return kOpIns;
+}
+
+static void
+add_one_hsp(const BlastHSP* hsp, const size_t last_soff, kstring_t* out)
+{
+    int strands = 0;
+    if (hsp->hbn_query.strand == REV) strands |= kStrandQueryRev;
+    if (hsp->hbn_subject.strand == REV) strands |= kStrandSubjectRev;
+    kputc_(strands, out);
+    put_varint(hsp->hbn_query.offset, out);
+    put_varint(hsp->hbn_query.end - hsp->hbn_query.offset, out);
+    put_svarint((i64)hsp->hbn_subject.offset - (i64)last_soff, out);
+    put_varint(hsp->hbn_subject.end - hsp->hbn_subject.offset, out);
+    put_svarint(hsp->score, out);
+    put_svarint(hsp->hsp_info.chain_score, out);
+    put_varint(hsp->hsp_info.num_ident, out);
+    put_varint(hsp->hsp_info.num_positives, out);
+    put_f64(hsp->evalue, out);
+    put_f64(hsp->bit_score, out);
+    put_f64(hsp->hsp_info.perc_identity, out);
+
+    const GapEditScript* esp = hsp->gap_info;
+    const int num_ops = esp ? esp->size : 0;
+    put_varint(num_ops, out);
+    for (int i = 0; i < num_ops; ++i) {
+        put_varint(((u64)esp->num[i] << 2) | op_code(esp->op_type[i]), out);
+    }
+}
+
+static void
+add_one_hsp_list(const BlastHSPList* hsp_list, kstring_t* out)
+{
+    const BlastHSP* first = hsp_list->hsp_array[0];
+    put_varint(first->hbn_subject.oid, out);
+    put_varint(first->hbn_subject.seq_size, out);
+    put_varint(hsp_list->hspcnt, out);
+    size_t last_soff = 0;
+    for (int i = 0; i < hsp_list->hspcnt; ++i) {
+        const BlastHSP* hsp = hsp_list->hsp_array[i];
+        hbn_assert(hsp->hbn_subject.oid == first->hbn_subject.oid);
+        add_one_hsp(hsp, last_soff, out);
+        last_soff = hsp->hbn_subject.offset;
+    }
+}
+
+static int
+num_nonempty_hsp_lists(const BlastHitList* hit_list)
+{
+    int n = 0;
+    for (int i = 0; i < hit_list->hsplist_count; ++i) {
+        const BlastHSPList* hsp_list = hit_list->hsplist_array[i];
+        if (hsp_list && hsp_list->hspcnt) ++n;
+    }
+    return n;
+}
+
+/// the record of hit_list, the oid of its query is returned in query_id
+static void
+add_one_record(const BlastHitList* hit_list, const int num_hsp_lists, int* query_id, kstring_t* out)
+{
+    const BlastHSP* first = NULL;
+    for (int i = 0; i < hit_list->hsplist_count && !first; ++i) {
+        const BlastHSPList* hsp_list = hit_list->hsplist_array[i];
+        if (hsp_list && hsp_list->hspcnt) first = hsp_list->hsp_array[0];
+    }
+    *query_id = first->hbn_query.oid;
+    put_varint(first->hbn_query.seq_size, out);
+    put_varint(num_hsp_lists, out);
+    for (int i = 0; i < hit_list->hsplist_count; ++i) {
+        const BlastHSPList* hsp_list = hit_list->hsplist_array[i];
+        if (hsp_list && hsp_list->hspcnt) add_one_hsp_list(hsp_list, out);
+    }
+}
+
+void
+HbnAlignFileWriteHeader(FILE* out)
+{
+    char header[kHbnAlignFileHeaderSize];
+    memcpy(header, kHeaderMagic, sizeof(kHeaderMagic));
+    write_u32(kHbnAlignFileVersion, header + 8);
+    write_u32(0, header + 12);
+    hbn_fwrite(header, 1, kHbnAlignFileHeaderSize, out);
+}
+
+void
+HbnAlignFileAddBlock(HbnHSPResults* results, kstring_t* out)
+{
+    ks_dinit(records);
+    ks_dinit(table);
+    int num_records = 0;
+    for (int i = 0; i < results->num_queries; ++i) {
+        const BlastHitList* hit_list = results->hitlist_array + i;
+        const int num_hsp_lists = num_nonempty_hsp_lists(hit_list);
+        if (!num_hsp_lists) continue;
+        const size_t from = ks_size(records);
+        int query_id = -1;
+        add_one_record(hit_list, num_hsp_lists, &query_id, &records);
+        put_varint(query_id, &table);
+        put_varint(ks_size(records) - from, &table);
+        ++num_records;
+    }
+    if (num_records) {
+        const size_t size_offset = ks_size(*out);
+        put_u32(0, out);
+        put_varint(num_records, out);
+        kputsn(ks_s(table), ks_size(table), out);
+        kputsn(ks_s(records), ks_size(records), out);
+        const size_t size = ks_size(*out) - size_offset - 4;
+        hbn_assert(size <= UINT32_MAX);
+        write_u32(size, ks_s(*out) + size_offset);
+    }
+    ks_destroy(records);
+    ks_destroy(table);
+}
+
+void
+HbnAlignFileWriteIndex(FILE* out, const u64 index_offset, const vec_align_file_index* index)
+{
+    ks_dinit(buf);
+    int last_query_id = 0;
+    u64 last_offset = 0;
+    for (size_t i = 0; i < kv_size(*index); ++i) {
+        const HbnAlignFileIndexEntry* e = &kv_A(*index, i);
+        put_svarint((i64)e->query_id - last_query_id, &buf);
+        put_varint(e->offset - last_offset, &buf);
+        put_varint(e->size, &buf);
+        last_query_id = e->query_id;
+        last_offset = e->offset;
+    }
+    put_u64(index_offset, &buf);
+    put_u64(kv_size(*index), &buf);
+    put_u32(kHbnAlignFileVersion, &buf);
+    put_u32(0, &buf);
+    kputsn(kFooterMagic, sizeof(kFooterMagic), &buf);
+    hbn_fwrite(ks_s(buf), 1, ks_size(buf), out);
+    ks_destroy(buf);
+}
+
+/// decoding
+
+typedef struct {
+    const u8* p;
+    const u8* end;
+    const char* path;
+} InputBytes;
+
+static void
+truncated_input(const InputBytes* in)
+{
+    HBN_ERR("Alignment file '%s' is truncated or corrupted", in->path);
+}
+
+static inline u64
+get_varint(InputBytes* in)
+{
+    u64 x = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (in->p >= in->end) truncated_input(in);
+        const u8 c = *in->p++;
+        x |= (u64)(c & 0x7f) << shift;
+        if (!(c & 0x80)) return x;
+    }
+    truncated_input(in);
+    return 0;
+}
+
+static inline i64
+get_svarint(InputBytes* in)
+{
+    const u64 x = get_varint(in);
+    return (i64)(x >> 1) ^ -(i64)(x & 1);
+}
+
+static u64
+get_fixed(InputBytes* in, const int n)
+{
+    if (in->end - in->p < n) truncated_input(in);
+    u64 x = 0;
+    for (int i = n - 1; i >= 0; --i) x = (x << 8) | in->p[i];
+    in->p += n;
+    return x;
+}
+
+static double
+get_f64(InputBytes* in)
+{
+    const u64 u = get_fixed(in, 8);
+    double x;
+    memcpy(&x, &u, sizeof(double));
+    return x;
+}
+
+static const EGapAlignOpType kOpTypes[3] = { eGapAlignSub, eGapAlignDel, eGapAlignIns };
+
+static BlastHSP*
+read_one_hsp(HbnHSPResults* results,
+    InputBytes* in,
+    const int query_id,
+    const size_t query_length,
+    const int context,
+    const int subject_id,
+    const size_t subject_length,
+    const size_t last_soff)
+{
+    BlastHSP* hsp = (BlastHSP*)HbnHSPResultsCalloc(results, 1, sizeof(BlastHSP));
+    hsp->hbn_in_arena = TRUE;
+    if (in->p >= in->end) truncated_input(in);
+    const int strands = *in->p++;
+    hsp->hbn_query.oid = query_id;
+    hsp->hbn_query.strand = (strands & kStrandQueryRev) ? REV : FWD;
+    hsp->hbn_query.offset = get_varint(in);
+    hsp->hbn_query.end = hsp->hbn_query.offset + get_varint(in);
+    hsp->hbn_query.seq_size = query_length;
+    hsp->hbn_subject.oid = subject_id;
+    hsp->hbn_subject.strand = (strands & kStrandSubjectRev) ? REV : FWD;
+    hsp->hbn_subject.offset = last_soff + get_svarint(in);
+    hsp->hbn_subject.end = hsp->hbn_subject.offset + get_varint(in);
+    hsp->hbn_subject.seq_size = subject_length;
+    hsp->query.offset = hsp->hbn_query.offset;
+    hsp->query.end = hsp->hbn_query.end;
+    hsp->subject.offset = hsp->hbn_subject.offset;
+    hsp->subject.end = hsp->hbn_subject.end;
+    hsp->context = context + hsp->hbn_query.strand;
+
+    hsp->score = get_svarint(in);
+    hsp->hsp_info.chain_score = get_svarint(in);
+    hsp->num_ident = hsp->hsp_info.num_ident = get_varint(in);
+    hsp->num_positives = hsp->hsp_info.num_positives = get_varint(in);
+    hsp->evalue = get_f64(in);
+    hsp->bit_score = get_f64(in);
+    hsp->hsp_info.perc_identity = get_f64(in);
+
+    const int num_ops = get_varint(in);
+    if (!num_ops) return hsp;
+    hsp->gap_info = HbnHSPResultsGapEditScriptNew(results, num_ops);
+    /// the alignment statistics of the edit script as update_traceback_hsp_list_info() counts them
+    int align_len = 0, gaps = 0, gap_opens = 0;
+    for (int i = 0; i < num_ops; ++i) {
+        const u64 x = get_varint(in);
+        const int code = x & 3;
+        if (code > kOpIns) truncated_input(in);
+        const int num = x >> 2;
+        hsp->gap_info->op_type[i] = kOpTypes[code];
+        hsp->gap_info->num[i] = num;
+        align_len += num;
+        if (code != kOpSub) {
+            ++gap_opens;
+            gaps += num;
+        }
+    }
+    hsp->hsp_info.align_len = align_len;
+    hsp->hsp_info.gaps = gaps;
+    hsp->hsp_info.gap_opens = gap_opens;
+    return hsp;
+}
+
+static BlastHSPList*
+read_one_hsp_list(HbnHSPResults* results,
+    InputBytes* in,
+    const int query_id,
+    const size_t query_length,
+    const int context,
+    const int query_index)
+{
+    const int subject_id = get_varint(in);
+    const size_t subject_length = get_varint(in);
+    const int num_hsp = get_varint(in);
+    BlastHSPList* hsp_list = (BlastHSPList*)HbnHSPResultsCalloc(results, 1, sizeof(BlastHSPList));
+    hsp_list->hsp_array = (BlastHSP**)HbnHSPResultsCalloc(results, num_hsp, sizeof(BlastHSP*));
+    hsp_list->hspcnt = num_hsp;
+    hsp_list->hsp_max = num_hsp;
+    hsp_list->oid = subject_id;
+    hsp_list->query_index = query_index;
+    size_t last_soff = 0;
+    for (int i = 0; i < num_hsp; ++i) {
+        BlastHSP* hsp = read_one_hsp(results, in, query_id, query_length, context, subject_id, subject_length, last_soff);
+        hsp_list->hsp_array[i] = hsp;
+        last_soff = hsp->hbn_subject.offset;
+    }
+    double best_evalue = hsp_list->hsp_array[0]->evalue;
+    double best_raw_score = hsp_list->hsp_array[0]->score;
+    for (int i = 0; i < num_hsp; ++i) {
+        best_evalue = hbn_min(best_evalue, hsp_list->hsp_array[i]->evalue);
+        best_raw_score = hbn_max(best_raw_score, hsp_list->hsp_array[i]->score);
+    }
+    hsp_list->best_evalue = best_evalue;
+    hsp_list->hbn_best_raw_score = best_raw_score;
+    return hsp_list;
+}
+
+/// decode the record into the next hit list of results
+static void
+read_one_record(HbnHSPResults* results, InputBytes* in, const int query_id)
+{
+    hbn_assert(results->num_queries < results->hitlist_max);
+    const int query_index = results->num_queries++;
+    BlastHitList* hit_list = results->hitlist_array + query_index;
+    const size_t query_length = get_varint(in);
+    const int hsplist_count = get_varint(in);
+    hit_list->hsplist_array = (BlastHSPList**)HbnHSPResultsCalloc(results, hsplist_count, sizeof(BlastHSPList*));
+    for (int i = 0; i < hsplist_count; ++i) {
+        hit_list->hsplist_array[i] = read_one_hsp_list(results, in, query_id, query_length, query_index * 2, query_index);
+    }
+
+    hit_list->hsplist_count = hit_list->hsplist_max = hsplist_count;
+    double worst_evalue = 0.0;
+    int low_score = INT32_MAX;
+    int num_hits = 0;
+    for (int i = 0; i < hsplist_count; ++i) {
+        BlastHSPList* hsp_list = hit_list->hsplist_array[i];
+        for (int j = 0; j < hsp_list->hspcnt; ++j) {
+            BlastHSP* hsp = hsp_list->hsp_array[j];
+            ++num_hits;
+            worst_evalue = hbn_max(worst_evalue, hsp->evalue);
+            low_score = hbn_min(low_score, hsp->score);
+        }
+    }
+    hit_list->num_hits = num_hits;
+    hit_list->low_score = low_score;
+    hit_list->worst_evalue = worst_evalue;
+}
+
+typedef struct {
+    int query_id;
+    u64 size;
+} BlockRecord;
+
+typedef kvec_t(BlockRecord) vec_block_record;
+
+/// the block at offset, its records are listed in records and in->p is left at the first one
+static void
+read_block_table(const HbnAlignFileReader* reader, const u64 offset, InputBytes* in, vec_block_record* records)
+{
+    in->p = (const u8*)reader->data + offset;
+    in->end = (const u8*)reader->data + reader->size;
+    in->path = reader->path;
+    const u64 block_size = get_fixed(in, 4);
+    if ((u64)(in->end - in->p) < block_size) truncated_input(in);
+    in->end = in->p + block_size;
+    const int num_records = get_varint(in);
+    kv_clear(*records);
+    for (int i = 0; i < num_records; ++i) {
+        BlockRecord r;
+        r.query_id = get_varint(in);
+        r.size = get_varint(in);
+        kv_push(BlockRecord, *records, r);
+    }
+}
+
+void
+HbnAlignFileIndexBlocks(const char* blocks, const size_t size, const u64 offset, vec_align_file_index* index)
+{
+    HbnAlignFileReader reader;
+    reader.path = "backup results";
+    reader.data = blocks;
+    reader.size = size;
+    kv_dinit(vec_block_record, records);
+    u64 block_offset = 0;
+    while (block_offset < size) {
+        InputBytes in;
+        read_block_table(&reader, block_offset, &in, &records);
+        u64 record_offset = offset + ((const char*)in.p - blocks);
+        for (size_t i = 0; i < kv_size(records); ++i) {
+            HbnAlignFileIndexEntry e;
+            e.query_id = kv_A(records, i).query_id;
+            e.size = kv_A(records, i).size;
+            e.offset = record_offset;
+            kv_push(HbnAlignFileIndexEntry, *index, e);
+            record_offset += e.size;
+        }
+        hbn_assert(record_offset == offset + ((const char*)in.end - blocks));
+        block_offset = (const char*)in.end - blocks;
+    }
+    kv_destroy(records);
+}
+
+HbnAlignFileReader*
+HbnAlignFileReaderNew(const char* path)
+{
+    HbnAlignFileReader* reader = (HbnAlignFileReader*)calloc(1, sizeof(HbnAlignFileReader));
+    reader->path = strdup(path);
+    reader->data = (const char*)hbn_mmap_file(path, &reader->size);
+    /// the blocks are decoded front to back, read ahead
+    if (reader->size) madvise((void*)reader->data, reader->size, MADV_SEQUENTIAL);
+    kv_init(reader->index);
+    if (reader->size < kHbnAlignFileHeaderSize + kHbnAlignFileFooterSize
+        ||
+        memcmp(reader->data, kHeaderMagic, sizeof(kHeaderMagic)) != 0) {
+        HBN_ERR("'%s' is not an alignment file of this version of %s, remove it and search again", path, HBN_PACKAGE_NAME);
+    }
+    InputBytes in = { (const u8*)reader->data + sizeof(kHeaderMagic), (const u8*)reader->data + reader->size, path };
+    const u32 version = get_fixed(&in, 4);
+    if (version != kHbnAlignFileVersion) {
+        HBN_ERR("Alignment file '%s' has version %u, version %d is supported", path, version, kHbnAlignFileVersion);
+    }
+
+    in.p = (const u8*)reader->data + reader->size - kHbnAlignFileFooterSize;
+    const u64 index_offset = get_fixed(&in, 8);
+    const u64 num_records = get_fixed(&in, 8);
+    in.p += 8;
+    if (memcmp(in.p, kFooterMagic, sizeof(kFooterMagic)) != 0
+        ||
+        index_offset < kHbnAlignFileHeaderSize
+        ||
+        index_offset > reader->size - kHbnAlignFileFooterSize) {
+        truncated_input(&in);
+    }
+
+    in.p = (const u8*)reader->data + index_offset;
+    in.end = (const u8*)reader->data + reader->size - kHbnAlignFileFooterSize;
+    kv_reserve(HbnAlignFileIndexEntry, reader->index, num_records);
+    int last_query_id = 0;
+    u64 last_offset = 0;
+    for (u64 i = 0; i < num_records; ++i) {
+        HbnAlignFileIndexEntry e;
+        e.query_id = last_query_id + get_svarint(&in);
+        e.offset = last_offset + get_varint(&in);
+        e.size = get_varint(&in);
+        if (e.offset + e.size > index_offset) truncated_input(&in);
+        kv_push(HbnAlignFileIndexEntry, reader->index, e);
+        last_query_id = e.query_id;
+        last_offset = e.offset;
+    }
+    return reader;
+}
+
+HbnAlignFileReader*
+HbnAlignFileReaderFree(HbnAlignFileReader* reader)
+{
+    hbn_munmap_file((void*)reader->data, reader->size);
+    kv_destroy(reader->index);
+    free((void*)reader->path);
+    free(reader);
+    return NULL;
+}
+
+void
+HbnAlignFileReaderLoadRecords(const HbnAlignFileReader* reader, const int from, const int to, HbnHSPResults* results)
+{
+    HbnHSPResultsClear(results, 0);
+    for (int i = from; i < to; ++i) {
+        const HbnAlignFileIndexEntry* e = &kv_A(reader->index, i);
+        InputBytes in = { (const u8*)reader->data + e->offset, (const u8*)reader->data + e->offset + e->size, reader->path };
+        read_one_record(results, &in, e->query_id);
+        if (in.p != in.end) truncated_input(&in);
+    }
+}
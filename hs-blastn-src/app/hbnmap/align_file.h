@@ -0,0 +1,91 @@
+#ifndef __ALIGN_FILE_H
+#define __ALIGN_FILE_H
+
+#include "../../corelib/hbn_aux.h"
+#include "../../ncbi_blast/setup/blast_hits.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// the binary alignment file holding the results of a query volume against a
+/// subject volume, which is the backup file of the search.
+///
+///   file     := header block* index footer
+///   header   := "HBNALN\r\n", u32 version, u32 0
+///   block    := u32 size of the rest of the block, varint num_records,
+///               (varint query oid, varint record size) * num_records,
+///               record * num_records
+///   record   := varint query length, varint num_hsp_lists, hsp_list * num_hsp_lists
+///   hsp_list := varint subject oid, varint subject length, varint num_hsps, hsp * num_hsps
+///   hsp      := u8 strands (bit 0 for a reverse query, bit 1 for a reverse subject),
+///               varint query offset, varint query span,
+///               svarint subject offset minus that of the previous hsp of the list,
+///               varint subject span, svarint score, svarint chain score,
+///               varint num_ident, varint num_positives,
+///               f64 evalue, f64 bit score, f64 perc identity,
+///               varint num_ops, varint (op length << 2 | op code) * num_ops
+///   index    := (svarint query oid minus that of the previous record,
+///               varint record offset minus that of the previous record,
+///               varint record size) per record, in file order
+///   footer   := u64 offset of the index, u64 num_records, u32 version, u32 0, "HBNIDX\r\n"
+///
+/// the oids are those in the volumes, the query coordinates are on the query
+/// strand of the hsp. fixed-size integers are little-endian, f64 is the IEEE-754
+/// bit pattern as a u64. varints are LEB128, svarints are zigzag-encoded varints.
+/// a block holds the queries of one chunk, the blocks of a file are in the
+/// order they were written, which is not the query order unless -ordered_output
+
+#define kHbnAlignFileVersion        1
+#define kHbnAlignFileHeaderSize     16
+#define kHbnAlignFileFooterSize     32
+
+typedef struct {
+    int query_id;
+    u32 size;
+    u64 offset;
+} HbnAlignFileIndexEntry;
+
+typedef kvec_t(HbnAlignFileIndexEntry) vec_align_file_index;
+
+void
+HbnAlignFileWriteHeader(FILE* out);
+
+/// append the hit lists of results, skipping the empty ones, to out as one block
+void
+HbnAlignFileAddBlock(HbnHSPResults* results, kstring_t* out);
+
+/// add the records of the size bytes of blocks, which start at offset of
+/// the file, to index
+void
+HbnAlignFileIndexBlocks(const char* blocks, const size_t size, const u64 offset, vec_align_file_index* index);
+
+/// write the index and the footer of the file, the index starts at index_offset
+void
+HbnAlignFileWriteIndex(FILE* out, const u64 index_offset, const vec_align_file_index* index);
+
+typedef struct {
+    const char* path;
+    const char* data;
+    size_t size;
+    /// the records in file order
+    vec_align_file_index index;
+} HbnAlignFileReader;
+
+/// map the file and load its index. the reader is read-only, threads
+/// may decode its records at the same time
+HbnAlignFileReader*
+HbnAlignFileReaderNew(const char* path);
+
+HbnAlignFileReader*
+HbnAlignFileReaderFree(HbnAlignFileReader* reader);
+
+/// decode the records [from, to) of reader->index into results, one hit list each
+void
+HbnAlignFileReaderLoadRecords(const HbnAlignFileReader* reader, const int from, const int to, HbnHSPResults* results);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __ALIGN_FILE_H
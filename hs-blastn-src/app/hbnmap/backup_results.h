@@ -3,8 +3,12 @@
 
 #include "../../corelib/seqdb.h"
 #include "../../ncbi_blast/setup/blast_hits.h"
+#include "../../ncbi_blast/setup/blast_query_info.h"
+#include "../../ncbi_blast/setup/blast_sequence_blk.h"
+#include "align_file.h"
 #include "hbn_options.h"
 #include "hbn_results.h"
+#include "output_writer.h"
 #include "tabular_format.h"
 #include <pthread.h>
 
@@ -15,20 +19,58 @@ extern "C" {
 void
 dump_m4_hits(const text_t* query_vol,
     const text_t* subject_vol,
+    const BLAST_SequenceBlk* query_blk,
+    const BlastQueryInfo* query_info,
     HbnHSPResults* results,
     const HbnProgramOptions* opts);
 
+/// format the results for the output into results->output_buf and, if backup,
+/// into a block of the backup alignment file in results->backup_buf. the residues
+/// of the alignments come from query_blk and results->aligned_subjects
+void
+format_one_result_set(const CSeqDB* queries,
+    const CSeqDB* db,
+    const BLAST_SequenceBlk* query_blk,
+    const BlastQueryInfo* query_info,
+    HbnHSPResults* results, 
+    const HbnProgramOptions* opts,
+    const BOOL backup);
+
 void
 dump_one_result_set(const CSeqDB* queries,
     const CSeqDB* db,
+    const BLAST_SequenceBlk* query_blk,
+    const BlastQueryInfo* query_info,
     HbnHSPResults* results, 
     const HbnProgramOptions* opts,
     FILE* out, 
     FILE* backup_out, 
     pthread_mutex_t* out_lock);
 
+/// the results read back from an alignment file come without the query block
+/// and the aligned subject residues of the traceback, load them from the volumes
+/// for the formats that print residues. the query block holds two contexts per
+/// hit list, query_info must have room for 2 * results->num_queries of them
+void
+recover_alignment_residues(const CSeqDB* queries,
+    const CSeqDB* db,
+    HbnHSPResults* results,
+    BLAST_SequenceBlk* query_blk,
+    BlastQueryInfo* query_info);
+
+/// decode the records [from, to) of reader, which are results of the queries
+/// against db, and format them for the output into results->output_buf.
+/// query_blk and query_info are scratch space for the residues
 void
-recover_qi_vs_sj_results(const CSeqDB* queries, const CSeqDB* db, const HbnProgramOptions* opts, FILE* in, FILE* out);
+recover_one_result_set(const CSeqDB* queries,
+    const CSeqDB* db,
+    const HbnProgramOptions* opts,
+    const HbnAlignFileReader* reader,
+    const int from,
+    const int to,
+    HbnHSPResults* results,
+    BLAST_SequenceBlk* query_blk,
+    BlastQueryInfo* query_info);
 
 #ifdef __cplusplus
 }
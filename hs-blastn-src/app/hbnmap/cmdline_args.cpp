@@ -39,6 +39,16 @@ const string kArgDbDir("db_dir");
 const string kDfltDbDir("hbndb");
 const string kArgKeepDb("keep_db");
 const bool kDfltKeepDb = false;
+const string kArgMmapDb("mmap_db");
+const bool kDfltMmapDb = false;
+const string kArgVerifyLktbl("verify_lktbl");
+const bool kDfltVerifyLktbl = false;
+const string kArgPrefetchMem("prefetch_mem");
+const size_t kDfltPrefetchMem = static_cast<size_t>(2000000000);
+const string kArgPrefetchThreads("prefetch_threads");
+const int kDfltPrefetchThreads = 1;
+const string kArgStreamQuery("stream_query");
+const bool kDfltStreamQuery = false;
 const string kArgMinQuerySize("min_query_size");
 const int kDfltMinQuerySize = 0;
 const string kArgMaxQueryVolSeqs("max_query_seqs");
@@ -57,8 +67,12 @@ const string kArgKmerSize("kmer_size");
 const int kDfltKmerSize = 15;
 const string kArgKmerWindow("kmer_window");
 const int kDfltKmerWindow = 10;
+const string kArgKmerSampling("kmer_sampling");
+const EHbnKmerSampling kDfltKmerSampling = eKmerSampleStride;
 const string kArgMaxKmerOcc("max_kmer_occ");
 const int kDfltMaxKmerOcc = 1000;
+const string kArgLookupTable("lookup_table");
+const EHbnLookupTableType kDfltLookupTable = eLktblAuto;
 const string kArgBlockSize("block_size");
 const int kDfltBlockSize = 2000;
 const string kArgDDFScore("ddf_score");
@@ -84,6 +98,10 @@ const string kArgSamRgSample("sam_sample");
 const char* kDfltSamRgSample = NULL;
 const string kArgSamDumpMd("sam_md");
 const bool kDfltSamDumpMd = false;
+const string kArgOrderedOutput("ordered_output");
+const bool kDfltOrderedOutput = false;
+const string kArgCompressOutput("gzip_output");
+const bool kDfltCompressOutput = false;
 
 /// query filtering options
 extern const string blast::kArgDustFiltering;
@@ -218,6 +236,31 @@ void CommandLineArguments::SetArgumentDescriptions(CArgDescriptions& arg_desc)
 
     arg_desc.AddFlag(kArgKeepDb, "Do not delete the database after search?", true);
 
+    arg_desc.AddFlag(kArgMmapDb, "Memory map the subject volumes and decode residues on demand instead of unpacking them?", true);
+
+    arg_desc.AddFlag(kArgVerifyLktbl, 
+                "Verify the checksums of saved lookup tables before using them? "
+                "This reads every page of the table and of the subject volume", true);
+
+    arg_desc.AddDefaultKey(kArgPrefetchMem, "memory_size",
+                "Memory budget for loading the next query or subject volume in the background while the current one is searched (0 disables prefetching)",
+                CArgDescriptions::eDataSize,
+                NStr::UInt8ToString_DataSize(kDfltPrefetchMem));
+    arg_desc.SetConstraint(kArgPrefetchMem, CArgAllowValuesGreaterThanOrEqual(0));
+
+    arg_desc.AddDefaultKey(kArgPrefetchThreads, "int_value",
+                "Number of threads building the lookup table of a prefetched subject volume. "
+                "They run alongside the search threads, so the CPUs are oversubscribed if this is large",
+                CArgDescriptions::eInteger,
+                NStr::IntToString(kDfltPrefetchThreads));
+    arg_desc.SetConstraint(kArgPrefetchThreads, CArgAllowValuesGreaterThanOrEqual(1));
+
+    arg_desc.AddFlag(kArgStreamQuery,
+                "Read the query volumes directly from the query files instead of building a query database? "
+                "Results are not backed up, so the job cannot be resumed. "
+                "Only if the subject fits in one volume (-max_subject_vol_res), "
+                "otherwise a query database is built as usual", true);
+
     arg_desc.AddOptionalKey(kArgMinQuerySize, "int_value",
                 "Skip query sequences shorter than this value",
                 CArgDescriptions::eInteger);
@@ -263,6 +306,14 @@ void CommandLineArguments::SetArgumentDescriptions(CArgDescriptions& arg_desc)
                 CArgDescriptions::eInteger);
     arg_desc.SetConstraint(kArgKmerWindow, CArgAllowValuesGreaterThanOrEqual(0));
 
+    arg_desc.AddDefaultKey(kArgKmerSampling, "sampling",
+                "Kmers indexed in subject sequences and looked up in queries:\n"
+                "  stride    = every kmer_window-th subject kmer, every query kmer,\n"
+                "  minimizer = minimizers of kmer_window consecutive kmers in both",
+                CArgDescriptions::eString,
+                EHbnKmerSamplingToName(kDfltKmerSampling));
+    arg_desc.SetConstraint(kArgKmerSampling, &(* new CArgAllow_Strings, "stride", "minimizer"));
+
     arg_desc.AddOptionalKey(kArgBlockSize, "int_value",
                 "Split subject database into consecutive blocks, each having this number of residues",
                 CArgDescriptions::eInteger);
@@ -279,6 +330,17 @@ void CommandLineArguments::SetArgumentDescriptions(CArgDescriptions& arg_desc)
                 NStr::IntToString(kDfltMaxKmerOcc));
     arg_desc.SetConstraint(kArgMaxKmerOcc, CArgAllowValuesGreaterThanOrEqual(1));
 
+    arg_desc.AddDefaultKey(kArgLookupTable, "index_type",
+                "Kmer index of the subject lookup table:\n"
+                "  auto   = direct for kmer size <= " + NStr::IntToString(kMaxDirectLktblKmerSize) 
+                + " if the subject volume has at least 4^kmer_size residues, bucket otherwise,\n"
+                "  hash   = hash table,\n"
+                "  direct = direct-address kmer array,\n"
+                "  bucket = sorted kmers addressed by bucket",
+                CArgDescriptions::eString,
+                EHbnLookupTableTypeToName(kDfltLookupTable));
+    arg_desc.SetConstraint(kArgLookupTable, &(* new CArgAllow_Strings, "auto", "hash", "direct", "bucket"));
+
     //// mem scoring options
     arg_desc.SetCurrentGroup(kGroupMemSc);
 
@@ -325,6 +387,12 @@ void CommandLineArguments::SetArgumentDescriptions(CArgDescriptions& arg_desc)
 
     arg_desc.AddFlag(kArgSamDumpMd, "Add MD tag to the SAM output", true);
 
+    arg_desc.AddFlag(kArgOrderedOutput, 
+                "Write the results in the order of the queries? "
+                "Otherwise they are written in the order the threads finish them", true);
+
+    arg_desc.AddFlag(kArgCompressOutput, "Compress the results with gzip?", true);
+
     /// query filtering options
     arg_desc.SetCurrentGroup(kGroupQueryFiltering);
 
@@ -464,6 +532,22 @@ void CommandLineArguments::ExtractAlgorithmOptions(const CArgs& args, CBlastOpti
     if (args.Exist(kArgKeepDb))
         m_Options->keep_db = static_cast<bool>(args[kArgKeepDb]);
 
+    if (args.Exist(kArgMmapDb))
+        m_Options->mmap_db = static_cast<bool>(args[kArgMmapDb]);
+    if (args.Exist(kArgVerifyLktbl))
+        m_Options->verify_lktbl = static_cast<bool>(args[kArgVerifyLktbl]);
+
+    if (args.Exist(kArgPrefetchMem) && args[kArgPrefetchMem].HasValue()) {
+        m_Options->prefetch_mem = args[kArgPrefetchMem].AsInt8();
+    }
+
+    if (args.Exist(kArgPrefetchThreads) && args[kArgPrefetchThreads].HasValue()) {
+        m_Options->prefetch_threads = args[kArgPrefetchThreads].AsInteger();
+    }
+
+    if (args.Exist(kArgStreamQuery))
+        m_Options->stream_query = static_cast<bool>(args[kArgStreamQuery]);
+
     if (args.Exist(kArgMinQuerySize) && args[kArgMinQuerySize].HasValue()) {
         m_Options->min_query_size = args[kArgMinQuerySize].AsInteger();
     }
@@ -497,6 +581,10 @@ void CommandLineArguments::ExtractAlgorithmOptions(const CArgs& args, CBlastOpti
         m_Options->kmer_window = args[kArgKmerWindow].AsInteger();
     }
 
+    if (args.Exist(kArgKmerSampling) && args[kArgKmerSampling].HasValue()) {
+        m_Options->kmer_sampling = NameToEHbnKmerSampling(args[kArgKmerSampling].AsString().c_str());
+    }
+
     if (args.Exist(kArgBlockSize) && args[kArgBlockSize].HasValue()) {
         m_Options->block_size = args[kArgBlockSize].AsInteger();
     }
@@ -509,6 +597,10 @@ void CommandLineArguments::ExtractAlgorithmOptions(const CArgs& args, CBlastOpti
         m_Options->max_kmer_occ = args[kArgMaxKmerOcc].AsInteger();
     }
 
+    if (args.Exist(kArgLookupTable) && args[kArgLookupTable].HasValue()) {
+        m_Options->lktbl_type = NameToEHbnLookupTableType(args[kArgLookupTable].AsString().c_str());
+    }
+
     /// mem chaining scoring options
     if (args.Exist(kArgMemScKmerSize) && args[kArgMemScKmerSize].HasValue()) {
         m_Options->memsc_kmer_size = args[kArgMemScKmerSize].AsInteger();
@@ -556,6 +648,12 @@ void CommandLineArguments::ExtractAlgorithmOptions(const CArgs& args, CBlastOpti
     if (args.Exist(kArgSamDumpMd))
         m_Options->dump_md = static_cast<bool>(args[kArgSamDumpMd]);
 
+    if (args.Exist(kArgOrderedOutput))
+        m_Options->ordered_output = static_cast<bool>(args[kArgOrderedOutput]);
+
+    if (args.Exist(kArgCompressOutput))
+        m_Options->compress_output = static_cast<bool>(args[kArgCompressOutput]);
+
     /// query filtering options
     if (args.Exist(kArgDustFiltering) && args[kArgDustFiltering].HasValue()) {
         string duststr = args[kArgDustFiltering].AsString();
@@ -679,6 +777,11 @@ void Init_HbnProgramOptions(HbnProgramOptions* opts)
     /// database options
     opts->db_dir = strdup(kDfltDbDir.c_str());
     opts->keep_db = kDfltKeepDb;
+    opts->mmap_db = kDfltMmapDb;
+    opts->verify_lktbl = kDfltVerifyLktbl;
+    opts->prefetch_mem = kDfltPrefetchMem;
+    opts->prefetch_threads = kDfltPrefetchThreads;
+    opts->stream_query = kDfltStreamQuery;
     opts->min_query_size = kDfltMinQuerySize;
     opts->max_query_vol_seqs = kDfltMaxQueryVolSeqs;
     opts->max_query_vol_res = kDfltMaxQueryVolRes;
@@ -689,7 +792,9 @@ void Init_HbnProgramOptions(HbnProgramOptions* opts)
     /// ddf scoring options
     opts->kmer_size = kDfltKmerSize;
     opts->kmer_window = kDfltKmerWindow;
+    opts->kmer_sampling = kDfltKmerSampling;
     opts->max_kmer_occ = kDfltMaxKmerOcc;
+    opts->lktbl_type = kDfltLookupTable;
     opts->block_size = kDfltBlockSize;
     opts->ddf_score = kDfltDDFScore;
 
@@ -703,6 +808,8 @@ void Init_HbnProgramOptions(HbnProgramOptions* opts)
     opts->rg_info = kDfltSamRgInfo;
     opts->rg_sample = kDfltSamRgSample;
     opts->dump_md = kDfltSamDumpMd;
+    opts->ordered_output = kDfltOrderedOutput;
+    opts->compress_output = kDfltCompressOutput;
 
     /// query filtering options
     opts->use_dust_masker = 1;
@@ -859,6 +966,14 @@ char* HbnProgramOptions2String(const HbnProgramOptions* opts)
     /// database options
     os_one_option_value(kArgDbDir, opts->db_dir);
     if (opts->keep_db) os_one_flag_option(kArgKeepDb);
+    if (opts->mmap_db) os_one_flag_option(kArgMmapDb);
+    if (opts->verify_lktbl) os_one_flag_option(kArgVerifyLktbl);
+    if (opts->prefetch_mem != kDfltPrefetchMem) {
+        string mem_str = NStr::UInt8ToString_DataSize(opts->prefetch_mem);
+        os_one_option_value(kArgPrefetchMem, mem_str);
+    }
+    if (opts->prefetch_threads != kDfltPrefetchThreads) os_one_option_value(kArgPrefetchThreads, opts->prefetch_threads);
+    if (opts->stream_query) os_one_flag_option(kArgStreamQuery);
     if (opts->min_query_size) os_one_option_value(kArgMinQuerySize, opts->min_query_size);
     if (opts->max_query_vol_seqs != kDfltMaxQueryVolSeqs) os_one_option_value(kArgMaxQueryVolSeqs, opts->max_query_vol_seqs);
     string size_str = NStr::UInt8ToString_DataSize(opts->max_query_vol_res);
@@ -871,7 +986,9 @@ char* HbnProgramOptions2String(const HbnProgramOptions* opts)
     /// ddf scoring
     os_one_option_value(kArgKmerSize, opts->kmer_size);
     os_one_option_value(kArgKmerWindow, opts->kmer_window);
+    os_one_option_value(kArgKmerSampling, EHbnKmerSamplingToName(opts->kmer_sampling));
     os_one_option_value(kArgMaxKmerOcc, opts->max_kmer_occ);
+    os_one_option_value(kArgLookupTable, EHbnLookupTableTypeToName(opts->lktbl_type));
     os_one_option_value(kArgBlockSize, opts->block_size);
     os_one_option_value(kArgDDFScore, opts->ddf_score);
 
@@ -882,6 +999,8 @@ char* HbnProgramOptions2String(const HbnProgramOptions* opts)
 
     /// output format
     os_one_option_value(kArgOutputFormat, opts->outfmt);
+    if (opts->ordered_output) os_one_flag_option(kArgOrderedOutput);
+    if (opts->compress_output) os_one_flag_option(kArgCompressOutput);
 
     /// query filtering options
     if (opts->use_dust_masker) {
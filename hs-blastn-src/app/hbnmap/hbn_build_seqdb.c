@@ -15,21 +15,26 @@ hbn_build_seqdb(const HbnProgramOptions* opts,
         (mkdir(opts->db_dir, S_IRWXU) != 0)) {
         HBN_ERR("Failed to create directory %s: %s", opts->db_dir, strerror(errno));
     }
+    HbnGzReaderSetNumThreads(opts->num_threads);
 
-    if (!hbndb_is_built(opts->query,
+    /// streamed queries are read from opts->query when they are searched
+    if ((!opts->stream_query)
+        &&
+        (!hbndb_is_built(opts->query,
             opts->db_dir,
             query_db_title,
             opts->min_query_size,
             opts->max_query_vol_seqs,
             opts->max_query_vol_res,
-            FALSE)) {
+            FALSE))) {
         build_db(opts->query,
             opts->db_dir,
             query_db_title,
             opts->min_query_size,
             opts->max_query_vol_seqs,
             opts->max_query_vol_res,
-            FALSE);
+            FALSE,
+            opts->num_threads);
         hbndb_make_built(opts->query,
             opts->db_dir,
             query_db_title,
@@ -62,7 +67,8 @@ hbn_build_seqdb(const HbnProgramOptions* opts,
             opts->min_subject_size,
             opts->max_subject_vol_seqs,
             opts->max_subject_vol_res,
-            FALSE);
+            FALSE,
+            opts->num_threads);
         hbndb_make_built(opts->subject,
             opts->db_dir,
             subject_db_title,
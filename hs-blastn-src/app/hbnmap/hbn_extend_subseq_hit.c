@@ -18,6 +18,10 @@ HbnSubseqHitExtnDataNew(const HbnProgramOptions* opts)
     kv_init(data->fwd_sbjct_subseq_list);
     kv_init(data->rev_sbjct_subseq_list);
     kv_init(data->sbjct_subseq_list);
+    for (int i = 0; i < kSubjectWindowCacheSize; ++i) {
+        data->window_cache.windows[i].sid = -1;
+        kv_init(data->window_cache.windows[i].seq);
+    }
     return data;
 }
 
@@ -30,10 +34,36 @@ HbnSubseqHitExtnDataFree(HbnSubseqHitExtnData* data)
     kv_destroy(data->fwd_sbjct_subseq_list);
     kv_destroy(data->rev_sbjct_subseq_list);
     kv_destroy(data->sbjct_subseq_list);
+    for (int i = 0; i < kSubjectWindowCacheSize; ++i) {
+        kv_destroy(data->window_cache.windows[i].seq);
+    }
     free(data);
     return NULL;
 }
 
+void
+HbnSubseqHitExtnDataClearCache(HbnSubseqHitExtnData* data)
+{
+    HbnSubjectWindowCache* cache = &data->window_cache;
+    for (int i = 0; i < kSubjectWindowCacheSize; ++i) cache->windows[i].sid = -1;
+}
+
+void
+HbnSubseqHitExtnDataReportStats(HbnSubseqHitExtnData** data_array, const int num_threads)
+{
+    size_t num_requests = 0, num_hits = 0, bytes_requested = 0, bytes_decoded = 0;
+    for (int i = 0; i < num_threads; ++i) {
+        const HbnSubjectWindowCache* cache = &data_array[i]->window_cache;
+        num_requests += cache->num_requests;
+        num_hits += cache->num_hits;
+        bytes_requested += cache->bytes_requested;
+        bytes_decoded += cache->bytes_decoded;
+    }
+    if (!num_requests) return;
+    HBN_LOG("%zu subject windows, %.1lf%% served from cache, %zu residues decoded, %zu saved",
+        num_requests, 100.0 * num_hits / num_requests, bytes_decoded, bytes_requested - bytes_decoded);
+}
+
 static BOOL
 chain_seed_list_is_contained(const BlastHSP* hsp_array,
     const int hsp_count,
@@ -266,73 +296,21 @@ set_blasthsp(HbnTracebackData* data,
     int sid,
     int subject_offset,
     int ssize,
-    const char* qaln,
-    const char* saln,
-    int aln_size,
     const HbnProgramOptions* opts,
     int ddf_score,
     int chain_score,
+    HbnHSPResults* results,
     BlastHSP* hsp)
 {
-    int score = 0;
-    int reward = abs(opts->reward);
-    int penalty = -abs(opts->penalty);
-    int go = -abs(opts->gap_open);
-    int ge = -abs(opts->gap_extend);
-    int i = 0;
-    int num_op = 0;
-    int num_ident = 0;
-    while (i < aln_size) {
-        char qc = qaln[i];
-        char sc = saln[i];
-        if (qc != GAP_CHAR && sc != GAP_CHAR) {
-            int j = i;
-            while (j < aln_size) {
-                qc = qaln[j];
-                sc = saln[j];
-                if (qc == GAP_CHAR || sc == GAP_CHAR) break;
-                score = (qc == sc) ? reward : penalty;
-                num_ident += (qc == sc);
-                ++j;
-            }
-            ++num_op;
-            i = j;
-            continue;
-        }
-        if (qc == GAP_CHAR) {
-            int l = 0;
-            int j = i;
-            while (j < aln_size) {
-                qc = qaln[j];
-                sc = saln[j];
-                if (qc != GAP_CHAR) break;
-                ++l;
-                ++j;
-            }
-            score += (go + ge * l);
-            ++num_op;
-            i = j;
-            continue;
-        }
-        hbn_assert(sc == GAP_CHAR);
-        {
-            int l = 0;
-            int j = i;
-            while (j < aln_size) {
-                qc = qaln[j];
-                sc = saln[j];
-                if (sc != GAP_CHAR) break;
-                ++l;
-                ++j;
-            }
-            score += (go + ge * l);
-            ++num_op;
-            i = j;
-            continue;
-        }
-    }
+    const int reward = abs(opts->reward);
+    const u32* ops = kv_data(data->ops) + data->op_head;
+    const int num_op = kv_size(data->ops) - data->op_head;
+    const int num_ident = data->num_ident;
+    const int aln_size = data->align_len;
 
-    hsp->score = score;
+    /// the hsps are rescored in the traceback stage. until then each carries
+    /// the score of its last column, which the truncation makes a match
+    hsp->score = reward;
     hsp->num_ident = num_ident;
     hsp->bit_score = 0.0;
     hsp->evalue = 0.0;
@@ -347,71 +325,12 @@ set_blasthsp(HbnTracebackData* data,
     hsp->context = fwd_query_context + qdir;
     hsp->num_positives = num_ident;
 
-    hsp->gap_info = GapEditScriptNew(num_op);
-    int op_idx = 0;
-    int gap_opens = 0;
-    int gaps = 0;
-    i = 0;
-    while (i < aln_size) {
-        char qc = qaln[i];
-        char sc = saln[i];
-        if (qc != GAP_CHAR && sc != GAP_CHAR) {
-            int j = i;
-            EGapAlignOpType type = eGapAlignSub;
-            int l = 0;
-            while (j < aln_size) {
-                qc = qaln[j];
-                sc = saln[j];
-                if (qc == GAP_CHAR || sc == GAP_CHAR) break;
-                ++l;
-                ++j;
-            }
-            hsp->gap_info->op_type[op_idx] = type;
-            hsp->gap_info->num[op_idx] = l;
-            ++op_idx;
-            i = j;
-            continue;
-        }
-        if (qc == GAP_CHAR) {
-            int l = 0;
-            int j = i;
-            EGapAlignOpType type = eGapAlignDel;
-            while (j < aln_size) {
-                qc = qaln[j];
-                sc = saln[j];
-                if (qc != GAP_CHAR) break;
-                ++l;
-                ++j;
-            }
-            hsp->gap_info->op_type[op_idx] = type;
-            hsp->gap_info->num[op_idx] = l;
-            ++gap_opens;
-            gaps += l;
-            ++op_idx;
-            i = j;
-            continue;
-        }
-        hbn_assert(sc == GAP_CHAR);
-        {
-            int l = 0;
-            int j = i;
-            EGapAlignOpType type = eGapAlignIns;
-            while (j < aln_size) {
-                qc = qaln[j];
-                sc = saln[j];
-                if (sc != GAP_CHAR) break;
-                ++l;
-                ++j;
-            }
-            hsp->gap_info->op_type[op_idx] = type;
-            hsp->gap_info->num[op_idx] = l;
-            ++gap_opens;
-            gaps += l;
-            ++op_idx;
-            i = j;
-            continue;
-        }
-    }    
+    hsp->gap_info = HbnHSPResultsGapEditScriptNew(results, num_op);
+    for (int i = 0; i < num_op; ++i) {
+        const int op = ALIGN_OP_TYPE(ops[i]);
+        hsp->gap_info->op_type[i] = (op == kAlignOpSub) ? eGapAlignSub : ((op == kAlignOpDel) ? eGapAlignDel : eGapAlignIns);
+        hsp->gap_info->num[i] = ALIGN_OP_NUM(ops[i]);
+    }
 
     hsp->hbn_query.oid = qid;
     hsp->hbn_query.strand = qdir;
@@ -431,28 +350,75 @@ set_blasthsp(HbnTracebackData* data,
     hsp->hsp_info.num_ident = num_ident;
     hsp->hsp_info.num_positives = num_ident;
     hsp->hsp_info.align_len = aln_size;
-    hsp->hsp_info.gap_opens = gap_opens;
-    hsp->hsp_info.gaps = gaps;
+    hsp->hsp_info.gap_opens = data->gap_opens;
+    hsp->hsp_info.gaps = data->gaps;
+}
 
-    if (op_idx != num_op) {
-        HBN_LOG("op_idx = %d, num_op = %d, align_size = %d", op_idx, num_op, aln_size);
-        dump_align_string(qaln, saln, aln_size, stderr);
-        dump_blasthsp(fprintf, stderr, *hsp);
+/// copy subject [from, to) to dst, with the ambiguous residues other than N turned into A.
+/// the select is branch free so that the compiler vectorises it
+static void
+decode_subject_range(const text_t* db, const int sid, const size_t from, const size_t to, vec_u8* buf, u8* dst)
+{
+    const u8* s = seqdb_subsequence_window(db, sid, from, to, buf);
+    const size_t n = to - from;
+    for (size_t i = 0; i < n; ++i) {
+        const u8 c = s[i];
+        dst[i] = (c < 4) ? c : ((c == 0xf) ? 0xf : 0);
     }
-    hbn_assert(op_idx == num_op);
 }
 
-static void
-extract_subject_subsequence_without_ambig_res(const text_t* db, const int sid, const size_t from, const size_t to, vec_u8* subject)
+/// subject [from, to) without ambiguous residues, served from the window cache if it is
+/// contained in a cached window. a cached window overlapping it is extended if the result
+/// is at most twice as long, otherwise the least recently used window is replaced.
+/// the result is valid until the next call.
+static const u8*
+extract_subject_subsequence_without_ambig_res(HbnSubjectWindowCache* cache,
+    const text_t* db, 
+    const int sid, 
+    const size_t from, 
+    const size_t to, 
+    vec_u8* buf)
 {
-    kv_clear(*subject);
-    const u8* s = db->unpacked_seq + seqdb_seq_offset(db, sid);
-    const u8 code_table[16] = {0,1,2,3,0,0,0,0,0,0,0,0,0,0,0,0xf};
-    for (size_t i = from; i < to; ++i) {
-        u8 c = s[i];
-        c = code_table[c];
-        kv_push(u8, *subject, c);
+    ++cache->clock;
+    ++cache->num_requests;
+    cache->bytes_requested += to - from;
+    HbnSubjectWindow* lru = cache->windows;
+    HbnSubjectWindow* overlap = NULL;
+    for (int i = 0; i < kSubjectWindowCacheSize; ++i) {
+        HbnSubjectWindow* w = cache->windows + i;
+        if (w->sid == sid && w->from <= from && to <= w->to) {
+            w->last_use = cache->clock;
+            ++cache->num_hits;
+            return kv_data(w->seq) + (from - w->from);
+        }
+        if (w->sid == sid && w->from < to && from < w->to && !overlap) overlap = w;
+        if (w->last_use < lru->last_use) lru = w;
+    }
+
+    if (overlap && hbn_max(to, overlap->to) - hbn_min(from, overlap->from) <= 2 * (to - from)) {
+        const size_t new_from = hbn_min(from, overlap->from);
+        const size_t new_to = hbn_max(to, overlap->to);
+        const size_t old_size = overlap->to - overlap->from;
+        kv_resize(u8, overlap->seq, new_to - new_from);
+        u8* seq = kv_data(overlap->seq);
+        memmove(seq + (overlap->from - new_from), seq, old_size);
+        if (new_from < overlap->from) decode_subject_range(db, sid, new_from, overlap->from, buf, seq);
+        if (overlap->to < new_to) decode_subject_range(db, sid, overlap->to, new_to, buf, seq + (overlap->to - new_from));
+        cache->bytes_decoded += (new_to - new_from) - old_size;
+        overlap->from = new_from;
+        overlap->to = new_to;
+        overlap->last_use = cache->clock;
+        return seq + (from - new_from);
     }
+
+    kv_resize(u8, lru->seq, to - from);
+    decode_subject_range(db, sid, from, to, buf, kv_data(lru->seq));
+    cache->bytes_decoded += to - from;
+    lru->sid = sid;
+    lru->from = from;
+    lru->to = to;
+    lru->last_use = cache->clock;
+    return kv_data(lru->seq);
 }
 
 static void
@@ -485,9 +451,9 @@ hbn_extend_subject_subseq_hit_list(HbnSubseqHitExtnData* data,
     for (int i = 0; i < hit_count && i < opts->max_hsps_per_subject + 1 && hsp_count < opts->max_hsps_per_subject; ++i) {
         HbnSubseqHit* hit = hit_array + i;
         //dump_subseq_hit(fprintf, stderr, *hit);
-        extract_subject_subsequence_without_ambig_res(db, hit->sid, hit->sfrom, hit->sto, subject_v);
-        const u8* subject = kv_data(*subject_v);
-        const int subject_length = kv_size(*subject_v);
+        const u8* subject = extract_subject_subsequence_without_ambig_res(&data->window_cache,
+                                db, hit->sid, hit->sfrom, hit->sto, subject_v);
+        const int subject_length = hit->sto - hit->sfrom;
         int strand = hit->qdir;
         InitHitFindData_AddQuery(hit_finder,
                 hit->sid, NULL,
@@ -531,10 +497,7 @@ hbn_extend_subject_subseq_hit_list(HbnSubseqHitExtnData* data,
             }
             BlastHSP* hsp = hsp_array + hsp_count;
             memset(hsp, 0, sizeof(BlastHSP));
-            const char* qaln = data->traceback_data->qas;
-            const char* saln = data->traceback_data->sas;
-            const int aln_len = data->traceback_data->qae - data->traceback_data->qas;
-            set_blasthsp(data->traceback_data, query_id, fwd_query_context, init_hit->sdir, query_length, hit->sid, hit->sfrom, seqdb_seq_size(db, hit->sid), qaln, saln, aln_len, opts, hit->score, init_hit->score, hsp);
+            set_blasthsp(data->traceback_data, query_id, fwd_query_context, init_hit->sdir, query_length, hit->sid, hit->sfrom, seqdb_seq_size(db, hit->sid), opts, hit->score, init_hit->score, results, hsp);
             s_ReduceGaps(hsp->gap_info,
                 query + data->traceback_data->qoff,
                 subject + data->traceback_data->soff,
@@ -549,14 +512,7 @@ hbn_extend_subject_subseq_hit_list(HbnSubseqHitExtnData* data,
 
     ks_introsort_blasthsp_score_gt(hsp_count, hsp_array);
     hsp_list->hbn_best_raw_score = hsp_array[0].score;
-    hsp_list->hspcnt = hsp_count;
-    hsp_list->hsp_max = hsp_count;
-    hsp_list->hsp_array = (BlastHSP**)calloc(hsp_count, sizeof(BlastHSP*));
-    for (int i = 0; i < hsp_count; ++i) {
-        BlastHSP* hsp = (BlastHSP*)calloc(1, sizeof(BlastHSP));
-        memcpy(hsp, hsp_array + i, sizeof(BlastHSP));
-        hsp_list->hsp_array[i] = hsp;
-    }
+    HbnHSPResultsSetHSPList(results, hsp_array, hsp_count, hsp_list);
 }
 
 void
@@ -603,12 +559,5 @@ hbn_extend_query_subseq_hit_list(HbnSubseqHit* subseq_hit_array,
     }
 
     if (!hsplist_count) return;
-    hit_list->hsplist_array = (BlastHSPList**)calloc(hsplist_count, sizeof(BlastHSPList*));
-    hit_list->hsplist_count = hsplist_count;
-    hit_list->hsplist_max = hsplist_count;
-    for (i = 0; i < hsplist_count; ++i) {
-        BlastHSPList* hsp_list = (BlastHSPList*)calloc(1, sizeof(BlastHSPList));
-        memcpy(hsp_list, hsplist_array + i, sizeof(BlastHSPList));
-        hit_list->hsplist_array[i] = hsp_list;
-    }
+    HbnHSPResultsSetHitList(results, hsplist_array, hsplist_count, hit_list);
 }
\ No newline at end of file
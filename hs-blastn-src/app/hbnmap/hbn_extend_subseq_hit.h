@@ -12,6 +12,30 @@
 extern "C" {
 #endif
 
+/// number of decoded subject windows kept by a thread
+#define kSubjectWindowCacheSize 4
+
+typedef struct {
+    int sid;
+    size_t from;
+    size_t to;
+    u64 last_use;
+    vec_u8 seq;
+} HbnSubjectWindow;
+
+/// candidates of one query, and the queries of a chunk, often hit the same
+/// region of a subject, so the windows are decoded once and served from here
+/// while they overlap
+typedef struct {
+    HbnSubjectWindow windows[kSubjectWindowCacheSize];
+    u64 clock;
+    size_t num_requests;
+    /// the window is contained in a cached one
+    size_t num_hits;
+    size_t bytes_requested;
+    size_t bytes_decoded;
+} HbnSubjectWindowCache;
+
 typedef struct {
     vec_subseq_hit fwd_sbjct_subseq_list;
     vec_subseq_hit rev_sbjct_subseq_list;
@@ -19,6 +43,7 @@ typedef struct {
     InitHitFindData* hit_finder;
     HbnTracebackData* traceback_data;
     vec_chain_seed chain_seed_list;
+    HbnSubjectWindowCache window_cache;
 } HbnSubseqHitExtnData;
 
 HbnSubseqHitExtnData*
@@ -27,6 +52,15 @@ HbnSubseqHitExtnDataNew(const HbnProgramOptions* opts);
 HbnSubseqHitExtnData*
 HbnSubseqHitExtnDataFree(HbnSubseqHitExtnData* data);
 
+/// empty the window cache since the next search may be against another subject
+/// volume. the statistics are kept for the run summary
+void
+HbnSubseqHitExtnDataClearCache(HbnSubseqHitExtnData* data);
+
+/// log the window cache statistics of the whole run, summed over the threads
+void
+HbnSubseqHitExtnDataReportStats(HbnSubseqHitExtnData** data_array, const int num_threads);
+
 void
 hbn_extend_query_subseq_hit_list(HbnSubseqHit* subseq_hit_array,
     int subseq_hit_count,
@@ -2,6 +2,8 @@
 
 #include "backup_results.h"
 
+const char* kBackupResultsDir = "backup_results";
+
 const char*
 make_qi_vs_sj_results_path(const char* wrk_dir, const char* stage, const int qi, const int sj, char path[])
 {
@@ -63,16 +65,150 @@ all_vs_sj_is_mapped(const char* wrk_dir,
     return TRUE;
 }
 
-void
-merge_qi_vs_sj_results(const char* wrk_dir, const char* stage, const int qi, const int sj, const CSeqDB* db, const HbnProgramOptions* opts, FILE* out)
+/// the alignment file of a query volume against the subject volume being merged
+typedef struct {
+    int qi;
+    HbnAlignFileReader* reader;
+    /// mapped when the first chunk of the file is taken
+    CSeqDB* queries;
+    int num_records;
+    /// the records of the files are numbered one after another for the output writer
+    int record_base;
+    int num_done_records;
+} MergeFile;
+
+/// the files are merged by opts->num_threads threads, which take chunks of
+/// HBN_QUERY_CHUNK_SIZE records in file order. a file is released as soon as
+/// its last chunk is formatted, so the files are read as a stream
+typedef struct {
+    const char* wrk_dir;
+    const CSeqDB* db;
+    const HbnProgramOptions* opts;
+    HbnOutputWriter* out;
+    MergeFile* file_array;
+    int num_files;
+    pthread_mutex_t lock;
+    int next_file;
+    int next_record;
+} MergeJob;
+
+static MergeFile*
+merge_job_next_chunk(MergeJob* job, int* from, int* to)
+{
+    MergeFile* file = NULL;
+    pthread_mutex_lock(&job->lock);
+    while (job->next_file < job->num_files
+           &&
+           job->next_record >= job->file_array[job->next_file].num_records) {
+        ++job->next_file;
+        job->next_record = 0;
+    }
+    if (job->next_file < job->num_files) {
+        file = job->file_array + job->next_file;
+        *from = job->next_record;
+        *to = hbn_min(*from + HBN_QUERY_CHUNK_SIZE, file->num_records);
+        job->next_record = *to;
+        if (!file->queries) file->queries = seqdb_load_mapped(job->wrk_dir, INIT_QUERY_DB_TITLE, file->qi);
+    }
+    pthread_mutex_unlock(&job->lock);
+    return file;
+}
+
+static void
+merge_job_chunk_done(MergeJob* job, MergeFile* file, const int num_records)
+{
+    pthread_mutex_lock(&job->lock);
+    file->num_done_records += num_records;
+    if (file->num_done_records == file->num_records) {
+        file->queries = CSeqDBFree(file->queries);
+        file->reader = HbnAlignFileReaderFree(file->reader);
+    }
+    pthread_mutex_unlock(&job->lock);
+}
+
+static void*
+merge_thread(void* params)
 {
+    MergeJob* job = (MergeJob*)(params);
+    HbnHSPResults* results = HbnHSPResultsNew(HBN_QUERY_CHUNK_SIZE);
+    BLAST_SequenceBlk* query_blk = BLAST_SequenceBlkNew();
+    BlastQueryInfo* query_info = BlastQueryInfoNew(HBN_QUERY_CHUNK_SIZE * 2);
+    int from, to;
+    MergeFile* file;
+    while ((file = merge_job_next_chunk(job, &from, &to))) {
+        recover_one_result_set(file->queries, job->db, job->opts, file->reader, from, to, results, query_blk, query_info);
+        HbnOutputWriterSubmit(job->out, file->record_base + from, file->record_base + to, &results->output_buf, NULL);
+        merge_job_chunk_done(job, file, to - from);
+    }
+    BLAST_SequenceBlkFree(query_blk);
+    BlastQueryInfoFree(query_info);
+    results = HbnHSPResultsFree(results);
+    return NULL;
+}
+
+/// format the results of the query volumes qi_array against subject volume sj
+/// for the output. db is the subject volume, it is loaded here if NULL and
+/// there are results to format
+static void
+merge_results_files(const char* wrk_dir,
+    const char* stage,
+    const int* qi_array,
+    const int num_files,
+    const int sj,
+    const CSeqDB* db,
+    const HbnProgramOptions* opts,
+    HbnOutputWriter* out)
+{
+    struct timeval begin, end;
+    gettimeofday(&begin, NULL);
+    MergeJob job;
+    job.wrk_dir = wrk_dir;
+    job.opts = opts;
+    job.out = out;
+    job.file_array = (MergeFile*)calloc(num_files, sizeof(MergeFile));
+    job.num_files = num_files;
+    job.next_file = 0;
+    job.next_record = 0;
+    pthread_mutex_init(&job.lock, NULL);
     char path[HBN_MAX_PATH_LEN];
-    make_qi_vs_sj_results_path(wrk_dir, stage, qi, sj, path);
-    hbn_dfopen(qi_vs_sj_in, path, "rb");
-    CSeqDB* queries = seqdb_load(wrk_dir, INIT_QUERY_DB_TITLE, qi);
-    recover_qi_vs_sj_results(queries, db, opts, qi_vs_sj_in, out);
-    hbn_fclose(qi_vs_sj_in);
-    CSeqDBFree(queries);
+    int num_records = 0;
+    for (int i = 0; i < num_files; ++i) {
+        MergeFile* file = job.file_array + i;
+        file->qi = qi_array[i];
+        make_qi_vs_sj_results_path(wrk_dir, stage, file->qi, sj, path);
+        file->reader = HbnAlignFileReaderNew(path);
+        file->num_records = kv_size(file->reader->index);
+        file->record_base = num_records;
+        num_records += file->num_records;
+        if (!file->num_records) file->reader = HbnAlignFileReaderFree(file->reader);
+    }
+
+    CSeqDB* loaded_db = NULL;
+    /// only the aligned subject windows are decoded when recovering the results
+    if (!db && num_records) db = loaded_db = seqdb_load_mapped(wrk_dir, INIT_SUBJECT_DB_TITLE, sj);
+    job.db = db;
+    const int num_threads = hbn_max(1, hbn_min(opts->num_threads, (num_records + HBN_QUERY_CHUNK_SIZE - 1) / HBN_QUERY_CHUNK_SIZE));
+    pthread_t jobs[num_threads];
+    HbnOutputWriterBeginBatch(out, NULL);
+    for (int i = 0; i < num_threads; ++i) pthread_create(jobs + i, NULL, merge_thread, &job);
+    for (int i = 0; i < num_threads; ++i) pthread_join(jobs[i], NULL);
+    HbnOutputWriterEndBatch(out);
+
+    for (int i = 0; i < num_files; ++i) {
+        hbn_assert(job.file_array[i].reader == NULL && job.file_array[i].queries == NULL);
+    }
+    if (loaded_db) loaded_db = CSeqDBFree(loaded_db);
+    free(job.file_array);
+    pthread_mutex_destroy(&job.lock);
+    gettimeofday(&end, NULL);
+    HBN_LOG("Merge %d backed-up records of %d query volumes against S%s with %d threads in %.2lf secs",
+        num_records, num_files, u64_to_fixed_width_string(sj, HBN_DIGIT_WIDTH), num_threads, hbn_time_diff(&begin, &end));
+}
+
+void
+merge_qi_vs_sj_results(const char* wrk_dir, const char* stage, const int qi, const int sj, const CSeqDB* db, const HbnProgramOptions* opts, HbnOutputWriter* out)
+{
+    merge_results_files(wrk_dir, stage, &qi, 1, sj, db, opts, out);
 }
 
 void
@@ -84,11 +220,10 @@ merge_all_vs_sj_results(const char* wrk_dir,
     const int node_id,
     const int num_nodes,
     const HbnProgramOptions* opts,
-    FILE* out)
+    HbnOutputWriter* out)
 {
-    CSeqDB* db = seqdb_load_unpacked_with_ambig_res(wrk_dir, INIT_SUBJECT_DB_TITLE, sj);
-    for (int i = qi_start + node_id; i < num_query_vols; i += num_nodes) {
-        merge_qi_vs_sj_results(wrk_dir, stage, i, sj, db, opts, out);
-    }
-    db = CSeqDBFree(db);
-}
\ No newline at end of file
+    kv_dinit(vec_int, qi_array);
+    for (int i = qi_start + node_id; i < num_query_vols; i += num_nodes) kv_push(int, qi_array, i);
+    merge_results_files(wrk_dir, stage, kv_data(qi_array), kv_size(qi_array), sj, NULL, opts, out);
+    kv_destroy(qi_array);
+}
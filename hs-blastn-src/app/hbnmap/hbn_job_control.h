@@ -4,11 +4,15 @@
 #include "../../corelib/hbn_aux.h"
 #include "../../corelib/seqdb.h"
 #include "hbn_options.h"
+#include "output_writer.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/// the directory of db_dir holding the alignment files of the searched volume pairs
+extern const char* kBackupResultsDir;
+
 const char*
 make_qi_vs_sj_results_path(const char* wrk_dir, const char* stage, const int qi, const int sj, char path[]);
 
@@ -31,7 +35,7 @@ all_vs_sj_is_mapped(const char* wrk_dir,
     const int num_nodes);
 
 void
-merge_qi_vs_sj_results(const char* wrk_dir, const char* stage, const int qi, const int sj, const CSeqDB* db, const HbnProgramOptions* opts, FILE* out);
+merge_qi_vs_sj_results(const char* wrk_dir, const char* stage, const int qi, const int sj, const CSeqDB* db, const HbnProgramOptions* opts, HbnOutputWriter* out);
 
 void
 merge_all_vs_sj_results(const char* wrk_dir, 
@@ -42,7 +46,7 @@ merge_all_vs_sj_results(const char* wrk_dir,
     const int node_id,
     const int num_nodes,
     const HbnProgramOptions* opts,
-    FILE* out);
+    HbnOutputWriter* out);
 
 #ifdef __cplusplus
 }
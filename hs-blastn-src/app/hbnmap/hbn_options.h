@@ -3,6 +3,7 @@
 
 #include "../../ncbi_blast/setup/blast_options.h"
 #include "../../ncbi_blast/setup/blast_types.h"
+#include "../../algo/hbn_lookup_table.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -73,6 +74,11 @@ typedef struct {
     /// database options
     const char*         db_dir;
     int                 keep_db;
+    int                 mmap_db;
+    int                 verify_lktbl;
+    size_t              prefetch_mem;
+    int                 prefetch_threads;
+    int                 stream_query;
     int                 min_query_size;
     int                 max_query_vol_seqs;
     size_t              max_query_vol_res;
@@ -83,7 +89,9 @@ typedef struct {
     /// ddf scoring options
     int                 kmer_size;
     int                 kmer_window;
+    EHbnKmerSampling    kmer_sampling;
     int                 max_kmer_occ;
+    EHbnLookupTableType lktbl_type;
     int                 block_size;
     int                 ddf_score;
 
@@ -98,6 +106,8 @@ typedef struct {
     int                 dump_md;
     const char*         rg_info;
     const char*         rg_sample;
+    int                 ordered_output;
+    int                 compress_output;
 
     /// query filtering options
     int                 use_dust_masker;
@@ -1,12 +1,14 @@
 #include "hbn_results.h"
 
 #include "../../corelib/m4_record.h"
+#include "../../corelib/record_builder.h"
+#include "../../ncbi_blast/setup/blast_encoding.h"
 #include "../../ncbi_blast/setup/hsp2string.h"
 
 const char* kSamVersion = "1.6";
 
 void
-print_sam_prolog(FILE* out, 
+print_sam_prolog(kstring_t* out, 
     const char* sam_version, 
     const char* prog_version, 
     const char* rg_info,
@@ -14,126 +16,147 @@ print_sam_prolog(FILE* out,
     int argc, 
     char* argv[])
 {
-    fprintf(out, "@HD\t");
-    fprintf(out, "VN:%s\t", sam_version);
-    fprintf(out, "SO:unknown\t");
-    fprintf(out, "GO:query\n");
+    ksprintf(out, "@HD\t");
+    ksprintf(out, "VN:%s\t", sam_version);
+    ksprintf(out, "SO:unknown\t");
+    ksprintf(out, "GO:query\n");
 
-    fprintf(out, "@PG\t");
-    fprintf(out, "ID:0\t");
-    fprintf(out, "VN:%s\t", prog_version);
-    fprintf(out, "CL:");
-    for (int i = 0; i < argc - 1; ++i) fprintf(out, "%s ", argv[i]);
-    fprintf(out, "%s", argv[argc-1]);
-    fprintf(out, "\t");
-    fprintf(out, "PN:mecat2map\n");
+    ksprintf(out, "@PG\t");
+    ksprintf(out, "ID:0\t");
+    ksprintf(out, "VN:%s\t", prog_version);
+    ksprintf(out, "CL:");
+    for (int i = 0; i < argc - 1; ++i) ksprintf(out, "%s ", argv[i]);
+    ksprintf(out, "%s", argv[argc-1]);
+    ksprintf(out, "\t");
+    ksprintf(out, "PN:mecat2map\n");
     if (rg_info) {
-        fprintf(out, "%s", rg_info);
-        if (rg_sample) fprintf(out, "\tSM:%s", rg_sample);
-        fprintf(out, "\n");
+        ksprintf(out, "%s", rg_info);
+        if (rg_sample) ksprintf(out, "\tSM:%s", rg_sample);
+        ksprintf(out, "\n");
     } else {
-        if (rg_sample) fprintf(out, "@RG\tSM:%s\n", rg_sample);
+        if (rg_sample) ksprintf(out, "@RG\tSM:%s\n", rg_sample);
     }
 }
 
+/// "<cnt><op>" of a cigar or an MD field
+static inline void
+put_count_and_op(const u64 cnt, const char op, kstring_t* out)
+{
+    char* p = rec_reserve(21, out);
+    p = rec_write_u64(cnt, p);
+    *p++ = op;
+    rec_commit(p, out);
+}
+
+/// the cigar comes from the edit script alone
 static void
-print_cigar_core(const BlastHSP* hsp, 
-    const kstring_t* aligned_strings, 
-    kstring_t* out)
+print_cigar_core(const BlastHSP* hsp, kstring_t* out)
 {
-    int aln_size = hsp->hsp_info.subject_align_offset - hsp->hsp_info.query_align_offset;
-    const char* q = ks_s(*aligned_strings) + hsp->hsp_info.subject_align_offset;
-    const char* s = ks_s(*aligned_strings) + hsp->hsp_info.query_align_offset;
-    int i = 0;
-    while (i < aln_size) {
-        char type = 'N';
-        int cnt = 0;
-        if (q[i] == GAP_CHAR) {  // delete from subject (gap in query)
-            type = 'D';
-            while (i < aln_size && q[i] == GAP_CHAR) {
-                hbn_assert(s[i] != GAP_CHAR);
-                ++i;
-                ++cnt;
-            }
-        } else if (s[i] == GAP_CHAR) { // insert into subject (gap in subject)
-            type = 'I';
-            while (i < aln_size && s[i] == GAP_CHAR) {
-                hbn_assert(q[i] != GAP_CHAR);
-                ++i;
-                ++cnt;
-            }
-        } else { // substitution
-            type = 'M';
-            hbn_assert(q[i] != GAP_CHAR && s[i] != GAP_CHAR);
-            while (i < aln_size && q[i] != GAP_CHAR && s[i] != GAP_CHAR) {
-                ++i;
-                ++cnt;
-            }
+    const GapEditScript* esp = hsp->gap_info;
+    char type = 'N';
+    int cnt = 0;
+    for (int i = 0; i < esp->size; ++i) {
+        if (esp->num[i] == 0) continue;
+        char t = 'M';
+        if (esp->op_type[i] == eGapAlignDel) { // gap in query, residues inserted into subject
+            t = 'I';
+        } else if (esp->op_type[i] == eGapAlignIns) { // gap in subject, residues deleted from it
+            t = 'D';
+        } else {
+            hbn_assert(esp->op_type[i] == eGapAlignSub);
+        }
+        if (t != type && cnt) {
+            put_count_and_op(cnt, type, out);
+            cnt = 0;
         }
-        ksprintf(out, "%d%c", cnt, type);
+        type = t;
+        cnt += esp->num[i];
     }
+    if (cnt) put_count_and_op(cnt, type, out);
 }
 
 void
-print_sam_cigar(const BlastHSP* hsp, 
-    const kstring_t* aligned_strings, 
-    kstring_t* out)
+print_sam_cigar(const BlastHSP* hsp, kstring_t* out)
 {
-    if (hsp->hbn_query.offset) ksprintf(out, "%zuS", hsp->hbn_query.offset);
-    print_cigar_core(hsp, aligned_strings, out);
+    if (hsp->hbn_query.offset) put_count_and_op(hsp->hbn_query.offset, 'S', out);
+    print_cigar_core(hsp, out);
     if (hsp->hbn_query.end < hsp->hbn_query.seq_size) 
-        ksprintf(out, "%zuS", hsp->hbn_query.seq_size - hsp->hbn_query.end);
+        put_count_and_op(hsp->hbn_query.seq_size - hsp->hbn_query.end, 'S', out);
 }
 
 void
-print_paf_cigar(const BlastHSP* hsp, 
-    const kstring_t* aligned_strings, 
-    kstring_t* out)
+print_paf_cigar(const BlastHSP* hsp, kstring_t* out)
 {
-    ksprintf(out, "cg:Z:");
-    print_cigar_core(hsp, aligned_strings, out);
+    kputsn("cg:Z:", 5, out);
+    print_cigar_core(hsp, out);
 }
 
+/// number of identical columns in the alignment, its number of columns is returned in aln_size
+static int
+count_identities(const BlastHSP* hsp, const u8* query, const u8* subject, int* aln_size)
+{
+    const GapEditScript* esp = hsp->gap_info;
+    int num_ident = 0, num_cols = 0;
+    for (int i = 0; i < esp->size; ++i) {
+        const int num = esp->num[i];
+        num_cols += num;
+        if (esp->op_type[i] == eGapAlignSub) {
+            for (int k = 0; k < num; ++k) num_ident += (query[k] == subject[k]);
+            query += num;
+            subject += num;
+        } else if (esp->op_type[i] == eGapAlignDel) {
+            subject += num;
+        } else {
+            query += num;
+        }
+    }
+    *aln_size = num_cols;
+    return num_ident;
+}
+
+/// SEQ holds the aligned subject residues, so MD spells the query residues
+/// at mismatches and deletions
 void
 print_md(const BlastHSP* hsp, 
-    const kstring_t* aligned_strings, 
+    const u8* query,
+    const u8* subject,
     kstring_t* out)
 {
-    ksprintf(out, "MD:Z:");
-    int aln_size = hsp->hsp_info.subject_align_offset - hsp->hsp_info.query_align_offset;
-    const char* q = ks_s(*aligned_strings) + hsp->hsp_info.subject_align_offset;
-    const char* s = ks_s(*aligned_strings) + hsp->hsp_info.query_align_offset;
-    int i = 0, l_md = 0;
-    while (i < aln_size) {
-        int j = i;
-        if (s[i] == GAP_CHAR) { // insert into subject (gap in  query)
-            while (j < aln_size && s[j] == GAP_CHAR) {
-                hbn_assert(q[j] != GAP_CHAR);
-                ++j;
-            }
-        } else if (q[i] == GAP_CHAR) { // delete from subject (gap in subject)
-            while (j < aln_size && q[j] == GAP_CHAR) {
-                hbn_assert(s[j] != GAP_CHAR);
-                ++j;
-            }
-            ksprintf(out, "%d^", l_md);
-            kputsn(&s[i], j - i, out);
-            l_md = 0;
-        } else { // substitution
-            hbn_assert(q[i] != GAP_CHAR && s[i] != GAP_CHAR);
-            while (j < aln_size && q[j] != GAP_CHAR && s[j] != GAP_CHAR) ++j;
-            for (int k = i; k < j; ++k) {
-                if (q[k] != s[k]) {
-                    ksprintf(out, "%d%c", l_md, s[k]);
+    kputsn("MD:Z:", 5, out);
+    const GapEditScript* esp = hsp->gap_info;
+    int l_md = 0;
+    BOOL in_gap = FALSE;
+    for (int i = 0; i < esp->size; ++i) {
+        const int num = esp->num[i];
+        if (num == 0) continue;
+        if (esp->op_type[i] == eGapAlignSub) {
+            for (int k = 0; k < num; ++k) {
+                if (query[k] != subject[k]) {
+                    put_count_and_op(l_md, BLASTNA_TO_IUPACNA[query[k]], out);
                     l_md = 0;
                 } else {
                     ++l_md;
                 }
             }
+            query += num;
+            subject += num;
+            in_gap = FALSE;
+        } else if (esp->op_type[i] == eGapAlignDel) { // gap in query
+            subject += num;
+            in_gap = FALSE;
+        } else { // gap in subject, adjacent runs make up one deletion
+            if (!in_gap) {
+                put_count_and_op(l_md, '^', out);
+                l_md = 0;
+            }
+            char* p = rec_reserve(num, out);
+            for (int k = 0; k < num; ++k) *p++ = BLASTNA_TO_IUPACNA[query[k]];
+            rec_commit(p, out);
+            query += num;
+            in_gap = TRUE;
         }
-        i = j;
-    }   
-    if (l_md > 0) ksprintf(out, "%d", l_md); 
+    }
+    if (l_md > 0) rec_put_u64(l_md, out); 
 }
 
 #if 0
@@ -153,7 +176,8 @@ print_md(const BlastHSP* hsp,
 
 void
 print_one_paf_result(const BlastHSP* hsp, 
-    const kstring_t* aligned_strings, 
+    const u8* query,
+    const u8* subject,
     const char* qname,
     const char* sname,
     const BOOL dump_cigar,
@@ -161,13 +185,13 @@ print_one_paf_result(const BlastHSP* hsp,
     kstring_t* out)
 {
     const char tab = '\t';
-    ksprintf(out, "%s", qname); /// 1) query name
+    kputs(qname, out); /// 1) query name
     kputc(tab, out);
-    ksprintf(out, "%zu", hsp->hbn_query.seq_size); /// 2) query length
+    rec_put_u64(hsp->hbn_query.seq_size, out); /// 2) query length
     kputc(tab, out);
-    ksprintf(out, "%zu", hsp->hbn_query.offset); /// 3) query start coordinate (0-based)
+    rec_put_u64(hsp->hbn_query.offset, out); /// 3) query start coordinate (0-based)
     kputc(tab, out);
-    ksprintf(out, "%zu", hsp->hbn_query.end); /// 4) query end coordinate (0-based)
+    rec_put_u64(hsp->hbn_query.end, out); /// 4) query end coordinate (0-based)
     kputc(tab, out);
     /// 5) '+' if query and subject on the same strand; '-' if opposite
     if (hsp->hbn_query.strand == hsp->hbn_subject.strand) {
@@ -176,47 +200,50 @@ print_one_paf_result(const BlastHSP* hsp,
         kputc('-', out);
     }
     kputc(tab, out);
-    ksprintf(out, "%s", sname); /// 6) subject name
+    kputs(sname, out); /// 6) subject name
     kputc(tab, out);
-    ksprintf(out, "%zu", hsp->hbn_subject.seq_size); /// 7) subject length
+    rec_put_u64(hsp->hbn_subject.seq_size, out); /// 7) subject length
     kputc(tab,out);
-    ksprintf(out, "%zu", hsp->hbn_subject.offset); /// 8) subject start coordinate
+    rec_put_u64(hsp->hbn_subject.offset, out); /// 8) subject start coordinate
     kputc(tab, out);
-    ksprintf(out, "%zu", hsp->hbn_subject.end); /// 9) subject end coordinate
+    rec_put_u64(hsp->hbn_subject.end, out); /// 9) subject end coordinate
     kputc(tab, out);
     
-    int num_ident = 0;
-    int aln_size = hsp->hsp_info.subject_align_offset - hsp->hsp_info.query_align_offset;
-    const char* q = ks_s(*aligned_strings) + hsp->hsp_info.subject_align_offset;
-    const char* s = ks_s(*aligned_strings) + hsp->hsp_info.query_align_offset;
-    for (int i = 0; i < aln_size; ++i) if (q[i] == s[i]) ++num_ident;
-    ksprintf(out, "%d", num_ident); /// 10) number of matching bases in the alignment
+    int aln_size = 0;
+    int num_ident = count_identities(hsp, query, subject, &aln_size);
+    rec_put_i64(num_ident, out); /// 10) number of matching bases in the alignment
     kputc(tab, out);
-    ksprintf(out, "%d", aln_size); /// 11) number of bases in the alignment (including gaps and mismatch bases)
+    rec_put_i64(aln_size, out); /// 11) number of bases in the alignment (including gaps and mismatch bases)
     kputc(tab, out);
-    ksprintf(out, "%d", 60); /// 12) mapq
+    kputsn("60", 2, out); /// 12) mapq
     kputc(tab, out);
-    ksprintf(out, "s1:i:%d", hsp->hsp_info.chain_score); /// chaining score
+    kputsn("s1:i:", 5, out); /// chaining score
+    rec_put_i64(hsp->hsp_info.chain_score, out);
     kputc(tab, out);
-    ksprintf(out, "NM:i:%d", aln_size - num_ident); /// gaps and mismatches in the alignment
+    kputsn("NM:i:", 5, out); /// gaps and mismatches in the alignment
+    rec_put_i64(aln_size - num_ident, out);
     kputc(tab, out);
-    ksprintf(out, "AS:i:%d", hsp->score); ///  dp score
+    kputsn("AS:i:", 5, out); ///  dp score
+    rec_put_i64(hsp->score, out);
     if (dump_cigar) {
         kputc(tab, out);
-        print_paf_cigar(hsp, aligned_strings, out);
+        print_paf_cigar(hsp, out);
     }
     if (dump_md) {
         kputc(tab, out);
-        print_md(hsp, aligned_strings, out);
+        print_md(hsp, query, subject, out);
     }
     kputc('\n', out);
 }
 
 void
 print_one_sam_result(const BlastHSP* hsp, 
-    const kstring_t* aligned_strings, 
+    const u8* query,
+    const u8* subject,
     const char* qname,
+    const size_t qname_size,
     const char* sname,
+    const size_t sname_size,
     const BOOL dump_md,
     const char* rg_sample,
     kstring_t* out)
@@ -224,76 +251,86 @@ print_one_sam_result(const BlastHSP* hsp,
     const char tab = '\t';
     int flag = 0;
     if (hsp->hbn_query.strand ==  REV) flag |= 0x10; // reverse query strand
-    ksprintf(out, "%s", qname); /// 1) query name
+    kputsn(qname, qname_size, out); /// 1) query name
     kputc(tab, out);
-    ksprintf(out, "%d", flag); /// 2) flag
+    rec_put_i64(flag, out); /// 2) flag
     kputc(tab, out);
-    ksprintf(out, "%s", sname); /// 3) subject name
+    kputsn(sname, sname_size, out); /// 3) subject name
     kputc(tab, out);
-    ksprintf(out, "%zu", hsp->hbn_subject.offset + 1); /// 4) left most subject position (1-based)
+    rec_put_u64(hsp->hbn_subject.offset + 1, out); /// 4) left most subject position (1-based)
     kputc(tab, out);
-    ksprintf(out, "%d", 60); /// 5) mapq
+    kputsn("60", 2, out); /// 5) mapq
     kputc(tab, out);
-    print_sam_cigar(hsp, aligned_strings, out); /// 6) cigar
+    print_sam_cigar(hsp, out); /// 6) cigar
     kputc(tab, out);
-    ksprintf(out, "*"); /// 7) rnext
+    kputc('*', out); /// 7) rnext
     kputc(tab, out);
-    ksprintf(out, "*"); /// 8) pnext
+    kputc('*', out); /// 8) pnext
     kputc(tab, out);
-    ksprintf(out, "%d", 0); /// 9) subject length
+    kputc('0', out); /// 9) subject length
     kputc(tab, out);
     /// 10) aligned subsequence
-    int num_ident = 0;
-    int aln_size = hsp->hsp_info.subject_align_offset - hsp->hsp_info.query_align_offset;
-    const char* q = ks_s(*aligned_strings) + hsp->hsp_info.subject_align_offset;
-    const char* s = ks_s(*aligned_strings) + hsp->hsp_info.query_align_offset;
-    for (int i = 0; i < aln_size; ++i) {
-        if (q[i] == s[i]) ++num_ident;
-        if (q[i] != GAP_CHAR) kputc(q[i], out);
-    }
+    const size_t subject_align_len = hsp->hbn_subject.end - hsp->hbn_subject.offset;
+    char* p = rec_reserve(subject_align_len, out);
+    for (size_t i = 0; i < subject_align_len; ++i) p[i] = BLASTNA_TO_IUPACNA[subject[i]];
+    rec_commit(p + subject_align_len, out);
+    int aln_size = 0;
+    int num_ident = count_identities(hsp, query, subject, &aln_size);
     kputc(tab, out);
-    ksprintf(out, "*"); /// 11) quality score
+    kputc('*', out); /// 11) quality score
     kputc(tab, out);
-    ksprintf(out, "s1:i:%d", hsp->hsp_info.chain_score); /// chaining score
+    kputsn("s1:i:", 5, out); /// chaining score
+    rec_put_i64(hsp->hsp_info.chain_score, out);
     kputc(tab, out);
-    ksprintf(out, "NM:i:%d", aln_size - num_ident); /// gaps and mismatches in the alignment
+    kputsn("NM:i:", 5, out); /// gaps and mismatches in the alignment
+    rec_put_i64(aln_size - num_ident, out);
     kputc(tab, out);
-    ksprintf(out, "AS:i:%d", hsp->score); ///  dp score
+    kputsn("AS:i:", 5, out); ///  dp score
+    rec_put_i64(hsp->score, out);
     if (dump_md) {
         kputc(tab, out);
-        print_md(hsp, aligned_strings, out);
+        print_md(hsp, query, subject, out);
     }
     if (rg_sample) {
         kputc(tab, out);
-        ksprintf(out, "RG:Z:%s", rg_sample);
+        kputsn("RG:Z:", 5, out);
+        kputs(rg_sample, out);
     }
     /// qs
     kputc(tab, out);
-    ksprintf(out, "qs:i:%d", hsp->query.offset);
+    kputsn("qs:i:", 5, out);
+    rec_put_i64(hsp->query.offset, out);
     /// qe
     kputc(tab, out);
-    ksprintf(out, "qe:i:%d", hsp->query.end);
+    kputsn("qe:i:", 5, out);
+    rec_put_i64(hsp->query.end, out);
     // ql
     kputc(tab, out);
-    ksprintf(out, "ql:i:%zu", hsp->hbn_query.seq_size);
+    kputsn("ql:i:", 5, out);
+    rec_put_u64(hsp->hbn_query.seq_size, out);
     /// identity
     kputc(tab, out);
-    ksprintf(out, "mc:f:%g", hsp->hsp_info.perc_identity);
+    kputsn("mc:f:", 5, out);
+    rec_put_general(hsp->hsp_info.perc_identity, out);
     /// evalue
     kputc(tab, out);
-    ksprintf(out, "EV:f:%g", hsp->evalue);
+    kputsn("EV:f:", 5, out);
+    rec_put_general(hsp->evalue, out);
     /// bit score
     kputc(tab, out);
-    ksprintf(out, "BS:f:%g", hsp->bit_score);
+    kputsn("BS:f:", 5, out);
+    rec_put_general(hsp->bit_score, out);
     /// identity
     kputc(tab, out);
-    ksprintf(out, "PI:f:%g", hsp->hsp_info.perc_identity);
+    kputsn("PI:f:", 5, out);
+    rec_put_general(hsp->hsp_info.perc_identity, out);
     kputc('\n', out);
 }
 
 void
 print_one_m4_result(const BlastHSP* hsp, 
-    const kstring_t* aligned_strings, 
+    const u8* query,
+    const u8* subject,
     const char* qname,
     const char* sname,
     const BOOL dump_cigar,
@@ -308,11 +345,11 @@ print_one_m4_result(const BlastHSP* hsp,
         if (dump_cigar || dump_md) ks_pop_back(*line);
         if (dump_cigar) {
             kputc('\t', line);
-            print_paf_cigar(hsp, aligned_strings, line);
+            print_paf_cigar(hsp, line);
         }
         if (dump_md) {
             kputc('\t', line);
-            print_md(hsp, aligned_strings, line);
+            print_md(hsp, query, subject, line);
         }
         if (dump_cigar || dump_md) kputc('\n', line);
         kputsn(ks_s(*line), ks_size(*line), out);
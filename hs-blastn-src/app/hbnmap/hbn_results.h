@@ -12,8 +12,11 @@ extern "C" {
 
 extern const char* kSamVersion;
 
+/// query and subject are the residues aligned by hsp, the query on the
+/// strand of the alignment. nothing else is needed to print it
+
 void
-print_sam_prolog(FILE* out, 
+print_sam_prolog(kstring_t* out, 
     const char* sam_version, 
     const char* prog_version, 
     const char* rg_info,
@@ -23,7 +26,8 @@ print_sam_prolog(FILE* out,
 
 void
 print_one_paf_result(const BlastHSP* hsp, 
-    const kstring_t* aligned_strings, 
+    const u8* query,
+    const u8* subject,
     const char* qname,
     const char* sname,
     const BOOL dump_cigar,
@@ -32,16 +36,20 @@ print_one_paf_result(const BlastHSP* hsp,
 
 void
 print_one_sam_result(const BlastHSP* hsp, 
-    const kstring_t* aligned_strings, 
+    const u8* query,
+    const u8* subject,
     const char* qname,
+    const size_t qname_size,
     const char* sname,
+    const size_t sname_size,
     const BOOL dump_md,
     const char* rg_sample,
     kstring_t* out);
 
 void
 print_one_m4_result(const BlastHSP* hsp, 
-    const kstring_t* aligned_strings, 
+    const u8* query,
+    const u8* subject,
     const char* qname,
     const char* sname,
     const BOOL dump_cigar,
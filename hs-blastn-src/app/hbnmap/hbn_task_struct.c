@@ -2,7 +2,8 @@
 
 #include "hbn_job_control.h"
 
-const char* kBackupResultsDir = "backup_results";
+static BOOL
+finish_prefetch(HbnVolumePrefetch* prefetch, const int vol_index, CSeqDB** vol_pp, LookupTable** lktbl_pp);
 
 hbn_task_struct*
 hbn_task_struct_new(const HbnProgramOptions* opts)
@@ -11,7 +12,7 @@ hbn_task_struct_new(const HbnProgramOptions* opts)
 
     ht_struct->qi_vs_sj_out = NULL;
     ht_struct->out = NULL;
-    pthread_mutex_init(&ht_struct->out_lock , NULL);
+    ht_struct->out_writer = NULL;
 
     const int query_and_subject_are_the_same = strcmp(opts->query, opts->subject) == 0;
 
@@ -28,16 +29,24 @@ hbn_task_struct_new(const HbnProgramOptions* opts)
     HbnOptionsHandle_Update(ht_struct->opts, ht_struct->opts_handle);
     ht_struct->query_and_subject_are_the_same = query_and_subject_are_the_same;
     ht_struct->lktbl = NULL;
+    ht_struct->query_prefetch.vol_index = -1;
+    ht_struct->subject_prefetch.vol_index = -1;
     hbn_assert(ht_struct->opts->num_threads > 0);
     ht_struct->word_data_array = (WordFindData**)calloc(ht_struct->opts->num_threads, sizeof(WordFindData*));
     ht_struct->hit_extn_data_array = (HbnSubseqHitExtnData**)calloc(ht_struct->opts->num_threads, sizeof(HbnSubseqHitExtnData*));
+    ht_struct->search_setup_array = (HbnSearchSetup**)calloc(ht_struct->opts->num_threads, sizeof(HbnSearchSetup*));
     ht_struct->results_array = (HbnHSPResults**)calloc(ht_struct->opts->num_threads, sizeof(HbnHSPResults*));
     for (int i = 0; i < ht_struct->opts->num_threads; ++i) {
         ht_struct->results_array[i] = HbnHSPResultsNew(HBN_QUERY_CHUNK_SIZE);
         ht_struct->hit_extn_data_array[i] = HbnSubseqHitExtnDataNew(opts);
+        ht_struct->search_setup_array[i] = HbnSearchSetupNew(ht_struct->opts_handle);
     }
 
     hbn_fopen(ht_struct->out, ht_struct->opts->output, "w");
+    ht_struct->out_writer = HbnOutputWriterNew(ht_struct->out,
+                                ht_struct->opts->ordered_output,
+                                ht_struct->opts->compress_output,
+                                ht_struct->opts->num_threads);
 
     return ht_struct;
 }
@@ -45,11 +54,15 @@ hbn_task_struct_new(const HbnProgramOptions* opts)
 hbn_task_struct*
 hbn_task_struct_free(hbn_task_struct* ht_struct)
 {
+    if (ht_struct->out_writer) ht_struct->out_writer = HbnOutputWriterFree(ht_struct->out_writer);
     if (ht_struct->out) hbn_fclose(ht_struct->out);
     ht_struct->out = NULL;
 
     hbn_task_struct_destroy_query_vol_context(ht_struct);
     hbn_task_struct_destroy_subject_vol_context(ht_struct);
+    finish_prefetch(&ht_struct->query_prefetch, -1, NULL, NULL);
+    finish_prefetch(&ht_struct->subject_prefetch, -1, NULL, NULL);
+    if (ht_struct->query_stream) ht_struct->query_stream = CSeqDBStreamFree(ht_struct->query_stream);
 
     if (!ht_struct->opts->keep_db) {
         char cmd[HBN_MAX_PATH_LEN];
@@ -57,11 +70,14 @@ hbn_task_struct_free(hbn_task_struct* ht_struct)
         hbn_system(cmd);
     }
 
+    HbnSubseqHitExtnDataReportStats(ht_struct->hit_extn_data_array, ht_struct->opts->num_threads);
     for (int i = 0; i < ht_struct->opts->num_threads; ++i) {
         ht_struct->hit_extn_data_array[i] = HbnSubseqHitExtnDataFree(ht_struct->hit_extn_data_array[i]);
         ht_struct->results_array[i] = HbnHSPResultsFree(ht_struct->results_array[i]);
+        ht_struct->search_setup_array[i] = HbnSearchSetupFree(ht_struct->search_setup_array[i]);
     }
     free(ht_struct->hit_extn_data_array);
+    free(ht_struct->search_setup_array);
     free(ht_struct->results_array);
     free(ht_struct->word_data_array);
     HbnOptionsHandleFree(ht_struct->opts_handle);
@@ -74,8 +90,8 @@ hbn_task_struct_destroy_query_vol_context(hbn_task_struct* ht_struct)
 {
     if (ht_struct->query_vol) {
         hbn_assert(ht_struct->query_vol_index >= 0);
-        hbn_assert(ht_struct->qi_vs_sj_out);
-        hbn_fclose(ht_struct->qi_vs_sj_out);
+        hbn_assert(ht_struct->qi_vs_sj_out || ht_struct->query_stream);
+        if (ht_struct->qi_vs_sj_out) hbn_fclose(ht_struct->qi_vs_sj_out);
         CSeqDBFree(ht_struct->query_vol);
     }
     ht_struct->query_vol = NULL;
@@ -83,17 +99,278 @@ hbn_task_struct_destroy_query_vol_context(hbn_task_struct* ht_struct)
     ht_struct->qi_vs_sj_out = NULL;
 }
 
+/// volume prefetching
+
+static size_t
+seqdb_vol_mem(const CSeqDBInfo* dbinfo, const size_t residue_bytes)
+{
+    return residue_bytes
+           +
+           (dbinfo->hdr_offset_to - dbinfo->hdr_offset_from)
+           +
+           sizeof(CAmbigSubseq) * (dbinfo->ambig_offset_to - dbinfo->ambig_offset_from)
+           +
+           sizeof(CSeqInfo) * dbinfo->num_seqs;
+}
+
+static size_t
+estimate_query_vol_mem(const HbnProgramOptions* opts, const char* db_title, const int vol_index)
+{
+    CSeqDBInfo dbinfo = seqdb_load_volume_info(opts->db_dir, db_title, vol_index + 1);
+    /// query volumes are memory mapped
+    return seqdb_vol_mem(&dbinfo, (dbinfo.seq_offset_to - dbinfo.seq_offset_from + 3) >> 2);
+}
+
+static size_t
+estimate_subject_vol_mem(const HbnProgramOptions* opts, const char* db_title, const int vol_index)
+{
+    CSeqDBInfo dbinfo = seqdb_load_volume_info(opts->db_dir, db_title, vol_index + 1);
+    const size_t num_residues = dbinfo.seq_offset_to - dbinfo.seq_offset_from;
+    size_t mem = seqdb_vol_mem(&dbinfo, opts->mmap_db ? ((num_residues + 3) >> 2) : num_residues);
+
+    char lktbl_path[HBN_MAX_PATH_LEN];
+    make_lookup_table_path(opts->db_dir, db_title, vol_index, num_residues, opts->kmer_size, opts->kmer_window,
+        opts->kmer_sampling, opts->max_kmer_occ, opts->lktbl_type, lktbl_path);
+    struct stat file_stat;
+    if (stat(lktbl_path, &file_stat) == 0) {
+        mem += file_stat.st_size;
+    } else {
+        mem += lookup_table_build_mem(num_residues, dbinfo.num_seqs, opts->kmer_size,
+                    opts->kmer_window, opts->kmer_sampling, opts->lktbl_type);
+    }
+    return mem;
+}
+
+static void
+touch_mapped_pages(const void* addr, const size_t size)
+{
+    const volatile u8* p = (const volatile u8*)(addr);
+    u8 x = 0;
+    for (size_t i = 0; i < size; i += 4096) x ^= p[i];
+    (void)x;
+}
+
+static void
+load_subject_vol(const HbnProgramOptions* opts,
+    const char* db_title,
+    const int vol_index,
+    const int num_threads,
+    CSeqDB** vol_pp,
+    LookupTable** lktbl_pp)
+{
+    CSeqDB* vol = NULL;
+    if (opts->mmap_db) {
+        vol = seqdb_load_mapped(opts->db_dir, db_title, vol_index);
+    } else {
+        vol = seqdb_load_unpacked_with_ambig_res(opts->db_dir, db_title, vol_index);
+    }
+    char lktbl_path[HBN_MAX_PATH_LEN];
+    make_lookup_table_path(opts->db_dir,
+        db_title,
+        vol_index,
+        seqdb_max_offset(vol),
+        opts->kmer_size,
+        opts->kmer_window,
+        opts->kmer_sampling,
+        opts->max_kmer_occ,
+        opts->lktbl_type,
+        lktbl_path);
+    LookupTable* lktbl = load_lookup_table(lktbl_path,
+                            opts->db_dir,
+                            db_title,
+                            vol,
+                            opts->kmer_size,
+                            opts->kmer_window,
+                            opts->kmer_sampling,
+                            opts->max_kmer_occ,
+                            opts->lktbl_type,
+                            opts->verify_lktbl);
+    if (!lktbl) {
+        lktbl = build_lookup_table(vol,
+                    opts->kmer_size,
+                    opts->kmer_window,
+                    opts->kmer_sampling,
+                    opts->max_kmer_occ,
+                    opts->lktbl_type,
+                    num_threads);
+        /// the lookup table only outlives this run if the database is kept
+        if (opts->keep_db) {
+            save_lookup_table(lktbl,
+                lktbl_path,
+                opts->db_dir,
+                db_title,
+                vol,
+                opts->kmer_window,
+                opts->kmer_sampling,
+                opts->max_kmer_occ);
+        }
+    }
+    *vol_pp = vol;
+    *lktbl_pp = lktbl;
+}
+
+static void*
+prefetch_vol_thread(void* params)
+{
+    HbnVolumePrefetch* prefetch = (HbnVolumePrefetch*)(params);
+    if (prefetch->stream) {
+        prefetch->vol = CSeqDBStreamReadVolume(prefetch->stream);
+    } else if (prefetch->is_subject) {
+        /// the search threads are still running, so the background build only gets -prefetch_threads
+        const int num_threads = hbn_min(prefetch->opts->prefetch_threads, prefetch->opts->num_threads);
+        load_subject_vol(prefetch->opts, prefetch->db_title, prefetch->vol_index, num_threads,
+            &prefetch->vol, &prefetch->lktbl);
+    } else {
+        prefetch->vol = seqdb_load_mapped(prefetch->opts->db_dir, prefetch->db_title, prefetch->vol_index);
+        touch_mapped_pages(prefetch->vol->packed_seq,
+            (prefetch->vol->dbinfo.seq_offset_to - prefetch->vol->dbinfo.seq_offset_from + 3) >> 2);
+    }
+    return NULL;
+}
+
+static void
+start_prefetch(hbn_task_struct* ht_struct,
+    HbnVolumePrefetch* prefetch,
+    HbnVolumePrefetch* other,
+    const BOOL is_subject,
+    const char* db_title,
+    const int vol_index)
+{
+    const HbnProgramOptions* opts = ht_struct->opts;
+    if (!opts->prefetch_mem || prefetch->vol_index == vol_index) return;
+    if (prefetch->vol_index >= 0) return;
+
+    const char* what = is_subject ? "S" : "Q";
+    const size_t mem = is_subject ? estimate_subject_vol_mem(opts, db_title, vol_index) 
+                                  : estimate_query_vol_mem(opts, db_title, vol_index);
+    const size_t other_mem = (other->vol_index >= 0) ? other->mem : 0;
+    if (mem + other_mem > opts->prefetch_mem) {
+        HBN_LOG("Do not prefetch %s%s: needs %zu bytes, %zu of %zu bytes of the prefetch budget are free",
+            what, u64_to_fixed_width_string(vol_index, HBN_DIGIT_WIDTH), mem, 
+            opts->prefetch_mem - hbn_min(other_mem, opts->prefetch_mem), opts->prefetch_mem);
+        return;
+    }
+
+    HBN_LOG("Prefetch %s%s (%zu bytes) in the background", what, u64_to_fixed_width_string(vol_index, HBN_DIGIT_WIDTH), mem);
+    prefetch->opts = opts;
+    prefetch->is_subject = is_subject;
+    prefetch->db_title = db_title;
+    prefetch->vol_index = vol_index;
+    prefetch->mem = mem;
+    prefetch->stream = NULL;
+    prefetch->vol = NULL;
+    prefetch->lktbl = NULL;
+    pthread_create(&prefetch->job, NULL, prefetch_vol_thread, prefetch);
+}
+
+/// wait for the prefetch and hand over its volume if it is vol_index, free it otherwise
+static BOOL
+finish_prefetch(HbnVolumePrefetch* prefetch, const int vol_index, CSeqDB** vol_pp, LookupTable** lktbl_pp)
+{
+    if (prefetch->vol_index < 0) return FALSE;
+    pthread_join(prefetch->job, NULL);
+    const BOOL r = (prefetch->vol_index == vol_index);
+    if (r) {
+        *vol_pp = prefetch->vol;
+        if (lktbl_pp) *lktbl_pp = prefetch->lktbl;
+    } else {
+        if (prefetch->vol) CSeqDBFree(prefetch->vol);
+        if (prefetch->lktbl) destroy_lookup_table(prefetch->lktbl);
+    }
+    prefetch->vol_index = -1;
+    prefetch->vol = NULL;
+    prefetch->lktbl = NULL;
+    return r;
+}
+
+void
+hbn_task_struct_prefetch_query_vol(hbn_task_struct* ht_struct, int query_vol_index)
+{
+    start_prefetch(ht_struct, &ht_struct->query_prefetch, &ht_struct->subject_prefetch,
+        FALSE, ht_struct->query_db_title, query_vol_index);
+}
+
+void
+hbn_task_struct_prefetch_subject_vol(hbn_task_struct* ht_struct, int subject_vol_index)
+{
+    start_prefetch(ht_struct, &ht_struct->subject_prefetch, &ht_struct->query_prefetch,
+        TRUE, ht_struct->subject_db_title, subject_vol_index);
+}
+
 void
 hbn_task_struct_build_query_vol_context(hbn_task_struct* ht_struct, int query_vol_index)
 {
     hbn_task_struct_destroy_query_vol_context(ht_struct);
-    ht_struct->query_vol = seqdb_load(ht_struct->opts->db_dir, ht_struct->query_db_title, query_vol_index);
+    if (!finish_prefetch(&ht_struct->query_prefetch, query_vol_index, &ht_struct->query_vol, NULL)) {
+        ht_struct->query_vol = seqdb_load_mapped(ht_struct->opts->db_dir, ht_struct->query_db_title, query_vol_index);
+    }
     ht_struct->query_vol_index = query_vol_index;
     hbn_assert(ht_struct->subject_vol);
     hbn_assert(ht_struct->subject_vol_index >= 0);
     ht_struct->qi_vs_sj_out = open_qi_vs_sj_results_file(ht_struct->opts->db_dir, kBackupResultsDir, query_vol_index, ht_struct->subject_vol_index, "w");
 }
 
+/// query stream
+
+void
+hbn_task_struct_open_query_stream(hbn_task_struct* ht_struct)
+{
+    const HbnProgramOptions* opts = ht_struct->opts;
+    hbn_task_struct_destroy_query_vol_context(ht_struct);
+    finish_prefetch(&ht_struct->query_prefetch, -1, NULL, NULL);
+    if (ht_struct->query_stream) CSeqDBStreamFree(ht_struct->query_stream);
+    ht_struct->query_stream = CSeqDBStreamNew(opts->query,
+                                opts->min_query_size,
+                                opts->max_query_vol_seqs,
+                                opts->max_query_vol_res);
+    ht_struct->query_stream_vol_index = 0;
+}
+
+static void
+start_query_stream_read(hbn_task_struct* ht_struct)
+{
+    HbnVolumePrefetch* prefetch = &ht_struct->query_prefetch;
+    hbn_assert(prefetch->vol_index < 0);
+    prefetch->opts = ht_struct->opts;
+    prefetch->is_subject = FALSE;
+    prefetch->db_title = NULL;
+    prefetch->vol_index = ht_struct->query_stream_vol_index++;
+    /// bounded by -max_query_vol_res, not by the prefetch budget
+    prefetch->mem = 0;
+    prefetch->stream = ht_struct->query_stream;
+    prefetch->vol = NULL;
+    prefetch->lktbl = NULL;
+    pthread_create(&prefetch->job, NULL, prefetch_vol_thread, prefetch);
+}
+
+BOOL
+hbn_task_struct_build_streamed_query_vol_context(hbn_task_struct* ht_struct)
+{
+    const HbnProgramOptions* opts = ht_struct->opts;
+    hbn_assert(ht_struct->query_stream);
+    hbn_assert(ht_struct->subject_vol);
+    hbn_assert(ht_struct->subject_vol_index >= 0);
+    hbn_task_struct_destroy_query_vol_context(ht_struct);
+    while (1) {
+        if (ht_struct->query_prefetch.vol_index < 0) start_query_stream_read(ht_struct);
+        const int vol_index = ht_struct->query_prefetch.vol_index;
+        CSeqDB* vol = NULL;
+        finish_prefetch(&ht_struct->query_prefetch, vol_index, &vol, NULL);
+        if (!vol) return FALSE;
+        /// read the next volume while this one is searched
+        if (opts->prefetch_mem) start_query_stream_read(ht_struct);
+        if (vol_index % opts->num_nodes != opts->node_id) {
+            CSeqDBFree(vol);
+            continue;
+        }
+        ht_struct->query_vol = vol;
+        ht_struct->query_vol_index = vol_index;
+        ht_struct->qi_vs_sj_out = NULL;
+        return TRUE;
+    }
+    return FALSE;
+}
+
 void
 hbn_task_struct_destroy_subject_vol_context(hbn_task_struct* ht_struct)
 {
@@ -117,18 +394,17 @@ hbn_task_struct_build_subject_vol_context(hbn_task_struct* ht_struct, int subjec
 {
     hbn_task_struct_destroy_subject_vol_context(ht_struct);
     ht_struct->subject_vol_index = subject_vol_index;
-    ht_struct->subject_vol = seqdb_load_unpacked_with_ambig_res(ht_struct->opts->db_dir, ht_struct->subject_db_title, subject_vol_index);
-    ht_struct->lktbl = build_lookup_table(ht_struct->subject_vol,
-                            ht_struct->opts->kmer_size,
-                            ht_struct->opts->kmer_window,
-                            ht_struct->opts->max_kmer_occ,
-                            ht_struct->opts->num_threads);
+    if (!finish_prefetch(&ht_struct->subject_prefetch, subject_vol_index, &ht_struct->subject_vol, &ht_struct->lktbl)) {
+        load_subject_vol(ht_struct->opts, ht_struct->subject_db_title, subject_vol_index, ht_struct->opts->num_threads,
+            &ht_struct->subject_vol, &ht_struct->lktbl);
+    }
     set_kmer_block_size_info(ht_struct->opts->block_size);
     for (int i = 0; i < ht_struct->opts->num_threads; ++i) {
         ht_struct->word_data_array[i] = WordFindDataNew(ht_struct->subject_vol, 
                                     ht_struct->lktbl, 
                                     ht_struct->opts->kmer_size, 
-                                    1, 
+                                    ht_struct->opts->kmer_window, 
+                                    ht_struct->opts->kmer_sampling, 
                                     ht_struct->opts->ddf_score, 
                                     ht_struct->query_and_subject_are_the_same);
     }
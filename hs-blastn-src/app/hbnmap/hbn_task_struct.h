@@ -4,6 +4,8 @@
 #include "cmdline_args.h"
 #include "hbn_extend_subseq_hit.h"
 #include "hbn_options_handle.h"
+#include "output_writer.h"
+#include "search_setup.h"
 #include "../../corelib/seqdb.h"
 #include "../../corelib/build_db.h"
 #include "../../algo/hbn_lookup_table.h"
@@ -21,12 +23,28 @@
 extern "C" {
 #endif
 
-extern const char* kBackupResultsDir;
+/// a query or subject volume loaded by a background thread
+/// while the current volume is searched
+typedef struct {
+    pthread_t           job;
+    const HbnProgramOptions* opts;
+    BOOL                is_subject;
+    const char*         db_title;
+    /// -1 if no volume is being prefetched
+    int                 vol_index;
+    /// estimated memory of the prefetched volume, counted against opts->prefetch_mem
+    size_t              mem;
+    /// if not NULL, the volume is the next one read from the query stream
+    CSeqDBStream*       stream;
+    CSeqDB*             vol;
+    LookupTable*        lktbl;
+} HbnVolumePrefetch;
 
 typedef struct {
     FILE*               qi_vs_sj_out;
     FILE*               out;
-    pthread_mutex_t     out_lock;
+    /// everything written to out goes through the writer
+    HbnOutputWriter*    out_writer;
 
     const char*         query_db_title;
     int                 query_vol_index;
@@ -43,7 +61,15 @@ typedef struct {
     LookupTable*        lktbl;
     WordFindData**      word_data_array;
     HbnSubseqHitExtnData** hit_extn_data_array;
+    HbnSearchSetup**    search_setup_array;
     HbnHSPResults**     results_array;
+
+    HbnVolumePrefetch   query_prefetch;
+    HbnVolumePrefetch   subject_prefetch;
+
+    /// query volumes of -stream_query
+    CSeqDBStream*       query_stream;
+    int                 query_stream_vol_index;
 } hbn_task_struct;
 
 hbn_task_struct*
@@ -64,6 +90,25 @@ hbn_task_struct_destroy_subject_vol_context(hbn_task_struct* ht_struct);
 void
 hbn_task_struct_build_subject_vol_context(hbn_task_struct* ht_struct, int subject_vol_index);
 
+/// start loading a volume in the background if it fits in opts->prefetch_mem.
+/// the next hbn_task_struct_build_*_vol_context() call waits for it and uses it
+/// if it is the volume asked for
+void
+hbn_task_struct_prefetch_query_vol(hbn_task_struct* ht_struct, int query_vol_index);
+
+void
+hbn_task_struct_prefetch_subject_vol(hbn_task_struct* ht_struct, int subject_vol_index);
+
+/// (re)start reading the query volumes from opts->query
+void
+hbn_task_struct_open_query_stream(hbn_task_struct* ht_struct);
+
+/// take the next query volume of this node from the query stream and start reading
+/// the one after it in the background. returns FALSE after the last volume.
+/// the results of streamed query volumes are not backed up
+BOOL
+hbn_task_struct_build_streamed_query_vol_context(hbn_task_struct* ht_struct);
+
 #ifdef __cplusplus
 }
 #endif
@@ -7,11 +7,78 @@
 #include "hbn_results.h"
 #include "../../corelib/hbn_package_version.h"
 
+/// the search job after (qvid, svid) in the order of the loops in main(),
+/// skipping the jobs whose results are already backed up
+static BOOL
+find_next_search_job(const HbnProgramOptions* opts,
+    const hbn_task_struct* task_struct,
+    const int num_query_vols,
+    const int num_subject_vols,
+    int svid,
+    int qvid,
+    int* next_svid,
+    int* next_qvid)
+{
+    qvid += opts->num_nodes;
+    while (svid < num_subject_vols) {
+        for (; qvid < num_query_vols; qvid += opts->num_nodes) {
+            if (!qi_vs_sj_is_mapped(opts->db_dir, kBackupResultsDir, qvid, svid)) {
+                *next_svid = svid;
+                *next_qvid = qvid;
+                return TRUE;
+            }
+        }
+        ++svid;
+        if (svid >= num_subject_vols) break;
+        qvid = (task_struct->query_and_subject_are_the_same ? svid : 0) + opts->node_id;
+        if (all_vs_sj_is_mapped(opts->db_dir, kBackupResultsDir, qvid, num_query_vols, svid, opts->node_id, opts->num_nodes)) {
+            qvid = num_query_vols;
+        }
+    }
+    return FALSE;
+}
+
+/// the streamed query volumes are only searched against a subject in one volume,
+/// so the query files are read once
+static void
+search_streamed_queries(hbn_task_struct* task_struct)
+{
+    char job_name[256];
+    const int svid = 0;
+    HBN_LOG("Searching against S%s", u64_to_fixed_width_string(svid, HBN_DIGIT_WIDTH));
+    hbn_task_struct_build_subject_vol_context(task_struct, svid);
+    hbn_task_struct_open_query_stream(task_struct);
+    while (hbn_task_struct_build_streamed_query_vol_context(task_struct)) {
+        char qibuf[64], sjbuf[64];
+        u64_to_fixed_width_string_r(task_struct->query_vol_index, qibuf, HBN_DIGIT_WIDTH);
+        u64_to_fixed_width_string_r(svid, sjbuf, HBN_DIGIT_WIDTH);
+        sprintf(job_name, "Q%s_vs_S%s", qibuf, sjbuf);
+        hbn_timing_begin(job_name);
+        hbn_align_one_volume(task_struct);
+        hbn_timing_end(job_name);
+    }
+}
+
 int main(int argc, char* argv[])
 {
     HbnProgramOptions* opts = (HbnProgramOptions*)calloc(1, sizeof(HbnProgramOptions));
     ParseHbnProgramCmdLineArguments(argc, argv, opts);
+    if (opts->stream_query && strcmp(opts->query, opts->subject) == 0) {
+        HBN_WARN("The query is the subject, it is not streamed");
+        opts->stream_query = FALSE;
+    }
     hbn_build_seqdb(opts, INIT_QUERY_DB_TITLE, INIT_SUBJECT_DB_TITLE);
+    if (opts->stream_query) {
+        /// every subject volume would read, decompress and parse the whole query input again
+        const int num_subject_vols = seqdb_load_num_volumes(opts->db_dir, INIT_SUBJECT_DB_TITLE);
+        if (num_subject_vols > 1) {
+            HBN_WARN("The subject is split into %d volumes, the query is not streamed. "
+                "Set -max_subject_vol_res above the subject size to stream the query", num_subject_vols);
+            opts->stream_query = FALSE;
+            /// the subject database is built already, this builds the query database
+            hbn_build_seqdb(opts, INIT_QUERY_DB_TITLE, INIT_SUBJECT_DB_TITLE);
+        }
+    }
 
     char path[HBN_MAX_PATH_LEN];
     sprintf(path, "%s/%s", opts->db_dir, kBackupResultsDir);
@@ -23,16 +90,27 @@ int main(int argc, char* argv[])
 
     hbn_task_struct* task_struct = hbn_task_struct_new(opts);
     if (opts->outfmt == eSAM) {
-        print_sam_prolog(task_struct->out, 
+        ks_dinit(prolog);
+        print_sam_prolog(&prolog, 
             kSamVersion, 
             HBN_PACKAGE_VERSION, 
             opts->rg_info,
             opts->rg_sample,
             argc, 
             argv);
+        HbnOutputWriterBeginBatch(task_struct->out_writer, NULL);
+        HbnOutputWriterSubmit(task_struct->out_writer, 0, 1, &prolog, NULL);
+        HbnOutputWriterEndBatch(task_struct->out_writer);
+        ks_destroy(prolog);
     }
-    const int num_query_vols = seqdb_load_num_volumes(opts->db_dir, task_struct->query_db_title);
     const int num_subject_vols = seqdb_load_num_volumes(opts->db_dir, task_struct->subject_db_title);
+    if (opts->stream_query) {
+        search_streamed_queries(task_struct);
+        task_struct = hbn_task_struct_free(task_struct);
+        free(opts);
+        return 0;
+    }
+    const int num_query_vols = seqdb_load_num_volumes(opts->db_dir, task_struct->query_db_title);
     const int query_vol_stride = opts->num_nodes;
     const int subject_vol_stride = 1;
     char job_name[256];
@@ -47,14 +125,18 @@ int main(int argc, char* argv[])
                 svid,
                 opts->node_id,
                 opts->num_nodes)) {
-            merge_all_vs_sj_results(opts->db_dir, kBackupResultsDir, qvid, num_query_vols, svid, opts->node_id, opts->num_nodes, opts, task_struct->out);
+            merge_all_vs_sj_results(opts->db_dir, kBackupResultsDir, qvid, num_query_vols, svid, opts->node_id, opts->num_nodes, opts, task_struct->out_writer);
             continue;
         }
         
         hbn_task_struct_build_subject_vol_context(task_struct, svid);
+        int next_svid = -1, next_qvid = -1;
+        if (find_next_search_job(opts, task_struct, num_query_vols, num_subject_vols, svid, num_query_vols, &next_svid, &next_qvid)) {
+            hbn_task_struct_prefetch_subject_vol(task_struct, next_svid);
+        }
         for (; qvid < num_query_vols; qvid += query_vol_stride) {
             if (qi_vs_sj_is_mapped(opts->db_dir, kBackupResultsDir, qvid, svid)) {
-                merge_qi_vs_sj_results(opts->db_dir, kBackupResultsDir, qvid, svid, task_struct->subject_vol, opts, task_struct->out);
+                merge_qi_vs_sj_results(opts->db_dir, kBackupResultsDir, qvid, svid, task_struct->subject_vol, opts, task_struct->out_writer);
                 continue;
             }
             char qibuf[64], sjbuf[64];
@@ -63,6 +145,9 @@ int main(int argc, char* argv[])
             sprintf(job_name, "Q%s_vs_S%s", qibuf, sjbuf);
             hbn_timing_begin(job_name);
             hbn_task_struct_build_query_vol_context(task_struct, qvid);
+            if (find_next_search_job(opts, task_struct, num_query_vols, num_subject_vols, svid, qvid, &next_svid, &next_qvid)) {
+                hbn_task_struct_prefetch_query_vol(task_struct, next_qvid);
+            }
             hbn_align_one_volume(task_struct);
             qi_vs_sj_make_mapped(opts->db_dir, kBackupResultsDir, qvid, svid);
             hbn_timing_end(job_name);
@@ -7,6 +7,7 @@ endif
 
 TARGET   := hs-blastn
 SOURCES  := \
+	align_file.c \
 	backup_results.c \
 	cmdline_args.cpp \
 	find_seeding_subseqs.cpp \
@@ -18,6 +19,8 @@ SOURCES  := \
 	hbn_task_struct.c \
 	main.c \
 	map_one_volume.c \
+	output_writer.c \
+	query_chunk_scheduler.c \
 	hbn_results.c \
 	search_setup.c \
 	subseq_hit.cpp \
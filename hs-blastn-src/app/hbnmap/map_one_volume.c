@@ -21,39 +21,89 @@
 #include "hbn_results.h"
 #include "tabular_format.h"
 #include "backup_results.h"
+#include "query_chunk_scheduler.h"
 
 #include <limits.h>
 #include <pthread.h>
+#include <sys/time.h>
+
+/// wall time a thread spends in each stage of align_one_query_block()
+typedef struct {
+    int num_chunks;
+    double setup_secs;
+    double seeding_secs;
+    double extension_secs;
+    double traceback_secs;
+    double output_secs;
+} SearchStageTimes;
 
 static int g_thread_id = -1;
 static pthread_mutex_t g_thread_id_lock;
-static int g_query_index = -1;
-static pthread_mutex_t g_query_index_lock;
+static QueryChunkScheduler* g_query_chunk_scheduler = NULL;
+static SearchStageTimes* g_stage_times = NULL;
 
 static void
-init_global_data()
+init_global_data(const CSeqDB* queries, const int num_threads, const BOOL in_order)
 {
     g_thread_id = 0;
     pthread_mutex_init(&g_thread_id_lock, NULL);
-    g_query_index = 0;
-    pthread_mutex_init(&g_query_index_lock, NULL);
+    g_query_chunk_scheduler = QueryChunkSchedulerNew(queries, num_threads, in_order);
+    g_stage_times = (SearchStageTimes*)calloc(num_threads, sizeof(SearchStageTimes));
+}
+
+static void
+report_stage_times(const int num_threads)
+{
+    SearchStageTimes total;
+    memset(&total, 0, sizeof(SearchStageTimes));
+    for (int t = 0; t < num_threads; ++t) {
+        SearchStageTimes* times = g_stage_times + t;
+        HBN_LOG("thread %d: %d chunks, setup %.2lf, seeding %.2lf, extension %.2lf, traceback %.2lf, output %.2lf secs",
+            t, times->num_chunks, times->setup_secs, times->seeding_secs,
+            times->extension_secs, times->traceback_secs, times->output_secs);
+        total.num_chunks += times->num_chunks;
+        total.setup_secs += times->setup_secs;
+        total.seeding_secs += times->seeding_secs;
+        total.extension_secs += times->extension_secs;
+        total.traceback_secs += times->traceback_secs;
+        total.output_secs += times->output_secs;
+    }
+    HBN_LOG("%d chunks, setup %.2lf, seeding %.2lf, extension %.2lf, traceback %.2lf, output %.2lf secs",
+        total.num_chunks, total.setup_secs, total.seeding_secs,
+        total.extension_secs, total.traceback_secs, total.output_secs);
+}
+
+static void
+destroy_global_data(const int num_threads)
+{
+    QueryChunkSchedulerReport(g_query_chunk_scheduler);
+    g_query_chunk_scheduler = QueryChunkSchedulerFree(g_query_chunk_scheduler);
+    report_stage_times(num_threads);
+    free(g_stage_times);
+    g_stage_times = NULL;
+}
+
+/// seconds since *last, which is moved to now
+static double
+stage_secs(struct timeval* last)
+{
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    const double secs = hbn_time_diff(last, &now);
+    *last = now;
+    return secs;
 }
 
 static int
 get_next_query_chunk(
     const text_t* queries, 
-    int* next_query_id,
-    pthread_mutex_t* query_id_lock,
+    QueryChunkScheduler* sched,
+    const int thread_id,
     BLAST_SequenceBlk* query_blk, 
     BlastQueryInfo* query_info)
 {
     int from = 0, to = 0;
-    pthread_mutex_lock(query_id_lock);
-    from = *next_query_id;
-    *next_query_id += HBN_QUERY_CHUNK_SIZE;
-    pthread_mutex_unlock(query_id_lock);
-    if (from >= queries->dbinfo.num_seqs) return 0;
-    to = hbn_min(from + HBN_QUERY_CHUNK_SIZE, queries->dbinfo.num_seqs);
+    if (!QueryChunkSchedulerNext(sched, thread_id, &from, &to)) return 0;
     int num_queries = to - from;
 
     int length = 0;
@@ -142,38 +192,21 @@ align_one_query_block(CSeqDB* query_vol,
     CSeqDB* subject_vol,
     WordFindData* word_data,
     HbnSubseqHitExtnData* extn_data,
+    HbnSearchSetup* setup,
     BLAST_SequenceBlk* query_blk,
     BlastQueryInfo* query_info,
     const HbnProgramOptions* opts,
-    const HbnOptionsHandle* opts_handle,
     HbnHSPResults* results,
-    FILE* out,
-    FILE* backup_out,
-    pthread_mutex_t* out_lock)
+    const int query_from,
+    HbnOutputWriter* out,
+    const BOOL backup,
+    SearchStageTimes* times)
 {
-    BlastScoreBlk* sbp = NULL;
-    BlastEffectiveLengthsParameters* eff_len_params = NULL;
-    BlastScoringParameters* score_params = NULL;
-    BlastExtensionParameters* ext_params = NULL;
-    BlastHitSavingParameters* hit_params = NULL;
-    BlastInitialWordParameters* word_params = NULL;
-    sbp = CSetupFactory__CreateScoreBlock(opts_handle, query_blk, query_info);
-    BlastScoreBlkCheck(sbp);
-    BLAST_GapAlignSetUp(eBlastTypeBlastn,
-        subject_vol,
-        opts_handle->m_ScoringOpts,
-        opts_handle->m_EffLenOpts,
-        opts_handle->m_ExtnOpts,
-        opts_handle->m_HitSaveOpts,
-        opts_handle->m_InitWordOpts,
-        query_info,
-        sbp,
-        &score_params,
-        &ext_params,
-        &hit_params,
-        &eff_len_params,
-        &word_params);
+    struct timeval last;
+    gettimeofday(&last, NULL);
+    HbnSearchSetupUpdate(setup, subject_vol, query_blk, query_info);
     HbnHSPResultsClear(results, query_info->num_queries);
+    times->setup_secs += stage_secs(&last);
 
     vec_int_pair* seeding_subseq_list = &word_data->seeding_subseqs;
     kv_dinit(vec_subseq_hit, fwd_subseq_hit_list);
@@ -220,6 +253,7 @@ align_one_query_block(CSeqDB* query_vol,
             &fwd_subseq_hit_list,
             &rev_subseq_hit_list,
             &subseq_hit_list);
+        times->seeding_secs += stage_secs(&last);
 
         hbn_extend_query_subseq_hit_list(kv_data(subseq_hit_list),
             kv_size(subseq_hit_list),
@@ -235,6 +269,7 @@ align_one_query_block(CSeqDB* query_vol,
             extn_data,
             results->hitlist_array + i,
             results);
+        times->extension_secs += stage_secs(&last);
         
         BlastHitList* hit_list = results->hitlist_array + i;
         for (int j = 0; j < hit_list->hsplist_count; ++j) {
@@ -243,29 +278,30 @@ align_one_query_block(CSeqDB* query_vol,
                 query_blk, 
                 query_info, 
                 subject_vol, 
-                sbp, 
-                score_params, 
-                ext_params->options, 
-                hit_params,
-                &results->aligned_strings);
+                setup->sbp, 
+                setup->score_params, 
+                setup->ext_params->options, 
+                setup->hit_params,
+                &results->aligned_subjects);
         }
+        times->traceback_secs += stage_secs(&last);
     }
 
-    dump_one_result_set(query_vol, subject_vol, results, opts, out, backup_out, out_lock);
+    format_one_result_set(query_vol, subject_vol, query_blk, query_info, results, opts, backup);
+    HbnOutputWriterSubmit(out,
+        query_from,
+        query_from + query_info->num_queries,
+        &results->output_buf,
+        &results->backup_buf);
+    times->output_secs += stage_secs(&last);
 
     kv_destroy(fwd_subseq_hit_list);
     kv_destroy(rev_subseq_hit_list);
     kv_destroy(subseq_hit_list);
     kv_destroy(subject_v);
-    sbp = BlastScoreBlkFree(sbp);
-    word_params = BlastInitialWordParametersFree(word_params);
-    hit_params = BlastHitSavingParametersFree(hit_params);
-    ext_params = BlastExtensionParametersFree(ext_params);
-    score_params = BlastScoringParametersFree(score_params);
-    eff_len_params = BlastEffectiveLengthsParametersFree(eff_len_params);
-
-    int gid = query_info->contexts[0].query_index;
-    if (gid && (gid % 1000 == 0)) HBN_LOG("%8d queries processed", gid);
+    HbnSearchSetupRelease(setup);
+    times->setup_secs += stage_secs(&last);
+    ++times->num_chunks;
 }
 
 static void*
@@ -282,29 +318,31 @@ hbn_align_worker(void* params)
     CSeqDB* subject_vol = ht_struct->subject_vol;
     WordFindData* word_data = ht_struct->word_data_array[thread_id];
     HbnSubseqHitExtnData* extn_data = ht_struct->hit_extn_data_array[thread_id];
+    HbnSearchSetup* setup = ht_struct->search_setup_array[thread_id];
     const HbnProgramOptions* opts = ht_struct->opts;
-    const HbnOptionsHandle* opts_handle = ht_struct->opts_handle;
     HbnHSPResults* results = ht_struct->results_array[thread_id];
     BLAST_SequenceBlk* query_blk = BLAST_SequenceBlkNew();
     BlastQueryInfo* query_info = BlastQueryInfoNew(HBN_QUERY_CHUNK_SIZE * 2);
 
     while (get_next_query_chunk(query_vol,
-                &g_query_index,
-                &g_query_index_lock,
+                g_query_chunk_scheduler,
+                thread_id,
                 query_blk,
                 query_info)) {
         align_one_query_block(query_vol,
             subject_vol,
             word_data,
             extn_data,
+            setup,
             query_blk,
             query_info,
             opts,
-            opts_handle,
             results,
-            ht_struct->out,
-            ht_struct->qi_vs_sj_out,
-            &ht_struct->out_lock);
+            query_info->contexts[0].query_index,
+            ht_struct->out_writer,
+            ht_struct->qi_vs_sj_out != NULL,
+            g_stage_times + thread_id);
+        QueryChunkSchedulerDone(g_query_chunk_scheduler, thread_id, query_info->num_queries);
     }
 
     BLAST_SequenceBlkFree(query_blk);
@@ -315,8 +353,10 @@ hbn_align_worker(void* params)
 void
 hbn_align_one_volume(hbn_task_struct* ht_struct)
 {
-    init_global_data();
     const int num_threads = ht_struct->opts->num_threads;
+    /// the ordered output holds back the chunks that are finished early, hand them out in order
+    init_global_data(ht_struct->query_vol, num_threads, ht_struct->opts->ordered_output);
+    HbnOutputWriterBeginBatch(ht_struct->out_writer, ht_struct->qi_vs_sj_out);
     pthread_t job_ids[num_threads];
     for (int i = 0; i < num_threads; ++i) {
         pthread_create(job_ids + i, NULL, hbn_align_worker, ht_struct);
@@ -324,4 +364,11 @@ hbn_align_one_volume(hbn_task_struct* ht_struct)
     for (int i = 0; i < num_threads; ++i) {
         pthread_join(job_ids[i], NULL);
     }
+    HbnOutputWriterEndBatch(ht_struct->out_writer);
+    destroy_global_data(num_threads);
+    HbnOutputWriterReportStats(ht_struct->out_writer);
+    for (int i = 0; i < num_threads; ++i) {
+        WordFindDataReportStats(ht_struct->word_data_array[i], i);
+        HbnSubseqHitExtnDataClearCache(ht_struct->hit_extn_data_array[i]);
+    }
 }
\ No newline at end of file
@@ -0,0 +1,262 @@
+#include "output_writer.h"
+
+#include <sys/time.h>
+
+/// write the whole blocks in buf and move the partial one to its front
+static void
+write_whole_blocks(kstring_t* buf, FILE* out)
+{
+    const size_t n = ks_size(*buf) / kOutputWriterBlockSize * kOutputWriterBlockSize;
+    if (!n) return;
+    hbn_fwrite(ks_s(*buf), 1, n, out);
+    memmove(ks_s(*buf), ks_s(*buf) + n, ks_size(*buf) - n);
+    ks_size(*buf) -= n;
+}
+
+static void
+write_all(kstring_t* buf, FILE* out)
+{
+    if (ks_empty(*buf)) return;
+    hbn_fwrite(ks_s(*buf), 1, ks_size(*buf), out);
+    ks_clear(*buf);
+}
+
+static void
+deflate_to_block(HbnOutputWriter* writer, const char* s, const size_t n, const int flush)
+{
+    z_stream* zstrm = &writer->zstrm;
+    zstrm->next_in = (Bytef*)(s);
+    zstrm->avail_in = n;
+    while (1) {
+        zstrm->next_out = (Bytef*)(ks_s(writer->block) + ks_size(writer->block));
+        zstrm->avail_out = kOutputWriterBlockSize - ks_size(writer->block);
+        int r = deflate(zstrm, flush);
+        if (r == Z_STREAM_ERROR) HBN_ERR("Fail to compress the results");
+        ks_size(writer->block) = kOutputWriterBlockSize - zstrm->avail_out;
+        if (zstrm->avail_out == 0) {
+            write_all(&writer->block, writer->out);
+            continue;
+        }
+        if (flush == Z_FINISH && r != Z_STREAM_END) continue;
+        break;
+    }
+    hbn_assert(zstrm->avail_in == 0);
+}
+
+static void
+write_slot(HbnOutputWriter* writer, HbnOutputSlot* slot)
+{
+    if (writer->compress) {
+        if (!ks_empty(slot->out)) deflate_to_block(writer, ks_s(slot->out), ks_size(slot->out), Z_NO_FLUSH);
+    } else if (!ks_empty(slot->out)) {
+        kputsn(ks_s(slot->out), ks_size(slot->out), &writer->block);
+        write_whole_blocks(&writer->block, writer->out);
+    }
+    if (writer->backup_out && !ks_empty(slot->backup)) {
+        HbnAlignFileIndexBlocks(ks_s(slot->backup), ks_size(slot->backup), writer->backup_size, &writer->backup_index);
+        writer->backup_size += ks_size(slot->backup);
+        kputsn(ks_s(slot->backup), ks_size(slot->backup), &writer->backup_block);
+        write_whole_blocks(&writer->backup_block, writer->backup_out);
+    }
+}
+
+/// the queued slot to write next, -1 if there is none
+static int
+find_next_slot(HbnOutputWriter* writer)
+{
+    int next = -1;
+    for (int i = 0; i < writer->num_slots; ++i) {
+        HbnOutputSlot* slot = writer->slot_array + i;
+        if (slot->state != kOutputSlotQueued) continue;
+        if (writer->ordered) {
+            if (slot->from == writer->next_from) return i;
+        } else if (next == -1 || slot->seq < writer->slot_array[next].seq) {
+            next = i;
+        }
+    }
+    return next;
+}
+
+static void*
+output_writer_thread(void* params)
+{
+    HbnOutputWriter* writer = (HbnOutputWriter*)(params);
+    pthread_mutex_lock(&writer->lock);
+    while (1) {
+        int i = find_next_slot(writer);
+        if (i == -1) {
+            if (writer->done) break;
+            pthread_cond_wait(&writer->slot_queued, &writer->lock);
+            continue;
+        }
+        HbnOutputSlot* slot = writer->slot_array + i;
+        slot->state = kOutputSlotWriting;
+        pthread_mutex_unlock(&writer->lock);
+
+        struct timeval begin, end;
+        gettimeofday(&begin, NULL);
+        write_slot(writer, slot);
+        ks_clear(slot->out);
+        ks_clear(slot->backup);
+        gettimeofday(&end, NULL);
+
+        pthread_mutex_lock(&writer->lock);
+        writer->write_secs += hbn_time_diff(&begin, &end);
+        writer->next_from = slot->to;
+        slot->state = kOutputSlotFree;
+        ++writer->num_free_slots;
+        pthread_cond_broadcast(&writer->slot_freed);
+    }
+    pthread_mutex_unlock(&writer->lock);
+    return NULL;
+}
+
+HbnOutputWriter*
+HbnOutputWriterNew(FILE* out, const BOOL ordered, const BOOL compress, const int num_threads)
+{
+    HbnOutputWriter* writer = (HbnOutputWriter*)calloc(1, sizeof(HbnOutputWriter));
+    writer->out = out;
+    writer->backup_out = NULL;
+    writer->ordered = ordered;
+    writer->compress = compress;
+    ks_init(writer->block);
+    ks_init(writer->backup_block);
+    kv_init(writer->backup_index);
+    if (compress) {
+        /// windowBits 15 + 16 writes a gzip header and trailer
+        if (deflateInit2(&writer->zstrm, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+            HBN_ERR("Fail to initialise the compression of the results");
+        }
+        writer->block.s = (char*)malloc(kOutputWriterBlockSize);
+        writer->block.m = kOutputWriterBlockSize;
+    }
+
+    /// one more slot for the chunk the ordered output waits for
+    writer->num_slots = num_threads * kOutputWriterSlotsPerThread + 1;
+    writer->slot_array = (HbnOutputSlot*)calloc(writer->num_slots, sizeof(HbnOutputSlot));
+    writer->num_free_slots = writer->num_slots;
+    pthread_mutex_init(&writer->lock, NULL);
+    pthread_cond_init(&writer->slot_queued, NULL);
+    pthread_cond_init(&writer->slot_freed, NULL);
+    pthread_create(&writer->job, NULL, output_writer_thread, writer);
+    return writer;
+}
+
+HbnOutputWriter*
+HbnOutputWriterFree(HbnOutputWriter* writer)
+{
+    HbnOutputWriterEndBatch(writer);
+    pthread_mutex_lock(&writer->lock);
+    writer->done = TRUE;
+    pthread_cond_signal(&writer->slot_queued);
+    pthread_mutex_unlock(&writer->lock);
+    pthread_join(writer->job, NULL);
+
+    if (writer->compress) {
+        deflate_to_block(writer, NULL, 0, Z_FINISH);
+        deflateEnd(&writer->zstrm);
+    }
+    write_all(&writer->block, writer->out);
+    fflush(writer->out);
+
+    for (int i = 0; i < writer->num_slots; ++i) {
+        ks_destroy(writer->slot_array[i].out);
+        ks_destroy(writer->slot_array[i].backup);
+    }
+    free(writer->slot_array);
+    ks_destroy(writer->block);
+    ks_destroy(writer->backup_block);
+    kv_destroy(writer->backup_index);
+    pthread_mutex_destroy(&writer->lock);
+    pthread_cond_destroy(&writer->slot_queued);
+    pthread_cond_destroy(&writer->slot_freed);
+    free(writer);
+    return NULL;
+}
+
+void
+HbnOutputWriterBeginBatch(HbnOutputWriter* writer, FILE* backup_out)
+{
+    pthread_mutex_lock(&writer->lock);
+    hbn_assert(writer->num_free_slots == writer->num_slots);
+    writer->backup_out = backup_out;
+    writer->next_from = 0;
+    pthread_mutex_unlock(&writer->lock);
+
+    if (backup_out) {
+        HbnAlignFileWriteHeader(backup_out);
+        writer->backup_size = kHbnAlignFileHeaderSize;
+        kv_clear(writer->backup_index);
+    }
+}
+
+void
+HbnOutputWriterEndBatch(HbnOutputWriter* writer)
+{
+    pthread_mutex_lock(&writer->lock);
+    while (writer->num_free_slots < writer->num_slots) pthread_cond_wait(&writer->slot_freed, &writer->lock);
+    pthread_mutex_unlock(&writer->lock);
+
+    /// the writer thread is idle until the next chunk is queued
+    if (writer->backup_out) {
+        write_all(&writer->backup_block, writer->backup_out);
+        HbnAlignFileWriteIndex(writer->backup_out, writer->backup_size, &writer->backup_index);
+        fflush(writer->backup_out);
+    }
+    writer->backup_out = NULL;
+}
+
+void
+HbnOutputWriterSubmit(HbnOutputWriter* writer,
+    const int from,
+    const int to,
+    kstring_t* out,
+    kstring_t* backup)
+{
+    struct timeval begin, end;
+    gettimeofday(&begin, NULL);
+    pthread_mutex_lock(&writer->lock);
+    /// the last free slot is kept for the chunk the ordered output waits for
+    while (writer->num_free_slots <= ((writer->ordered && from != writer->next_from) ? 1 : 0)) {
+        pthread_cond_wait(&writer->slot_freed, &writer->lock);
+    }
+    HbnOutputSlot* slot = writer->slot_array;
+    while (slot->state != kOutputSlotFree) ++slot;
+    --writer->num_free_slots;
+
+    kstring_t tmp = slot->out;
+    slot->out = *out;
+    *out = tmp;
+    if (backup) {
+        tmp = slot->backup;
+        slot->backup = *backup;
+        *backup = tmp;
+    }
+    slot->from = from;
+    slot->to = to;
+    slot->seq = writer->next_seq++;
+    slot->state = kOutputSlotQueued;
+
+    gettimeofday(&end, NULL);
+    ++writer->num_chunks;
+    writer->num_bytes += ks_size(slot->out);
+    writer->max_queued_chunks = hbn_max(writer->max_queued_chunks, writer->num_slots - writer->num_free_slots);
+    writer->wait_secs += hbn_time_diff(&begin, &end);
+    pthread_cond_signal(&writer->slot_queued);
+    pthread_mutex_unlock(&writer->lock);
+}
+
+void
+HbnOutputWriterReportStats(HbnOutputWriter* writer)
+{
+    pthread_mutex_lock(&writer->lock);
+    HBN_LOG("output writer: %d chunks, %zu bytes, at most %d of %d chunks queued, threads waited %.2lf secs, writer busy %.2lf secs",
+        writer->num_chunks, writer->num_bytes, writer->max_queued_chunks, writer->num_slots,
+        writer->wait_secs, writer->write_secs);
+    writer->num_chunks = 0;
+    writer->num_bytes = 0;
+    writer->max_queued_chunks = 0;
+    writer->wait_secs = 0.0;
+    writer->write_secs = 0.0;
+    pthread_mutex_unlock(&writer->lock);
+}
@@ -0,0 +1,118 @@
+#ifndef __OUTPUT_WRITER_H
+#define __OUTPUT_WRITER_H
+
+#include "../../corelib/hbn_aux.h"
+#include "../../corelib/kstring.h"
+#include "align_file.h"
+
+#include <pthread.h>
+#include <zlib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// the output is handed to fwrite() in blocks of this many bytes,
+/// a partial block is kept until it fills up or the writer is freed
+#define kOutputWriterBlockSize      (1<<22)
+/// formatted chunks that may wait for the writer, per search thread
+#define kOutputWriterSlotsPerThread 4
+
+#define kOutputSlotFree     0
+#define kOutputSlotQueued   1
+#define kOutputSlotWriting  2
+
+typedef struct {
+    int state;
+    /// the chunk holds the queries [from, to) of the volume
+    int from;
+    int to;
+    /// arrival order, chunks are written in this order if the output is not ordered
+    u64 seq;
+    kstring_t out;
+    kstring_t backup;
+} HbnOutputSlot;
+
+/// the formatted chunks of the search threads are queued here and written
+/// by one writer thread, so a search thread never waits for the disk.
+///
+/// a thread swaps its buffers with the empty buffers of a free slot, no
+/// bytes are copied. the queue is bounded: a thread waits while all slots
+/// are taken. if the output is ordered, the writer holds the chunks back
+/// until the chunk starting at the first unwritten query has arrived, and
+/// one slot is kept for that chunk so that the threads holding the later
+/// ones cannot starve it.
+typedef struct {
+    FILE* out;
+    /// the binary results of the current batch are backed up here if not NULL,
+    /// as an alignment file (align_file.h)
+    FILE* backup_out;
+    /// size of the backup file so far and the index of the records in it
+    u64 backup_size;
+    vec_align_file_index backup_index;
+    BOOL ordered;
+    BOOL compress;
+    z_stream zstrm;
+    /// output not written yet, the compressed output if compress
+    kstring_t block;
+    kstring_t backup_block;
+
+    pthread_t job;
+    pthread_mutex_t lock;
+    /// signaled when a chunk is queued or the writer is freed
+    pthread_cond_t slot_queued;
+    /// signaled when a chunk is written
+    pthread_cond_t slot_freed;
+    HbnOutputSlot* slot_array;
+    int num_slots;
+    int num_free_slots;
+    u64 next_seq;
+    /// first query of the next chunk to write if the output is ordered
+    int next_from;
+    BOOL done;
+
+    /// statistics since the last HbnOutputWriterReportStats()
+    int num_chunks;
+    size_t num_bytes;
+    int max_queued_chunks;
+    double wait_secs;
+    double write_secs;
+} HbnOutputWriter;
+
+HbnOutputWriter*
+HbnOutputWriterNew(FILE* out, const BOOL ordered, const BOOL compress, const int num_threads);
+
+/// write everything queued, finish the compressed stream and stop the writer thread.
+/// out is flushed but not closed
+HbnOutputWriter*
+HbnOutputWriterFree(HbnOutputWriter* writer);
+
+/// the chunks of a query volume make up a batch. if the output is ordered,
+/// the chunks of a batch must cover the queries [0, n) of the volume.
+/// the header of the backup file is written here, the backup of a chunk
+/// is a block of the alignment file
+void
+HbnOutputWriterBeginBatch(HbnOutputWriter* writer, FILE* backup_out);
+
+/// wait until every chunk of the batch is written, then finish the backup
+/// file with its index and flush it
+void
+HbnOutputWriterEndBatch(HbnOutputWriter* writer);
+
+/// queue the chunk of queries [from, to). the contents of out and backup,
+/// which may be NULL, are taken over, they are empty on return
+void
+HbnOutputWriterSubmit(HbnOutputWriter* writer,
+    const int from,
+    const int to,
+    kstring_t* out,
+    kstring_t* backup);
+
+void
+HbnOutputWriterReportStats(HbnOutputWriter* writer);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __OUTPUT_WRITER_H
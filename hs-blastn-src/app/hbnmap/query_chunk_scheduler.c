@@ -0,0 +1,178 @@
+#include "query_chunk_scheduler.h"
+
+#include "hbn_options.h"
+
+#define query_range_pack(head, tail) ((((u64)(tail)) << 32) | ((u64)(head)))
+#define query_range_head(range) ((int)((range) & UINT32_MAX))
+#define query_range_tail(range) ((int)((range) >> 32))
+
+QueryChunkScheduler*
+QueryChunkSchedulerNew(const CSeqDB* queries, const int num_threads, const BOOL in_order)
+{
+    QueryChunkScheduler* sched = (QueryChunkScheduler*)calloc(1, sizeof(QueryChunkScheduler));
+    sched->queries = queries;
+    sched->num_threads = num_threads;
+    sched->in_order = in_order;
+
+    const int num_queries = seqdb_num_seqs(queries);
+    sched->query_residue_starts = (size_t*)malloc(sizeof(size_t) * (num_queries + 1));
+    size_t num_residues = 0;
+    for (int i = 0; i < num_queries; ++i) {
+        sched->query_residue_starts[i] = num_residues;
+        num_residues += seqdb_seq_size(queries, i);
+    }
+    sched->query_residue_starts[num_queries] = num_residues;
+    sched->chunk_residues = num_residues / ((size_t)num_threads * kQueryChunksPerThread);
+    sched->chunk_residues = hbn_max(sched->chunk_residues, 1);
+    sched->chunk_residues = hbn_min(sched->chunk_residues, kMaxQueryChunkResidues);
+
+    if (posix_memalign((void**)&sched->ranges, 64, sizeof(QueryRange) * num_threads)) {
+        HBN_ERR("fail to allocate query ranges for %d threads", num_threads);
+    }
+    int head = 0;
+    for (int t = 0; t < num_threads; ++t) {
+        const size_t residue_to = num_residues * (t + 1) / num_threads;
+        int tail = head;
+        while (tail < num_queries && sched->query_residue_starts[tail] < residue_to) ++tail;
+        if (t == num_threads - 1) tail = num_queries;
+        if (in_order) tail = (t == 0) ? num_queries : head;
+        sched->ranges[t].range = query_range_pack(head, tail);
+        head = tail;
+    }
+
+    sched->stats = (QueryChunkThreadStats*)calloc(num_threads, sizeof(QueryChunkThreadStats));
+    gettimeofday(&sched->start_time, NULL);
+    for (int t = 0; t < num_threads; ++t) sched->stats[t].last_time = sched->start_time;
+    return sched;
+}
+
+QueryChunkScheduler*
+QueryChunkSchedulerFree(QueryChunkScheduler* sched)
+{
+    free(sched->query_residue_starts);
+    free(sched->ranges);
+    free(sched->stats);
+    free(sched);
+    return NULL;
+}
+
+static BOOL
+pop_query_chunk(QueryChunkScheduler* sched, const int range_id, int* from, int* to)
+{
+    QueryRange* qr = sched->ranges + range_id;
+    const size_t* residue_starts = sched->query_residue_starts;
+    u64 range = __atomic_load_n(&qr->range, __ATOMIC_ACQUIRE);
+    while (1) {
+        const int head = query_range_head(range);
+        const int tail = query_range_tail(range);
+        if (head >= tail) return FALSE;
+        int end = head + 1;
+        while (end < tail
+               &&
+               end - head < HBN_QUERY_CHUNK_SIZE
+               &&
+               residue_starts[end + 1] - residue_starts[head] <= sched->chunk_residues) ++end;
+        if (__atomic_compare_exchange_n(&qr->range, &range, query_range_pack(end, tail),
+                FALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            *from = head;
+            *to = end;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+static BOOL
+steal_query_range(QueryChunkScheduler* sched, const int thread_id)
+{
+    const size_t* residue_starts = sched->query_residue_starts;
+    while (1) {
+        int victim = -1;
+        size_t max_residues = 0;
+        u64 victim_range = 0;
+        for (int i = 1; i < sched->num_threads; ++i) {
+            const int t = (thread_id + i) % sched->num_threads;
+            u64 range = __atomic_load_n(&sched->ranges[t].range, __ATOMIC_ACQUIRE);
+            const int head = query_range_head(range);
+            const int tail = query_range_tail(range);
+            if (head >= tail) continue;
+            const size_t residues = residue_starts[tail] - residue_starts[head];
+            if (residues > max_residues) {
+                victim = t;
+                max_residues = residues;
+                victim_range = range;
+            }
+        }
+        if (victim == -1) return FALSE;
+
+        /// take [split, tail), at least one query and about half of the residues
+        const int head = query_range_head(victim_range);
+        const int tail = query_range_tail(victim_range);
+        const size_t residue_mid = residue_starts[head] + max_residues / 2;
+        int split = tail - 1;
+        while (split > head + 1 && residue_starts[split - 1] >= residue_mid) --split;
+        if (__atomic_compare_exchange_n(&sched->ranges[victim].range, &victim_range, query_range_pack(head, split),
+                FALSE, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+            /// our own range is empty, no one else writes to it
+            __atomic_store_n(&sched->ranges[thread_id].range, query_range_pack(split, tail), __ATOMIC_RELEASE);
+            ++sched->stats[thread_id].num_steals;
+            return TRUE;
+        }
+    }
+    return FALSE;
+}
+
+int
+QueryChunkSchedulerNext(QueryChunkScheduler* sched, const int thread_id, int* from, int* to)
+{
+    QueryChunkThreadStats* stats = sched->stats + thread_id;
+    struct timeval begin, end;
+    gettimeofday(&begin, NULL);
+    stats->busy_secs += hbn_time_diff(&stats->last_time, &begin);
+
+    BOOL r = FALSE;
+    if (sched->in_order) {
+        r = pop_query_chunk(sched, 0, from, to);
+    } else {
+        r = pop_query_chunk(sched, thread_id, from, to);
+        while (!r && steal_query_range(sched, thread_id)) r = pop_query_chunk(sched, thread_id, from, to);
+    }
+
+    gettimeofday(&end, NULL);
+    stats->idle_secs += hbn_time_diff(&begin, &end);
+    stats->last_time = end;
+    if (!r) return 0;
+    ++stats->num_chunks;
+    stats->num_queries += *to - *from;
+    stats->num_residues += sched->query_residue_starts[*to] - sched->query_residue_starts[*from];
+    return *to - *from;
+}
+
+void
+QueryChunkSchedulerDone(QueryChunkScheduler* sched, const int thread_id, const int num_queries)
+{
+    const int n = __atomic_add_fetch(&sched->num_processed_queries, num_queries, __ATOMIC_RELAXED);
+    if (n / 1000 > (n - num_queries) / 1000) HBN_LOG("%8d queries processed", n / 1000 * 1000);
+}
+
+void
+QueryChunkSchedulerReport(QueryChunkScheduler* sched)
+{
+    struct timeval finish_time = sched->start_time;
+    for (int t = 0; t < sched->num_threads; ++t) {
+        if (hbn_time_diff(&finish_time, &sched->stats[t].last_time) > 0.0) finish_time = sched->stats[t].last_time;
+    }
+    const double wall_secs = hbn_time_diff(&sched->start_time, &finish_time);
+    double busy_secs = 0.0;
+    HBN_LOG("query chunk size: %d queries or %zu residues", HBN_QUERY_CHUNK_SIZE, sched->chunk_residues);
+    for (int t = 0; t < sched->num_threads; ++t) {
+        QueryChunkThreadStats* stats = sched->stats + t;
+        /// waiting for the last thread to finish
+        const double idle_secs = stats->idle_secs + hbn_time_diff(&stats->last_time, &finish_time);
+        busy_secs += stats->busy_secs;
+        HBN_LOG("thread %d: %d chunks, %d queries, %zu residues, %d steals, busy %.2lf secs, idle %.2lf secs",
+            t, stats->num_chunks, stats->num_queries, stats->num_residues, stats->num_steals, stats->busy_secs, idle_secs);
+    }
+    double util = (wall_secs > 0.0) ? 100.0 * busy_secs / (wall_secs * sched->num_threads) : 100.0;
+    HBN_LOG("%d threads, %.2lf secs, %.2lf%% busy", sched->num_threads, wall_secs, util);
+}
@@ -0,0 +1,79 @@
+#ifndef __QUERY_CHUNK_SCHEDULER_H
+#define __QUERY_CHUNK_SCHEDULER_H
+
+#include "../../corelib/hbn_aux.h"
+#include "../../corelib/seqdb.h"
+
+#include <sys/time.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// chunks are closed at this many residues or HBN_QUERY_CHUNK_SIZE queries,
+/// whichever comes first, and hold at least one query
+#define kMaxQueryChunkResidues  1000000
+/// aim for this many chunks per thread so that the tail of a volume is fine grained
+#define kQueryChunksPerThread   16
+
+/// the queries of a volume are split into one contiguous range per thread,
+/// balanced by residues. a thread takes chunks from the head of its own range
+/// and, when it runs dry, steals the residue-weighted upper half of the
+/// largest remaining range. both ends of a range live in one word updated
+/// with compare-and-swap, so no lock is taken.
+///
+/// if the chunks are to be finished in query order, e.g. for the ordered
+/// output, all threads take them from the head of one shared range instead.
+typedef struct {
+    /// (tail << 32) | head
+    u64 range;
+    char pad[64 - sizeof(u64)];
+} QueryRange;
+
+typedef struct {
+    int num_chunks;
+    int num_queries;
+    size_t num_residues;
+    int num_steals;
+    double busy_secs;
+    double idle_secs;
+    struct timeval last_time;
+} QueryChunkThreadStats;
+
+typedef struct {
+    const CSeqDB* queries;
+    int num_threads;
+    BOOL in_order;
+    size_t chunk_residues;
+    /// residues of queries [0, i) are query_residue_starts[i]
+    size_t* query_residue_starts;
+    QueryRange* ranges;
+    QueryChunkThreadStats* stats;
+    int num_processed_queries;
+    struct timeval start_time;
+} QueryChunkScheduler;
+
+QueryChunkScheduler*
+QueryChunkSchedulerNew(const CSeqDB* queries, const int num_threads, const BOOL in_order);
+
+QueryChunkScheduler*
+QueryChunkSchedulerFree(QueryChunkScheduler* sched);
+
+/// next chunk [*from, *to) for thread_id, return the number of queries in it.
+/// time between two calls is accounted as busy, time spent in here as idle.
+int
+QueryChunkSchedulerNext(QueryChunkScheduler* sched, const int thread_id, int* from, int* to);
+
+/// record that thread_id has processed a chunk of num_queries queries
+void
+QueryChunkSchedulerDone(QueryChunkScheduler* sched, const int thread_id, const int num_queries);
+
+/// log per-thread busy/idle statistics, threads that finished early are idle until the last one finishes
+void
+QueryChunkSchedulerReport(QueryChunkScheduler* sched);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __QUERY_CHUNK_SCHEDULER_H
@@ -823,4 +823,227 @@ BLAST_GapAlignSetUp(EBlastProgramType program_number,
         *hit_params, NULL, sbp, query_info,
         avg_subject_length, word_params);
    return status;
-}
\ No newline at end of file
+}
+/// HbnSearchSetup
+
+#define kSearchSetupMaxContexts (HBN_QUERY_CHUNK_SIZE * 2)
+
+static void
+s_GetNuclScores(const BlastScoringOptions* scoring_options, Int4* reward, Int4* penalty)
+{
+    /* Zero reward and penalty ask for matrix only scoring, the statistics are
+       computed with the default blastn scores then, see BLAST_CalcEffLengths() */
+    if (scoring_options->reward == 0 && scoring_options->penalty == 0) {
+        *reward = BLAST_REWARD;
+        *penalty = BLAST_PENALTY;
+    } else {
+        *reward = scoring_options->reward;
+        *penalty = scoring_options->penalty;
+    }
+}
+
+/// the score block of BlastSetup_ScoreBlkInit() for every context of a chunk.
+/// the gapped Karlin block is read from the tables and shared by all contexts.
+/// the ungapped blocks are only a fallback of the tables, so the ideal block
+/// stands in for the query composition, as s_JumperScoreBlkFill() does
+static BlastScoreBlk*
+s_QueryIndependentScoreBlkNew(const BlastScoringOptions* scoring_options, const int num_contexts)
+{
+    BlastScoreBlk* sbp = BlastScoreBlkNew(BLASTNA_SEQ_CODE, num_contexts);
+    hbn_assert(sbp);
+    if (sbp->gbp) {
+        sfree(sbp->gbp);
+        sbp->gbp = NULL;
+    }
+    sbp->scale_factor = 1.0;
+    sbp->complexity_adjusted_scoring = scoring_options->complexity_adjusted_scoring;
+    Int2 status = Blast_ScoreBlkMatrixInit(eBlastTypeBlastn, scoring_options, sbp, NULL);
+    hbn_assert(status == 0);
+    status = Blast_ScoreBlkKbpIdealCalc(sbp);
+    hbn_assert(status == 0);
+
+    for (int context = 0; context < num_contexts; ++context) {
+        sbp->kbp_std[context] = Blast_KarlinBlkNew();
+        Blast_KarlinBlkCopy(sbp->kbp_std[context], sbp->kbp_ideal);
+    }
+    sbp->kbp = sbp->kbp_std;
+
+    Int4 reward, penalty;
+    s_GetNuclScores(scoring_options, &reward, &penalty);
+    Blast_KarlinBlk* kbp = sbp->kbp_gap_std[0] = Blast_KarlinBlkNew();
+    status = Blast_KarlinBlkNuclGappedCalc(kbp,
+                scoring_options->gap_open, scoring_options->gap_extend,
+                reward, penalty,
+                sbp->kbp_std[0], &(sbp->round_down), NULL);
+    hbn_assert(status == 0);
+    for (int context = 1; context < num_contexts; ++context) {
+        sbp->kbp_gap_std[context] = Blast_KarlinBlkNew();
+        Blast_KarlinBlkCopy(sbp->kbp_gap_std[context], kbp);
+    }
+    sbp->kbp_gap = sbp->kbp_gap_std;
+
+    return sbp;
+}
+
+HbnSearchSetup*
+HbnSearchSetupNew(const HbnOptionsHandle* opts_handle)
+{
+    HbnSearchSetup* setup = (HbnSearchSetup*)calloc(1, sizeof(HbnSearchSetup));
+    setup->opts_handle = opts_handle;
+    setup->last_query_length = -1;
+
+    const BlastScoringOptions* scoring_options = opts_handle->m_ScoringOpts;
+    Int4 reward, penalty;
+    s_GetNuclScores(scoring_options, &reward, &penalty);
+    setup->query_independent = scoring_options->gapped_calculation
+        &&
+        Blast_NuclGappedCostsAreTabulated(reward, penalty, scoring_options->gap_open, scoring_options->gap_extend);
+    if (!setup->query_independent) return setup;
+
+    setup->sbp = s_QueryIndependentScoreBlkNew(scoring_options, kSearchSetupMaxContexts);
+    Blast_GetNuclAlphaBeta(reward, penalty,
+        scoring_options->gap_open, scoring_options->gap_extend,
+        setup->sbp->kbp_ideal, scoring_options->gapped_calculation,
+        &setup->alpha, &setup->beta);
+
+    BlastQueryInfo* query_info = BlastQueryInfoNew(kSearchSetupMaxContexts);
+    query_info->first_context = 0;
+    query_info->last_context = kSearchSetupMaxContexts - 1;
+    query_info->num_queries = HBN_QUERY_CHUNK_SIZE;
+    for (int i = 0; i < kSearchSetupMaxContexts; ++i) query_info->contexts[i].is_valid = TRUE;
+    Int2 status = BlastScoringParametersNew(scoring_options, setup->sbp, &setup->score_params);
+    hbn_assert(status == 0);
+    status = BlastExtensionParametersNew(eBlastTypeBlastn, opts_handle->m_ExtnOpts, 
+                setup->sbp, query_info, &setup->ext_params);
+    hbn_assert(status == 0);
+    BlastQueryInfoFree(query_info);
+    BlastEffectiveLengthsParametersNew(opts_handle->m_EffLenOpts, 0, 0, &setup->eff_len_params);
+
+    return setup;
+}
+
+HbnSearchSetup*
+HbnSearchSetupFree(HbnSearchSetup* setup)
+{
+    HbnSearchSetupRelease(setup);
+    if (setup->query_independent) {
+        setup->sbp = BlastScoreBlkFree(setup->sbp);
+        setup->hit_params = BlastHitSavingParametersFree(setup->hit_params);
+        setup->ext_params = BlastExtensionParametersFree(setup->ext_params);
+        setup->score_params = BlastScoringParametersFree(setup->score_params);
+        setup->eff_len_params = BlastEffectiveLengthsParametersFree(setup->eff_len_params);
+    }
+    free(setup);
+    return NULL;
+}
+
+/// BLAST_CalcEffLengths() for blastn, with alpha, beta and the gapped Karlin block
+/// shared by all contexts
+static void
+s_CalcQueryIndependentEffLengths(HbnSearchSetup* setup, BlastQueryInfo* query_info)
+{
+    const BlastEffectiveLengthsParameters* eff_len_params = setup->eff_len_params;
+    const BlastEffectiveLengthsOptions* eff_len_options = eff_len_params->options;
+    const Blast_KarlinBlk* kbp = setup->sbp->kbp_gap_std[0];
+
+    Int8 db_length = (eff_len_options->db_length > 0) 
+                     ? eff_len_options->db_length : eff_len_params->real_db_length;
+    if (db_length == 0 &&
+        !BlastEffectiveLengthsOptions_IsSearchSpaceSet(eff_len_options)) {
+        return;
+    }
+    Int4 db_num_seqs = (eff_len_options->dbseq_num > 0) 
+                       ? eff_len_options->dbseq_num : eff_len_params->real_num_seqs;
+    if (db_length != setup->last_db_length || db_num_seqs != setup->last_db_num_seqs) {
+        setup->last_db_length = db_length;
+        setup->last_db_num_seqs = db_num_seqs;
+        setup->last_query_length = -1;
+    }
+
+    for (int index = query_info->first_context; index <= query_info->last_context; ++index) {
+        Int4 length_adjustment = 0;
+        Int4 query_length;
+        Int8 effective_search_space =
+            s_GetEffectiveSearchSpaceForContext(eff_len_options, index, NULL);
+
+        if (query_info->contexts[index].is_valid &&
+            ((query_length = query_info->contexts[index].query_length) > 0)) {
+            if (query_length != setup->last_query_length) {
+                BLAST_ComputeLengthAdjustment(kbp->K, kbp->logK,
+                                              setup->alpha/kbp->Lambda, setup->beta,
+                                              query_length, db_length,
+                                              db_num_seqs, &setup->last_length_adjustment);
+                setup->last_query_length = query_length;
+            }
+            length_adjustment = setup->last_length_adjustment;
+
+            if (effective_search_space == 0) {
+                Int8 effective_db_length = db_length - ((Int8)db_num_seqs * length_adjustment);
+                if (effective_db_length <= 0) effective_db_length = 1;
+                effective_search_space = effective_db_length * (query_length - length_adjustment);
+            }
+        }
+        query_info->contexts[index].eff_searchsp = effective_search_space;
+        query_info->contexts[index].length_adjustment = length_adjustment;
+    }
+}
+
+void
+HbnSearchSetupUpdate(HbnSearchSetup* setup,
+    const text_t* db,
+    BLAST_SequenceBlk* query_blk,
+    BlastQueryInfo* query_info)
+{
+    const HbnOptionsHandle* opts_handle = setup->opts_handle;
+    if (!setup->query_independent) {
+        BlastInitialWordParameters* word_params = NULL;
+        setup->sbp = CSetupFactory__CreateScoreBlock(opts_handle, query_blk, query_info);
+        BlastScoreBlkCheck(setup->sbp);
+        BLAST_GapAlignSetUp(eBlastTypeBlastn,
+            db,
+            opts_handle->m_ScoringOpts,
+            opts_handle->m_EffLenOpts,
+            opts_handle->m_ExtnOpts,
+            opts_handle->m_HitSaveOpts,
+            opts_handle->m_InitWordOpts,
+            query_info,
+            setup->sbp,
+            &setup->score_params,
+            &setup->ext_params,
+            &setup->hit_params,
+            &setup->eff_len_params,
+            &word_params);
+        BlastInitialWordParametersFree(word_params);
+        return;
+    }
+
+    hbn_assert(query_info->last_context < kSearchSetupMaxContexts);
+    Int8 total_length = seqdb_size(db);
+    Int4 num_seqs = seqdb_num_seqs(db);
+    Int8 avg_subject_length = total_length / num_seqs;
+    setup->eff_len_params->real_db_length = total_length;
+    setup->eff_len_params->real_num_seqs = num_seqs;
+    s_CalcQueryIndependentEffLengths(setup, query_info);
+
+    Int4 cbs = setup->ext_params->options->compositionBasedStats;
+    if (setup->hit_params_contexts < query_info->last_context + 1) {
+        setup->hit_params = BlastHitSavingParametersFree(setup->hit_params);
+        BlastHitSavingParametersNew(eBlastTypeBlastn, opts_handle->m_HitSaveOpts, setup->sbp, 
+            query_info, avg_subject_length, cbs, &setup->hit_params);
+        setup->hit_params_contexts = query_info->last_context + 1;
+    } else {
+        BlastHitSavingParametersUpdate(eBlastTypeBlastn, setup->sbp, query_info, 
+            avg_subject_length, cbs, setup->hit_params);
+    }
+}
+
+void
+HbnSearchSetupRelease(HbnSearchSetup* setup)
+{
+    if (setup->query_independent) return;
+    setup->sbp = BlastScoreBlkFree(setup->sbp);
+    setup->hit_params = BlastHitSavingParametersFree(setup->hit_params);
+    setup->ext_params = BlastExtensionParametersFree(setup->ext_params);
+    setup->score_params = BlastScoringParametersFree(setup->score_params);
+    setup->eff_len_params = BlastEffectiveLengthsParametersFree(setup->eff_len_params);
+}
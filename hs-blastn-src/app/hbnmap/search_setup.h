@@ -30,7 +30,52 @@ BLAST_GapAlignSetUp(EBlastProgramType program_number,
     BlastExtensionParameters** ext_params,
     BlastHitSavingParameters** hit_params,
     BlastEffectiveLengthsParameters** eff_len_params,
-    BlastInitialWordParameters** word_params);                                
+    BlastInitialWordParameters** word_params);
+
+/// the score block and search parameters of a thread, reused across query chunks.
+///
+/// when the gap costs are found in the tables, the gapped Karlin-Altschul
+/// parameters and alpha/beta do not depend on the query composition, so the score
+/// block is built once for HBN_QUERY_CHUNK_SIZE * 2 contexts and only the effective
+/// lengths and hit cutoffs are refreshed per chunk. otherwise the whole setup is
+/// rebuilt for every chunk as before.
+typedef struct {
+    const HbnOptionsHandle* opts_handle;
+    BOOL query_independent;
+    BlastScoreBlk* sbp;
+    BlastScoringParameters* score_params;
+    BlastExtensionParameters* ext_params;
+    BlastHitSavingParameters* hit_params;
+    BlastEffectiveLengthsParameters* eff_len_params;
+    /// number of contexts hit_params->cutoffs has room for
+    int hit_params_contexts;
+    double alpha;
+    double beta;
+    /// the length adjustment depends only on the query length once the
+    /// database is fixed, and both strands of a query, and often whole
+    /// chunks of reads, share it
+    Int4 last_query_length;
+    Int4 last_length_adjustment;
+    Int8 last_db_length;
+    Int4 last_db_num_seqs;
+} HbnSearchSetup;
+
+HbnSearchSetup*
+HbnSearchSetupNew(const HbnOptionsHandle* opts_handle);
+
+HbnSearchSetup*
+HbnSearchSetupFree(HbnSearchSetup* setup);
+
+/// set up the search of the chunk in query_blk and query_info against db
+void
+HbnSearchSetupUpdate(HbnSearchSetup* setup,
+    const text_t* db,
+    BLAST_SequenceBlk* query_blk,
+    BlastQueryInfo* query_info);
+
+/// release what was built for one chunk only
+void
+HbnSearchSetupRelease(HbnSearchSetup* setup);
 
 #ifdef __cplusplus
 }
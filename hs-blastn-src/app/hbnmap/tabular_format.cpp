@@ -1,6 +1,7 @@
 #include "tabular_format.h"
 
 #include "../../corelib/hbn_package_version.h"
+#include "../../corelib/record_builder.h"
 #include "../../ncbi_blast/cmdline_args/format_flags.hpp"
 #include "../../ncbi_blast/str_util/ncbistr.hpp"
 
@@ -13,91 +14,53 @@ BEGIN_SCOPE(align_format)
 
 using namespace std;
 
+/// what get_score_string() of the BLAST tabular formatter prints for the
+/// evalue, the very small ones are printed with NStr::DoubleToString(evalue, 2, fDoubleScientific)
 static void
-get_score_string(double evalue,
-    double bit_score,
-    double total_bit_score,
-    int raw_score,
-    string& evalue_str,
-    string& bit_score_str,
-    string& total_bit_score_str,
-    string& raw_score_str)
+put_evalue(const double evalue, kstring_t* out)
 {
-    char evalue_buf[100], bit_score_buf[100], total_bit_score_buf[100];
-
-    /* Facilitates comparing formatted output using diff */
-    static string kBitScoreFormat("%4.1lf");
-#ifdef CTOOLKIT_COMPATIBLE
-    static bool ctoolkit_compatible = false;
-    static bool value_set = false;
-    if ( !value_set ) {
-        if (getenv("CTOOLKIT_COMPATIBLE")) {
-            kBitScoreFormat.assign("%4.0lf");
-            ctoolkit_compatible = true;
-        }
-        value_set = true;
-    }
-#endif /* CTOOLKIT_COMPATIBLE */
-    
     if (evalue < 1.0e-180) {
-        snprintf(evalue_buf, sizeof(evalue_buf), "0.0");
-    } else if (evalue < 1.0e-99) {
-        snprintf(evalue_buf, sizeof(evalue_buf), "%2.0le", evalue);        
-#ifdef CTOOLKIT_COMPATIBLE
-        if (ctoolkit_compatible) {
-            strncpy(evalue_buf, evalue_buf+1, sizeof(evalue_buf-1));
-        }
-#endif /* CTOOLKIT_COMPATIBLE */
+        kputsn("0.0", 3, out);
     } else if (evalue < 0.0009) {
-        snprintf(evalue_buf, sizeof(evalue_buf), "%3.0le", evalue);
+        rec_put_exp(evalue, 2, 0, out);
     } else if (evalue < 0.1) {
-        snprintf(evalue_buf, sizeof(evalue_buf), "%4.3lf", evalue);
+        rec_put_fixed(evalue, 3, 4, out);
     } else if (evalue < 1.0) { 
-        snprintf(evalue_buf, sizeof(evalue_buf), "%3.2lf", evalue);
+        rec_put_fixed(evalue, 2, 3, out);
     } else if (evalue < 10.0) {
-        snprintf(evalue_buf, sizeof(evalue_buf), "%2.1lf", evalue);
+        rec_put_fixed(evalue, 1, 2, out);
     } else { 
-        snprintf(evalue_buf, sizeof(evalue_buf), "%2.0lf", evalue);
+        rec_put_fixed(evalue, 0, 2, out);
     }
-    
+}
+
+static void
+put_bit_score(const double bit_score, kstring_t* out)
+{
     if (bit_score > 99999){
-        snprintf(bit_score_buf, sizeof(bit_score_buf), "%5.3le", bit_score);
+        rec_put_exp(bit_score, 3, 5, out);
     } else if (bit_score > 99.9){
-        snprintf(bit_score_buf, sizeof(bit_score_buf), "%3.0ld",
-            (long)bit_score);
-    } else {
-        snprintf(bit_score_buf, sizeof(bit_score_buf), kBitScoreFormat.c_str(),
-            bit_score);
-    }
-    if (total_bit_score > 99999){
-        snprintf(total_bit_score_buf, sizeof(total_bit_score_buf), "%5.3le", 
-            total_bit_score);
-    } else if (total_bit_score > 99.9){
-        snprintf(total_bit_score_buf, sizeof(total_bit_score_buf), "%3.0ld",
-            (long)total_bit_score);
+        rec_put_i64_width((long)bit_score, 3, out);
     } else {
-        snprintf(total_bit_score_buf, sizeof(total_bit_score_buf), "%2.1lf",
-            total_bit_score);
+        rec_put_fixed(bit_score, 1, 4, out);
     }
-    evalue_str = evalue_buf;
-    bit_score_str = bit_score_buf;
-    total_bit_score_str = total_bit_score_buf;
-    if (raw_score <= 0)
-      raw_score = -1;
-    NStr::IntToString(raw_score_str, raw_score);
 }
 
 static void
-print_query_and_db_names(const char* query_name, const char* db_name, ostringstream& out)
+print_query_and_db_names(const char* query_name, const size_t query_name_size, const char* db_name, kstring_t* out)
 {
-    out << "# "
-        << HBN_PACKAGE_NAME
-        << ' '
-        << HBN_PACKAGE_VERSION
-        << '\n';
-    
-    out << "# Query: " << query_name << '\n';
-    out << "# Database: " << db_name << '\n';
+    kputsn("# ", 2, out);
+    kputs(HBN_PACKAGE_NAME, out);
+    kputc(' ', out);
+    kputs(HBN_PACKAGE_VERSION, out);
+    kputc('\n', out);
+
+    kputsn("# Query: ", 9, out);
+    kputsn(query_name, query_name_size, out);
+    kputc('\n', out);
+    kputsn("# Database: ", 12, out);
+    kputs(db_name, out);
+    kputc('\n', out);
 }
 
 void x_PrintFieldNames(ostringstream& m_Ostream, vector<ETabularField>& m_FieldsToShow)
@@ -229,19 +192,42 @@ void x_AddDefaultFieldsToShow(map<string, ETabularField>& m_FieldMap, vector<ETa
     }
 }
 
+/// the "# Fields:" line of the default fields, built on first use
+static const string&
+default_field_names()
+{
+    static const string field_names = []() {
+        map<string, ETabularField> field_map;
+        for (size_t i = 0; i < kNumTabularOutputFormatSpecifiers; i++) {
+            field_map.insert(make_pair(sc_FormatSpecifiers[i].name,
+                                        sc_FormatSpecifiers[i].field));
+        }
+        vector<ETabularField> default_fields;
+        x_AddDefaultFieldsToShow(field_map, default_fields);
+        ostringstream out;
+        x_PrintFieldNames(out, default_fields);
+        return out.str();
+    }();
+    return field_names;
+}
+
 void
 print_tabular_header(const char* query_name,
+    const size_t query_name_size,
     const char* db_name,
     BlastHitList* hit_list,
-    map<string, ETabularField>& m_FieldMap,
-    vector<ETabularField>& m_DefaultFieldsToShow,
-    ostringstream& out)
+    kstring_t* out)
 {
-    print_query_and_db_names(query_name, db_name, out);
+    print_query_and_db_names(query_name, query_name_size, db_name, out);
     int num_hits = 0;
     for (int i = 0; i < hit_list->hsplist_count; ++i) num_hits += hit_list->hsplist_array[i]->hspcnt;
-    if (num_hits) x_PrintFieldNames(out, m_DefaultFieldsToShow);
-    out << "# " << num_hits << " hits found" << '\n';
+    if (num_hits) {
+        const string& field_names = default_field_names();
+        kputsn(field_names.c_str(), field_names.size(), out);
+    }
+    kputsn("# ", 2, out);
+    rec_put_i64(num_hits, out);
+    kputsn(" hits found\n", 12, out);
 }
 
 static void
@@ -273,71 +259,69 @@ set_tabular_repoart_pos(const BlastHSP* hsp, int* qstart, int* qend, int* sstart
 static void
 print_tabular_report_for_one_hsp(const BlastHSP* hsp,
     const char* query_name,
+    const size_t query_name_size,
     const char* subject_name,
-    ostringstream& out)
+    const size_t subject_name_size,
+    kstring_t* out)
 {
     const char delim = '\t';
-    string evalue_str;
-    string bit_score_str;
-    string total_bit_score_str;
-    string raw_score_str;
-    get_score_string(hsp->evalue,
-        hsp->bit_score,
-        0,
-        hsp->score,
-        evalue_str,
-        bit_score_str,
-        total_bit_score_str,
-        raw_score_str);
-    if ((hsp->evalue >= 1.0e-180) && (hsp->evalue < 0.0009)){
-    	evalue_str = NStr::DoubleToString(hsp->evalue, 2, NStr::fDoubleScientific);
-    }
-
     int qs, qe, ss, se;
     set_tabular_repoart_pos(hsp, &qs, &qe, &ss, &se);
     
-    out << query_name << delim 
-        << subject_name << delim
-        << NStr::DoubleToString(hsp->hsp_info.perc_identity, 3) << delim
-        << hsp->hsp_info.align_len << delim
-        << hsp->hsp_info.align_len - hsp->hsp_info.num_ident << delim
-        << hsp->hsp_info.gap_opens << delim
-        << qs << delim
-        << qe << delim
-        << ss << delim
-        << se << delim
-        << evalue_str << delim
-        << bit_score_str << '\n';
+    kputsn(query_name, query_name_size, out);
+    kputc(delim, out);
+    kputsn(subject_name, subject_name_size, out);
+    kputc(delim, out);
+    rec_put_fixed(hsp->hsp_info.perc_identity, 3, 0, out);
+    kputc(delim, out);
+    rec_put_i64(hsp->hsp_info.align_len, out);
+    kputc(delim, out);
+    rec_put_i64(hsp->hsp_info.align_len - hsp->hsp_info.num_ident, out);
+    kputc(delim, out);
+    rec_put_i64(hsp->hsp_info.gap_opens, out);
+    kputc(delim, out);
+    rec_put_i64(qs, out);
+    kputc(delim, out);
+    rec_put_i64(qe, out);
+    kputc(delim, out);
+    rec_put_i64(ss, out);
+    kputc(delim, out);
+    rec_put_i64(se, out);
+    kputc(delim, out);
+    put_evalue(hsp->evalue, out);
+    kputc(delim, out);
+    put_bit_score(hsp->bit_score, out);
+    kputc('\n', out);
 }
 
 static void
 print_tabular_report_for_one_hitlist(const char* query_name,
+    const size_t query_name_size,
     const char* db_name,
     const CSeqDB* db,
     BlastHitList* hit_list,
     const EOutputFormat outfmt,
-    map<string, ETabularField>& m_FieldMap,
-    vector<ETabularField>& m_DefaultFieldsToShow,
-    ostringstream& out)
+    kstring_t* out)
 {
-    if (outfmt == eTabularWithComments) print_tabular_header(query_name, db_name, hit_list, m_FieldMap, m_DefaultFieldsToShow, out);
+    if (outfmt == eTabularWithComments) print_tabular_header(query_name, query_name_size, db_name, hit_list, out);
     for (int i = 0; i < hit_list->hsplist_count; ++i) {
         BlastHSPList* hsp_list = hit_list->hsplist_array[i];
         if (!hsp_list->hspcnt) continue;
         const int subject_id = hsp_list->hsp_array[0]->hbn_subject.oid;
         const char* subject_name = seqdb_seq_name(db, subject_id);
+        const size_t subject_name_size = seqdb_seq_name_size(db, subject_id);
         for (int j = 0; j < hsp_list->hspcnt; ++j) {
             //HBN_LOG("*** oid = %d, hspcnt = %d", hsp_list->oid, hsp_list->hspcnt);
             BlastHSP* hsp = hsp_list->hsp_array[j];
-            print_tabular_report_for_one_hsp(hsp, query_name, subject_name, out);
+            print_tabular_report_for_one_hsp(hsp, query_name, query_name_size, subject_name, subject_name_size, out);
         }
     }
 }
 
-static const char*
-extract_query_name(BlastHitList* hit_list, const CSeqDB* queries)
+static int
+extract_query_id(BlastHitList* hit_list)
 {
-    const char* query_name = NULL;
+    int query_id = -1;
     //HBN_LOG("hsplist: %d", hit_list->hsplist_count);
     for (int i = 0; i < hit_list->hsplist_count; ++i) {
         BlastHSPList* hsp_list = hit_list->hsplist_array[i];
@@ -345,40 +329,31 @@ extract_query_name(BlastHitList* hit_list, const CSeqDB* queries)
         for (int j = 0; j < hsp_list->hspcnt; ++j) {
             BlastHSP* hsp = hsp_list->hsp_array[j];
             if (!hsp) continue;
-            int oid = hsp->hbn_query.oid;
-            query_name = seqdb_seq_name(queries, oid);
+            query_id = hsp->hbn_query.oid;
             break;
         }
     }
-    return query_name;
+    return query_id;
 }
 
 extern "C"
 void
 print_tabular_reports(HbnHSPResults* results, const char* db_name, const CSeqDB* db, const CSeqDB* queries, const EOutputFormat outfmt)
 {
-    map<string, ETabularField> field_map;
-    for (size_t i = 0; i < kNumTabularOutputFormatSpecifiers; i++) {
-        field_map.insert(make_pair(sc_FormatSpecifiers[i].name,
-                                    sc_FormatSpecifiers[i].field));
-    }
-    vector<ETabularField> default_fields;
-    x_AddDefaultFieldsToShow(field_map, default_fields);
-    ostringstream out;
+    kstring_t* out = &results->output_buf;
+    ks_clear(*out);
     //HBN_LOG("number of queries: %d", results->num_queries);
     for (int i = 0; i < results->num_queries; ++i) {
         BlastHitList* hit_list = results->hitlist_array + i;
-        const char* query_name = extract_query_name(hit_list, queries);
-        if (!query_name) {
+        const int query_id = extract_query_id(hit_list);
+        if (query_id == -1) {
             //HBN_LOG("%d fail to find query name", query_name);
             continue;
         }
-        print_tabular_report_for_one_hitlist(query_name, db_name, db, hit_list, outfmt, field_map, default_fields, out);
+        print_tabular_report_for_one_hitlist(seqdb_seq_name(queries, query_id),
+            seqdb_seq_name_size(queries, query_id),
+            db_name, db, hit_list, outfmt, out);
     }
-    kstring_t* out_buf = &results->output_buf;
-    ks_clear(*out_buf);
-    string out_str = out.str();
-    kputsn(out_str.c_str(), out_str.size(), out_buf);
 }
 
 END_SCOPE(align_format)
@@ -258,59 +258,16 @@ s_HSPListPostTracebackUpdate(EBlastProgramType program_number,
 }
 
 void
-add_align_string(BlastHSP* hsp, const u8* query, const u8* subject, kstring_t* aligned_string)
+add_aligned_subject(BlastHSP* hsp, const u8* subject, kstring_t* aligned_subjects)
 {
-    const char BLASTNA_TO_IUPACNA[BLASTNA_SIZE] = {
-    'A', 'C', 'G', 'T', 'R', 'Y', 'M', 'K', 
-    'W', 'S', 'B', 'D', 'H', 'V', 'N', '-'
-    };
-    hsp->hsp_info.query_align_offset = ks_size(*aligned_string);
-    int qi = hsp->hbn_query.offset;
-    const u8* q = query + qi;
-    for (int i = 0; i < hsp->gap_info->size; ++i) {
-        EGapAlignOpType type = hsp->gap_info->op_type[i];
-        int num = hsp->gap_info->num[i];
-        if (type == eGapAlignSub || type == eGapAlignIns) {
-            for (int p = 0; p < num; ++p, ++q, ++qi) {
-                hbn_assert(qi < hsp->hbn_query.seq_size);
-                u8 c = *q;
-                hbn_assert(c >= 0 && c < BLASTNA_SIZE, 
-                    "i = %d, nop = %d, p = %d, num = %d, c = %d, qi = %d, qsize = %d, qid = %d",
-                    i, hsp->gap_info->size, p, num, c, qi, hsp->hbn_query.seq_size, hsp->hbn_query.oid);
-                int dc = BLASTNA_TO_IUPACNA[c];
-                kputc(dc, aligned_string);
-            }
-        } else if (type == eGapAlignDel) {
-            for (int p = 0; p < num; ++p) {
-                kputc(GAP_CHAR, aligned_string);
-            }
-        }
-    }
-    hbn_assert(qi == hsp->hbn_query.end);
-
-    hsp->hsp_info.subject_align_offset = ks_size(*aligned_string);
-    int si = hsp->hbn_subject.offset;
-    const u8* s = subject + si;
-    for (int i = 0; i < hsp->gap_info->size; ++i) {
-        EGapAlignOpType type = hsp->gap_info->op_type[i];
-        int num = hsp->gap_info->num[i];
-        if (type == eGapAlignSub || type == eGapAlignDel) {
-            for (int p = 0; p < num; ++p, ++s, ++si) {
-                u8 c = *s;
-                int dc = BLASTNA_TO_IUPACNA[c];
-                kputc(dc, aligned_string);
-            }
-        } else if (type == eGapAlignIns) {
-            for (int p = 0; p < num; ++p) {
-                kputc(GAP_CHAR, aligned_string);
-            }
-        }
-    }
-    hbn_assert(si == hsp->hbn_subject.end);
+    hsp->hsp_info.subject_align_offset = ks_size(*aligned_subjects);
+    kputsn((const char*)(subject + hsp->hbn_subject.offset),
+        hsp->hbn_subject.end - hsp->hbn_subject.offset,
+        aligned_subjects);
 }
 
 static void
-update_traceback_hsp_list_info(BlastHSPList* hsp_list, const BLAST_SequenceBlk* query_blk, const BlastQueryInfo* query_info, const u8* subject, Int4** matrix, kstring_t* aligned_string)
+update_traceback_hsp_list_info(BlastHSPList* hsp_list, const BLAST_SequenceBlk* query_blk, const BlastQueryInfo* query_info, const u8* subject, Int4** matrix, kstring_t* aligned_subjects)
 {
     for (int i = 0; i < hsp_list->hspcnt; ++i) {
         BlastHSP* hsp = hsp_list->hsp_array[i];
@@ -373,7 +330,7 @@ update_traceback_hsp_list_info(BlastHSPList* hsp_list, const BLAST_SequenceBlk*
         hsp->num_ident = num_ident;
         hsp->num_positives = num_positives;
         if (align_len > 0) hsp->hsp_info.perc_identity = 100.0 * num_ident / align_len;
-        add_align_string(hsp, query, subject, aligned_string);
+        add_aligned_subject(hsp, subject, aligned_subjects);
     }
 }
 
@@ -387,7 +344,7 @@ compute_traceback_from_hsplist(EBlastProgramType program_number,
     const BlastScoringParameters* score_params,
     const BlastExtensionOptions* ext_options,
     const BlastHitSavingParameters* hit_params,
-    kstring_t* aligned_string)
+    kstring_t* aligned_subjects)
 {
     if (!hsp_list->hspcnt) return 0;
     BlastHitSavingOptions* hit_options = hit_params->options;
@@ -396,9 +353,24 @@ compute_traceback_from_hsplist(EBlastProgramType program_number,
     BlastHSP** hsp_array = hsp_list->hsp_array;
     const int subject_id = hsp_array[0]->hbn_subject.oid;
     const int subject_length = seqdb_seq_size(subject_blk, subject_id);
-    const u8* subject = subject_blk->unpacked_seq + seqdb_seq_offset(subject_blk, subject_id);
     Int4 extra_start = Blast_HSPListPurgeHSPsWithCommonEndpoints(program_number, hsp_list, FALSE);
     extra_start = 0;
+    /// Blast_HSPReevaluateWithAmbiguitiesGapped() may extend an hsp with exact matches,
+    /// but never beyond the query ends. so only the subject window covering the hsps,
+    /// each widened by the query length on both sides, is needed
+    int window_from = subject_length, window_to = 0;
+    for (int index = extra_start; index < hsp_list->hspcnt; ++index) {
+        BlastHSP* hsp = hsp_array[index];
+        if (!hsp) continue;
+        const int query_length = query_info->contexts[hsp->context].query_length;
+        window_from = hbn_min(window_from, hsp->subject.offset - hsp->query.end);
+        window_to = hbn_max(window_to, hsp->subject.end + query_length - hsp->query.offset);
+    }
+    window_from = hbn_max(window_from, 0);
+    window_to = hbn_min(window_to, subject_length);
+    if (window_from > window_to) window_from = window_to = 0;
+    kv_dinit(vec_u8, subject_window);
+    const u8* subject = seqdb_subsequence_window(subject_blk, subject_id, window_from, window_to, &subject_window) - window_from;
     for (int index = extra_start; index < hsp_list->hspcnt; ++index) {
         Boolean delete_hsp = FALSE;
         BlastHSP* hsp = hsp_array[index];
@@ -415,6 +387,7 @@ compute_traceback_from_hsplist(EBlastProgramType program_number,
     Blast_HSPListSortByScore(hsp_list);
     purge_contained_hsps(hsp_list, hit_options->min_diag_separation);
     s_HSPListPostTracebackUpdate(program_number, hsp_list, query_info, score_params, hit_params, sbp, subject_length);
-    update_traceback_hsp_list_info(hsp_list, query_blk, query_info, subject, sbp->matrix->data, aligned_string);
+    update_traceback_hsp_list_info(hsp_list, query_blk, query_info, subject, sbp->matrix->data, aligned_subjects);
+    kv_destroy(subject_window);
     return 0;
 }
\ No newline at end of file
@@ -8,8 +8,10 @@
 extern "C" {
 #endif
 
+/// append the subject residues aligned by hsp to aligned_subjects and
+/// record where they start in hsp->hsp_info.subject_align_offset
 void
-add_align_string(BlastHSP* hsp, const u8* query, const u8* subject, kstring_t* aligned_string);
+add_aligned_subject(BlastHSP* hsp, const u8* subject, kstring_t* aligned_subjects);
 
 void
 purge_contained_hsps(BlastHSPList* hsp_list, const int min_diag_seperation);
@@ -24,7 +26,7 @@ compute_traceback_from_hsplist(EBlastProgramType program_number,
     const BlastScoringParameters* score_params,
     const BlastExtensionOptions* ext_options,
     const BlastHitSavingParameters* hit_params,
-    kstring_t* aligned_string);
+    kstring_t* aligned_subjects);
 
 #ifdef __cplusplus
 }
@@ -14,13 +14,16 @@ int main(int argc, char* argv[])
     HbnOptionsHandle_Update(opts, opts_handle);
     hbn_dfopen(out, opts->output, "w");
     if (opts->outfmt == eSAM) {
-        print_sam_prolog(out, 
+        ks_dinit(prolog);
+        print_sam_prolog(&prolog, 
             kSamVersion, 
             HBN_PACKAGE_VERSION, 
             opts->rg_info,
             opts->rg_sample,
             argc, 
             argv);
+        hbn_fwrite(ks_s(prolog), 1, ks_size(prolog), out);
+        ks_destroy(prolog);
     }
     const int num_query_vols = seqdb_load_num_volumes(opts->db_dir, INIT_QUERY_DB_TITLE);
     const int num_subject_vols = seqdb_load_num_volumes(opts->db_dir, INIT_SUBJECT_DB_TITLE);
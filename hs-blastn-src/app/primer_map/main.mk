@@ -14,10 +14,12 @@ SOURCES  := \
 		primer_map_chain_dp.c \
 		primer_map_hit_finder.c \
 		primer_map_one_volume.c \
+		../hbnmap/align_file.c \
 		../hbnmap/backup_results.c \
 		../hbnmap/hbn_build_seqdb.c \
 		../hbnmap/hbn_options_handle.c \
 		../hbnmap/hbn_results.c \
+		../hbnmap/output_writer.c \
 		../hbnmap/search_setup.c \
 		../hbnmap/tabular_format.cpp \
 		../hbnmap/traceback_stage.c
@@ -205,6 +205,7 @@ set_blasthsp(BlastGapAlignStruct* gap_align,
     const HbnProgramOptions* opts,
     int ddf_score,
     int chain_score,
+    HbnHSPResults* results,
     BlastHSP* hsp)
 {
     int score = 0;
@@ -280,7 +281,7 @@ set_blasthsp(BlastGapAlignStruct* gap_align,
     hsp->context = fwd_query_context + qdir;
     hsp->num_positives = num_ident;
 
-    hsp->gap_info = GapEditScriptNew(num_op);
+    hsp->gap_info = HbnHSPResultsGapEditScriptNew(results, num_op);
     int op_idx = 0;
     int gap_opens = 0;
     int gaps = 0;
@@ -437,6 +438,7 @@ qx_map_one_query_subject_hit_list(PrimerMapHitFindData* hit_finder,
     BlastQueryInfo* primer_info,
     HbnInitHit* hit_array,
     int hit_count,
+    HbnHSPResults* results,
     BlastHSPList* hsp_list)
 {
     BlastHSP hsp_array[g_opts->max_hsps_per_subject];
@@ -525,6 +527,7 @@ qx_map_one_query_subject_hit_list(PrimerMapHitFindData* hit_finder,
             g_opts,
             hit->score,
             hit->score,
+            results,
             hsp);
         //dump_blasthsp(fprintf, stderr, *hsp);
         if (hspcnt == g_opts->max_hsps_per_subject) break;
@@ -537,14 +540,7 @@ qx_map_one_query_subject_hit_list(PrimerMapHitFindData* hit_finder,
     ks_introsort_blasthsp_score_gt(hspcnt, hsp_array);
     hsp_list->oid = primer_index;
     hsp_list->hbn_best_raw_score = hsp_array[0].score;
-    hsp_list->hspcnt = hspcnt;
-    hsp_list->hsp_max = hspcnt;
-    hsp_list->hsp_array = (BlastHSP**)calloc(hspcnt, sizeof(BlastHSP*));
-    for (int i = 0; i < hspcnt; ++i) {
-        BlastHSP* hsp = Blast_HSPNew();
-        memcpy(hsp, hsp_array + i, sizeof(BlastHSP));
-        hsp_list->hsp_array[i] = hsp;
-    }
+    HbnHSPResultsSetHSPList(results, hsp_array, hspcnt, hsp_list);
     //exit(0);
 }
 
@@ -558,6 +554,7 @@ qx_map_one_query_hit_list(PrimerMapHitFindData* hit_finder,
     BlastQueryInfo* primer_info,    
     HbnInitHit* hit_array,
     int hit_count,
+    HbnHSPResults* results,
     BlastHitList* hit_list)
 {
     BlastHSPList hsplist_array[kPrimerBatchSize];
@@ -578,6 +575,7 @@ qx_map_one_query_hit_list(PrimerMapHitFindData* hit_finder,
             primer_info,
             hit_array + i,
             j - i,
+            results,
             &hsplist_array[hsplist_count]);
         if (hsplist_array[hsplist_count].hspcnt > 0) ++hsplist_count;
         hbn_assert(hsplist_count <= kPrimerBatchSize);
@@ -585,14 +583,7 @@ qx_map_one_query_hit_list(PrimerMapHitFindData* hit_finder,
     }
 
     if (!hsplist_count) return;
-    hit_list->hsplist_array = (BlastHSPList**)calloc(hsplist_count, sizeof(BlastHSPList*));
-    hit_list->hsplist_count = hsplist_count;
-    hit_list->hsplist_max = hsplist_count;
-    for (i = 0; i < hsplist_count; ++i) {
-        BlastHSPList* hsp_list = (BlastHSPList*)calloc(1, sizeof(BlastHSPList));
-        memcpy(hsp_list, hsplist_array + i, sizeof(BlastHSPList));
-        hit_list->hsplist_array[i] = hsp_list;
-    }
+    HbnHSPResultsSetHitList(results, hsplist_array, hsplist_count, hit_list);
 }
 
 static void
@@ -657,6 +648,7 @@ qx_map_one_batch(PrimerMapHitFindData* hit_finder,
             primer_info,
             hit_array + i,
             j - i,
+            results,
             hit_list);
         i = j;
 
@@ -671,13 +663,13 @@ qx_map_one_batch(PrimerMapHitFindData* hit_finder,
                 score_params, 
                 ext_params->options, 
                 hit_params,
-                &results->aligned_strings);
+                &results->aligned_subjects);
             //HBN_LOG("qid = %d, sid = %d, hspcnt = %d", 
             //    qid, hit_list->hsplist_array[j]->oid, hit_list->hsplist_array[j]->hspcnt);
         }
         //HBN_LOG("number of hsplist: %d", hit_list->hsplist_count);
     }
-    dump_one_result_set(g_query_volume, g_primer_volume, results, g_opts, g_out, NULL, &g_out_lock);
+    dump_one_result_set(g_query_volume, g_primer_volume, query_blk, query_info, results, g_opts, g_out, NULL, &g_out_lock);
 
     sbp = BlastScoreBlkFree(sbp);
     word_params = BlastInitialWordParametersFree(word_params);
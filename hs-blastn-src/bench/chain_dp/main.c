@@ -0,0 +1,165 @@
+#include "../../algo/chain_dp.h"
+
+#include <time.h>
+
+/// replays synthetic seed sets through chaining_find_candidates() and reports
+/// a digest of the init hits and chain seeds and the time per pass. the sets
+/// mimic the ones the hbnmap seeding stage passes for noisy long reads against
+/// a repetitive reference: 15-mers, a few dozen seeds per set with a long tail,
+/// most of them on one drifting diagonal and the rest on repeat copies.
+
+#define kFnvBasis   ((u64)0xcbf29ce484222325ULL)
+#define kFnvPrime   ((u64)0x100000001b3ULL)
+
+static u64 s_rand_state = 88172645463325252ULL;
+
+static u64
+bench_rand()
+{
+    s_rand_state ^= s_rand_state << 13;
+    s_rand_state ^= s_rand_state >> 7;
+    s_rand_state ^= s_rand_state << 17;
+    return s_rand_state;
+}
+
+static int
+bench_rand_int(const int n)
+{
+    return (int)(bench_rand() % (u64)n);
+}
+
+static int
+chain_seed_cmp(const void* a, const void* b)
+{
+    const ChainSeed* x = (const ChainSeed*)(a);
+    const ChainSeed* y = (const ChainSeed*)(b);
+    if (x->soff != y->soff) return (x->soff < y->soff) ? -1 : 1;
+    if (x->qoff != y->qoff) return (x->qoff < y->qoff) ? -1 : 1;
+    return 0;
+}
+
+/// one seed set, sorted by subject offset like the sets of the seeding stage
+static int
+make_seed_set(vec_chain_seed* seeds)
+{
+    /// median about 30 seeds, one set in a hundred has up to 8000
+    int n = 8 + bench_rand_int(40);
+    if (bench_rand_int(100) == 0) n = 100 + bench_rand_int(8000);
+    const int kmer_size = 15;
+    const idx s0 = bench_rand_int(4000000);
+    const int read_size = n * 12 + 1000;
+    const int num_repeats = 1 + bench_rand_int(4);
+    idx repeat_shift[4];
+    for (int r = 0; r < num_repeats; ++r) repeat_shift[r] = bench_rand_int(read_size) - read_size / 2;
+    ChainSeed seed = { kmer_size, 0, 0, FWD, 0 };
+    int drift = 0;
+    idx qoff = bench_rand_int(1000);
+    for (int i = 0; i < n; ++i) {
+        qoff += 1 + bench_rand_int(20);
+        drift += bench_rand_int(5) - 2;
+        seed.qoff = qoff;
+        seed.soff = s0 + qoff + drift;
+        const int kind = bench_rand_int(10);
+        if (kind >= 6) {
+            /// a copy of the kmer in a nearby repeat
+            seed.soff += repeat_shift[bench_rand_int(num_repeats)];
+        } else if (kind == 5) {
+            /// a random hit
+            seed.qoff = bench_rand_int(read_size);
+        }
+        if (seed.soff < 0) seed.soff = 0;
+        kv_push(ChainSeed, *seeds, seed);
+    }
+    qsort(kv_data(*seeds) + kv_size(*seeds) - n, n, sizeof(ChainSeed), chain_seed_cmp);
+    return n;
+}
+
+static u64
+fnv_u64(u64 h, const u64 x)
+{
+    h ^= x;
+    return h * kFnvPrime;
+}
+
+static double
+bench_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void
+print_usage(const char* prog)
+{
+    fprintf(stderr, "USAGE:\n");
+    fprintf(stderr, "  %s [-scalar] [num_sets [num_passes]]\n", prog);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "  -scalar      use the scalar predecessor scan on every cpu\n");
+    fprintf(stderr, "  num_sets     number of seed sets (default: 100000)\n");
+    fprintf(stderr, "  num_passes   number of passes over the sets (default: 3)\n");
+}
+
+int main(int argc, char* argv[])
+{
+    int argi = 1;
+    if (argi < argc && strcmp(argv[argi], "-scalar") == 0) {
+        chain_dp_use_scalar_kernel();
+        ++argi;
+    }
+    if (argi < argc && argv[argi][0] == '-') {
+        print_usage(argv[0]);
+        return 1;
+    }
+    const int num_sets = (argi < argc) ? atoi(argv[argi++]) : 100000;
+    const int num_passes = (argi < argc) ? atoi(argv[argi++]) : 3;
+    if (num_sets < 1 || num_passes < 1 || argi < argc) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    kv_dinit(vec_chain_seed, seeds);
+    kv_dinit(vec_int, set_sizes);
+    for (int i = 0; i < num_sets; ++i) kv_push(int, set_sizes, make_seed_set(&seeds));
+
+    ChainWorkData* data = ChainWorkDataNew(1, 20);
+    kv_dinit(vec_init_hit, hits);
+    kv_dinit(vec_chain_seed, chain_seeds);
+    u64 digest = kFnvBasis;
+    double secs = 0.0;
+    for (int pass = 0; pass < num_passes; ++pass) {
+        size_t offset = 0;
+        for (int i = 0; i < num_sets; ++i) {
+            const int n = kv_A(set_sizes, i);
+            kv_clear(hits);
+            kv_clear(chain_seeds);
+            const double t = bench_seconds();
+            chaining_find_candidates(data, kv_data(seeds) + offset, n, FALSE, FWD, &hits, &chain_seeds);
+            secs += bench_seconds() - t;
+            offset += n;
+            if (pass) continue;
+            for (size_t k = 0; k < kv_size(hits); ++k) {
+                const HbnInitHit* hit = kv_data(hits) + k;
+                digest = fnv_u64(digest, hit->qbeg);
+                digest = fnv_u64(digest, hit->qend);
+                digest = fnv_u64(digest, hit->sbeg);
+                digest = fnv_u64(digest, hit->send);
+                digest = fnv_u64(digest, hit->score);
+                digest = fnv_u64(digest, hit->chain_seed_count);
+            }
+            for (size_t k = 0; k < kv_size(chain_seeds); ++k) {
+                digest = fnv_u64(digest, kv_A(chain_seeds, k).qoff);
+                digest = fnv_u64(digest, kv_A(chain_seeds, k).soff);
+            }
+        }
+    }
+    printf("kernel %s, %d sets, %zu seeds, digest %016llx, %.3f s per pass\n",
+        chain_dp_kernel_name(), num_sets, kv_size(seeds), (unsigned long long)digest, secs / num_passes);
+
+    ChainWorkDataFree(data);
+    kv_destroy(hits);
+    kv_destroy(chain_seeds);
+    kv_destroy(seeds);
+    kv_destroy(set_sizes);
+    return 0;
+}
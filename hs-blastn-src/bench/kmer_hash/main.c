@@ -0,0 +1,120 @@
+#include "../../algo/kmer_hash.h"
+
+#include <time.h>
+
+/// times the kmer hashing kernel on each instruction set the cpu supports: the
+/// lookup table build path, kmer_hash_load_pac() + kmer_hash_extract() on the
+/// 2-bit pac, and the seeding path, kmer_hash_extract_from_residues() on
+/// unpacked residues. a random sequence is hashed in chunks of read size, once
+/// for every kmer (window 1) and once for every window_size-th kmer like the
+/// subject index. the digest of the hash values must agree across the kernels.
+
+static const char* kKernelNames[] = { "scalar", "sse4.2", "avx2" };
+
+static u64 s_rand_state = 88172645463325252ULL;
+
+static u64
+bench_rand()
+{
+    s_rand_state ^= s_rand_state << 13;
+    s_rand_state ^= s_rand_state >> 7;
+    s_rand_state ^= s_rand_state << 17;
+    return s_rand_state;
+}
+
+static double
+bench_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static u64
+digest_hashes(u64 h, const u64* hash_array, const size_t n)
+{
+    for (size_t i = 0; i < n; ++i) h = (h ^ hash_array[i]) * 0x100000001b3ULL;
+    return h;
+}
+
+static void
+print_usage(const char* prog)
+{
+    fprintf(stderr, "USAGE:\n");
+    fprintf(stderr, "  %s [mbp [kmer_size [window_size [chunk_size]]]]\n", prog);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "  mbp           sequence size in millions of residues (default: 50)\n");
+    fprintf(stderr, "  kmer_size     at most %d (default: 15)\n", kMaxKmerHashKmerSize);
+    fprintf(stderr, "  window_size   stride of the sampled kmers (default: 10)\n");
+    fprintf(stderr, "  chunk_size    residues hashed per call (default: 10000)\n");
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc > 5 || (argc > 1 && argv[1][0] == '-')) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    const size_t seq_size = (size_t)(((argc > 1) ? atof(argv[1]) : 50) * 1000000);
+    const int kmer_size = (argc > 2) ? atoi(argv[2]) : 15;
+    const int window_size = (argc > 3) ? atoi(argv[3]) : 10;
+    const size_t chunk_size = (argc > 4) ? (size_t)atol(argv[4]) : 10000;
+    if (seq_size < 1000 || kmer_size < 1 || kmer_size > kMaxKmerHashKmerSize || window_size < 1
+        || chunk_size < (size_t)kmer_size || chunk_size > seq_size) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    /// the pac holds four residues per byte, the first one in the two most significant bits
+    u8* seq = (u8*)malloc(seq_size);
+    u8* pac = (u8*)calloc((seq_size + 3) / 4, 1);
+    for (size_t i = 0; i < seq_size; ++i) {
+        seq[i] = bench_rand() & 3;
+        pac[i >> 2] |= seq[i] << ((3 - (i & 3)) << 1);
+    }
+    printf("%zu residues in chunks of %zu, kmer_size %d\n", seq_size, chunk_size, kmer_size);
+
+    /// kmer_hash_extract_from_residues() resizes words and hash_list to each chunk,
+    /// the pac path works in buffers of its own
+    u64* pac_words = (u64*)malloc(sizeof(u64) * kmer_hash_num_words(chunk_size));
+    u64* pac_hash_array = (u64*)malloc(sizeof(u64) * kmer_hash_num_kmers(chunk_size, kmer_size, 1));
+    kv_dinit(vec_u64, words);
+    kv_dinit(vec_u64, hash_list);
+    for (size_t k = 0; k < sizeof(kKernelNames) / sizeof(kKernelNames[0]); ++k) {
+        if (!kmer_hash_use_kernel(kKernelNames[k])) {
+            printf("%-7s not supported by this cpu\n", kKernelNames[k]);
+            continue;
+        }
+        for (int w = 0; w < 2; ++w) {
+            const int window = w ? window_size : 1;
+            if (w && window_size == 1) break;
+            u64 pac_digest = 0, res_digest = 0;
+            double t = bench_seconds();
+            for (size_t from = 0; from < seq_size; from += chunk_size) {
+                const size_t to = hbn_min(from + chunk_size, seq_size);
+                kmer_hash_load_pac(pac, from, to, pac_words);
+                const size_t n = kmer_hash_extract(pac_words, 0, to - from, kmer_size, window, pac_hash_array);
+                pac_digest = digest_hashes(pac_digest, pac_hash_array, n);
+            }
+            const double pac_secs = bench_seconds() - t;
+            t = bench_seconds();
+            for (size_t from = 0; from < seq_size; from += chunk_size) {
+                const size_t to = hbn_min(from + chunk_size, seq_size);
+                const size_t n = kmer_hash_extract_from_residues(seq + from, to - from, kmer_size, window, &words, &hash_list);
+                res_digest = digest_hashes(res_digest, kv_data(hash_list), n);
+            }
+            const double res_secs = bench_seconds() - t;
+            printf("%-7s window %2d: pac %7.1f Mbases/s, residues %7.1f Mbases/s, digest %016llx%s\n",
+                kmer_hash_kernel_name(), window, seq_size / pac_secs / 1e6, seq_size / res_secs / 1e6,
+                (unsigned long long)pac_digest, (pac_digest == res_digest) ? "" : " (residue digest differs)");
+        }
+    }
+
+    free(pac_words);
+    free(pac_hash_array);
+    kv_destroy(words);
+    kv_destroy(hash_list);
+    free(seq);
+    free(pac);
+    return 0;
+}
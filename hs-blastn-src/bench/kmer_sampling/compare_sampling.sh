@@ -0,0 +1,56 @@
+#!/bin/bash
+# Compares -kmer_sampling stride and minimizer on fixed data: 160 simulated
+# reads of 1-4 kbp, 80 with 5% and 80 with 12% substitution and indel errors,
+# against a 310 kbp reference carrying 3 kbp repeats. A read is recalled if one
+# of its hits overlaps the locus it was simulated from, which its name records
+# as r<id>_e<error>_<subject>_<from>_<to>_<strand>.
+#
+# Each mode first builds and saves its lookup table with -keep_db, then the
+# search is timed three more times with the saved table, so reads/s is the best
+# of those runs and leaves out the index build.
+#
+# usage: compare_sampling.sh [hs-blastn [kmer_window [num_threads]]]
+
+here=$(cd "$(dirname "$0")" && pwd)
+hbn=${1:-$here/../../../Linux-amd64/bin/hs-blastn}
+window=${2:-10}
+threads=${3:-1}
+data=$here/data
+reads=$data/sampling_reads.fa.gz
+ref=$data/sampling_ref.fa.gz
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+gzip -dc "$reads" | sed -n 's/^>//p' > "$work/names"
+num_reads=$(wc -l < "$work/names")
+for mode in stride minimizer; do
+    db=$work/db_$mode
+    args="-num_threads $threads -db_dir $db -keep_db -outfmt 6 -kmer_sampling $mode -kmer_window $window"
+    if ! "$hbn" $args "$reads" "$ref" > /dev/null 2> "$work/log"; then
+        cat "$work/log" >&2
+        echo "FAILED: $hbn $args" >&2
+        exit 1
+    fi
+    ns=0
+    for rep in 1 2 3; do
+        rm -rf "$db/backup_results"
+        t0=$(date +%s%N)
+        "$hbn" $args "$reads" "$ref" > "$work/$mode.tab6" 2> "$work/log" || exit 1
+        t1=$(date +%s%N)
+        if [ $ns -eq 0 ] || [ $((t1 - t0)) -lt $ns ]; then ns=$((t1 - t0)); fi
+    done
+    awk -v mode="$mode" -v window="$window" -v num_reads="$num_reads" -v ns=$ns '
+        FNR == NR { split($1, f, "_"); ++m[f[2]]; next }
+        {
+            split($1, f, "_")
+            s = ($9 < $10) ? $9 : $10
+            e = ($9 < $10) ? $10 : $9
+            if ($2 == f[3] && s <= f[5] && e >= f[4]) hit[$1] = f[2]
+        }
+        END {
+            for (r in hit) { ++n[hit[r]]; ++total }
+            printf("%-9s window %d: recall %d/%d (e5 %d/%d, e12 %d/%d), %.1f reads/s\n",
+                mode, window, total, num_reads, n["e5"], m["e5"], n["e12"], m["e12"],
+                num_reads / (ns / 1e9))
+        }' "$work/names" "$work/$mode.tab6"
+done
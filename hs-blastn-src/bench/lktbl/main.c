@@ -0,0 +1,103 @@
+#include "../../algo/hbn_lookup_table.h"
+
+#include <time.h>
+
+/// times extract_kmer_list() over one kmer set for the khash, direct and bucket
+/// lookup tables of a random volume. half of the kmers are taken from the
+/// volume, so they are mostly indexed, and the other half are random, so most of
+/// them miss, like the read kmers of the seeding stage.
+
+static u64 s_rand_state = 88172645463325252ULL;
+
+static u64
+bench_rand()
+{
+    s_rand_state ^= s_rand_state << 13;
+    s_rand_state ^= s_rand_state >> 7;
+    s_rand_state ^= s_rand_state << 17;
+    return s_rand_state;
+}
+
+static CSeqDB*
+make_random_volume(const size_t num_residues)
+{
+    CSeqDB* db = CSeqDBNew();
+    db->dbinfo.num_seqs = 1;
+    db->dbinfo.db_size = num_residues;
+    db->dbinfo.seq_offset_to = num_residues;
+    db->seq_info_list = (CSeqInfo*)calloc(1, sizeof(CSeqInfo));
+    db->seq_info_list[0].seq_size = num_residues;
+    db->unpacked_seq = (u8*)malloc(num_residues);
+    for (size_t i = 0; i < num_residues; ++i) db->unpacked_seq[i] = bench_rand() & 3;
+    return db;
+}
+
+static double
+bench_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void
+print_usage(const char* prog)
+{
+    fprintf(stderr, "USAGE:\n");
+    fprintf(stderr, "  %s [mbp [kmer_size [million_lookups [window_size]]]]\n", prog);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "  mbp               volume size in millions of residues (default: 50)\n");
+    fprintf(stderr, "  kmer_size         the direct table is skipped above %d (default: 12)\n", kMaxDirectLktblKmerSize);
+    fprintf(stderr, "  million_lookups   number of kmers looked up (default: 20)\n");
+    fprintf(stderr, "  window_size       subject kmer stride (default: 10)\n");
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc > 5 || (argc > 1 && argv[1][0] == '-')) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    const size_t num_residues = (size_t)((argc > 1) ? atof(argv[1]) : 50) * 1000000;
+    const int kmer_size = (argc > 2) ? atoi(argv[2]) : 12;
+    const int num_lookups = (int)(((argc > 3) ? atof(argv[3]) : 20) * 1000000);
+    const int window_size = (argc > 4) ? atoi(argv[4]) : 10;
+    if (num_residues < 1000 || kmer_size < 8 || kmer_size > 32 || num_lookups < 1 || window_size < 1) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    CSeqDB* db = make_random_volume(num_residues);
+    const u64 kmer_mask = (kmer_size == 32) ? U64_MAX : ((U64_ONE << (kmer_size * 2)) - 1);
+    u64* kmers = (u64*)malloc(sizeof(u64) * num_lookups);
+    for (int i = 0; i < num_lookups; ++i) {
+        if (i & 1) {
+            kmers[i] = bench_rand() & kmer_mask;
+            continue;
+        }
+        const u8* s = db->unpacked_seq + bench_rand() % (num_residues - kmer_size);
+        u64 h = 0;
+        for (int j = 0; j < kmer_size; ++j) h = (h << 2) | s[j];
+        kmers[i] = h;
+    }
+
+    for (int t = eLktblHash; t < eLktblEndValue; ++t) {
+        const EHbnLookupTableType type = (EHbnLookupTableType)(t);
+        if (type == eLktblDirect && kmer_size > kMaxDirectLktblKmerSize) continue;
+        LookupTable* lktbl = build_lookup_table(db, kmer_size, window_size, eKmerSampleStride, 1000, type, 1);
+        const double t0 = bench_seconds();
+        u64 num_offsets = 0, n;
+        for (int i = 0; i < num_lookups; ++i) {
+            extract_kmer_list(lktbl, kmers[i], &n);
+            num_offsets += n;
+        }
+        const double secs = bench_seconds() - t0;
+        printf("%-6s k = %d, %.1f M lookups/s, %zu offsets\n",
+            EHbnLookupTableTypeToName(type), kmer_size, num_lookups / secs / 1e6, (size_t)num_offsets);
+        lktbl = destroy_lookup_table(lktbl);
+    }
+
+    free(kmers);
+    db = CSeqDBFree(db);
+    return 0;
+}
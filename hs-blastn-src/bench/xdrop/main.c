@@ -0,0 +1,295 @@
+#include "../../algo/dalign.h"
+#include "../../algo/edlib_wrapper.h"
+#include "../../algo/xdrop_extend.h"
+
+#include <time.h>
+
+/// times the overhang extension of hbn_traceback(): xdrop_extend() against the
+/// dalign_align() + edlib_nw() path it replaced, which is copied below. the
+/// overhangs are simulated noisy long read ends behind an exact anchor of
+/// kMatLen residues: substitutions, insertions and deletions at the given error
+/// rate, and for one overhang in three the read turns into unrelated sequence
+/// part way, like an adapter or a chimeric junction. even overhangs are right
+/// extensions, odd ones left extensions, which the old path had to reverse first.
+
+#define kMatLen         8
+#define kMaxOverHang    1000
+
+static u64 s_rand_state = 88172645463325252ULL;
+
+static u64
+bench_rand()
+{
+    s_rand_state ^= s_rand_state << 13;
+    s_rand_state ^= s_rand_state >> 7;
+    s_rand_state ^= s_rand_state << 17;
+    return s_rand_state;
+}
+
+static int
+bench_rand_int(const int n)
+{
+    return (int)(bench_rand() % (u64)n);
+}
+
+typedef struct {
+    /// right extensions start at query[0] and subject[0], left ones at
+    /// query[query_length-1] and subject[subject_length-1]
+    size_t query_offset;
+    int query_length;
+    size_t subject_offset;
+    int subject_length;
+    int right;
+} Overhang;
+
+typedef kvec_t(Overhang) vec_overhang;
+
+static void
+make_overhang(const int max_overhang, const int error_percent, vec_u8* queries, vec_u8* subjects, vec_overhang* overhangs)
+{
+    Overhang o;
+    o.query_offset = kv_size(*queries);
+    o.subject_offset = kv_size(*subjects);
+    o.right = (kv_size(*overhangs) % 2) == 0;
+    const int n = kMatLen + 1 + bench_rand_int(max_overhang);
+    for (int i = 0; i < n; ++i) kv_push(u8, *subjects, bench_rand_int(4));
+    const u8* s = kv_data(*subjects) + o.subject_offset;
+    const int diverge = (bench_rand_int(3) == 0) ? kMatLen + bench_rand_int(n - kMatLen) : n;
+    for (int i = 0; i < kMatLen; ++i) kv_push(u8, *queries, s[i]);
+    for (int i = kMatLen; i < n; ++i) {
+        if (i >= diverge) {
+            kv_push(u8, *queries, bench_rand_int(4));
+            continue;
+        }
+        if (bench_rand_int(100) >= error_percent) {
+            kv_push(u8, *queries, s[i]);
+            continue;
+        }
+        const int e = bench_rand_int(4);
+        if (e == 0) {
+            /// insertion
+            kv_push(u8, *queries, bench_rand_int(4));
+            kv_push(u8, *queries, s[i]);
+        } else if (e == 1) {
+            /// deletion
+        } else {
+            kv_push(u8, *queries, (s[i] + 1 + bench_rand_int(3)) & 3);
+        }
+    }
+    o.query_length = kv_size(*queries) - o.query_offset;
+    o.subject_length = n;
+    if (!o.right) {
+        u8* q = kv_data(*queries) + o.query_offset;
+        for (int x = 0, y = o.query_length - 1; x < y; ++x, --y) { u8 t = q[x]; q[x] = q[y]; q[y] = t; }
+        u8* t = kv_data(*subjects) + o.subject_offset;
+        for (int x = 0, y = o.subject_length - 1; x < y; ++x, --y) { u8 c = t[x]; t[x] = t[y]; t[y] = c; }
+    }
+    kv_push(Overhang, *overhangs, o);
+}
+
+/// the old path: dalign_align() finds the end of the overhang, then
+/// edlib_nw() aligns the same region again for the traceback
+static int
+overhang_extend(DalignData* dalign,
+    EdlibAlignData* edlib,
+    const u8* query,
+    const int query_length,
+    const u8* subject,
+    const int subject_length,
+    kstring_t* qaln,
+    kstring_t* saln)
+{
+    int qoff, qend, soff, send;
+    double ident_perc;
+    int r = dalign_align(dalign,
+                query,
+                0,
+                query_length,
+                subject,
+                0,
+                subject_length,
+                1,
+                0.65,
+                &qoff,
+                &qend,
+                &soff,
+                &send,
+                &ident_perc,
+                NULL,
+                NULL);
+    if (!r) return r;
+    return edlib_nw(edlib, query + qoff, qend - qoff, subject + soff, send - soff, qaln, saln);
+}
+
+typedef struct {
+    double secs;
+    size_t num_extended;
+    size_t qcnt;
+    size_t scnt;
+    size_t num_cols;
+    size_t num_ident;
+} ExtendStats;
+
+static void
+old_path_extend(DalignData* dalign,
+    EdlibAlignData* edlib,
+    const u8* query,
+    const u8* subject,
+    const Overhang* o,
+    vec_u8* qsbuf,
+    vec_u8* ssbuf,
+    kstring_t* qaln,
+    kstring_t* saln,
+    ExtendStats* stats)
+{
+    const u8* q = query + o->query_offset;
+    const u8* s = subject + o->subject_offset;
+    if (!o->right) {
+        /// left_extend() copied both sequences reversed
+        kv_clear(*qsbuf);
+        kv_clear(*ssbuf);
+        for (int i = o->query_length; i; --i) kv_push(u8, *qsbuf, q[i-1]);
+        for (int i = o->subject_length; i; --i) kv_push(u8, *ssbuf, s[i-1]);
+        q = kv_data(*qsbuf);
+        s = kv_data(*ssbuf);
+    }
+    ks_clear(*qaln);
+    ks_clear(*saln);
+    if (!overhang_extend(dalign, edlib, q, o->query_length, s, o->subject_length, qaln, saln)) return;
+    ++stats->num_extended;
+    stats->num_cols += ks_size(*qaln);
+    for (size_t i = 0; i < ks_size(*qaln); ++i) {
+        const char qc = ks_A(*qaln, i);
+        const char sc = ks_A(*saln, i);
+        if (qc != GAP_CHAR) ++stats->qcnt;
+        if (sc != GAP_CHAR) ++stats->scnt;
+        if (qc == sc) ++stats->num_ident;
+    }
+}
+
+static void
+xdrop_path_extend(XdropExtendData* xdrop,
+    const u8* query,
+    const u8* subject,
+    const Overhang* o,
+    vec_align_op* ops,
+    ExtendStats* stats)
+{
+    const int step = o->right ? 1 : -1;
+    const u8* q = query + o->query_offset + (o->right ? 0 : o->query_length - 1);
+    const u8* s = subject + o->subject_offset + (o->right ? 0 : o->subject_length - 1);
+    int qcnt, scnt;
+    const int ncol = xdrop_extend(xdrop, q, o->query_length, s, o->subject_length, step, ops, &qcnt, &scnt);
+    if (!ncol) return;
+    ++stats->num_extended;
+    stats->num_cols += ncol;
+    stats->qcnt += qcnt;
+    stats->scnt += scnt;
+    int i = 0, j = 0;
+    for (size_t k = 0; k < kv_size(*ops); ++k) {
+        const int type = ALIGN_OP_TYPE(kv_A(*ops, k));
+        const int num = ALIGN_OP_NUM(kv_A(*ops, k));
+        if (type == kAlignOpDel) {
+            j += num;
+        } else if (type == kAlignOpIns) {
+            i += num;
+        } else {
+            for (int c = 0; c < num; ++c, ++i, ++j) stats->num_ident += q[i * step] == s[j * step];
+        }
+    }
+}
+
+static double
+bench_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void
+print_stats(const char* name, const ExtendStats* stats)
+{
+    printf("%-12s %.1f ms, %zu extended, %zu query and %zu subject residues, %.1f%% identity\n",
+        name, stats->secs * 1e3, stats->num_extended, stats->qcnt, stats->scnt,
+        stats->num_cols ? 100.0 * stats->num_ident / stats->num_cols : 0.0);
+}
+
+static void
+print_usage(const char* prog)
+{
+    fprintf(stderr, "USAGE:\n");
+    fprintf(stderr, "  %s [num_overhangs [max_overhang [error_percent [num_passes]]]]\n", prog);
+    fprintf(stderr, "\n");
+    fprintf(stderr, "  num_overhangs   number of simulated overhangs (default: 2000)\n");
+    fprintf(stderr, "  max_overhang    longest overhang, at most %d like hbn_traceback() (default: %d)\n", kMaxOverHang, kMaxOverHang);
+    fprintf(stderr, "  error_percent   read error rate (default: 12)\n");
+    fprintf(stderr, "  num_passes      the best pass is reported (default: 3)\n");
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc > 5 || (argc > 1 && argv[1][0] == '-')) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    const int num_overhangs = (argc > 1) ? atoi(argv[1]) : 2000;
+    const int max_overhang = (argc > 2) ? atoi(argv[2]) : kMaxOverHang;
+    const int error_percent = (argc > 3) ? atoi(argv[3]) : 12;
+    const int num_passes = (argc > 4) ? atoi(argv[4]) : 3;
+    if (num_overhangs < 1 || max_overhang < 1 || max_overhang > kMaxOverHang
+        || error_percent < 0 || error_percent > 100 || num_passes < 1) {
+        print_usage(argv[0]);
+        return 1;
+    }
+
+    kv_dinit(vec_u8, queries);
+    kv_dinit(vec_u8, subjects);
+    kv_dinit(vec_overhang, overhangs);
+    for (int i = 0; i < num_overhangs; ++i) make_overhang(max_overhang, error_percent, &queries, &subjects, &overhangs);
+
+    DalignData* dalign = DalignDataNew(0.35);
+    EdlibAlignData* edlib = EdlibAlignDataNew();
+    XdropExtendData* xdrop = XdropExtendDataNew();
+    kv_dinit(vec_u8, qsbuf);
+    kv_dinit(vec_u8, ssbuf);
+    ks_dinit(qaln);
+    ks_dinit(saln);
+    kv_dinit(vec_align_op, ops);
+    ExtendStats best_old, best_xdrop;
+    for (int pass = 0; pass < num_passes; ++pass) {
+        ExtendStats old_stats, xdrop_stats;
+        memset(&old_stats, 0, sizeof(ExtendStats));
+        memset(&xdrop_stats, 0, sizeof(ExtendStats));
+        double t = bench_seconds();
+        for (int i = 0; i < num_overhangs; ++i) {
+            old_path_extend(dalign, edlib, kv_data(queries), kv_data(subjects), kv_data(overhangs) + i,
+                &qsbuf, &ssbuf, &qaln, &saln, &old_stats);
+        }
+        old_stats.secs = bench_seconds() - t;
+        t = bench_seconds();
+        for (int i = 0; i < num_overhangs; ++i) {
+            xdrop_path_extend(xdrop, kv_data(queries), kv_data(subjects), kv_data(overhangs) + i, &ops, &xdrop_stats);
+        }
+        xdrop_stats.secs = bench_seconds() - t;
+        if (pass == 0 || old_stats.secs < best_old.secs) best_old = old_stats;
+        if (pass == 0 || xdrop_stats.secs < best_xdrop.secs) best_xdrop = xdrop_stats;
+    }
+    printf("%d overhangs of up to %d residues at %d%% error, %zu query residues\n",
+        num_overhangs, max_overhang, error_percent, kv_size(queries));
+    print_stats("dalign+edlib", &best_old);
+    print_stats("xdrop", &best_xdrop);
+
+    DalignDataFree(dalign);
+    EdlibAlignDataFree(edlib);
+    XdropExtendDataFree(xdrop);
+    kv_destroy(qsbuf);
+    kv_destroy(ssbuf);
+    ks_destroy(qaln);
+    ks_destroy(saln);
+    kv_destroy(ops);
+    kv_destroy(queries);
+    kv_destroy(subjects);
+    kv_destroy(overhangs);
+    return 0;
+}
@@ -1,6 +1,7 @@
 #include "build_db.h"
 
 #include <ctype.h>
+#include <pthread.h>
 #include <string.h>
 #include <sys/stat.h>   
 #include <unistd.h>
@@ -12,71 +13,43 @@
 #include "seqdb.h"
 #include "fasta.h"
 
-static void
-pack_one_seq(int* id_in_seqdb,
-    size_t* seq_offset_in_seqdb,
-    size_t* hdr_offset_in_seqdb,
-    kstring_t* seq_name,
-    kstring_t* seq_data,
-    FILE* hdr_file,
-    FILE* seq_info_file,
-    FILE* packed_seq_file,
-    size_t* ambig_offset_in_seqdb,
-    FILE* ambig_subseq_file)
+/// length of the sequence name, which ends at the first space of the header line
+static size_t
+seq_name_size(const kstring_t* seq_name)
 {
-    CSeqInfo seq_info;
-    seq_info.seq_offset = *seq_offset_in_seqdb;
-    seq_info.seq_size = ks_size(*seq_data);
-    seq_info.hdr_offset = *hdr_offset_in_seqdb;
-    seq_info.ambig_offset = *ambig_offset_in_seqdb;
-    seq_info.ambig_size = 0;
-
-    /// dump header
-    if (id_in_seqdb) {  // rename sequence
-        char buf[64];
-        u64_to_fixed_width_string_r(*id_in_seqdb, buf, HBN_DIGIT_WIDTH);
-        ++(*id_in_seqdb);
-        buf[HBN_DIGIT_WIDTH] = '\0';
-        hbn_fwrite(buf, 1, HBN_DIGIT_WIDTH+1, hdr_file);
-        seq_info.hdr_size = HBN_DIGIT_WIDTH;
-        *hdr_offset_in_seqdb += (HBN_DIGIT_WIDTH + 1);
-    } else { // use the orignal header
-        size_t n = 0;
-        while (n < ks_size(*seq_name)) {
-            int c = ks_A(*seq_name, n);
-            if (isspace(c)) break;
-            ++n;
-        }
-        hbn_assert(n > 0);
-        seq_info.hdr_size = n;
-        if (n == ks_size(*seq_name)) {
-            kputc('\0', seq_name);
-            hbn_fwrite(ks_s(*seq_name), 1, n+1, hdr_file);
-            ks_pop_back(*seq_name);
-        } else {
-            int c = ks_A(*seq_name, n);
-            ks_A(*seq_name, n) = '\0';
-            hbn_fwrite(ks_s(*seq_name), 1, n+1, hdr_file);
-            ks_A(*seq_name, n) = c;
-        }
-        *hdr_offset_in_seqdb += (n + 1);
+    size_t n = 0;
+    while (n < ks_size(*seq_name)) {
+        int c = ks_A(*seq_name, n);
+        if (isspace(c)) break;
+        ++n;
     }
+    hbn_assert(n > 0);
+    return n;
+}
 
-    /// dump packed sequence
-    const size_t ubytes = (seq_info.seq_size + 3) >> 2;
-    u8* es = (u8*)calloc(ubytes, 1);
+/// 2-bit encode the residues into es, which holds (seq_size + 3) / 4 zeroed bytes.
+/// ambiguous residues are packed as 0 and their runs are appended to ambig_list
+static void
+pack_seq_residues(const kstring_t* seq_data, u8* es, vec_ambig_subseq* ambig_list)
+{
+    const size_t seq_size = ks_size(*seq_data);
     size_t i = 0;
     int c, c1;
     u8 ec, ec1;
-    while (i < seq_info.seq_size) {
+    while (i < seq_size) {
         c = ks_A(*seq_data, i);
         ec = nst_nt16_table[c];
         if (ec > 3) {
-            CAmbigSubseq ambig = { i, c, 1 };
+            /// zero the padding too, so that the ambig file is reproducible
+            CAmbigSubseq ambig;
+            memset(&ambig, 0, sizeof(CAmbigSubseq));
+            ambig.offset = i;
+            ambig.ambig_residue = c;
+            ambig.count = 1;
             ec1 = 0;
             _set_pac(es, i, ec1);
             ++i;
-            while (i < seq_info.seq_size) {
+            while (i < seq_size) {
                 c1 = ks_A(*seq_data, i);
                 ec1 = nst_nt16_table[c1];
                 if (ec != ec1) break;
@@ -85,64 +58,301 @@ pack_one_seq(int* id_in_seqdb,
                 ++ambig.count;
                 ++i;
             }
-            ++seq_info.ambig_size;
-            hbn_fwrite(&ambig, sizeof(CAmbigSubseq), 1, ambig_subseq_file);
-            ++(*ambig_offset_in_seqdb);
+            kv_push(CAmbigSubseq, *ambig_list, ambig);
         } else {
             _set_pac(es, i, ec);
             ++i;
         }
     }
-    hbn_fwrite(es, 1, ubytes, packed_seq_file);
+}
+
+/// parallel database builder.
+/// reader threads parse the input files into batches of raw sequences, packer threads
+/// 2-bit encode the batches and the calling thread writes them in input order,
+/// assigning the global offsets, so the database is the same for any number of threads
+
+#define kDbBuildBatchResidues   (4 << 20)
+#define kDbBuildBatchSeqs       10000
+
+typedef kvec_t(CSeqInfo) vec_seq_info;
+
+typedef struct {
+    int             file_index;
+    int             batch_index;
+    BOOL            is_last_batch;
+    /// sequence names, each ends with '\0'
+    kstring_t       hdr;
+    /// raw residues, freed after packing
+    kstring_t       raw_seq;
+    /// offsets are relative to this batch. seq_offset is into raw_seq until the batch is packed
+    vec_seq_info    seq_info_list;
+    size_t          num_residues;
+    vec_u8          pac;
+    vec_ambig_subseq ambig_list;
+} DbBuildBatch;
 
-    /// dump sequence info
-    hbn_fwrite(&seq_info, sizeof(CSeqInfo), 1, seq_info_file);
+typedef kvec_t(DbBuildBatch*) vec_db_build_batch;
 
-    *seq_offset_in_seqdb += (ubytes << 2);
-    free(es);
+typedef struct {
+    vec_void_ptr    file_list;
+    int             min_seq_size;
+    int             next_file;
+    int             num_active_readers;
+    int             writer_file;
+    int             writer_batch;
+    /// batches read and not yet written, bounded by max_batches except for the writer's file
+    int             num_batches;
+    int             max_batches;
+    vec_db_build_batch raw_batches;
+    vec_db_build_batch packed_batches;
+    vec_db_build_batch free_batches;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+} DbBuilder;
+
+/// the input is a sequence file or a list of sequence files, one per line
+static EDbFormat
+load_input_file_list(const char* input, vec_void_ptr* file_list)
+{
+    EDbFormat fmt = hbn_guess_db_format(input);
+    if (fmt == eDbFormatEmptyFile) {
+        HBN_LOG("file %s is empty", input);
+    } else if (fmt == eDbFormatUnknown) {
+        HbnLineReader* line_reader = HbnLineReaderNew(input);
+        while (!HbnLineReaderAtEof(line_reader)) {
+            HbnLineReaderReadOneLine(line_reader);
+            kstring_t* line = &line_reader->line;
+            if (ks_empty(*line)) continue;
+            kputc('\0', line);
+            if (truncate_both_end_spaces(ks_s(*line)) == 0) continue;
+            kv_push(void*, *file_list, strdup(ks_s(*line)));
+        }
+        HbnLineReaderFree(line_reader);
+    } else {
+        kv_push(void*, *file_list, strdup(input));
+    }
+    return fmt;
+}
+
+static DbBuildBatch*
+take_free_batch(DbBuilder* builder, const int file_index, const int batch_index)
+{
+    pthread_mutex_lock(&builder->lock);
+    /// the file being written can always go ahead, so the writer never waits on a full pipeline
+    while (builder->num_batches >= builder->max_batches
+           &&
+           !(file_index == builder->writer_file && builder->num_batches < 2 * builder->max_batches)) {
+        pthread_cond_wait(&builder->cond, &builder->lock);
+    }
+    ++builder->num_batches;
+    DbBuildBatch* batch = NULL;
+    if (kv_empty(builder->free_batches)) {
+        batch = (DbBuildBatch*)calloc(1, sizeof(DbBuildBatch));
+    } else {
+        batch = kv_pop(builder->free_batches);
+    }
+    pthread_mutex_unlock(&builder->lock);
+
+    batch->file_index = file_index;
+    batch->batch_index = batch_index;
+    batch->is_last_batch = FALSE;
+    ks_clear(batch->hdr);
+    ks_clear(batch->raw_seq);
+    kv_clear(batch->seq_info_list);
+    batch->num_residues = 0;
+    kv_clear(batch->pac);
+    kv_clear(batch->ambig_list);
+    return batch;
 }
 
 static void
-pack_one_file(const char* file_path,
-    int* id_in_seqdb,
-    size_t* seq_offset_in_seqdb,
-    size_t* hdr_offset_in_seqdb,
-    FILE* hdr_file,
-    FILE* seq_info_file,
-    FILE* packed_seq_file,
-    size_t* ambig_offset_in_seqdb,
-    FILE* ambig_subseq_file,
-    const int min_seq_size,
-    size_t* total_seq_count,
-    size_t* total_res_count)
+free_db_build_batch(DbBuildBatch* batch)
 {
-    HBN_LOG("pack %s", file_path);
-    size_t file_seq_count = 0;
-    size_t file_res_count = 0;
+    ks_destroy(batch->hdr);
+    ks_destroy(batch->raw_seq);
+    kv_destroy(batch->seq_info_list);
+    kv_destroy(batch->pac);
+    kv_destroy(batch->ambig_list);
+    free(batch);
+}
+
+/// index of the batch with the smallest (file_index, batch_index)
+static size_t
+first_db_build_batch(const vec_db_build_batch* batches)
+{
+    size_t k = 0;
+    for (size_t i = 1; i < kv_size(*batches); ++i) {
+        const DbBuildBatch* a = kv_A(*batches, i);
+        const DbBuildBatch* b = kv_A(*batches, k);
+        if (a->file_index < b->file_index
+            ||
+            (a->file_index == b->file_index && a->batch_index < b->batch_index)) k = i;
+    }
+    return k;
+}
+
+static DbBuildBatch*
+remove_db_build_batch(vec_db_build_batch* batches, const size_t i)
+{
+    DbBuildBatch* batch = kv_A(*batches, i);
+    kv_A(*batches, i) = kv_back(*batches);
+    kv_pop_back(*batches);
+    return batch;
+}
+
+static void
+read_one_file(DbBuilder* builder, const int file_index)
+{
+    const char* file_path = (const char*)kv_A(builder->file_list, file_index);
+    struct timeval begin, end;
+    gettimeofday(&begin, NULL);
     HbnFastaReader* reader = HbnFastaReaderNew(file_path);
     HbnFastaReaderSkipErrorFormatedSequences(reader);
+    int batch_index = 0;
+    DbBuildBatch* batch = take_free_batch(builder, file_index, batch_index++);
     while (!HbnLineReaderAtEof(reader->line_reader)) {
         if (!HbnFastaReaderReadOneSeq(reader)) continue;
-        if (ks_size(reader->sequence) < min_seq_size) continue;
-        pack_one_seq(id_in_seqdb,
-            seq_offset_in_seqdb,
-            hdr_offset_in_seqdb,
-            &reader->name,
-            &reader->sequence,
-            hdr_file,
-            seq_info_file,
-            packed_seq_file,
-            ambig_offset_in_seqdb,
-            ambig_subseq_file);
-        ++file_seq_count;
-        file_res_count += ks_size(reader->sequence);
+        if (ks_size(reader->sequence) < builder->min_seq_size) continue;
+        CSeqInfo seq_info;
+        seq_info.seq_offset = ks_size(batch->raw_seq);
+        seq_info.seq_size = ks_size(reader->sequence);
+        seq_info.hdr_offset = ks_size(batch->hdr);
+        seq_info.hdr_size = seq_name_size(&reader->name);
+        seq_info.ambig_offset = 0;
+        seq_info.ambig_size = 0;
+        kputsn(ks_s(reader->name), seq_info.hdr_size, &batch->hdr);
+        kputc('\0', &batch->hdr);
+        kputsn(ks_s(reader->sequence), seq_info.seq_size, &batch->raw_seq);
+        kv_push(CSeqInfo, batch->seq_info_list, seq_info);
+        batch->num_residues += seq_info.seq_size;
+        if (batch->num_residues >= kDbBuildBatchResidues || kv_size(batch->seq_info_list) >= kDbBuildBatchSeqs) {
+            pthread_mutex_lock(&builder->lock);
+            kv_push(DbBuildBatch*, builder->raw_batches, batch);
+            pthread_cond_broadcast(&builder->cond);
+            pthread_mutex_unlock(&builder->lock);
+            batch = take_free_batch(builder, file_index, batch_index++);
+        }
     }
+    const size_t file_bytes = HbnLineReaderPosition(reader->line_reader);
     HbnFastaReaderFree(reader);
 
-    char buf1[64], buf2[64];
-    HBN_LOG("pack %s sequences (%s)", u64_to_string_comma(file_seq_count, buf1), u64_to_string_datasize(file_res_count, buf2));
-    *total_seq_count += file_seq_count;
-    *total_res_count += file_res_count;
+    /// the last batch of a file may be empty, the writer needs it to move to the next file
+    batch->is_last_batch = TRUE;
+    pthread_mutex_lock(&builder->lock);
+    kv_push(DbBuildBatch*, builder->raw_batches, batch);
+    pthread_cond_broadcast(&builder->cond);
+    pthread_mutex_unlock(&builder->lock);
+
+    gettimeofday(&end, NULL);
+    const double secs = hbn_time_diff(&begin, &end);
+    char buf[64];
+    HBN_LOG("read %s (%s bytes) in %.2lf secs (%.2lf MB/s)", file_path, u64_to_string_comma(file_bytes, buf), secs,
+        (secs > 0.0) ? file_bytes / secs / 1e6 : 0.0);
+}
+
+static void*
+db_reader_thread(void* params)
+{
+    DbBuilder* builder = (DbBuilder*)(params);
+    pthread_mutex_lock(&builder->lock);
+    while (builder->next_file < kv_size(builder->file_list)) {
+        const int file_index = builder->next_file++;
+        pthread_mutex_unlock(&builder->lock);
+        read_one_file(builder, file_index);
+        pthread_mutex_lock(&builder->lock);
+    }
+    --builder->num_active_readers;
+    pthread_cond_broadcast(&builder->cond);
+    pthread_mutex_unlock(&builder->lock);
+    return NULL;
+}
+
+static void
+pack_db_build_batch(DbBuildBatch* batch)
+{
+    size_t pac_size = 0;
+    for (size_t i = 0; i < kv_size(batch->seq_info_list); ++i) {
+        pac_size += (kv_A(batch->seq_info_list, i).seq_size + 3) >> 2;
+    }
+    kv_resize(u8, batch->pac, pac_size);
+    memset(kv_data(batch->pac), 0, pac_size);
+
+    size_t pac_offset = 0;
+    for (size_t i = 0; i < kv_size(batch->seq_info_list); ++i) {
+        CSeqInfo* seq_info = &kv_A(batch->seq_info_list, i);
+        kstring_t seq_data;
+        seq_data.s = ks_s(batch->raw_seq) + seq_info->seq_offset;
+        seq_data.l = seq_data.m = seq_info->seq_size;
+        seq_info->seq_offset = pac_offset << 2;
+        seq_info->ambig_offset = kv_size(batch->ambig_list);
+        pack_seq_residues(&seq_data, kv_data(batch->pac) + pac_offset, &batch->ambig_list);
+        seq_info->ambig_size = kv_size(batch->ambig_list) - seq_info->ambig_offset;
+        pac_offset += (seq_info->seq_size + 3) >> 2;
+    }
+    ks_destroy(batch->raw_seq);
+    ks_init(batch->raw_seq);
+}
+
+static void*
+db_packer_thread(void* params)
+{
+    DbBuilder* builder = (DbBuilder*)(params);
+    pthread_mutex_lock(&builder->lock);
+    while (1) {
+        if (!kv_empty(builder->raw_batches)) {
+            DbBuildBatch* batch = remove_db_build_batch(&builder->raw_batches, first_db_build_batch(&builder->raw_batches));
+            pthread_mutex_unlock(&builder->lock);
+            pack_db_build_batch(batch);
+            pthread_mutex_lock(&builder->lock);
+            kv_push(DbBuildBatch*, builder->packed_batches, batch);
+            pthread_cond_broadcast(&builder->cond);
+            continue;
+        }
+        if (builder->num_active_readers == 0) break;
+        pthread_cond_wait(&builder->cond, &builder->lock);
+    }
+    pthread_mutex_unlock(&builder->lock);
+    return NULL;
+}
+
+static void
+write_db_build_batch(DbBuildBatch* batch,
+    int* id_in_seqdb,
+    size_t* seq_offset_in_seqdb,
+    size_t* hdr_offset_in_seqdb,
+    size_t* ambig_offset_in_seqdb,
+    FILE* hdr_file,
+    FILE* seq_info_file,
+    FILE* packed_seq_file,
+    FILE* ambig_subseq_file)
+{
+    const size_t num_seqs = kv_size(batch->seq_info_list);
+    if (id_in_seqdb) { // rename sequences
+        char buf[64];
+        ks_clear(batch->hdr);
+        for (size_t i = 0; i < num_seqs; ++i) {
+            u64_to_fixed_width_string_r(*id_in_seqdb, buf, HBN_DIGIT_WIDTH);
+            ++(*id_in_seqdb);
+            kputsn(buf, HBN_DIGIT_WIDTH, &batch->hdr);
+            kputc('\0', &batch->hdr);
+            CSeqInfo* seq_info = &kv_A(batch->seq_info_list, i);
+            seq_info->hdr_offset = i * (HBN_DIGIT_WIDTH + 1);
+            seq_info->hdr_size = HBN_DIGIT_WIDTH;
+        }
+    }
+    for (size_t i = 0; i < num_seqs; ++i) {
+        CSeqInfo* seq_info = &kv_A(batch->seq_info_list, i);
+        seq_info->seq_offset += *seq_offset_in_seqdb;
+        seq_info->hdr_offset += *hdr_offset_in_seqdb;
+        seq_info->ambig_offset += *ambig_offset_in_seqdb;
+    }
+    hbn_fwrite(ks_s(batch->hdr), 1, ks_size(batch->hdr), hdr_file);
+    hbn_fwrite(kv_data(batch->seq_info_list), sizeof(CSeqInfo), num_seqs, seq_info_file);
+    hbn_fwrite(kv_data(batch->pac), 1, kv_size(batch->pac), packed_seq_file);
+    hbn_fwrite(kv_data(batch->ambig_list), sizeof(CAmbigSubseq), kv_size(batch->ambig_list), ambig_subseq_file);
+    *seq_offset_in_seqdb += kv_size(batch->pac) << 2;
+    *hdr_offset_in_seqdb += ks_size(batch->hdr);
+    *ambig_offset_in_seqdb += kv_size(batch->ambig_list);
 }
 
 void
@@ -306,13 +516,21 @@ build_db(const char* input,
     const int min_seq_size,
     const int max_file_seqs,
     const size_t max_file_res,
-    const int rename_seq)
+    const int rename_seq,
+    const int num_threads)
 {
-    EDbFormat fmt = hbn_guess_db_format(input);
-    if (fmt == eDbFormatEmptyFile) {
-        HBN_LOG("file %s is empty", input);
-        return;
-    }
+    DbBuilder builder;
+    memset(&builder, 0, sizeof(DbBuilder));
+    if (load_input_file_list(input, &builder.file_list) == eDbFormatEmptyFile) return;
+    const int num_files = kv_size(builder.file_list);
+    const int num_readers = hbn_min(num_files, hbn_max(num_threads / 2, 1));
+    const int num_packers = hbn_max(num_threads - num_readers, 1);
+    builder.min_seq_size = min_seq_size;
+    builder.num_active_readers = num_readers;
+    builder.max_batches = 2 * (num_readers + num_packers);
+    pthread_mutex_init(&builder.lock, NULL);
+    pthread_cond_init(&builder.cond, NULL);
+    HBN_LOG("build %s with %d reader and %d packer threads", seqdb_title, num_readers, num_packers);
 
     char path[HBN_MAX_PATH_LEN];
     make_seq_info_path(seqdb_dir, seqdb_title, path);
@@ -330,43 +548,74 @@ build_db(const char* input,
     size_t ambig_offset_in_seqdb = 0;
     size_t seq_count = 0;
     size_t res_count = 0;
+    size_t file_seq_count = 0;
+    size_t file_res_count = 0;
 
-    if (fmt == eDbFormatUnknown) {
-        HbnLineReader* line_reader = HbnLineReaderNew(input);
-        while (!HbnLineReaderAtEof(line_reader)) {
-            HbnLineReaderReadOneLine(line_reader);
-            kstring_t* line = &line_reader->line;
-            if (ks_empty(*line)) continue;
-            kputc('\0', line);
-            if (truncate_both_end_spaces(ks_s(*line)) == 0) continue;
-            pack_one_file(ks_s(*line), 
-                read_id, 
-                &seq_offset_in_seqdb, 
-                &hdr_offset_in_seqdb, 
-                hdr_file,
-                seq_info_file,
-                packed_seq_file,
-                &ambig_offset_in_seqdb,
-                ambig_subseq_file,
-                min_seq_size,
-                &seq_count,
-                &res_count);
+    pthread_t reader_jobs[hbn_max(num_readers, 1)];
+    pthread_t packer_jobs[num_packers];
+    for (int i = 0; i < num_readers; ++i) pthread_create(reader_jobs + i, NULL, db_reader_thread, &builder);
+    for (int i = 0; i < num_packers; ++i) pthread_create(packer_jobs + i, NULL, db_packer_thread, &builder);
+
+    pthread_mutex_lock(&builder.lock);
+    while (builder.writer_file < num_files) {
+        DbBuildBatch* batch = NULL;
+        for (size_t i = 0; i < kv_size(builder.packed_batches); ++i) {
+            DbBuildBatch* b = kv_A(builder.packed_batches, i);
+            if (b->file_index == builder.writer_file && b->batch_index == builder.writer_batch) {
+                batch = remove_db_build_batch(&builder.packed_batches, i);
+                break;
+            }
         }
-        HbnLineReaderFree(line_reader);
-    } else {
-        pack_one_file(input, 
-            read_id, 
-            &seq_offset_in_seqdb, 
-            &hdr_offset_in_seqdb, 
+        if (!batch) {
+            pthread_cond_wait(&builder.cond, &builder.lock);
+            continue;
+        }
+        pthread_mutex_unlock(&builder.lock);
+
+        if (batch->batch_index == 0) HBN_LOG("pack %s", (const char*)kv_A(builder.file_list, batch->file_index));
+        write_db_build_batch(batch,
+            read_id,
+            &seq_offset_in_seqdb,
+            &hdr_offset_in_seqdb,
+            &ambig_offset_in_seqdb,
             hdr_file,
             seq_info_file,
             packed_seq_file,
-            &ambig_offset_in_seqdb,
-            ambig_subseq_file,
-            min_seq_size,
-            &seq_count,
-            &res_count);
-    }    
+            ambig_subseq_file);
+        file_seq_count += kv_size(batch->seq_info_list);
+        file_res_count += batch->num_residues;
+        if (batch->is_last_batch) {
+            char buf1[64], buf2[64];
+            HBN_LOG("pack %s sequences (%s)", u64_to_string_comma(file_seq_count, buf1), u64_to_string_datasize(file_res_count, buf2));
+            seq_count += file_seq_count;
+            res_count += file_res_count;
+            file_seq_count = 0;
+            file_res_count = 0;
+        }
+
+        pthread_mutex_lock(&builder.lock);
+        if (batch->is_last_batch) {
+            ++builder.writer_file;
+            builder.writer_batch = 0;
+        } else {
+            ++builder.writer_batch;
+        }
+        kv_push(DbBuildBatch*, builder.free_batches, batch);
+        --builder.num_batches;
+        pthread_cond_broadcast(&builder.cond);
+    }
+    pthread_mutex_unlock(&builder.lock);
+
+    for (int i = 0; i < num_readers; ++i) pthread_join(reader_jobs[i], NULL);
+    for (int i = 0; i < num_packers; ++i) pthread_join(packer_jobs[i], NULL);
+    for (size_t i = 0; i < kv_size(builder.free_batches); ++i) free_db_build_batch(kv_A(builder.free_batches, i));
+    kv_destroy(builder.free_batches);
+    kv_destroy(builder.raw_batches);
+    kv_destroy(builder.packed_batches);
+    for (size_t i = 0; i < kv_size(builder.file_list); ++i) free(kv_A(builder.file_list, i));
+    kv_destroy(builder.file_list);
+    pthread_mutex_destroy(&builder.lock);
+    pthread_cond_destroy(&builder.cond);
 
     hbn_fclose(seq_info_file);
     hbn_fclose(packed_seq_file);
@@ -384,4 +633,123 @@ build_db(const char* input,
     volinfo.ambig_offset_from = 0;
     volinfo.ambig_offset_to = ambig_offset_in_seqdb;
     build_volume_info(seqdb_dir, seqdb_title, volinfo, max_file_res, max_file_seqs);
-}
\ No newline at end of file
+}
+
+/// query stream
+
+CSeqDBStream*
+CSeqDBStreamNew(const char* input,
+    const int min_seq_size,
+    const int max_vol_seqs,
+    const size_t max_vol_res)
+{
+    CSeqDBStream* stream = (CSeqDBStream*)calloc(1, sizeof(CSeqDBStream));
+    stream->min_seq_size = min_seq_size;
+    stream->max_vol_seqs = max_vol_seqs;
+    stream->max_vol_res = max_vol_res;
+    kv_init(stream->file_list);
+    load_input_file_list(input, &stream->file_list);
+    return stream;
+}
+
+CSeqDBStream*
+CSeqDBStreamFree(CSeqDBStream* stream)
+{
+    if (stream->reader) HbnFastaReaderFree(stream->reader);
+    for (size_t i = 0; i < kv_size(stream->file_list); ++i) free(kv_A(stream->file_list, i));
+    kv_destroy(stream->file_list);
+    free(stream);
+    return NULL;
+}
+
+/// next sequence of at least min_seq_size residues, NULL after the last input file
+static HbnFastaReader*
+stream_next_seq(CSeqDBStream* stream)
+{
+    while (1) {
+        if (!stream->reader) {
+            if (stream->next_file >= kv_size(stream->file_list)) return NULL;
+            const char* file_path = (const char*)kv_A(stream->file_list, stream->next_file);
+            ++stream->next_file;
+            HBN_LOG("stream %s", file_path);
+            stream->reader = HbnFastaReaderNew(file_path);
+            HbnFastaReaderSkipErrorFormatedSequences(stream->reader);
+        }
+        HbnFastaReader* reader = stream->reader;
+        while (!HbnLineReaderAtEof(reader->line_reader)) {
+            if (!HbnFastaReaderReadOneSeq(reader)) continue;
+            if (ks_size(reader->sequence) < stream->min_seq_size) continue;
+            return reader;
+        }
+        stream->reader = HbnFastaReaderFree(reader);
+    }
+    return NULL;
+}
+
+CSeqDB*
+CSeqDBStreamReadVolume(CSeqDBStream* stream)
+{
+    ks_dinit(hdr);
+    kv_dinit(vec_u8, pac);
+    kv_dinit(vec_ambig_subseq, ambig_list);
+    kv_dinit(vec_seq_info, seq_info_list);
+    size_t vol_res = 0;
+    HbnFastaReader* reader = NULL;
+
+    /// volumes are closed at the same sequences as build_volume_info() closes them
+    while ((reader = stream_next_seq(stream))) {
+        CSeqInfo seq_info;
+        seq_info.seq_offset = kv_size(pac) << 2;
+        seq_info.seq_size = ks_size(reader->sequence);
+        seq_info.hdr_offset = ks_size(hdr);
+        seq_info.hdr_size = seq_name_size(&reader->name);
+        seq_info.ambig_offset = kv_size(ambig_list);
+
+        kputsn(ks_s(reader->name), seq_info.hdr_size, &hdr);
+        kputc('\0', &hdr);
+
+        const size_t ubytes = (seq_info.seq_size + 3) >> 2;
+        const size_t pac_size = kv_size(pac);
+        if (pac_size + ubytes > kv_max(pac)) kv_reserve(u8, pac, (pac_size + ubytes) * 2);
+        kv_size(pac) = pac_size + ubytes;
+        u8* es = kv_data(pac) + pac_size;
+        memset(es, 0, ubytes);
+        pack_seq_residues(&reader->sequence, es, &ambig_list);
+        seq_info.ambig_size = kv_size(ambig_list) - seq_info.ambig_offset;
+        kv_push(CSeqInfo, seq_info_list, seq_info);
+
+        vol_res += seq_info.seq_size;
+        if (vol_res >= stream->max_vol_res || kv_size(seq_info_list) >= stream->max_vol_seqs) break;
+    }
+
+    if (kv_empty(seq_info_list)) {
+        ks_destroy(hdr);
+        kv_destroy(pac);
+        kv_destroy(ambig_list);
+        kv_destroy(seq_info_list);
+        return NULL;
+    }
+
+    CSeqDB* vol = CSeqDBNew();
+    const CSeqInfo* last = &kv_back(seq_info_list);
+    vol->dbinfo.seq_start_id = stream->next_seq_id;
+    vol->dbinfo.num_seqs = kv_size(seq_info_list);
+    vol->dbinfo.db_size = vol_res;
+    vol->dbinfo.seq_offset_from = stream->seq_offset;
+    vol->dbinfo.seq_offset_to = stream->seq_offset + last->seq_offset + last->seq_size;
+    vol->dbinfo.hdr_offset_from = stream->hdr_offset;
+    vol->dbinfo.hdr_offset_to = stream->hdr_offset + ks_size(hdr);
+    vol->dbinfo.ambig_offset_from = stream->ambig_offset;
+    vol->dbinfo.ambig_offset_to = stream->ambig_offset + kv_size(ambig_list);
+    stream->next_seq_id += kv_size(seq_info_list);
+    stream->seq_offset += kv_size(pac) << 2;
+    stream->hdr_offset += ks_size(hdr);
+    stream->ambig_offset += kv_size(ambig_list);
+
+    /// offsets in seq_info_list are relative to this volume, as seqdb_load() leaves them
+    vol->seq_info_list = kv_data(seq_info_list);
+    vol->seq_header_list = ks_release(&hdr);
+    vol->packed_seq = kv_data(pac);
+    vol->ambig_subseq_list = kv_data(ambig_list);
+    return vol;
+}
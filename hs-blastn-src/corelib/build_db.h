@@ -2,6 +2,7 @@
 #define __BUILD_DB_H
 
 #include "seqdb.h"
+#include "fasta.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -32,7 +33,37 @@ build_db(const char* input,
     const int min_seq_size,
     const int max_file_seqs,
     const size_t max_file_res,
-    const int rename_seq);
+    const int rename_seq,
+    const int num_threads);
+
+/// reads the input sequences into in-memory volumes, without building the seqdb files.
+/// the volumes hold the same sequences and ids as the volumes of build_db() would
+typedef struct {
+    vec_void_ptr file_list;
+    size_t next_file;
+    HbnFastaReader* reader;
+    int min_seq_size;
+    int max_vol_seqs;
+    size_t max_vol_res;
+
+    int next_seq_id;
+    size_t seq_offset;
+    size_t hdr_offset;
+    size_t ambig_offset;
+} CSeqDBStream;
+
+CSeqDBStream*
+CSeqDBStreamNew(const char* input,
+    const int min_seq_size,
+    const int max_vol_seqs,
+    const size_t max_vol_res);
+
+CSeqDBStream*
+CSeqDBStreamFree(CSeqDBStream* stream);
+
+/// next volume, NULL after the last sequence
+CSeqDB*
+CSeqDBStreamReadVolume(CSeqDBStream* stream);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,272 @@
+#include "gz_reader.h"
+
+#include <string.h>
+
+static int g_gz_num_threads = 1;
+
+void HbnGzReaderSetNumThreads(int num_threads)
+{
+    g_gz_num_threads = hbn_max(num_threads, 1);
+}
+
+/// fixed part of a gzip member header, before the extra field
+#define kGzHdrSize      12
+/// crc32 and isize
+#define kGzTrailerSize  8
+
+static u32 gz_le16(const u8* p)
+{
+    return (u32)p[0] | ((u32)p[1] << 8);
+}
+
+static u32 gz_le32(const u8* p)
+{
+    return gz_le16(p) | (gz_le16(p + 2) << 16);
+}
+
+/// size of the BGZF block starting with hdr[0, kGzHdrSize + xlen), 0 if it is not a BGZF block
+static size_t bgzf_block_size(const u8* hdr, const size_t xlen)
+{
+    if (hdr[0] != 31 || hdr[1] != 139 || hdr[2] != 8 || !(hdr[3] & 4)) return 0;
+    const u8* p = hdr + kGzHdrSize;
+    const u8* end = p + xlen;
+    while (p + 4 <= end) {
+        const u32 slen = gz_le16(p + 2);
+        if (p[0] == 'B' && p[1] == 'C' && slen == 2 && p + 6 <= end) return gz_le16(p + 4) + 1;
+        p += 4 + slen;
+    }
+    return 0;
+}
+
+static void gz_batch_reserve_in(HbnGzBatch* batch, const size_t size)
+{
+    if (size <= batch->in_max) return;
+    batch->in_max = hbn_max(size, batch->in_max * 2);
+    batch->in = (u8*)realloc(batch->in, batch->in_max);
+}
+
+static void gz_batch_reserve_out(HbnGzBatch* batch, const size_t size)
+{
+    if (size <= batch->out_max) return;
+    batch->out_max = hbn_max(size, batch->out_max * 2);
+    batch->out = (char*)realloc(batch->out, batch->out_max);
+}
+
+/// read whole BGZF blocks until the batch holds kGzBatchSize bytes, return FALSE at the end of input.
+/// offset tracks the position of the next block in the compressed file.
+static BOOL read_bgzf_batch(FILE* in, size_t* offset, HbnGzBatch* batch)
+{
+    batch->in_size = 0;
+    while (batch->in_size < kGzBatchSize) {
+        gz_batch_reserve_in(batch, batch->in_size + kGzHdrSize);
+        u8* hdr = batch->in + batch->in_size;
+        size_t n = fread(hdr, 1, kGzHdrSize, in);
+        if (n == 0 && feof(in)) return FALSE;
+        if (n != kGzHdrSize) HBN_ERR("truncated BGZF block header at compressed offset %zu", *offset);
+        const size_t xlen = (hdr[3] & 4) ? gz_le16(hdr + 10) : 0;
+        gz_batch_reserve_in(batch, batch->in_size + kGzHdrSize + xlen);
+        hdr = batch->in + batch->in_size;
+        if (fread(hdr + kGzHdrSize, 1, xlen, in) != xlen) {
+            HBN_ERR("truncated BGZF block header at compressed offset %zu", *offset);
+        }
+        const size_t block_size = bgzf_block_size(hdr, xlen);
+        if (block_size < kGzHdrSize + xlen + kGzTrailerSize) {
+            HBN_ERR("gzip member at compressed offset %zu is not a BGZF block", *offset);
+        }
+        gz_batch_reserve_in(batch, batch->in_size + block_size);
+        hdr = batch->in + batch->in_size;
+        const size_t rest = block_size - kGzHdrSize - xlen;
+        if (fread(hdr + kGzHdrSize + xlen, 1, rest, in) != rest) {
+            HBN_ERR("truncated BGZF block at compressed offset %zu", *offset);
+        }
+        batch->in_size += block_size;
+        *offset += block_size;
+    }
+    return TRUE;
+}
+
+static void inflate_bgzf_batch(z_stream* zs, HbnGzBatch* batch)
+{
+    batch->out_size = 0;
+    size_t i = 0;
+    while (i < batch->in_size) {
+        const u8* block = batch->in + i;
+        const size_t xlen = gz_le16(block + 10);
+        const size_t block_size = bgzf_block_size(block, xlen);
+        const u8* trailer = block + block_size - kGzTrailerSize;
+        const u32 crc = gz_le32(trailer);
+        const size_t isize = gz_le32(trailer + 4);
+        /// one spare byte keeps next_out non-NULL for empty blocks such as the EOF marker,
+        /// inflate() rejects a NULL output buffer even when no output is expected
+        gz_batch_reserve_out(batch, batch->out_size + isize + 1);
+
+        inflateReset(zs);
+        zs->next_in = (Bytef*)(block + kGzHdrSize + xlen);
+        zs->avail_in = block_size - kGzHdrSize - xlen - kGzTrailerSize;
+        zs->next_out = (Bytef*)(batch->out + batch->out_size);
+        zs->avail_out = isize;
+        int r = inflate(zs, Z_FINISH);
+        if (r != Z_STREAM_END || zs->avail_out) HBN_ERR("corrupted BGZF block: %s", zs->msg ? zs->msg : "size mismatch");
+        if (crc32(0L, zs->next_out - isize, isize) != crc) HBN_ERR("corrupted BGZF block: crc mismatch");
+        batch->out_size += isize;
+        i += block_size;
+    }
+}
+
+/// fill the batch with kGzBatchSize decompressed bytes, return FALSE at the end of input
+static BOOL read_gz_batch(gzFile in, HbnGzBatch* batch)
+{
+    gz_batch_reserve_out(batch, kGzBatchSize);
+    batch->out_size = 0;
+    while (batch->out_size < kGzBatchSize) {
+        int n = hbn_gzread(in, batch->out + batch->out_size, kGzBatchSize - batch->out_size);
+        if (n == 0) return FALSE;
+        batch->out_size += n;
+    }
+    return TRUE;
+}
+
+/// the read batch with the smallest seq, NULL if none
+static HbnGzBatch* next_read_batch(HbnGzReader* reader)
+{
+    HbnGzBatch* next = NULL;
+    for (int i = 0; i < reader->num_batches; ++i) {
+        HbnGzBatch* batch = reader->batches + i;
+        if (batch->state == eGzBatchRead && (!next || batch->seq < next->seq)) next = batch;
+    }
+    return next;
+}
+
+static void* gz_worker(void* params)
+{
+    HbnGzReader* reader = (HbnGzReader*)(params);
+    z_stream zs;
+    memset(&zs, 0, sizeof(z_stream));
+    if (reader->is_bgzf && inflateInit2(&zs, -15) != Z_OK) HBN_ERR("fail to initialise zlib");
+
+    pthread_mutex_lock(&reader->lock);
+    while (!reader->stop) {
+        HbnGzBatch* batch = next_read_batch(reader);
+        if (batch) {
+            batch->state = eGzBatchBusy;
+            pthread_mutex_unlock(&reader->lock);
+            inflate_bgzf_batch(&zs, batch);
+            pthread_mutex_lock(&reader->lock);
+            batch->state = eGzBatchDone;
+            pthread_cond_broadcast(&reader->cond);
+            continue;
+        }
+
+        batch = reader->batches + reader->read_seq % reader->num_batches;
+        if (!reader->input_eof && !reader->reading && batch->state == eGzBatchFree) {
+            reader->reading = TRUE;
+            pthread_mutex_unlock(&reader->lock);
+            const BOOL more = reader->is_bgzf ? read_bgzf_batch(reader->bgzf_in, &reader->bgzf_offset, batch)
+                                              : read_gz_batch(reader->gz_in, batch);
+            /// the last batch may be partial
+            const BOOL has_data = reader->is_bgzf ? (batch->in_size > 0) : (batch->out_size > 0);
+            pthread_mutex_lock(&reader->lock);
+            reader->reading = FALSE;
+            if (has_data) {
+                batch->seq = reader->read_seq++;
+                batch->state = reader->is_bgzf ? eGzBatchRead : eGzBatchDone;
+            }
+            if (!more) reader->input_eof = TRUE;
+            pthread_cond_broadcast(&reader->cond);
+            continue;
+        }
+
+        if (reader->input_eof) break;
+        pthread_cond_wait(&reader->cond, &reader->lock);
+    }
+    pthread_mutex_unlock(&reader->lock);
+
+    if (reader->is_bgzf) inflateEnd(&zs);
+    return NULL;
+}
+
+static BOOL file_is_bgzf(const char* filename)
+{
+    if (strcmp(filename, "-") == 0) return FALSE;
+    hbn_dfopen(in, filename, "rb");
+    u8 hdr[kGzHdrSize + 6];
+    const size_t n = fread(hdr, 1, sizeof(hdr), in);
+    hbn_fclose(in);
+    return n == sizeof(hdr) && gz_le16(hdr + 10) == 6 && bgzf_block_size(hdr, 6) > 0;
+}
+
+HbnGzReader*
+HbnGzReaderNew(const char* filename)
+{
+    HbnGzReader* reader = (HbnGzReader*)calloc(1, sizeof(HbnGzReader));
+    reader->is_bgzf = file_is_bgzf(filename);
+    if (reader->is_bgzf) {
+        hbn_fopen(reader->bgzf_in, filename, "rb");
+        reader->num_workers = g_gz_num_threads;
+    } else {
+        hbn_gzopen(reader->gz_in, filename, "r");
+        reader->num_workers = 1;
+    }
+    /// one batch in the hands of the consumer, one being read and one per worker
+    reader->num_batches = reader->num_workers + 2;
+    reader->batches = (HbnGzBatch*)calloc(reader->num_batches, sizeof(HbnGzBatch));
+    pthread_mutex_init(&reader->lock, NULL);
+    pthread_cond_init(&reader->cond, NULL);
+    reader->workers = (pthread_t*)calloc(reader->num_workers, sizeof(pthread_t));
+    for (int i = 0; i < reader->num_workers; ++i) {
+        pthread_create(reader->workers + i, NULL, gz_worker, reader);
+    }
+    return reader;
+}
+
+HbnGzReader*
+HbnGzReaderFree(HbnGzReader* reader)
+{
+    pthread_mutex_lock(&reader->lock);
+    reader->stop = TRUE;
+    pthread_cond_broadcast(&reader->cond);
+    pthread_mutex_unlock(&reader->lock);
+    for (int i = 0; i < reader->num_workers; ++i) pthread_join(reader->workers[i], NULL);
+    free(reader->workers);
+
+    if (reader->bgzf_in) hbn_fclose(reader->bgzf_in);
+    if (reader->gz_in) hbn_gzclose(reader->gz_in);
+    for (int i = 0; i < reader->num_batches; ++i) {
+        free(reader->batches[i].in);
+        free(reader->batches[i].out);
+    }
+    free(reader->batches);
+    pthread_mutex_destroy(&reader->lock);
+    pthread_cond_destroy(&reader->cond);
+    free(reader);
+    return NULL;
+}
+
+size_t HbnGzReaderRead(HbnGzReader* reader, char* buf, size_t count)
+{
+    size_t n = 0;
+    while (n < count) {
+        HbnGzBatch* batch = reader->batches + reader->consume_seq % reader->num_batches;
+        pthread_mutex_lock(&reader->lock);
+        while (batch->state != eGzBatchDone && !(reader->input_eof && reader->consume_seq == reader->read_seq)) {
+            pthread_cond_wait(&reader->cond, &reader->lock);
+        }
+        const BOOL at_eof = (batch->state != eGzBatchDone);
+        pthread_mutex_unlock(&reader->lock);
+        if (at_eof) break;
+
+        const size_t m = hbn_min(count - n, batch->out_size - reader->consume_pos);
+        memcpy(buf + n, batch->out + reader->consume_pos, m);
+        n += m;
+        reader->consume_pos += m;
+        if (reader->consume_pos == batch->out_size) {
+            pthread_mutex_lock(&reader->lock);
+            batch->state = eGzBatchFree;
+            ++reader->consume_seq;
+            reader->consume_pos = 0;
+            pthread_cond_broadcast(&reader->cond);
+            pthread_mutex_unlock(&reader->lock);
+        }
+    }
+    return n;
+}
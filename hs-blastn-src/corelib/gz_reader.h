@@ -0,0 +1,79 @@
+#ifndef __GZ_READER_H
+#define __GZ_READER_H
+
+#include "hbn_aux.h"
+
+#include <pthread.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// input is read and decompressed in batches of about this many bytes
+#define kGzBatchSize    (1 << 20)
+
+typedef enum {
+    eGzBatchFree,
+    /// compressed BGZF blocks are read, waiting for a worker
+    eGzBatchRead,
+    eGzBatchBusy,
+    /// decompressed data is ready for the consumer
+    eGzBatchDone
+} EGzBatchState;
+
+typedef struct {
+    u8*             in;
+    size_t          in_size;
+    size_t          in_max;
+    char*           out;
+    size_t          out_size;
+    size_t          out_max;
+    size_t          seq;
+    EGzBatchState   state;
+} HbnGzBatch;
+
+/// reads a plain, gzip or BGZF file ahead of the consumer.
+/// BGZF blocks carry their compressed size, so one worker at a time reads
+/// a batch of whole blocks and any free worker inflates it. other files are
+/// decompressed by gzread() on a single worker. either way the batches form
+/// a ring that the consumer drains in input order.
+typedef struct {
+    BOOL            is_bgzf;
+    FILE*           bgzf_in;
+    /// compressed offset of the next BGZF block, for error messages
+    size_t          bgzf_offset;
+    gzFile          gz_in;
+    BOOL            input_eof;
+    BOOL            reading;
+    BOOL            stop;
+
+    int             num_batches;
+    HbnGzBatch*     batches;
+    /// batches [consume_seq, read_seq) are read
+    size_t          read_seq;
+    size_t          consume_seq;
+    size_t          consume_pos;
+
+    int             num_workers;
+    pthread_t*      workers;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+} HbnGzReader;
+
+/// number of workers decompressing a BGZF file, 1 by default
+void HbnGzReaderSetNumThreads(int num_threads);
+
+HbnGzReader*
+HbnGzReaderNew(const char* filename);
+
+HbnGzReader*
+HbnGzReaderFree(HbnGzReader* reader);
+
+/// copy the next count bytes to buf, fewer only at the end of input
+size_t HbnGzReaderRead(HbnGzReader* reader, char* buf, size_t count);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __GZ_READER_H
@@ -1,8 +1,10 @@
 #include "hbn_aux.h"
 
 #include <errno.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
@@ -171,6 +173,39 @@ off_t hbn_get_file_size(HBN_LOG_PARAMS_GENERIC, const char* path)
     return sbuf.st_size;
 }
 
+void* safe_mmap_file(HBN_LOG_PARAMS_GENERIC, const char* path, size_t* size)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        const char* y = strerror(errno);
+        HBN_ERR_GENERIC("fail to open file '%s': %s", path, y);
+    }
+    struct stat sbuf;
+    if (fstat(fd, &sbuf) == -1) {
+        const char* y = strerror(errno);
+        HBN_ERR_GENERIC("fail to stat file '%s': %s", path, y);
+    }
+    *size = sbuf.st_size;
+    void* addr = NULL;
+    if (*size > 0) {
+        addr = mmap(NULL, *size, PROT_READ, MAP_SHARED, fd, 0);
+        if (addr == MAP_FAILED) {
+            const char* y = strerror(errno);
+            HBN_ERR_GENERIC("fail to mmap file '%s': %s", path, y);
+        }
+    }
+    close(fd);
+    return addr;
+}
+
+void safe_munmap_file(HBN_LOG_PARAMS_GENERIC, void* addr, size_t size)
+{
+    if (!addr || !size) return;
+    if (munmap(addr, size) != 0) {
+        HBN_ERR_GENERIC("%s", strerror(errno));
+    }
+}
+
 double hbn_time_diff(const struct timeval* begin, const struct timeval* end)
 {
     double d = end->tv_sec - begin->tv_sec;
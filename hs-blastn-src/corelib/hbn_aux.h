@@ -90,6 +90,14 @@ off_t hbn_get_file_size(HBN_LOG_PARAMS_GENERIC, const char* path);
 #define hbn_fclose(stream)                      safe_fclose(HBN_LOG_ARGS_DEFAULT, stream)
 #define hbn_file_size(path)                     hbn_get_file_size(HBN_LOG_ARGS_DEFAULT, path)
 
+/// memory mapped file
+
+void* safe_mmap_file(HBN_LOG_PARAMS_GENERIC, const char* path, size_t* size);
+void safe_munmap_file(HBN_LOG_PARAMS_GENERIC, void* addr, size_t size);
+
+#define hbn_mmap_file(path, size)               safe_mmap_file(HBN_LOG_ARGS_DEFAULT, path, size)
+#define hbn_munmap_file(addr, size)             safe_munmap_file(HBN_LOG_ARGS_DEFAULT, addr, size)
+
 /// timing
 
 double hbn_time_diff(const struct timeval* begin, const struct timeval* end);
@@ -18,7 +18,7 @@ HbnBufferedLineReader*
 HbnBufferedLineReaderNew(const char* filename)
 {
     HbnBufferedLineReader* reader = (HbnBufferedLineReader*)calloc(1, sizeof(HbnBufferedLineReader));
-    hbn_gzopen(reader->stream, filename, "r");
+    reader->stream = HbnGzReaderNew(filename);
     reader->eof = FALSE;
     reader->ungetline = FALSE;
     reader->buffer_size = 32 * 1024;
@@ -35,7 +35,7 @@ HbnBufferedLineReaderNew(const char* filename)
 HbnBufferedLineReader*
 HbnBufferedLineReaderFree(HbnBufferedLineReader* reader)
 {
-    hbn_gzclose(reader->stream);
+    HbnGzReaderFree(reader->stream);
     free(reader->buffer);
     ks_destroy(reader->line);
     free(reader);
@@ -44,7 +44,7 @@ HbnBufferedLineReaderFree(HbnBufferedLineReader* reader)
 
 BOOL HbnBufferedLineReaderAtEof(const HbnBufferedLineReader* reader)
 {
-    return gzeof(reader->stream) && (reader->pos >= reader->end) && (!reader->ungetline);
+    return reader->eof && (reader->pos >= reader->end) && (!reader->ungetline);
 }
 
 char HbnBufferedLineReaderPeekChar(HbnBufferedLineReader* reader)
@@ -78,22 +78,12 @@ void HbnBufferedLineReaderUngetline(HbnBufferedLineReader* reader)
 }
 
 static ERW_Result
-HbnBufferedLineReaderLoadData(gzFile stream, char* buffer, int count, int* bytes_read)
+HbnBufferedLineReaderLoadData(HbnGzReader* stream, char* buffer, int count, int* bytes_read)
 {
     ERW_Result result = eRW_Success;
-    int n = gzread(stream, buffer, count);
-    if (n < count) {
-        hbn_assert(gzeof(stream));
-        if (gzeof(stream)) {
-            result = eRW_Eof;
-        } else {
-            int errno;
-            const char* error_string = gzerror(stream, &errno);
-            if (errno) {
-                HBN_ERR("%s", error_string);
-            }
-        }
-    }
+    /// read errors are reported by the decompression workers
+    int n = HbnGzReaderRead(stream, buffer, count);
+    if (n < count) result = eRW_Eof;
     *bytes_read = n;
     return result;
 }
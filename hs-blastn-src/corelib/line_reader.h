@@ -2,13 +2,14 @@
 #define __LINE_READER_H
 
 #include "hbn_aux.h"
+#include "gz_reader.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 typedef struct {
-    gzFile      stream;
+    HbnGzReader* stream;
     BOOL        eof;
     BOOL        ungetline;
     size_t      last_read_size;
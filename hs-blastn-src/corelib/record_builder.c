@@ -0,0 +1,225 @@
+#include "record_builder.h"
+
+#include "hbn_aux.h"
+
+#include <math.h>
+
+const char kRecDigitPairs[200] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/// the powers of ten that are exact in a double
+static const double kPow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+/// the scaled values are below kMaxScaled and off from the exact products by a
+/// few ulps, those closer than this to a rounding tie are left to ksprintf()
+#define kTieWindow  1e-6
+#define kMaxScaled  1e9
+
+static double
+pow10_of(const int n)
+{
+    return (n <= 22) ? kPow10[n] : pow(10.0, n);
+}
+
+/// m rounded to the nearest integer, FALSE if it is too close to a tie to tell
+static BOOL
+round_scaled(const double m, u64* r)
+{
+    const double f = floor(m);
+    const double frac = m - f;
+    if (fabs(frac - 0.5) < kTieWindow) return FALSE;
+    *r = (u64)f + (frac > 0.5);
+    return TRUE;
+}
+
+/// a > 0 rounded to num_digits significant digits, which are returned as an
+/// integer together with the decimal exponent of the first one
+static BOOL
+significant_digits(const double a, const int num_digits, u64* digits, int* exponent)
+{
+    if (!(a >= 1e-290 && a < 1e290) || num_digits > 9) return FALSE;
+    const double lo = kPow10[num_digits - 1];
+    const double hi = kPow10[num_digits];
+    int e = (int)floor(log10(a));
+    /// log10() may be one off next to the powers of ten. a value that
+    /// is off from the next power by less than the rounding error rounds
+    /// to that power whichever exponent we pick
+    for (int retry = 0; retry < 3; ++retry) {
+        const int k = num_digits - 1 - e;
+        const double m = (k >= 0) ? a * pow10_of(k) : a / pow10_of(-k);
+        if (m >= hi) {
+            if (m < hi + 0.01) {
+                *digits = (u64)lo;
+                *exponent = e + 1;
+                return TRUE;
+            }
+            ++e;
+            continue;
+        }
+        if (m < lo) {
+            if (m > lo - 0.01) {
+                *digits = (u64)lo;
+                *exponent = e;
+                return TRUE;
+            }
+            --e;
+            continue;
+        }
+        u64 r;
+        if (!round_scaled(m, &r)) return FALSE;
+        if (r == (u64)hi) {
+            r = (u64)lo;
+            ++e;
+        }
+        *digits = r;
+        *exponent = e;
+        return TRUE;
+    }
+    return FALSE;
+}
+
+/// the n digits of x, leading zeros included
+static void
+write_fixed_digits(u64 x, const int n, char* p)
+{
+    for (int i = n - 1; i >= 0; --i) {
+        p[i] = '0' + (char)(x % 10);
+        x /= 10;
+    }
+}
+
+/// "e+XX", at least two digits of exponent
+static char*
+write_exponent(int e, char* p)
+{
+    *p++ = 'e';
+    *p++ = (e < 0) ? '-' : '+';
+    if (e < 0) e = -e;
+    if (e < 10) *p++ = '0';
+    return rec_write_u64((u64)e, p);
+}
+
+static void
+put_right_aligned(const char* buf, const int n, const int width, kstring_t* s)
+{
+    char* p = rec_reserve(hbn_max(n, width), s);
+    for (int i = n; i < width; ++i) *p++ = ' ';
+    memcpy(p, buf, n);
+    rec_commit(p + n, s);
+}
+
+void rec_put_i64_width(i64 x, int width, kstring_t* s)
+{
+    char buf[32];
+    const int n = rec_write_i64(x, buf) - buf;
+    put_right_aligned(buf, n, width, s);
+}
+
+void rec_put_fixed(double x, int precision, int width, kstring_t* s)
+{
+    hbn_assert(precision >= 0 && precision <= 9);
+    const double m = fabs(x) * kPow10[precision];
+    u64 r;
+    if (!(m < kMaxScaled) || !round_scaled(m, &r)) {
+        ksprintf(s, "%*.*f", width, precision, x);
+        return;
+    }
+    char buf[32], *p = buf;
+    if (signbit(x)) *p++ = '-';
+    const u64 scale = (u64)kPow10[precision];
+    p = rec_write_u64(r / scale, p);
+    if (precision) {
+        *p++ = '.';
+        write_fixed_digits(r % scale, precision, p);
+        p += precision;
+    }
+    put_right_aligned(buf, p - buf, width, s);
+}
+
+void rec_put_exp(double x, int precision, int width, kstring_t* s)
+{
+    hbn_assert(precision >= 0 && precision <= 8);
+    const double a = fabs(x);
+    u64 digits = 0;
+    int e = 0;
+    if (!(a == 0.0 || significant_digits(a, precision + 1, &digits, &e))) {
+        ksprintf(s, "%*.*e", width, precision, x);
+        return;
+    }
+    char d[16];
+    write_fixed_digits(digits, precision + 1, d);
+    char buf[32], *p = buf;
+    if (signbit(x)) *p++ = '-';
+    *p++ = d[0];
+    if (precision) {
+        *p++ = '.';
+        memcpy(p, d + 1, precision);
+        p += precision;
+    }
+    p = write_exponent(e, p);
+    put_right_aligned(buf, p - buf, width, s);
+}
+
+void rec_put_general(double x, kstring_t* s)
+{
+    /// %g is %e or %f with 6 significant digits and the trailing zeros of the fraction removed
+    const int P = 6;
+    const double a = fabs(x);
+    char buf[32], *p = buf;
+    if (signbit(x)) *p++ = '-';
+    if (a == 0.0) {
+        *p++ = '0';
+        put_right_aligned(buf, p - buf, 0, s);
+        return;
+    }
+    u64 digits;
+    int e;
+    if (!significant_digits(a, P, &digits, &e)) {
+        ksprintf(s, "%g", x);
+        return;
+    }
+    char d[8];
+    write_fixed_digits(digits, P, d);
+    if (e < -4 || e >= P) {
+        int n = P;
+        while (n > 1 && d[n - 1] == '0') --n;
+        *p++ = d[0];
+        if (n > 1) {
+            *p++ = '.';
+            memcpy(p, d + 1, n - 1);
+            p += n - 1;
+        }
+        p = write_exponent(e, p);
+    } else if (e >= 0) {
+        int n = P;
+        while (n > e + 1 && d[n - 1] == '0') --n;
+        memcpy(p, d, e + 1);
+        p += e + 1;
+        if (n > e + 1) {
+            *p++ = '.';
+            memcpy(p, d + e + 1, n - e - 1);
+            p += n - e - 1;
+        }
+    } else {
+        int n = P;
+        while (d[n - 1] == '0') --n;
+        *p++ = '0';
+        *p++ = '.';
+        for (int i = -1; i > e; --i) *p++ = '0';
+        memcpy(p, d, n);
+        p += n;
+    }
+    put_right_aligned(buf, p - buf, 0, s);
+}
@@ -0,0 +1,104 @@
+#ifndef __RECORD_BUILDER_H
+#define __RECORD_BUILDER_H
+
+#include "hbn_defs.h"
+#include "kstring.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// appenders for the fields of the text output records (SAM, PAF, M4 and
+/// the tabular formats).
+///
+/// numbers are converted by hand instead of through ksprintf(), the text is
+/// the same as that of the printf() conversion named at each function. the
+/// string in s is kept NUL-terminated like the other kput functions do.
+
+extern const char kRecDigitPairs[200];
+
+/// make room for n more characters and the NUL, return where they go
+static inline char* rec_reserve(size_t n, kstring_t* s)
+{
+    if (s->l + n + 1 > s->m) ks_reserve(s, s->l + n + 1);
+    return s->s + s->l;
+}
+
+/// the characters up to p have been written into the room from rec_reserve()
+static inline void rec_commit(char* p, kstring_t* s)
+{
+    s->l = p - s->s;
+    s->s[s->l] = '\0';
+}
+
+static inline int rec_num_digits(u64 x)
+{
+    int n = 1;
+    while (1) {
+        if (x < 10) return n;
+        if (x < 100) return n + 1;
+        if (x < 1000) return n + 2;
+        if (x < 10000) return n + 3;
+        x /= 10000;
+        n += 4;
+    }
+}
+
+/// "%llu" into p, return the end of the digits
+static inline char* rec_write_u64(u64 x, char* p)
+{
+    char* end = p + rec_num_digits(x);
+    char* q = end;
+    while (x >= 100) {
+        const int i = (int)(x % 100) * 2;
+        x /= 100;
+        q -= 2;
+        q[0] = kRecDigitPairs[i];
+        q[1] = kRecDigitPairs[i + 1];
+    }
+    if (x >= 10) {
+        q[-2] = kRecDigitPairs[x * 2];
+        q[-1] = kRecDigitPairs[x * 2 + 1];
+    } else {
+        q[-1] = '0' + (char)x;
+    }
+    return end;
+}
+
+/// "%lld" into p, return the end of the digits
+static inline char* rec_write_i64(i64 x, char* p)
+{
+    if (x >= 0) return rec_write_u64((u64)x, p);
+    *p++ = '-';
+    return rec_write_u64(-(u64)x, p);
+}
+
+/// "%llu"
+static inline void rec_put_u64(u64 x, kstring_t* s)
+{
+    rec_commit(rec_write_u64(x, rec_reserve(20, s)), s);
+}
+
+/// "%lld"
+static inline void rec_put_i64(i64 x, kstring_t* s)
+{
+    rec_commit(rec_write_i64(x, rec_reserve(21, s)), s);
+}
+
+/// "%*lld", right-aligned in width columns
+void rec_put_i64_width(i64 x, int width, kstring_t* s);
+
+/// "%*.*f", 0 <= precision <= 9. values of 1e9 and more after scaling go to ksprintf()
+void rec_put_fixed(double x, int precision, int width, kstring_t* s);
+
+/// "%*.*e", 0 <= precision <= 8
+void rec_put_exp(double x, int precision, int width, kstring_t* s);
+
+/// "%g", also what a default std::ostream writes for a double
+void rec_put_general(double x, kstring_t* s);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __RECORD_BUILDER_H
@@ -212,6 +212,12 @@ const char* seqdb_seq_name(const CSeqDB* seqdb, const int seq_id)
     return seqdb->seq_header_list + seqdb->seq_info_list[seq_id].hdr_offset;
 }
 
+size_t seqdb_seq_name_size(const CSeqDB* seqdb, const int seq_id)
+{
+    hbn_assert(seq_id < seqdb->dbinfo.num_seqs);
+    return seqdb->seq_info_list[seq_id].hdr_size;
+}
+
 int seqdb_num_seqs(const CSeqDB* seqdb)
 {
     return seqdb->dbinfo.num_seqs;
@@ -352,6 +358,48 @@ seqdb_recover_subsequence_ambig_res(const CSeqDB* seqdb,
     }
 }
 
+const u8*
+seqdb_subsequence_window(const CSeqDB* seqdb,
+    const int seq_id,
+    const size_t from,
+    const size_t to,
+    vec_u8* buf)
+{
+    const size_t start = seqdb_seq_offset(seqdb, seq_id);
+    hbn_assert(from <= to && to <= seqdb_seq_size(seqdb, seq_id));
+    if (seqdb->unpacked_seq) return seqdb->unpacked_seq + start + from;
+
+    hbn_assert(seqdb->packed_seq);
+    kv_resize(u8, *buf, to - from);
+    u8* seq = kv_data(*buf);
+    const u8* pac = seqdb->packed_seq;
+    for (size_t i = start + from; i < start + to; ++i) *seq++ = _get_pac(pac, i);
+    seq = kv_data(*buf);
+
+    /// ambiguous runs are sorted by offset, skip the runs ending before from
+    CSeqInfo seqinfo = seqdb->seq_info_list[seq_id];
+    const CAmbigSubseq* amb_array = seqdb->ambig_subseq_list + seqinfo.ambig_offset;
+    size_t left = 0, right = seqinfo.ambig_size;
+    while (left < right) {
+        size_t mid = (left + right) >> 1;
+        if (amb_array[mid].offset + amb_array[mid].count <= from) {
+            left = mid + 1;
+        } else {
+            right = mid;
+        }
+    }
+    for (size_t i = left; i < seqinfo.ambig_size && amb_array[i].offset < to; ++i) {
+        int res = amb_array[i].ambig_residue;
+        hbn_assert((res >= 'A' && res <= 'Z') || (res >= 'a' && res <= 'z'));
+        res = nst_nt16_table[res];
+        hbn_assert(res >= 0 && res < 16);
+        size_t amb_from = hbn_max(amb_array[i].offset, from);
+        size_t amb_to = hbn_min(amb_array[i].offset + amb_array[i].count, to);
+        for (size_t pos = amb_from; pos < amb_to; ++pos) seq[pos - from] = res;
+    }
+    return seq;
+}
+
 void
 seqdb_recover_sequence_ambig_res(const CSeqDB* seqdb,
     const int seq_id,
@@ -489,6 +537,46 @@ seqdb_load_unpacked(const char* seqdb_dir, const char* seqdb_title, int vol_id)
     return vol;
 }
 
+CSeqDB*
+seqdb_load_mapped(const char* seqdb_dir, const char* seqdb_title, int vol_id)
+{
+    CSeqDB* vol = (CSeqDB*)calloc(1, sizeof(CSeqDB));
+    ++vol_id;
+    vol->dbinfo = seqdb_load_volume_info(seqdb_dir, seqdb_title, vol_id);
+    char path[HBN_MAX_PATH_LEN];
+
+    hbn_assert((vol->dbinfo.seq_offset_from&3) == 0);
+    make_packed_seq_path(seqdb_dir, seqdb_title, path);
+    vol->pac_mmap_addr = hbn_mmap_file(path, &vol->pac_mmap_size);
+    hbn_assert(((vol->dbinfo.seq_offset_to + 3) >> 2) <= vol->pac_mmap_size);
+    vol->packed_seq = (u8*)(vol->pac_mmap_addr) + (vol->dbinfo.seq_offset_from >> 2);
+
+    make_header_path(seqdb_dir, seqdb_title, path);
+    vol->hdr_mmap_addr = hbn_mmap_file(path, &vol->hdr_mmap_size);
+    hbn_assert(vol->dbinfo.hdr_offset_to <= vol->hdr_mmap_size);
+    vol->seq_header_list = (char*)(vol->hdr_mmap_addr) + vol->dbinfo.hdr_offset_from;
+
+    make_ambig_subseq_path(seqdb_dir, seqdb_title, path);
+    vol->ambig_mmap_addr = hbn_mmap_file(path, &vol->ambig_mmap_size);
+    hbn_assert(sizeof(CAmbigSubseq) * vol->dbinfo.ambig_offset_to <= vol->ambig_mmap_size);
+    vol->ambig_subseq_list = (CAmbigSubseq*)(vol->ambig_mmap_addr) + vol->dbinfo.ambig_offset_from;
+
+    /// offsets in seq_info are rebased to this volume, so seq_info is still copied
+    vol->seq_info_list = load_seq_infos(seqdb_dir, seqdb_title, vol->dbinfo.seq_start_id, vol->dbinfo.seq_start_id + vol->dbinfo.num_seqs);
+    const size_t hdr_offset_from = vol->dbinfo.hdr_offset_from;
+    const size_t seq_offset_from = vol->dbinfo.seq_offset_from;
+    const size_t ambig_offset_from = vol->dbinfo.ambig_offset_from;
+    for (int i = 0; i < vol->dbinfo.num_seqs; ++i) {
+        hbn_assert(vol->seq_info_list[i].hdr_offset >= hdr_offset_from);
+        vol->seq_info_list[i].hdr_offset -= hdr_offset_from;
+        hbn_assert(vol->seq_info_list[i].seq_offset >= seq_offset_from);
+        vol->seq_info_list[i].seq_offset -= seq_offset_from;
+        vol->seq_info_list[i].ambig_offset -= ambig_offset_from;
+    }
+
+    return vol;
+}
+
 CSeqDB*
 seqdb_load_unpacked_with_ambig_res(const char* seqdb_dir, const char* seqdb_title, int vol_id)
 {
@@ -503,11 +591,17 @@ seqdb_load_unpacked_with_ambig_res(const char* seqdb_dir, const char* seqdb_titl
 CSeqDB*
 CSeqDBFree(CSeqDB* vol)
 {
-    free(vol->packed_seq);
+    if (vol->pac_mmap_addr || vol->hdr_mmap_addr || vol->ambig_mmap_addr) {
+        hbn_munmap_file(vol->pac_mmap_addr, vol->pac_mmap_size);
+        hbn_munmap_file(vol->hdr_mmap_addr, vol->hdr_mmap_size);
+        hbn_munmap_file(vol->ambig_mmap_addr, vol->ambig_mmap_size);
+    } else {
+        free(vol->packed_seq);
+        free(vol->seq_header_list);
+        free(vol->ambig_subseq_list);
+    }
     free(vol->unpacked_seq);
-    free(vol->seq_header_list);
     free(vol->seq_info_list);
-    free(vol->ambig_subseq_list);
     free(vol);
     return NULL;
 }
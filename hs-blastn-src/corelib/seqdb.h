@@ -21,6 +21,8 @@ typedef struct {
     int count;
 } CAmbigSubseq;
 
+typedef kvec_t(CAmbigSubseq) vec_ambig_subseq;
+
 typedef struct {
     size_t seq_offset;
     size_t seq_size;
@@ -64,6 +66,15 @@ typedef struct {
     u8* packed_seq;
     u8* unpacked_seq;
     //char* raw_seq;
+
+    /// seqdb_load_mapped(): packed_seq, seq_header_list and ambig_subseq_list
+    /// point into these read-only mappings of the pac, hdr and ambig files
+    void* pac_mmap_addr;
+    size_t pac_mmap_size;
+    void* hdr_mmap_addr;
+    size_t hdr_mmap_size;
+    void* ambig_mmap_addr;
+    size_t ambig_mmap_size;
 } CSeqDB;
 
 typedef CSeqDB text_t;
@@ -83,6 +94,11 @@ seqdb_load(const char* seqdb_dir, const char* seqdb_title, int vol_id);
 CSeqDB*
 seqdb_load_unpacked(const char* seqdb_dir, const char* seqdb_title, int vol_id);
 
+/// same as seqdb_load(), but the packed sequences, headers and ambiguous residues
+/// are not copied. they are served from the memory mapped database files.
+CSeqDB*
+seqdb_load_mapped(const char* seqdb_dir, const char* seqdb_title, int vol_id);
+
 void
 make_ambig_subseq_path(const char* data_dir, const char* db_name, char path[]);
 
@@ -113,6 +129,9 @@ size_t seqdb_seq_size(const CSeqDB* seqdb, const int seq_id);
 
 const char* seqdb_seq_name(const CSeqDB* seqdb, const int seq_id);
 
+/// strlen(seqdb_seq_name()), kept in the header table of the volume
+size_t seqdb_seq_name_size(const CSeqDB* seqdb, const int seq_id);
+
 int seqdb_num_seqs(const CSeqDB* seqdb);
 
 size_t seqdb_size(const CSeqDB* seqdb);
@@ -190,6 +209,16 @@ seqdb_extract_raw_subsequence(const CSeqDB* seqdb,
     const int strand,
     vec_u8* seq);
 
+/// residues [from, to) of the forward strand of seq_id with ambiguous residues recovered.
+/// the returned pointer points into the unpacked sequence if the volume is unpacked,
+/// otherwise only this window is decoded from the packed sequence into buf.
+const u8*
+seqdb_subsequence_window(const CSeqDB* seqdb,
+    const int seq_id,
+    const size_t from,
+    const size_t to,
+    vec_u8* buf);
+
 void
 seqdb_recover_sequence_ambig_res(const CSeqDB* seqdb,
     const int seq_id,
@@ -3,11 +3,13 @@
 static const u32 kMemChunkSize = 8 * 1024 * 1024;
 
 static MemoryChunk*
-MemoryChunkNew(const u32 object_size)
+MemoryChunkNew(const u32 object_size, const size_t size)
 {
     MemoryChunk* chunk = (MemoryChunk*)malloc(sizeof(MemoryChunk));
-    chunk->data = (char*)malloc(kMemChunkSize);
+    chunk->data = (char*)malloc(size);
+    if (!chunk->data) HBN_ERR("fail to allocate %zu bytes", size);
     chunk->avail_data = 0;
+    chunk->size = size;
     chunk->object_size = object_size;
     return chunk;
 }
@@ -29,8 +31,8 @@ MemoryChunkClear(MemoryChunk* chunk)
 static void*
 MemoryChunkAlloc(MemoryChunk* chunk, const u32 num_objects)
 {
-    u32 alloc_bytes = num_objects * chunk->object_size;
-    if (chunk->avail_data + alloc_bytes > kMemChunkSize) return NULL;
+    size_t alloc_bytes = (size_t)num_objects * chunk->object_size;
+    if (chunk->avail_data + alloc_bytes > chunk->size) return NULL;
     char* p = chunk->data + chunk->avail_data;
     chunk->avail_data += alloc_bytes;
     return (void*)(p);
@@ -40,8 +42,7 @@ static u32
 round_up_16(const u32 s)
 {
     const u32 mask = 15;
-    u32 r = 16 - (s & mask);
-    return s + r;
+    return (s + mask) & ~mask;
 }
 
 SmallObjectAlloc*
@@ -51,7 +52,7 @@ SmallObjectAllocNew(const u32 object_size)
     kv_init(alloc->chunk_list);
     alloc->first_avail_chunk = 0;
     alloc->object_size = round_up_16(object_size);
-    MemoryChunk* chunk = MemoryChunkNew(alloc->object_size);
+    MemoryChunk* chunk = MemoryChunkNew(alloc->object_size, kMemChunkSize);
     kv_push(MemoryChunk*, alloc->chunk_list, chunk);
     return alloc;
 }
@@ -70,19 +71,42 @@ SmallObjectAllocFree(SmallObjectAlloc* alloc)
 void
 SmallObjectAllocClear(SmallObjectAlloc* alloc)
 {
-    for (size_t i = 0; i <= alloc->first_avail_chunk; ++i) {
-        MemoryChunkClear(kv_A(alloc->chunk_list, i));
+    /// the dedicated chunks are released, the regular ones are kept for reuse
+    size_t n = 0;
+    for (size_t i = 0; i < kv_size(alloc->chunk_list); ++i) {
+        MemoryChunk* chunk = kv_A(alloc->chunk_list, i);
+        if (chunk->size > kMemChunkSize) {
+            MemoryChunkFree(chunk);
+            continue;
+        }
+        MemoryChunkClear(chunk);
+        kv_A(alloc->chunk_list, n) = chunk;
+        ++n;
     }
+    kv_size(alloc->chunk_list) = n;
     alloc->first_avail_chunk = 0;
 }
 
 void*
 SmallObjectAllocAlloc(SmallObjectAlloc* alloc, const u32 num_objects)
 {
+    const size_t alloc_bytes = (size_t)num_objects * alloc->object_size;
+    if (alloc_bytes > kMemChunkSize) {
+        /// larger than any regular chunk, so it gets a chunk of its own. the chunk is
+        /// full, so it goes in front of first_avail_chunk with the used chunks
+        MemoryChunk* chunk = MemoryChunkNew(alloc->object_size, alloc_bytes);
+        chunk->avail_data = alloc_bytes;
+        kv_push(MemoryChunk*, alloc->chunk_list, chunk);
+        MemoryChunk** a = kv_data(alloc->chunk_list);
+        for (size_t i = kv_size(alloc->chunk_list) - 1; i > alloc->first_avail_chunk; --i) a[i] = a[i-1];
+        a[alloc->first_avail_chunk] = chunk;
+        ++alloc->first_avail_chunk;
+        return chunk->data;
+    }
     void* p = MemoryChunkAlloc(kv_A(alloc->chunk_list, alloc->first_avail_chunk), num_objects);
     if (!p) {
         if (alloc->first_avail_chunk + 1 == kv_size(alloc->chunk_list)) {
-            MemoryChunk* chunk = MemoryChunkNew(alloc->object_size);
+            MemoryChunk* chunk = MemoryChunkNew(alloc->object_size, kMemChunkSize);
             kv_push(MemoryChunk*, alloc->chunk_list, chunk);
         }
         ++alloc->first_avail_chunk;
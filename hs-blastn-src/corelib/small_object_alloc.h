@@ -9,7 +9,9 @@ extern "C" {
 
 typedef struct {
     char* data;
-    u32 avail_data;
+    size_t avail_data;
+    /// kMemChunkSize, or the size of the one request a dedicated chunk is made for
+    size_t size;
     u32 object_size;
 } MemoryChunk;
 
@@ -13,6 +13,7 @@ SOURCES      := \
 	./corelib/db_format.c \
 	./corelib/fasta.c \
 	./corelib/gapped_candidate.c \
+	./corelib/gz_reader.c \
 	./corelib/hbn_aux.c \
 	./corelib/hbn_package_version.c \
 	./corelib/kstring.c \
@@ -21,6 +22,7 @@ SOURCES      := \
 	./corelib/name2id_map.c \
 	./corelib/partition_aux.c \
 	./corelib/raw_reads.c \
+	./corelib/record_builder.c \
 	./corelib/seqdb_summary.c \
 	./corelib/seqdb.c \
 	./corelib/small_object_alloc.c \
@@ -34,8 +36,10 @@ SOURCES      := \
 	./algo/hbn_traceback_aux.c \
 	./algo/init_hit_finder.c \
 	./algo/hbn_lookup_table.c \
+	./algo/kmer_hash.c \
 	./algo/sort_sr_hit_seeds.cpp \
 	./algo/word_finder.c \
+	./algo/xdrop_extend.c \
 	./ncbi_blast/c_ncbi_blast_aux.c \
 	./ncbi_blast/ncbi_blast_aux.cpp \
 	./ncbi_blast/cmdline_args/blast_args.cpp \
@@ -66,4 +70,4 @@ SOURCES      := \
 
 SRC_INCDIRS  := ./third_party/spreadsortv2
 
-SUBMAKEFILES := ./app/primer_map/main.mk ./app/hbnmap/main.mk
\ No newline at end of file
+SUBMAKEFILES := ./app/primer_map/main.mk ./app/hbnmap/main.mk ./app/hbnconvert/main.mk ./bench/chain_dp/main.mk ./bench/xdrop/main.mk ./bench/lktbl/main.mk ./bench/kmer_hash/main.mk
\ No newline at end of file
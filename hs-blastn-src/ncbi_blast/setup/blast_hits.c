@@ -111,33 +111,25 @@ HbnHSPResultsNew(int hitlist_max)
    results->num_queries = 0;
    results->hitlist_array = (BlastHitList*)calloc(hitlist_max, sizeof(BlastHitList));
    ks_init(results->output_buf);
-   ks_init(results->aligned_strings);
+   ks_init(results->backup_buf);
+   ks_init(results->aligned_subjects);
+   results->arena = SmallObjectAllocNew(16);
    return results;
 }
 
 void
 HbnHSPResultsClear(HbnHSPResults* results, int num_queries)
 {
-   ks_clear(results->aligned_strings);
+   ks_clear(results->aligned_subjects);
    ks_clear(results->output_buf);
+   ks_clear(results->backup_buf);
    for (int i = 0; i < results->num_queries; ++i) {
       BlastHitList* hit_list = results->hitlist_array + i;
-      if (hit_list == NULL) continue;
-      for (int j = 0; j < hit_list->hsplist_count; ++j) {
-         BlastHSPList* hsp_list = hit_list->hsplist_array[j];
-         if (hsp_list == NULL) continue;
-         for (int k = 0; k < hsp_list->hspcnt; ++k) {
-            BlastHSP* hsp = hsp_list->hsp_array[k];
-            if (hsp == NULL) continue;
-            hsp = Blast_HSPFree(hsp);
-         }
-         sfree(hsp_list->hsp_array);
-         sfree(hsp_list);
-      }
-      sfree(hit_list->hsplist_array);
+      hit_list->hsplist_array = NULL;
       hit_list->hsplist_count = 0;
       hit_list->hsplist_max = 0;
    }
+   SmallObjectAllocClear(results->arena);
    results->num_queries = num_queries;
 }
 
@@ -146,12 +138,68 @@ HbnHSPResultsFree(HbnHSPResults* results)
 {
    HbnHSPResultsClear(results, 0);
    if (results->hitlist_array) free(results->hitlist_array);
-   ks_destroy(results->aligned_strings);
+   ks_destroy(results->aligned_subjects);
    ks_destroy(results->output_buf);
+   ks_destroy(results->backup_buf);
+   SmallObjectAllocFree(results->arena);
    free(results);
    return NULL;
 }
 
+void*
+HbnHSPResultsCalloc(HbnHSPResults* results, size_t n, size_t size)
+{
+   const size_t bytes = n * size;
+   if (!bytes) return NULL;
+   const u32 unit = results->arena->object_size;
+   const u32 num_units = (bytes + unit - 1) / unit;
+   void* p = SmallObjectAllocAlloc(results->arena, num_units);
+   memset(p, 0, bytes);
+   return p;
+}
+
+GapEditScript*
+HbnHSPResultsGapEditScriptNew(HbnHSPResults* results, int size)
+{
+   if (size <= 0) return NULL;
+   GapEditScript* esp = (GapEditScript*)HbnHSPResultsCalloc(results, 1, sizeof(GapEditScript));
+   esp->size = size;
+   esp->op_type = (EGapAlignOpType*)HbnHSPResultsCalloc(results, size, sizeof(EGapAlignOpType));
+   esp->num = (Int4*)HbnHSPResultsCalloc(results, size, sizeof(Int4));
+   return esp;
+}
+
+void
+HbnHSPResultsSetHSPList(HbnHSPResults* results,
+   const BlastHSP* hsp_array,
+   int hsp_count,
+   BlastHSPList* hsp_list)
+{
+   BlastHSP* hsps = (BlastHSP*)HbnHSPResultsCalloc(results, hsp_count, sizeof(BlastHSP));
+   memcpy(hsps, hsp_array, sizeof(BlastHSP) * hsp_count);
+   hsp_list->hspcnt = hsp_count;
+   hsp_list->hsp_max = hsp_count;
+   hsp_list->hsp_array = (BlastHSP**)HbnHSPResultsCalloc(results, hsp_count, sizeof(BlastHSP*));
+   for (int i = 0; i < hsp_count; ++i) {
+      hsps[i].hbn_in_arena = TRUE;
+      hsp_list->hsp_array[i] = hsps + i;
+   }
+}
+
+void
+HbnHSPResultsSetHitList(HbnHSPResults* results,
+   const BlastHSPList* hsplist_array,
+   int hsplist_count,
+   BlastHitList* hit_list)
+{
+   BlastHSPList* hsp_lists = (BlastHSPList*)HbnHSPResultsCalloc(results, hsplist_count, sizeof(BlastHSPList));
+   memcpy(hsp_lists, hsplist_array, sizeof(BlastHSPList) * hsplist_count);
+   hit_list->hsplist_array = (BlastHSPList**)HbnHSPResultsCalloc(results, hsplist_count, sizeof(BlastHSPList*));
+   hit_list->hsplist_count = hsplist_count;
+   hit_list->hsplist_max = hsplist_count;
+   for (int i = 0; i < hsplist_count; ++i) hit_list->hsplist_array[i] = hsp_lists + i;
+}
+
 JumperEditsBlock* JumperEditsBlockFree(JumperEditsBlock* block)
 {
    ///
@@ -229,7 +277,7 @@ SBlastHitsParameters* SBlastHitsParametersFree(SBlastHitsParameters* param)
 
 BlastHSP* Blast_HSPFree(BlastHSP* hsp)
 {
-   if (!hsp)
+   if (!hsp || hsp->hbn_in_arena)
       return NULL;
    hsp->gap_info = GapEditScriptDelete(hsp->gap_info);
    hsp->map_info = BlastHSPMappingInfoFree(hsp->map_info);
@@ -565,10 +613,13 @@ s_UpdateReevaluatedHSP(BlastHSP* hsp, Boolean gapped,
             int last_num=hsp->gap_info->size - 1;
             if (best_end_esp_index != last_num|| best_start_esp_index > 0)
             {
-                GapEditScript* esp_temp = GapEditScriptNew(best_end_esp_index-best_start_esp_index+1);
-                GapEditScriptPartialCopy(esp_temp, 0, hsp->gap_info, best_start_esp_index, best_end_esp_index);
-                hsp->gap_info = GapEditScriptDelete(hsp->gap_info);
-                hsp->gap_info = esp_temp;
+                /* Cut the edit script in place, as s_CutOffGapEditScript()
+                   does, since it may live in the arena of an HbnHSPResults */
+                GapEditScript* esp = hsp->gap_info;
+                int size = best_end_esp_index-best_start_esp_index+1;
+                memmove(esp->op_type, esp->op_type + best_start_esp_index, sizeof(EGapAlignOpType) * size);
+                memmove(esp->num, esp->num + best_start_esp_index, sizeof(Int4) * size);
+                esp->size = size;
             }
             last_num = hsp->gap_info->size - 1;
             hsp->gap_info->num[last_num] = best_end_esp_num;
@@ -208,7 +208,6 @@ typedef struct {
    int align_len;
    int gaps;
    int gap_opens;
-   size_t query_align_offset;
    size_t subject_align_offset;
 } HbnHSPInfo;
 
@@ -239,6 +238,8 @@ typedef struct BlastHSP {
    HbnSeg hbn_subject; /**< subject sequence info. */
    HbnGapEditScript* hbn_gap_info; /**< gapped alignment. */
    HbnHSPInfo hsp_info;
+   Boolean hbn_in_arena; /**< The HSP and its edit script are owned by the arena
+                              of an HbnHSPResults, Blast_HSPFree() leaves them */
 } BlastHSP;
 
 typedef kvec_t(BlastHSP) vec_blasthsp;
@@ -294,15 +295,46 @@ typedef struct {
    BlastHitList* hitlist_array;
    int hitlist_max;
    kstring_t output_buf;
-   kstring_t aligned_strings;
+   /// the hit lists in the binary form of the backup results
+   kstring_t backup_buf;
+   /// the subject residues aligned by the HSPs, each HSP finds its own at
+   /// hsp_info.subject_align_offset
+   kstring_t aligned_subjects;
+   /// the HSPs, edit scripts and HSP lists of the hit lists. nothing in
+   /// here is freed one by one, HbnHSPResultsClear() releases it at once
+   SmallObjectAlloc* arena;
 } HbnHSPResults;
 
 HbnHSPResults*
 HbnHSPResultsNew(int hitlist_max);
 
+/// empty the hit lists and the arena, and make room for num_queries hit lists
 void
 HbnHSPResultsClear(HbnHSPResults* results, int num_queries);
 
+/// zeroed memory for n objects of the given size from the arena of results
+void*
+HbnHSPResultsCalloc(HbnHSPResults* results, size_t n, size_t size);
+
+/// an edit script of size operations from the arena of results
+GapEditScript*
+HbnHSPResultsGapEditScriptNew(HbnHSPResults* results, int size);
+
+/// copy hsp_count HSPs, whose edit scripts are in the arena, to the
+/// arena and make them the HSPs of hsp_list
+void
+HbnHSPResultsSetHSPList(HbnHSPResults* results,
+   const BlastHSP* hsp_array,
+   int hsp_count,
+   BlastHSPList* hsp_list);
+
+/// copy hsplist_count HSP lists to the arena and make them the lists of hit_list
+void
+HbnHSPResultsSetHitList(HbnHSPResults* results,
+   const BlastHSPList* hsplist_array,
+   int hsplist_count,
+   BlastHitList* hit_list);
+
 HbnHSPResults*
 HbnHSPResultsFree(HbnHSPResults* results);
 
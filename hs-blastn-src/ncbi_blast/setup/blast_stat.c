@@ -4057,6 +4057,47 @@ Int2 Blast_GetNuclAlphaBeta(Int4 reward, Int4 penalty, Int4 gap_open,
     return 0;
 }
 
+Boolean Blast_NuclGappedCostsAreTabulated(Int4 reward, Int4 penalty,
+                                          Int4 gap_open, Int4 gap_extend)
+{
+    const int kGapOpenIndex = 0;
+    const int kGapExtIndex = 1;
+    Int4 num_combinations = 0;
+    Int4 gap_open_max = 0, gap_extend_max = 0;
+    Int4 index = 0;
+    array_of_8* normal=NULL;
+    array_of_8* linear=NULL;
+    Boolean round_down = FALSE;
+    Boolean found = FALSE;
+    Int2 status = s_GetNuclValuesArray(reward,
+                                       penalty,
+                                       &num_combinations,
+                                       &normal,
+                                       &linear,
+                                       &gap_open_max,
+                                       &gap_extend_max,
+                                       &round_down,
+                                       NULL);
+
+    if (status == 0 && normal) {
+        if (gap_open == 0 && gap_extend == 0 && linear) {
+            found = TRUE;
+        } else {
+            for (index = 0; index < num_combinations; ++index) {
+                if (normal[index][kGapOpenIndex] == gap_open &&
+                    normal[index][kGapExtIndex] == gap_extend) {
+                    found = TRUE;
+                    break;
+                }
+            }
+        }
+    }
+
+    sfree(linear);
+    sfree(normal);
+    return found;
+}
+
 /** Calculates score from expect value and search space.
  * @param E expect value [in]
  * @param kbp contains Karlin-Altschul parameters [in]
@@ -719,6 +719,19 @@ Int2 Blast_GetNuclAlphaBeta(Int4 reward, Int4 penalty, Int4 gap_open,
                             Boolean gapped_calculation,
                             double *alpha, double *beta);
 
+/** Are the gapped Karlin-Altschul parameters, alpha and beta for these
+ * substitution and gap scores read from the tables? If so they do not
+ * depend on the ungapped Karlin block, hence not on the query composition.
+ * @param reward Match reward score [in]
+ * @param penalty Mismatch penalty score [in]
+ * @param gap_open Gap opening (existence) cost [in]
+ * @param gap_extend Gap extension cost [in]
+ * @return TRUE if the gap costs are found in the tables
+ */
+NCBI_XBLAST_EXPORT
+Boolean Blast_NuclGappedCostsAreTabulated(Int4 reward, Int4 penalty,
+                                          Int4 gap_open, Int4 gap_extend);
+
 /** Rescale the PSSM, using composition-based statistics, for use
  *  with RPS BLAST. This function produces a PSSM for a single RPS DB
  *  sequence (of size db_seq_length) and incorporates information from
@@ -1,6 +1,7 @@
 #include "hsp2string.h"
 
 #include "../str_util/ncbistr.hpp"
+#include "../../corelib/record_builder.h"
 
 #include <sstream>
 #include <stdarg.h>
@@ -19,36 +20,32 @@ const char* blasthsp_to_string_names(const BlastHSP* hsp, ...)
     const char* subject_name = va_arg(arg_ptr, const char*);
     va_end(arg_ptr);
 
-    ostringstream os;
     const char kDelim = '\t';
-    os << query_name 
-       << kDelim
-       << subject_name
-       << kDelim
-       << hsp->hsp_info.perc_identity
-       << kDelim
-       << hsp->score
-       << kDelim
-       << hsp->hbn_query.strand
-       << kDelim
-       << hsp->hbn_query.offset
-       << kDelim
-       << hsp->hbn_query.end
-       << kDelim
-       << hsp->hbn_query.seq_size
-       << kDelim
-       << hsp->hbn_subject.strand
-       << kDelim
-       << hsp->hbn_subject.offset
-       << kDelim
-       << hsp->hbn_subject.end
-       << kDelim
-       << hsp->hbn_subject.seq_size
-       << endl;
-    string s = os.str();
     ks_clear(*hspstr);
-    kputsn(s.c_str(), s.size(), hspstr);
-    //kputc('\0', hspstr);
+    kputs(query_name, hspstr);
+    kputc(kDelim, hspstr);
+    kputs(subject_name, hspstr);
+    kputc(kDelim, hspstr);
+    rec_put_general(hsp->hsp_info.perc_identity, hspstr);
+    kputc(kDelim, hspstr);
+    rec_put_i64(hsp->score, hspstr);
+    kputc(kDelim, hspstr);
+    rec_put_i64(hsp->hbn_query.strand, hspstr);
+    kputc(kDelim, hspstr);
+    rec_put_u64(hsp->hbn_query.offset, hspstr);
+    kputc(kDelim, hspstr);
+    rec_put_u64(hsp->hbn_query.end, hspstr);
+    kputc(kDelim, hspstr);
+    rec_put_u64(hsp->hbn_query.seq_size, hspstr);
+    kputc(kDelim, hspstr);
+    rec_put_i64(hsp->hbn_subject.strand, hspstr);
+    kputc(kDelim, hspstr);
+    rec_put_u64(hsp->hbn_subject.offset, hspstr);
+    kputc(kDelim, hspstr);
+    rec_put_u64(hsp->hbn_subject.end, hspstr);
+    kputc(kDelim, hspstr);
+    rec_put_u64(hsp->hbn_subject.seq_size, hspstr);
+    kputc('\n', hspstr);
     return ks_s(*hspstr);    
 }
 
@@ -112,7 +109,6 @@ BlastHSP* string_to_blasthsp_ids(const char* str, ...)
     hsp->hbn_subject.end = StringToUInt8(components[10]);
     hsp->hbn_subject.seq_size = StringToUInt8(components[11]);
 
-    hsp->hsp_info.query_align_offset = 0;
     hsp->hsp_info.subject_align_offset = 0;
 
     return hsp;    
@@ -154,7 +150,6 @@ BlastHSP* string_to_blasthsp_name2idmap(const char* str, ...)
     hsp->hbn_subject.end = StringToUInt8(components[10]);
     hsp->hbn_subject.seq_size = StringToUInt8(components[11]);
 
-    hsp->hsp_info.query_align_offset = 0;
     hsp->hsp_info.subject_align_offset = 0;
 
     return hsp;